@@ -19,6 +19,7 @@
 #define ANDROID_IINTERFACE_H
 
 #include <binder/Binder.h>
+#include <utils/StringAtom.h>
 
 namespace android {
 
@@ -81,7 +82,8 @@ protected:
 
 
 #define IMPLEMENT_META_INTERFACE(INTERFACE, NAME)                       \
-    const android::String16 I##INTERFACE::descriptor(NAME);             \
+    const android::String16 I##INTERFACE::descriptor(                   \
+            android::StringAtom(NAME).string());                        \
     const android::String16&                                            \
             I##INTERFACE::getInterfaceDescriptor() const {              \
         return I##INTERFACE::descriptor;                                \
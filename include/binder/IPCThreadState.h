@@ -18,6 +18,7 @@
 #define ANDROID_IPC_THREAD_STATE_H
 
 #include <utils/Errors.h>
+#include <utils/Timers.h>
 #include <binder/Parcel.h>
 #include <binder/ProcessState.h>
 #include <utils/Vector.h>
@@ -29,6 +30,8 @@ typedef  int  uid_t;
 // ---------------------------------------------------------------------------
 namespace android {
 
+class TransactionStats;
+
 class IPCThreadState
 {
 public:
@@ -63,6 +66,28 @@ public:
                                          uint32_t code, const Parcel& data,
                                          Parcel* reply, uint32_t flags);
 
+            // While a batch is open, one-way transactions made from this
+            // thread are queued in the command buffer instead of each going
+            // to the driver in its own BINDER_WRITE_READ.  Batches nest; the
+            // queue is sent when the outermost batch ends, when it reaches
+            // its size limits, or before anything that waits for a response
+            // from the driver.  Errors from queued transactions are reported
+            // by the call that sends them.
+            void                beginOnewayBatch();
+            status_t            endOnewayBatch();
+            status_t            flushOnewayBatch();
+
+            // Batches one-way transactions for the lifetime of the object.
+            class OnewayBatch {
+            public:
+                inline OnewayBatch() : mState(IPCThreadState::self()) {
+                    mState->beginOnewayBatch();
+                }
+                inline ~OnewayBatch() { mState->endOnewayBatch(); }
+            private:
+                IPCThreadState* mState;
+            };
+
             void                incStrongHandle(int32_t handle);
             void                decStrongHandle(int32_t handle);
             void                incWeakHandle(int32_t handle);
@@ -82,11 +107,21 @@ public:
     // in to it but doesn't want to acquire locks in its services while in
     // the background.
     static  void                disableBackgroundScheduling(bool disable);
+
+    // Per-interface histograms of transaction latency and size for this
+    // process, see TransactionStats.  Recording is off by default; it can
+    // also be turned on with the debug.binder.stats property, and the
+    // result is shown by "dumpsys <native service> --binder-stats".
+    static  void                setTransactionStatsEnabled(bool enabled);
+    static  void                dumpTransactionStats(String8& result);
     
 private:
                                 IPCThreadState();
                                 ~IPCThreadState();
 
+            status_t            sendTransaction(int32_t handle,
+                                                uint32_t code, const Parcel& data,
+                                                Parcel* reply, uint32_t flags);
             status_t            sendReply(const Parcel& reply, uint32_t flags);
             status_t            waitForResponse(Parcel *reply,
                                                 status_t *acquireResult=NULL);
@@ -98,6 +133,10 @@ private:
                                                      const Parcel& data,
                                                      status_t* statusBuffer);
             status_t            executeCommand(int32_t command);
+            status_t            queueOnewayTransaction(int32_t handle,
+                                                       uint32_t code,
+                                                       const Parcel& data,
+                                                       uint32_t flags);
             
             void                clearCaller();
             
@@ -120,6 +159,16 @@ private:
             uid_t               mOrigCallingUid;
             int32_t             mStrictModePolicy;
             int32_t             mLastTransactionBinderFlags;
+
+            // Copies of the queued one-way payloads; the driver reads them
+            // when the batch is sent.
+            Vector<Parcel*>     mOnewayBatch;
+            size_t              mOnewayBatchBytes;
+            int32_t             mOnewayBatchDepth;
+
+            // Only allocated once transaction stats are enabled.
+            TransactionStats*   mStats;
+            nsecs_t             mInReceivedTime;
 };
 
 }; // namespace android
@@ -87,6 +87,15 @@ public:
     void                setError(status_t err);
     
     status_t            write(const void* data, size_t len);
+    // Like write(), but only records a reference to the caller's buffer
+    // instead of copying it.  The buffer must remain valid and unmodified
+    // until the parcel has been sent, repositioned or freed.  Borrowed
+    // buffers are gathered into the parcel's own storage in one pass the
+    // first time the flat data is needed, typically right before it is
+    // handed to the binder driver.  Combined with setDataCapacity() this
+    // lets callers that know the final size build the parcel without any
+    // reallocation and with a single copy of each borrowed byte.
+    status_t            writeBorrowed(const void* data, size_t len);
     void*               writeInplace(size_t len);
     status_t            writeUnpadded(const void* data, size_t len);
     status_t            writeInt32(int32_t val);
@@ -195,6 +204,20 @@ public:
     
     void                print(TextOutput& to, uint32_t flags = 0) const;
 
+    // Counters for the per-thread pool that parcel data and object arrays
+    // are allocated from, summed over all threads.  highWaterBytes is the
+    // most any single thread's pool has held at once.
+    struct BufferPoolStats {
+        size_t          hits;
+        size_t          misses;
+        size_t          oversized;
+        size_t          cachedBytes;
+        size_t          highWaterBytes;
+    };
+
+    static void         getBufferPoolStats(BufferPoolStats* stats);
+    static void         dumpBufferPool(String8& result);
+
 private:
                         Parcel(const Parcel& o);
     Parcel&             operator=(const Parcel& o);
@@ -208,6 +231,10 @@ private:
     void                freeDataNoInit();
     void                initState();
     void                scanForFds() const;
+    status_t            gatherSegments(size_t capacity = 0) const;
+    inline status_t     flushSegments() const {
+                            return mSegments.isEmpty() ? NO_ERROR : gatherSegments();
+                        }
                         
     template<class T>
     status_t            readAligned(T *pArg) const;
@@ -234,6 +261,15 @@ private:
     release_func        mOwner;
     void*               mOwnerCookie;
 
+    // Caller-owned buffers written with writeBorrowed() that have not been
+    // copied into mData yet.  The parcel's size already accounts for them.
+    struct Segment {
+        size_t          offset;
+        const void*     data;
+        size_t          len;
+    };
+    mutable Vector<Segment> mSegments;
+
     class Blob {
     public:
         Blob();
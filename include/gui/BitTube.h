@@ -32,8 +32,26 @@ class Parcel;
 class BitTube : public RefBase
 {
 public:
+    enum Transport {
+        // a SOCK_SEQPACKET socketpair, one packet per object
+        SOCKET = 0,
+        // a single-producer single-consumer ring in shared memory. getFd()
+        // returns an eventfd that becomes readable when the ring is not
+        // empty, so it can be polled like the socket.
+        SHARED_RING = 1,
+    };
+
+    enum {
+        // The socket default is typically about 128KB, which is much
+        // larger than we really need.
+        DEFAULT_BUFFER_SIZE = 4 * 1024,
+        MAX_BUFFER_SIZE = 16 * 1024 * 1024,
+    };
 
             BitTube();
+    // 'size' is the socket buffer size, or the capacity of the ring in
+    // bytes. initCheck() fails if it is larger than MAX_BUFFER_SIZE.
+    explicit BitTube(size_t size, Transport transport = SOCKET);
             BitTube(const Parcel& data);
     virtual ~BitTube();
 
@@ -44,6 +62,10 @@ public:
 
     status_t writeToParcel(Parcel* reply) const;
 
+    // Send and receive as many of the objects as fit, or are available, with
+    // as few system calls as possible, and return how many. sendObjects()
+    // returns -EAGAIN if none fit; recvObjects() returns 0 if none are
+    // available.
     template <typename T>
     static ssize_t sendObjects(const sp<BitTube>& tube,
             T const* events, size_t count) {
@@ -57,8 +79,30 @@ public:
     }
 
 private:
+    struct SharedRing;
+
+    void init(size_t size, Transport transport);
+    status_t mapRing(int fd, uint32_t capacity);
+
+    ssize_t writeRing(void const* vaddr, size_t count, size_t objSize);
+    ssize_t readRing(void* vaddr, size_t count, size_t objSize);
+
+    ssize_t sendBatch(void const* events, size_t count, size_t objSize);
+    ssize_t recvBatch(void* events, size_t count, size_t objSize);
+
     int mSendFd;
     mutable int mReceiveFd;
+    size_t mBufferSize;
+
+    // SHARED_RING only. The ring is shared with another process, so each
+    // side keeps its own copy of the capacity and of the position it owns
+    // rather than trusting the shared header.
+    int mRingFd;
+    SharedRing* mRing;
+    size_t mRingMapSize;
+    uint32_t mRingCapacity;
+    uint32_t mRingHead;
+    uint32_t mRingTail;
 
     static ssize_t sendObjects(const sp<BitTube>& tube,
             void const* events, size_t count, size_t objSize);
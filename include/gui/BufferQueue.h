@@ -311,6 +311,19 @@ private:
 
     status_t setBufferCountServerLocked(int bufferCount);
 
+    // slotFreedLocked wakes up the producers blocked in dequeueBuffer waiting
+    // for a free slot, if there are any.
+    void slotFreedLocked();
+
+    // queueDrainedLocked wakes up the threads waiting for mQueue to drain,
+    // if there are any and the queue is now empty.
+    void queueDrainedLocked();
+
+    // stateChangedLocked wakes up every waiting thread so that it
+    // re-evaluates the whole state, e.g. after the BufferQueue was abandoned
+    // or disconnected, or the buffer count or synchronous mode changed.
+    void stateChangedLocked();
+
     struct BufferSlot {
 
         BufferSlot()
@@ -471,11 +484,47 @@ private:
     // by the connect and disconnect methods.
     int mConnectedApi;
 
-    // mDequeueCondition condition used for dequeueBuffer in synchronous mode
+    // mDequeueCondition is signaled when a slot becomes free, for
+    // dequeueBuffer. mDequeueWaiters is the number of threads waiting on it,
+    // so that nothing is signaled when nobody waits, which is the common
+    // case for the consumer.
     mutable Condition mDequeueCondition;
+    int mDequeueWaiters;
+
+    // mDrainCondition is signaled when mQueue becomes empty, for
+    // drainQueueLocked and for dequeueBuffer when the number of buffers
+    // needs to change. mDrainWaiters is the number of threads waiting on it.
+    mutable Condition mDrainCondition;
+    int mDrainWaiters;
+
+    // Fifo is a fixed-size ring of slot indices. A slot is queued at most
+    // once, so NUM_BUFFER_SLOTS entries are always enough and queueing or
+    // acquiring a buffer never allocates or moves memory.
+    class Fifo {
+    public:
+        Fifo() : mHead(0), mSize(0) { }
+        inline bool isEmpty() const { return mSize == 0; }
+        inline size_t size() const { return mSize; }
+        inline int front() const { return mItems[mHead]; }
+        inline int& editFront() { return mItems[mHead]; }
+        inline int operator[](size_t index) const {
+            return mItems[(mHead + index) % NUM_BUFFER_SLOTS];
+        }
+        inline void push_back(int buf) {
+            mItems[(mHead + mSize++) % NUM_BUFFER_SLOTS] = buf;
+        }
+        inline void pop_front() {
+            mHead = (mHead + 1) % NUM_BUFFER_SLOTS;
+            mSize--;
+        }
+        inline void clear() { mHead = mSize = 0; }
+    private:
+        int mItems[NUM_BUFFER_SLOTS];
+        size_t mHead;
+        size_t mSize;
+    };
 
     // mQueue is a FIFO of queued buffers used in synchronous mode
-    typedef Vector<int> Fifo;
     Fifo mQueue;
 
     // mAbandoned indicates that the BufferQueue will no longer be used to
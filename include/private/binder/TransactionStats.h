@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BINDER_TRANSACTION_STATS_H
+#define ANDROID_BINDER_TRANSACTION_STATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String16.h>
+#include <utils/Timers.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+
+class Parcel;
+class String8;
+
+/*
+ * Histograms of binder transaction latency, size and dispatch delay, keyed
+ * by interface descriptor, transaction code and direction.
+ *
+ * Each IPCThreadState owns one table and is the only writer, so recording
+ * takes no locks.  dump() reads the tables of live threads while they keep
+ * running; the counters may be slightly torn, which is fine for statistics.
+ * Tables of threads that exit are folded into a process-wide table.
+ */
+class TransactionStats
+{
+public:
+    enum Direction {
+        OUTGOING = 0,
+        INCOMING = 1,
+    };
+
+    static inline bool isEnabled() { return sEnabled != 0; }
+    static void setEnabled(bool enabled);
+
+    static TransactionStats* create(pid_t tid);
+    static void destroy(TransactionStats* stats);
+
+    // Returns the interface descriptor written by Parcel::writeInterfaceToken()
+    // at the start of 'data', or NULL.  The string points into the parcel.
+    static const char16_t* peekInterfaceToken(const Parcel& data, uint32_t code,
+            size_t* outLength);
+
+    void record(Direction direction, const char16_t* descriptor, size_t descriptorLength,
+            uint32_t code, size_t dataSize, size_t replySize,
+            nsecs_t latency, nsecs_t dispatchDelay);
+
+    static void dump(String8& result);
+
+private:
+    enum {
+        THREAD_CAPACITY = 64,
+        PROCESS_CAPACITY = 256,
+        // Bucket i counts values in [2^i, 2^(i+1)) microseconds; bucket 0
+        // also holds anything shorter and the last bucket anything longer.
+        TIME_BUCKETS = 20,
+        // Bucket i counts sizes in [2^(i+6), 2^(i+7)) bytes, clamped the
+        // same way.
+        SIZE_BUCKETS = 16,
+    };
+
+    struct Entry {
+        volatile int32_t    used;
+        uint32_t            hash;
+        uint32_t            code;
+        int32_t             direction;
+        String16            descriptor;
+        uint32_t            count;
+        nsecs_t             totalLatency;
+        uint64_t            totalDataSize;
+        uint64_t            totalReplySize;
+        uint32_t            latency[TIME_BUCKETS];
+        uint32_t            dispatchDelay[TIME_BUCKETS];
+        uint32_t            dataSize[SIZE_BUCKETS];
+    };
+
+                        TransactionStats(pid_t tid, size_t capacity);
+                        ~TransactionStats();
+
+    Entry*              lookup(uint32_t hash, int32_t direction, uint32_t code,
+                               const char16_t* descriptor, size_t descriptorLength);
+    void                merge(const TransactionStats& other);
+    void                print(String8& result) const;
+
+    static volatile int32_t sEnabled;
+
+    const pid_t         mTid;
+    const size_t        mCapacity;
+    Entry*              mEntries;
+    uint32_t            mDropped;
+    TransactionStats*   mPrev;
+    TransactionStats*   mNext;
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_BINDER_TRANSACTION_STATS_H
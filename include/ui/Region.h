@@ -42,7 +42,7 @@ public:
         Region& operator = (const Region& rhs);
 
     inline  bool        isEmpty() const     { return mBounds.isEmpty();  }
-    inline  bool        isRect() const      { return mStorage.isEmpty(); }
+    inline  bool        isRect() const      { return mStorage.isEmpty() && !mInlineCount; }
 
     inline  Rect        getBounds() const   { return mBounds; }
     inline  Rect        bounds() const      { return getBounds(); }
@@ -153,13 +153,27 @@ private:
     static void boolean_operation(int op, Region& dst,
             const Region& lhs, const Rect& rhs);
 
+    // handles the operations whose result is one of the operands or a
+    // single rect without running the general sweep.
+    static bool quick_operation(int op, Region& dst,
+            const Region& lhs, const Region& rhs, int dx, int dy);
+
     static void translate(Region& reg, int dx, int dy);
     static void translate(Region& dst, const Region& reg, int dx, int dy);
 
     static bool validate(const Region& reg, const char* name);
-    
+
+    void        spillInline();
+
+    enum { INLINE_RECTS = 4 };
+
     Rect            mBounds;
     Vector<Rect>    mStorage;
+    // Regions of up to INLINE_RECTS rects keep them here rather than in
+    // mStorage, so the common small results don't touch the heap.  At most
+    // one of mStorage and mInline is in use at a time.
+    uint32_t        mInlineCount;
+    Rect            mInline[INLINE_RECTS];
 };
 
 
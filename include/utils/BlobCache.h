@@ -21,14 +21,18 @@
 
 #include <utils/Flattenable.h>
 #include <utils/RefBase.h>
-#include <utils/SortedVector.h>
 #include <utils/threads.h>
 
 namespace android {
 
+class FileMap;
+
 // A BlobCache is an in-memory cache for binary key/value pairs.  A BlobCache
 // does NOT provide any thread-safety guarantees.
 //
+// Entries are kept in a hash table, so get and set take constant time.  When
+// the cache is full, the least recently used entries are evicted first.
+//
 // The cache contents can be serialized to an in-memory buffer or mmap'd file
 // and then reloaded in a subsequent execution of the program.  This
 // serialization is non-portable and the data should only be used by the device
@@ -41,6 +45,7 @@ public:
     // maxValueSize, respectively. The total combined size of ALL cache entries
     // (key sizes plus value sizes) will not exceed maxTotalSize.
     BlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize);
+    virtual ~BlobCache();
 
     // set inserts a new binary value into the cache and associates it with the
     // given binary key.  If the key or value are too large for the cache then
@@ -109,72 +114,111 @@ public:
     virtual status_t unflatten(void const* buffer, size_t size, int fds[],
             size_t count);
 
+    // unflattenMapped is like unflatten, except that the cache keeps
+    // pointing at the key and value data in 'map' instead of copying it to
+    // the heap.  The serialized cache starts 'offset' bytes into the map.
+    // The cache takes its own reference to the map and releases it when the
+    // contents are next replaced or the cache is destroyed; the caller must
+    // not modify the mapped data in the meantime.
+    //
+    // Entries that are later replaced by set are copied as usual, so a
+    // read-only mapping is sufficient.
+    status_t unflattenMapped(FileMap* map, size_t offset);
+
+    // Stats holds counters describing how well the cache is doing.  They
+    // are reset only when the cache is destroyed.
+    struct Stats {
+        // hits and misses count calls to get that did and did not find the
+        // key.
+        uint32_t hits;
+        uint32_t misses;
+
+        // insertions counts the key/value pairs stored by set or loaded by
+        // unflatten, and rejections those that were not cached because of
+        // the size limits.
+        uint32_t insertions;
+        uint32_t rejections;
+
+        // evictions and evictedBytes count the entries, and their combined
+        // key and value sizes, that were dropped to make room for others.
+        uint32_t evictions;
+        size_t evictedBytes;
+
+        // entries, totalSize and mappedSize describe the current contents;
+        // mappedSize is the part served from a map by unflattenMapped.
+        size_t entries;
+        size_t totalSize;
+        size_t mappedSize;
+    };
+
+    // getStats fills in 'stats' with the current counters.
+    void getStats(Stats* stats) const;
+
 private:
     // Copying is disallowed.
     BlobCache(const BlobCache&);
     void operator=(const BlobCache&);
 
-    // A random function helper to get around MinGW not having nrand48()
-    long int blob_random();
-
-    // clean evicts a randomly chosen set of entries from the cache such that
-    // the total size of all remaining entries is less than mMaxTotalSize/2.
-    void clean();
-
-    // isCleanable returns true if the cache is full enough for the clean method
-    // to have some effect, and false otherwise.
-    bool isCleanable() const;
-
-    // A Blob is an immutable sized unstructured data blob.
-    class Blob : public RefBase {
-    public:
-        Blob(const void* data, size_t size, bool copyData);
-        ~Blob();
-
-        bool operator<(const Blob& rhs) const;
+    // An Entry is a single key/value pair in the cache.  Entries are chained
+    // into a hash bucket and into a list ordered from least to most recently
+    // used.  An entry that owns its data is allocated with the key and the
+    // value immediately following the struct; otherwise mKey and mValue
+    // point into mMap.
+    struct Entry {
+        Entry* mHashNext;
+        Entry* mOlder;
+        Entry* mNewer;
+        uint32_t mHash;
+        size_t mKeySize;
+        size_t mValueSize;
+        const uint8_t* mKey;
+        const uint8_t* mValue;
 
-        const void* getData() const;
-        size_t getSize() const;
+        inline bool isMapped() const {
+            return mKey != reinterpret_cast<const uint8_t*>(this + 1);
+        }
+    };
 
-    private:
-        // Copying is not allowed.
-        Blob(const Blob&);
-        void operator=(const Blob&);
+    // store inserts or replaces the entry for the given key, evicting other
+    // entries if needed.  The sizes must already have been checked against
+    // the per-entry limits.  If copyData is false the key and value are
+    // referenced rather than copied, and must outlive the entry.
+    void store(const void* key, size_t keySize, const void* value,
+            size_t valueSize, bool copyData);
 
-        // mData points to the buffer containing the blob data.
-        const void* mData;
+    // load replaces the contents of the cache with the serialized contents
+    // in 'buffer', copying the data or referencing it as store does.
+    status_t load(const void* buffer, size_t size, bool copyData);
 
-        // mSize is the size of the blob data in bytes.
-        size_t mSize;
+    // find returns the entry for the given key, or NULL.
+    Entry* find(const void* key, size_t keySize, uint32_t hash) const;
 
-        // mOwnsData indicates whether or not this Blob object should free the
-        // memory pointed to by mData when the Blob gets destructed.
-        bool mOwnsData;
-    };
+    // link adds 'e' to its hash bucket and as the most recently used entry.
+    // unlink removes it from both.  Neither updates mTotalSize.
+    void link(Entry* e);
+    void unlink(Entry* e);
 
-    // A CacheEntry is a single key/value pair in the cache.
-    class CacheEntry {
-    public:
-        CacheEntry();
-        CacheEntry(const sp<Blob>& key, const sp<Blob>& value);
-        CacheEntry(const CacheEntry& ce);
+    // touch marks 'e' as the most recently used entry.
+    void touch(Entry* e);
 
-        bool operator<(const CacheEntry& rhs) const;
-        const CacheEntry& operator=(const CacheEntry&);
+    // removeEntry unlinks 'e', frees it and updates the size accounting.
+    void removeEntry(Entry* e);
 
-        sp<Blob> getKey() const;
-        sp<Blob> getValue() const;
+    // removeAll frees every entry and releases mMap.
+    void removeAll();
 
-        void setValue(const sp<Blob>& value);
+    // grow doubles the number of hash buckets and rehashes the entries.
+    void grow();
 
-    private:
+    // clean evicts the least recently used entries from the cache until the
+    // total size of all remaining entries is at most mMaxTotalSize/2.
+    void clean();
 
-        // mKey is the key that identifies the cache entry.
-        sp<Blob> mKey;
+    // isCleanable returns true if the cache is full enough for the clean method
+    // to have some effect, and false otherwise.
+    bool isCleanable() const;
 
-        // mValue is the cached data associated with the key.
-        sp<Blob> mValue;
-    };
+    static uint32_t hashKey(const void* key, size_t keySize);
 
     // A Header is the header for the entire BlobCache serialization format. No
     // need to make this portable, so we simply write the struct out.
@@ -237,13 +281,25 @@ private:
     // the cache.
     size_t mTotalSize;
 
-    // mRandState is the pseudo-random number generator state. It is passed to
-    // nrand48 to generate random numbers when needed.
-    unsigned short mRandState[3];
-
-    // mCacheEntries stores all the cache entries that are resident in memory.
-    // Cache entries are added to it by the 'set' method.
-    SortedVector<CacheEntry> mCacheEntries;
+    // mBuckets is the hash table of entries, with mBucketCount buckets.  The
+    // bucket count is a power of two, and the table is allocated by the first
+    // insertion and grown so that there are never more entries than buckets.
+    Entry** mBuckets;
+    size_t mBucketCount;
+    size_t mNumEntries;
+
+    // mOldest and mNewest are the ends of the list of entries ordered by
+    // last use.  Both set and a successful get make an entry the newest.
+    Entry* mOldest;
+    Entry* mNewest;
+
+    // mMap is the mapping passed to unflattenMapped, if any entries may still
+    // refer to it, and mMappedSize the total size of such entries.
+    FileMap* mMap;
+    size_t mMappedSize;
+
+    // mStats holds the hit, miss and eviction counters reported by getStats.
+    Stats mStats;
 };
 
 }
@@ -0,0 +1,621 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_FLAT_HASH_MAP_H
+#define ANDROID_UTILS_FLAT_HASH_MAP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <cutils/log.h>
+
+#include <utils/Errors.h>
+#include <utils/String8.h>
+#include <utils/TypeHelpers.h>
+
+namespace android {
+
+/* Implementation type.  Nothing to see here.
+ *
+ * An open addressing hashtable of TEntry, which has a getKey() returning a
+ * TKey, using Robin Hood hashing: an insert that finds a bucket whose entry
+ * is closer to its own home bucket than the new one takes that bucket and
+ * carries the old entry further along. Probe lengths stay short and even,
+ * so a lookup can give up as soon as it meets an entry closer to home than
+ * the key would be. Removing shifts the following entries back instead of
+ * leaving a tombstone.
+ *
+ * Each bucket holds the entry's hash, with the top bit set so that 0 means
+ * empty, and the entries themselves live in a separate array right after
+ * the hashes, in the same allocation. Probing compares hashes only and
+ * touches an entry once its hash matches.
+ *
+ * Entries are moved with memcpy() when their traits allow it, so tables of
+ * String8 or sp<> rehash without touching any reference count.
+ */
+template <typename TKey, typename TEntry>
+class FlatHashtable {
+public:
+    FlatHashtable();
+    FlatHashtable(const FlatHashtable& other);
+    ~FlatHashtable();
+
+    FlatHashtable& operator =(const FlatHashtable& other);
+
+    inline size_t size() const { return mSize; }
+    inline size_t capacity() const { return mCapacity; }
+    inline size_t bucketCount() const { return mBucketCount; }
+
+    /* Removes all entries, but keeps the buckets. */
+    void clear();
+
+    /* Makes room for at least minimumCapacity entries. */
+    void reserve(size_t minimumCapacity);
+
+    /* Releases the buckets the current entries don't need. */
+    void shrink();
+
+    /* Returns the index of the next entry after index, or -1. */
+    ssize_t next(ssize_t index) const;
+
+    inline const TEntry& entryAt(size_t index) const { return mEntries[index]; }
+    inline TEntry& editEntryAt(size_t index) { return mEntries[index]; }
+
+    /* Returns the index of the entry whose key is equal to key, or -1.
+     * TLookup may be any type that compares equal to TKey with ==, as long
+     * as hash is what hash_type() would return for the equivalent TKey. */
+    template <typename TLookup>
+    ssize_t find(hash_t hash, const TLookup& key) const;
+
+    /* Adds an entry whose key must not be in the table yet, and returns its
+     * index. Invalidates the indices of the other entries. */
+    size_t add(hash_t hash, const TEntry& entry);
+
+    /* Removes an entry. Invalidates the indices of the other entries. */
+    void removeAt(size_t index);
+
+private:
+    enum {
+        MIN_BUCKETS = 8,
+        // set in the hash of every full bucket
+        OCCUPIED = 0x80000000,
+    };
+
+    // raw storage for an entry in transit
+    union EntryStorage {
+        char data[sizeof(TEntry)];
+        double alignDouble;
+        int64_t alignInt64;
+        void* alignPointer;
+    };
+
+    // Fibonacci hashing: the top bits of the product depend on all the bits
+    // of the hash, so that keys like sequential ints, or pointers that are
+    // all multiples of 16, still spread over the whole table.
+    inline size_t bucketFor(uint32_t hash) const {
+        return (hash * 2654435769u) >> mShift;
+    }
+
+    inline size_t distanceOf(uint32_t hash, size_t index) const {
+        return (index - bucketFor(hash)) & (mBucketCount - 1);
+    }
+
+    static inline void relocate(TEntry* dest, TEntry* src) {
+        if (traits<TEntry>::has_trivial_move) {
+            memcpy(static_cast<void*>(dest), static_cast<const void*>(src), sizeof(TEntry));
+        } else {
+            new (dest) TEntry(*src);
+            src->~TEntry();
+        }
+    }
+
+    static size_t bucketCountFor(size_t capacity);
+
+    void allocate(size_t bucketCount);
+    void release();
+    void rehash(size_t bucketCount);
+    size_t place(uint32_t hash, TEntry* carried);
+
+    uint32_t* mHashes;
+    TEntry* mEntries;
+    size_t mBucketCount;
+    uint32_t mShift;
+    size_t mCapacity;
+    size_t mSize;
+};
+
+template <typename TKey, typename TEntry>
+FlatHashtable<TKey, TEntry>::FlatHashtable() :
+        mHashes(NULL), mEntries(NULL), mBucketCount(0), mShift(32),
+        mCapacity(0), mSize(0) {
+}
+
+template <typename TKey, typename TEntry>
+FlatHashtable<TKey, TEntry>::FlatHashtable(const FlatHashtable& other) :
+        mHashes(NULL), mEntries(NULL), mBucketCount(0), mShift(32),
+        mCapacity(0), mSize(0) {
+    *this = other;
+}
+
+template <typename TKey, typename TEntry>
+FlatHashtable<TKey, TEntry>::~FlatHashtable() {
+    release();
+}
+
+template <typename TKey, typename TEntry>
+FlatHashtable<TKey, TEntry>& FlatHashtable<TKey, TEntry>::operator =(
+        const FlatHashtable& other) {
+    if (this != &other) {
+        release();
+        if (other.mSize) {
+            // same buckets, same hashing: every entry keeps its index
+            allocate(other.mBucketCount);
+            memcpy(mHashes, other.mHashes, mBucketCount * sizeof(uint32_t));
+            for (size_t i = 0; i < mBucketCount; i++) {
+                if (mHashes[i]) {
+                    new (&mEntries[i]) TEntry(other.mEntries[i]);
+                }
+            }
+            mSize = other.mSize;
+        }
+    }
+    return *this;
+}
+
+template <typename TKey, typename TEntry>
+void FlatHashtable<TKey, TEntry>::clear() {
+    if (!traits<TEntry>::has_trivial_dtor) {
+        for (size_t i = 0; i < mBucketCount; i++) {
+            if (mHashes[i]) {
+                mEntries[i].~TEntry();
+            }
+        }
+    }
+    if (mHashes) {
+        memset(mHashes, 0, mBucketCount * sizeof(uint32_t));
+    }
+    mSize = 0;
+}
+
+template <typename TKey, typename TEntry>
+void FlatHashtable<TKey, TEntry>::reserve(size_t minimumCapacity) {
+    if (minimumCapacity > mCapacity) {
+        rehash(bucketCountFor(minimumCapacity));
+    }
+}
+
+template <typename TKey, typename TEntry>
+void FlatHashtable<TKey, TEntry>::shrink() {
+    size_t bucketCount = bucketCountFor(mSize);
+    if (bucketCount < mBucketCount) {
+        rehash(bucketCount);
+    }
+}
+
+template <typename TKey, typename TEntry>
+ssize_t FlatHashtable<TKey, TEntry>::next(ssize_t index) const {
+    for (size_t i = size_t(index + 1); i < mBucketCount; i++) {
+        if (mHashes[i]) {
+            return ssize_t(i);
+        }
+    }
+    return -1;
+}
+
+template <typename TKey, typename TEntry>
+template <typename TLookup>
+ssize_t FlatHashtable<TKey, TEntry>::find(hash_t hash, const TLookup& key) const {
+    if (!mSize) {
+        return -1;
+    }
+    hash |= OCCUPIED;
+    const size_t mask = mBucketCount - 1;
+    size_t index = bucketFor(hash);
+    for (size_t distance = 0; ; distance++) {
+        uint32_t h = mHashes[index];
+        if (!h) {
+            return -1;
+        }
+        if (h == hash && mEntries[index].getKey() == key) {
+            return ssize_t(index);
+        }
+        if (distanceOf(h, index) < distance) {
+            // the key would have displaced this entry
+            return -1;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+template <typename TKey, typename TEntry>
+size_t FlatHashtable<TKey, TEntry>::add(hash_t hash, const TEntry& entry) {
+    // copy first: entry may be in the table that is about to grow
+    EntryStorage carried;
+    TEntry* carriedEntry = reinterpret_cast<TEntry*>(carried.data);
+    new (carriedEntry) TEntry(entry);
+    if (mSize >= mCapacity) {
+        rehash(mBucketCount ? mBucketCount * 2 : size_t(MIN_BUCKETS));
+    }
+    size_t index = place(hash | OCCUPIED, carriedEntry);
+    mSize += 1;
+    return index;
+}
+
+template <typename TKey, typename TEntry>
+void FlatHashtable<TKey, TEntry>::removeAt(size_t index) {
+    mEntries[index].~TEntry();
+    const size_t mask = mBucketCount - 1;
+    size_t next = (index + 1) & mask;
+    while (mHashes[next] && distanceOf(mHashes[next], next) != 0) {
+        relocate(&mEntries[index], &mEntries[next]);
+        mHashes[index] = mHashes[next];
+        index = next;
+        next = (next + 1) & mask;
+    }
+    mHashes[index] = 0;
+    mSize -= 1;
+}
+
+template <typename TKey, typename TEntry>
+size_t FlatHashtable<TKey, TEntry>::bucketCountFor(size_t capacity) {
+    if (!capacity) {
+        return 0;
+    }
+    size_t bucketCount = MIN_BUCKETS;
+    while (bucketCount - bucketCount / 8 < capacity) {
+        bucketCount *= 2;
+    }
+    return bucketCount;
+}
+
+template <typename TKey, typename TEntry>
+void FlatHashtable<TKey, TEntry>::allocate(size_t bucketCount) {
+    // The entries follow the hashes at a multiple of 32 bytes, since
+    // bucketCount is a power of two and at least MIN_BUCKETS, so they are
+    // as aligned as malloc() makes the block.
+    void* storage = malloc(bucketCount * (sizeof(uint32_t) + sizeof(TEntry)));
+    LOG_ALWAYS_FATAL_IF(!storage, "FlatHashtable: out of memory");
+    mHashes = static_cast<uint32_t*>(storage);
+    mEntries = reinterpret_cast<TEntry*>(mHashes + bucketCount);
+    memset(mHashes, 0, bucketCount * sizeof(uint32_t));
+    mBucketCount = bucketCount;
+    mShift = 32;
+    for (size_t n = bucketCount; n > 1; n >>= 1) {
+        mShift -= 1;
+    }
+    // at most 7/8 full; Robin Hood probing stays short well past that
+    mCapacity = bucketCount - bucketCount / 8;
+}
+
+template <typename TKey, typename TEntry>
+void FlatHashtable<TKey, TEntry>::release() {
+    clear();
+    free(mHashes);
+    mHashes = NULL;
+    mEntries = NULL;
+    mBucketCount = 0;
+    mShift = 32;
+    mCapacity = 0;
+}
+
+template <typename TKey, typename TEntry>
+void FlatHashtable<TKey, TEntry>::rehash(size_t bucketCount) {
+    uint32_t* oldHashes = mHashes;
+    TEntry* oldEntries = mEntries;
+    size_t oldBucketCount = mBucketCount;
+
+    if (bucketCount) {
+        allocate(bucketCount);
+    } else {
+        mHashes = NULL;
+        mEntries = NULL;
+        mBucketCount = 0;
+        mShift = 32;
+        mCapacity = 0;
+    }
+    // the old buckets are thrown away, so each old entry is carried from
+    // where it is
+    for (size_t i = 0; i < oldBucketCount; i++) {
+        if (oldHashes[i]) {
+            place(oldHashes[i], &oldEntries[i]);
+        }
+    }
+    free(oldHashes);
+}
+
+template <typename TKey, typename TEntry>
+size_t FlatHashtable<TKey, TEntry>::place(uint32_t hash, TEntry* carried) {
+    const size_t mask = mBucketCount - 1;
+    size_t index = bucketFor(hash);
+    size_t distance = 0;
+    ssize_t placed = -1;
+    for (;;) {
+        uint32_t h = mHashes[index];
+        if (!h) {
+            relocate(&mEntries[index], carried);
+            mHashes[index] = hash;
+            return placed >= 0 ? size_t(placed) : index;
+        }
+        size_t d = distanceOf(h, index);
+        if (d < distance) {
+            // take the bucket from the entry that is closer to home, and
+            // carry that one on instead
+            EntryStorage swapped;
+            TEntry* swappedEntry = reinterpret_cast<TEntry*>(swapped.data);
+            relocate(swappedEntry, &mEntries[index]);
+            relocate(&mEntries[index], carried);
+            relocate(carried, swappedEntry);
+            mHashes[index] = hash;
+            hash = h;
+            distance = d;
+            if (placed < 0) {
+                placed = ssize_t(index);
+            }
+        }
+        index = (index + 1) & mask;
+        distance += 1;
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+/* Implementation type.  Nothing to see here. */
+struct flat_hash_no_lookup_t {
+private:
+    flat_hash_no_lookup_t();
+};
+
+/* The other type, if any, that a map or set keyed by TKey can be searched
+ * with, and how to hash it the way hash_type() hashes the equivalent key.
+ * Keys without one get a lookup type nobody can make, so that the lookup
+ * overloads never get in the way. */
+template <typename TKey>
+struct flat_hash_lookup_t {
+    typedef flat_hash_no_lookup_t type;
+};
+
+template <>
+struct flat_hash_lookup_t<String8> {
+    typedef const char* type;
+    static inline hash_t hash(const char* key) { return hash_string(key, strlen(key)); }
+};
+
+// ---------------------------------------------------------------------------
+
+/**
+ * A hash map of unique keys to values, stored in place in a single array
+ * (see FlatHashtable above). Unlike KeyedVector, add() and removeItem() are
+ * O(1); unlike BasicHashtable, an entry costs no more than its key, its
+ * value and its hash, and a lookup walks adjacent memory instead of a chain.
+ *
+ * Maps keyed by String8 can be searched with a const char* without making a
+ * String8 first (see flat_hash_lookup_t).
+ *
+ * Indices are only valid until the next add() or remove. To walk the map:
+ *
+ *     for (ssize_t i = map.next(-1); i >= 0; i = map.next(i)) { ... }
+ *
+ * TKey needs a hash_type() specialization.
+ */
+template <typename TKey, typename TValue>
+class FlatHashMap {
+public:
+    typedef TKey key_type;
+    typedef TValue value_type;
+    // what else keys can be looked up with, see flat_hash_lookup_t
+    typedef typename flat_hash_lookup_t<TKey>::type lookup_type;
+
+    FlatHashMap() { }
+    explicit FlatHashMap(size_t minimumCapacity) { mTable.reserve(minimumCapacity); }
+
+    inline size_t size() const { return mTable.size(); }
+    inline bool isEmpty() const { return mTable.size() == 0; }
+    //! returns how many entries fit before the map grows
+    inline size_t capacity() const { return mTable.capacity(); }
+
+    inline void clear() { mTable.clear(); }
+    inline void reserve(size_t minimumCapacity) { mTable.reserve(minimumCapacity); }
+    inline void shrink() { mTable.shrink(); }
+
+    inline ssize_t indexOfKey(const TKey& key) const {
+        return mTable.find(hash_type(key), key);
+    }
+    inline ssize_t indexOfKey(lookup_type key) const {
+        return mTable.find(Lookup::hash(key), key);
+    }
+
+    /* The key must be in the map. */
+    const TValue& valueFor(const TKey& key) const;
+    const TValue& valueFor(lookup_type key) const;
+    TValue& editValueFor(const TKey& key);
+
+    inline ssize_t next(ssize_t index) const { return mTable.next(index); }
+    inline const TKey& keyAt(size_t index) const { return mTable.entryAt(index).key; }
+    inline const TValue& valueAt(size_t index) const { return mTable.entryAt(index).value; }
+    inline TValue& editValueAt(size_t index) { return mTable.editEntryAt(index).value; }
+
+    /* Adds the key, or replaces its value if it is already there. Returns
+     * the index of the entry. */
+    ssize_t add(const TKey& key, const TValue& value);
+
+    /* Returns the index the key had, or NAME_NOT_FOUND. */
+    ssize_t removeItem(const TKey& key);
+    ssize_t removeItem(lookup_type key);
+    inline void removeItemAt(size_t index) { mTable.removeAt(index); }
+
+private:
+    typedef key_value_pair_t<TKey, TValue> Entry;
+    typedef flat_hash_lookup_t<TKey> Lookup;
+
+    FlatHashtable<TKey, Entry> mTable;
+};
+
+template <typename TKey, typename TValue>
+const TValue& FlatHashMap<TKey, TValue>::valueFor(const TKey& key) const {
+    ssize_t index = indexOfKey(key);
+    LOG_ALWAYS_FATAL_IF(index < 0, "FlatHashMap::valueFor: no such key");
+    return valueAt(index);
+}
+
+template <typename TKey, typename TValue>
+const TValue& FlatHashMap<TKey, TValue>::valueFor(lookup_type key) const {
+    ssize_t index = indexOfKey(key);
+    LOG_ALWAYS_FATAL_IF(index < 0, "FlatHashMap::valueFor: no such key");
+    return valueAt(index);
+}
+
+template <typename TKey, typename TValue>
+TValue& FlatHashMap<TKey, TValue>::editValueFor(const TKey& key) {
+    ssize_t index = indexOfKey(key);
+    LOG_ALWAYS_FATAL_IF(index < 0, "FlatHashMap::editValueFor: no such key");
+    return editValueAt(index);
+}
+
+template <typename TKey, typename TValue>
+ssize_t FlatHashMap<TKey, TValue>::add(const TKey& key, const TValue& value) {
+    const hash_t hash = hash_type(key);
+    ssize_t index = mTable.find(hash, key);
+    if (index >= 0) {
+        mTable.editEntryAt(index).value = value;
+        return index;
+    }
+    return ssize_t(mTable.add(hash, Entry(key, value)));
+}
+
+template <typename TKey, typename TValue>
+ssize_t FlatHashMap<TKey, TValue>::removeItem(const TKey& key) {
+    ssize_t index = indexOfKey(key);
+    if (index < 0) {
+        return NAME_NOT_FOUND;
+    }
+    mTable.removeAt(index);
+    return index;
+}
+
+template <typename TKey, typename TValue>
+ssize_t FlatHashMap<TKey, TValue>::removeItem(lookup_type key) {
+    ssize_t index = indexOfKey(key);
+    if (index < 0) {
+        return NAME_NOT_FOUND;
+    }
+    mTable.removeAt(index);
+    return index;
+}
+
+// ---------------------------------------------------------------------------
+
+/* Implementation type.  Nothing to see here. */
+template <typename TKey>
+struct flat_hash_set_entry_t {
+    TKey key;
+
+    flat_hash_set_entry_t(const TKey& key) : key(key) { }
+    inline const TKey& getKey() const { return key; }
+};
+
+template <typename K>
+struct trait_trivial_dtor< flat_hash_set_entry_t<K> >
+{ enum { value = traits<K>::has_trivial_dtor }; };
+template <typename K>
+struct trait_trivial_copy< flat_hash_set_entry_t<K> >
+{ enum { value = traits<K>::has_trivial_copy }; };
+template <typename K>
+struct trait_trivial_move< flat_hash_set_entry_t<K> >
+{ enum { value = traits<K>::has_trivial_move }; };
+
+/**
+ * A hash set of unique keys, with the same storage and rules as
+ * FlatHashMap.
+ */
+template <typename TKey>
+class FlatHashSet {
+public:
+    typedef TKey value_type;
+    typedef typename flat_hash_lookup_t<TKey>::type lookup_type;
+
+    FlatHashSet() { }
+    explicit FlatHashSet(size_t minimumCapacity) { mTable.reserve(minimumCapacity); }
+
+    inline size_t size() const { return mTable.size(); }
+    inline bool isEmpty() const { return mTable.size() == 0; }
+    inline size_t capacity() const { return mTable.capacity(); }
+
+    inline void clear() { mTable.clear(); }
+    inline void reserve(size_t minimumCapacity) { mTable.reserve(minimumCapacity); }
+    inline void shrink() { mTable.shrink(); }
+
+    inline ssize_t indexOf(const TKey& key) const {
+        return mTable.find(hash_type(key), key);
+    }
+    inline ssize_t indexOf(lookup_type key) const {
+        return mTable.find(Lookup::hash(key), key);
+    }
+    inline bool contains(const TKey& key) const { return indexOf(key) >= 0; }
+    inline bool contains(lookup_type key) const { return indexOf(key) >= 0; }
+
+    inline ssize_t next(ssize_t index) const { return mTable.next(index); }
+    inline const TKey& itemAt(size_t index) const { return mTable.entryAt(index).key; }
+
+    /* Adds the key if it isn't there yet. Returns the index of the entry. */
+    ssize_t add(const TKey& key);
+
+    /* Returns the index the key had, or NAME_NOT_FOUND. */
+    ssize_t remove(const TKey& key);
+    ssize_t remove(lookup_type key);
+    inline void removeAt(size_t index) { mTable.removeAt(index); }
+
+private:
+    typedef flat_hash_set_entry_t<TKey> Entry;
+    typedef flat_hash_lookup_t<TKey> Lookup;
+
+    FlatHashtable<TKey, Entry> mTable;
+};
+
+template <typename TKey>
+ssize_t FlatHashSet<TKey>::add(const TKey& key) {
+    const hash_t hash = hash_type(key);
+    ssize_t index = mTable.find(hash, key);
+    if (index >= 0) {
+        return index;
+    }
+    return ssize_t(mTable.add(hash, Entry(key)));
+}
+
+template <typename TKey>
+ssize_t FlatHashSet<TKey>::remove(const TKey& key) {
+    ssize_t index = indexOf(key);
+    if (index < 0) {
+        return NAME_NOT_FOUND;
+    }
+    mTable.removeAt(index);
+    return index;
+}
+
+template <typename TKey>
+ssize_t FlatHashSet<TKey>::remove(lookup_type key) {
+    ssize_t index = indexOf(key);
+    if (index < 0) {
+        return NAME_NOT_FOUND;
+    }
+    mTable.removeAt(index);
+    return index;
+}
+
+}; // namespace android
+
+#endif // ANDROID_UTILS_FLAT_HASH_MAP_H
@@ -20,6 +20,7 @@
 #include <utils/threads.h>
 #include <utils/RefBase.h>
 #include <utils/KeyedVector.h>
+#include <utils/String8.h>
 #include <utils/Timers.h>
 
 #include <android/looper.h>
@@ -145,6 +146,20 @@ public:
      */
     bool getAllowNonCallbacks() const;
 
+    /**
+     * Delivers message deadlines through a timerfd registered with the epoll instance
+     * instead of recomputing the poll timeout from the head of the message queue.
+     *
+     * Once enabled, enqueuing a message at the head of the queue rearms the timer
+     * rather than waking the poll, so pollOnce() no longer returns ALOOPER_POLL_WAKE
+     * just because a message was sent; it returns when the message is due instead.
+     *
+     * Returns true if the timer is enabled, false if it could not be created.
+     *
+     * This method can be called on any thread.
+     */
+    bool enableMessageTimer();
+
     /**
      * Waits for events to be available, with optional timeout in milliseconds.
      * Invokes callbacks for all file descriptors on which an event occurred.
@@ -319,12 +334,25 @@ public:
      */
     static sp<Looper> getForThread();
 
+    /**
+     * Appends a description of the registered file descriptors to the given string,
+     * including how many poll events each of them has delivered since it was added.
+     * Useful for profiling which file descriptors are hot.
+     *
+     * This method can be called on any thread.
+     */
+    void dump(String8& result);
+
 private:
     struct Request {
-        int fd;
+        Request() : fd(-1), ident(0), events(0), data(NULL), eventCount(0) { }
+
+        int fd; // -1 for unused slots of mRequests
         int ident;
+        int events;
         sp<LooperCallback> callback;
         void* data;
+        uint32_t eventCount; // number of poll events delivered for this request
     };
 
     struct Response {
@@ -333,30 +361,47 @@ private:
     };
 
     struct MessageEnvelope {
-        MessageEnvelope() : uptime(0) { }
-
-        MessageEnvelope(nsecs_t uptime, const sp<MessageHandler> handler,
-                const Message& message) : uptime(uptime), handler(handler), message(message) {
-        }
+        MessageEnvelope() : uptime(0), seq(0),
+                heapIndex(-1), prevForHandler(-1), nextForHandler(-1) { }
 
         nsecs_t uptime;
+        uint64_t seq; // breaks ties between messages with the same uptime (FIFO order)
         sp<MessageHandler> handler;
         Message message;
+
+        // Position of this envelope in mMessageHeap, or -1 if the slot is free.
+        ssize_t heapIndex;
+
+        // Links to the other envelopes destined for the same handler.
+        // For free slots, nextForHandler links the free list instead.
+        ssize_t prevForHandler;
+        ssize_t nextForHandler;
     };
 
     const bool mAllowNonCallbacks; // immutable
 
-    int mWakeReadPipeFd;  // immutable
-    int mWakeWritePipeFd; // immutable
+    int mWakeEventFd;     // immutable
+    volatile int32_t mWakePending; // non-zero while a wake is signalled but not yet consumed
+    int mTimerFd;         // set once by enableMessageTimer(), -1 when disabled
     Mutex mLock;
 
+    // Pending messages.  Envelopes live in slots of mMessageEnvelopes which are
+    // recycled through a free list.  mMessageHeap is a binary min-heap of slot
+    // indices ordered by (uptime, seq) and mMessageHandlers maps each handler
+    // to the first slot of the list of its pending envelopes.
     Vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
+    Vector<size_t> mMessageHeap; // guarded by mLock
+    KeyedVector<MessageHandler*, ssize_t> mMessageHandlers; // guarded by mLock
+    ssize_t mFreeEnvelope; // guarded by mLock
+    uint64_t mNextMessageSeq; // guarded by mLock
+    nsecs_t mTimerUptime; // guarded by mLock, LLONG_MAX when the timerfd is disarmed
     bool mSendingMessage; // guarded by mLock
 
     int mEpollFd; // immutable
 
-    // Locked list of file descriptor monitoring requests.
-    KeyedVector<int, Request> mRequests;  // guarded by mLock
+    // Locked table of file descriptor monitoring requests, indexed by fd.
+    Vector<Request> mRequests;  // guarded by mLock
+    size_t mRequestCount;       // guarded by mLock
 
     // This state is only used privately by pollOnce and does not require a lock since
     // it runs on a single thread.
@@ -366,7 +411,19 @@ private:
 
     int pollInner(int timeoutMillis);
     void awoken();
+    void drainTimer();
+    void updateTimerLocked();
     void pushResponse(int events, const Request& request);
+    int removeFdLocked(int fd);
+    Request* getRequestLocked(int fd);
+
+    size_t enqueueMessageLocked(nsecs_t uptime, const sp<MessageHandler>& handler,
+            const Message& message);
+    void removeMessageLocked(size_t slot);
+    bool messageBeforeLocked(size_t slotA, size_t slotB) const;
+    void setHeapSlotLocked(size_t heapIndex, size_t slot);
+    void siftUpLocked(size_t heapIndex);
+    void siftDownLocked(size_t heapIndex);
 
     static void initTLSKey();
     static void threadDestructor(void *st);
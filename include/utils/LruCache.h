@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_LRU_CACHE_H
+#define ANDROID_UTILS_LRU_CACHE_H
+
+#include <stdlib.h>
+
+#include <cutils/log.h>
+
+#include <utils/BasicHashtable.h>
+#include <utils/GenerationCache.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+/* Implementation types.  Nothing to see here. */
+template <typename TKey, typename TValue>
+struct lru_cache_node_t {
+    TKey key;
+    TValue value;
+    size_t cost;
+    hash_t hash;
+    lru_cache_node_t* older;
+    lru_cache_node_t* newer;
+
+    lru_cache_node_t(const TKey& key, const TValue& value, size_t cost, hash_t hash) :
+            key(key), value(value), cost(cost), hash(hash), older(NULL), newer(NULL) { }
+};
+
+// The hashtable only holds a pointer to the node, so rehashing moves
+// 4 bytes per entry and never invalidates the LRU links.
+template <typename TKey, typename TValue>
+struct lru_cache_slot_t {
+    lru_cache_node_t<TKey, TValue>* node;
+
+    inline const TKey& getKey() const { return node->key; }
+};
+
+template <typename K, typename V>
+struct trait_trivial_ctor< lru_cache_slot_t<K, V> > { enum { value = true }; };
+template <typename K, typename V>
+struct trait_trivial_dtor< lru_cache_slot_t<K, V> > { enum { value = true }; };
+template <typename K, typename V>
+struct trait_trivial_copy< lru_cache_slot_t<K, V> > { enum { value = true }; };
+template <typename K, typename V>
+struct trait_trivial_move< lru_cache_slot_t<K, V> > { enum { value = true }; };
+
+/**
+ * A LRU cache with the same semantics as GenerationCache, built on
+ * BasicHashtable so that get(), put() and remove() are O(1).
+ *
+ * Entries are kept in nodes allocated from a pool that grows in chunks and
+ * is only returned to the heap by clear() or the destructor, and are linked
+ * from oldest to youngest through the nodes themselves.
+ *
+ * Besides the maximum number of entries, the cache can be bounded by the
+ * total cost of its entries, in whatever unit put() is given (usually
+ * bytes). The oldest entries are evicted until a new entry fits both
+ * limits.
+ *
+ * TKey needs a hash_type() specialization.
+ */
+template <typename TKey, typename TValue>
+class LruCache {
+public:
+    enum Capacity {
+        kUnlimitedCapacity = 0,
+    };
+
+    /* maxCapacity: the maximum number of entries, or kUnlimitedCapacity.
+     * maxCost: the maximum total cost of the entries, or 0 for no limit.
+     */
+    explicit LruCache(uint32_t maxCapacity, size_t maxCost = 0);
+    virtual ~LruCache();
+
+    void setOnEntryRemovedListener(OnEntryRemoved<TKey, TValue>* listener);
+
+    size_t size() const { return mTable.size(); }
+    size_t cost() const { return mCost; }
+
+    void clear();
+
+    bool contains(const TKey& key) const;
+
+    /* Returns the value for the key and makes it the youngest entry, or a
+     * default constructed value if the key isn't in the cache.
+     */
+    const TValue& get(const TKey& key);
+
+    /* Adds a new entry as the youngest, evicting the oldest entries as
+     * needed. Returns false, and changes nothing, if the key is already in
+     * the cache or if the cost alone is over maxCost.
+     */
+    bool put(const TKey& key, const TValue& value, size_t cost = 0);
+
+    bool remove(const TKey& key);
+    bool removeOldest();
+
+    /* The key of the oldest entry, which must exist. */
+    const TKey& getOldestKey() const { return mOldest->key; }
+
+private:
+    typedef lru_cache_node_t<TKey, TValue> Node;
+    typedef lru_cache_slot_t<TKey, TValue> Slot;
+
+    enum {
+        MIN_NODES_PER_CHUNK = 16,
+        MAX_NODES_PER_CHUNK = 1024,
+    };
+
+    LruCache(const LruCache&);
+    LruCache& operator =(const LruCache&);
+
+    ssize_t findSlot(hash_t hash, const TKey& key) const;
+    void removeSlot(size_t index);
+
+    void attachToCache(Node* node);
+    void detachFromCache(Node* node);
+
+    Node* allocateNode();
+    void releaseNode(Node* node);
+
+    BasicHashtable<TKey, Slot> mTable;
+    uint32_t mMaxCapacity;
+    size_t mMaxCost;
+    size_t mCost;
+
+    OnEntryRemoved<TKey, TValue>* mListener;
+
+    Node* mOldest;
+    Node* mYoungest;
+
+    // node pool: unused nodes are chained through their first word
+    Vector<void*> mChunks;
+    size_t mPooledNodes;
+    void* mFreeNodes;
+
+    const TValue mNullValue;
+};
+
+template <typename TKey, typename TValue>
+LruCache<TKey, TValue>::LruCache(uint32_t maxCapacity, size_t maxCost) :
+        mMaxCapacity(maxCapacity), mMaxCost(maxCost), mCost(0),
+        mListener(NULL), mOldest(NULL), mYoungest(NULL),
+        mPooledNodes(0), mFreeNodes(NULL), mNullValue() {
+}
+
+template <typename TKey, typename TValue>
+LruCache<TKey, TValue>::~LruCache() {
+    clear();
+}
+
+template <typename TKey, typename TValue>
+void LruCache<TKey, TValue>::setOnEntryRemovedListener(
+        OnEntryRemoved<TKey, TValue>* listener) {
+    mListener = listener;
+}
+
+template <typename TKey, typename TValue>
+void LruCache<TKey, TValue>::clear() {
+    Node* node = mOldest;
+    while (node) {
+        Node* next = node->newer;
+        if (mListener) {
+            (*mListener)(node->key, node->value);
+        }
+        node->~Node();
+        node = next;
+    }
+    mTable.clear();
+    mOldest = mYoungest = NULL;
+    mCost = 0;
+
+    for (size_t i = 0; i < mChunks.size(); i++) {
+        free(mChunks[i]);
+    }
+    mChunks.clear();
+    mPooledNodes = 0;
+    mFreeNodes = NULL;
+}
+
+template <typename TKey, typename TValue>
+ssize_t LruCache<TKey, TValue>::findSlot(hash_t hash, const TKey& key) const {
+    return mTable.find(-1, hash, key);
+}
+
+template <typename TKey, typename TValue>
+bool LruCache<TKey, TValue>::contains(const TKey& key) const {
+    return findSlot(hash_type(key), key) >= 0;
+}
+
+template <typename TKey, typename TValue>
+const TValue& LruCache<TKey, TValue>::get(const TKey& key) {
+    ssize_t index = findSlot(hash_type(key), key);
+    if (index < 0) {
+        return mNullValue;
+    }
+    Node* node = mTable.entryAt(index).node;
+    if (node != mYoungest) {
+        detachFromCache(node);
+        attachToCache(node);
+    }
+    return node->value;
+}
+
+template <typename TKey, typename TValue>
+bool LruCache<TKey, TValue>::put(const TKey& key, const TValue& value, size_t cost) {
+    if (mMaxCost && cost > mMaxCost) {
+        return false;
+    }
+    const hash_t hash = hash_type(key);
+    if (findSlot(hash, key) >= 0) {
+        return false;
+    }
+
+    while (mOldest && ((mMaxCapacity != kUnlimitedCapacity && size() >= mMaxCapacity)
+            || (mMaxCost && mCost + cost > mMaxCost))) {
+        if (!removeOldest()) {
+            break;
+        }
+    }
+
+    Node* node = new (allocateNode()) Node(key, value, cost, hash);
+    Slot slot;
+    slot.node = node;
+    mTable.add(hash, slot);
+    mCost += cost;
+    attachToCache(node);
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool LruCache<TKey, TValue>::remove(const TKey& key) {
+    ssize_t index = findSlot(hash_type(key), key);
+    if (index < 0) {
+        return false;
+    }
+    removeSlot(index);
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool LruCache<TKey, TValue>::removeOldest() {
+    if (!mOldest) {
+        return false;
+    }
+    ssize_t index = findSlot(mOldest->hash, mOldest->key);
+    if (index < 0) {
+        ALOGE("LruCache: removeOldest failed to find the oldest entry in the table. "
+                "Is the key's hash_type() or operator== kaput?");
+        return false;
+    }
+    removeSlot(index);
+    return true;
+}
+
+template <typename TKey, typename TValue>
+void LruCache<TKey, TValue>::removeSlot(size_t index) {
+    Node* node = mTable.entryAt(index).node;
+    mTable.removeAt(index);
+    detachFromCache(node);
+    mCost -= node->cost;
+    if (mListener) {
+        (*mListener)(node->key, node->value);
+    }
+    node->~Node();
+    releaseNode(node);
+}
+
+template <typename TKey, typename TValue>
+void LruCache<TKey, TValue>::attachToCache(Node* node) {
+    node->older = mYoungest;
+    node->newer = NULL;
+    if (mYoungest) {
+        mYoungest->newer = node;
+    } else {
+        mOldest = node;
+    }
+    mYoungest = node;
+}
+
+template <typename TKey, typename TValue>
+void LruCache<TKey, TValue>::detachFromCache(Node* node) {
+    if (node->older) {
+        node->older->newer = node->newer;
+    } else {
+        mOldest = node->newer;
+    }
+    if (node->newer) {
+        node->newer->older = node->older;
+    } else {
+        mYoungest = node->older;
+    }
+    node->older = node->newer = NULL;
+}
+
+template <typename TKey, typename TValue>
+typename LruCache<TKey, TValue>::Node* LruCache<TKey, TValue>::allocateNode() {
+    if (!mFreeNodes) {
+        // grow the pool by about as much as it already holds, but no more
+        // than the cache can use
+        size_t count = mPooledNodes;
+        if (count < MIN_NODES_PER_CHUNK) {
+            count = MIN_NODES_PER_CHUNK;
+        } else if (count > MAX_NODES_PER_CHUNK) {
+            count = MAX_NODES_PER_CHUNK;
+        }
+        if (mMaxCapacity != kUnlimitedCapacity && mPooledNodes < mMaxCapacity
+                && count > mMaxCapacity - mPooledNodes) {
+            count = mMaxCapacity - mPooledNodes;
+        }
+        // nodes are at least as large as the free list link
+        char* chunk = static_cast<char*>(malloc(count * sizeof(Node)));
+        LOG_ALWAYS_FATAL_IF(!chunk, "LruCache: out of memory");
+        mChunks.add(chunk);
+        mPooledNodes += count;
+        for (size_t i = count; i > 0; i--) {
+            void* node = chunk + (i - 1) * sizeof(Node);
+            *static_cast<void**>(node) = mFreeNodes;
+            mFreeNodes = node;
+        }
+    }
+    void* node = mFreeNodes;
+    mFreeNodes = *static_cast<void**>(node);
+    return static_cast<Node*>(node);
+}
+
+template <typename TKey, typename TValue>
+void LruCache<TKey, TValue>::releaseNode(Node* node) {
+    *reinterpret_cast<void**>(node) = mFreeNodes;
+    mFreeNodes = node;
+}
+
+}; // namespace android
+
+#endif // ANDROID_UTILS_LRU_CACHE_H
@@ -168,6 +168,7 @@ inline String16 String16::operator+(const String16& other) const
 
 inline int String16::compare(const String16& other) const
 {
+    if (mString == other.mString) return 0;
     return strzcmp16(mString, size(), other.mString, other.size());
 }
 
@@ -183,11 +184,15 @@ inline bool String16::operator<=(const String16& other) const
 
 inline bool String16::operator==(const String16& other) const
 {
+    // copies and interned strings (see StringAtom) share buffers
+    if (mString == other.mString) return true;
     return strzcmp16(mString, size(), other.mString, other.size()) == 0;
 }
 
 inline bool String16::operator!=(const String16& other) const
 {
+    // copies and interned strings (see StringAtom) share buffers
+    if (mString == other.mString) return false;
     return strzcmp16(mString, size(), other.mString, other.size()) != 0;
 }
 
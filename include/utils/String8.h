@@ -34,6 +34,15 @@ class TextOutput;
 
 //! This is a string holding UTF-8 characters. Does not allow the value more
 // than 0x10FFFF, which is not valid unicode codepoint.
+//
+// Strings of up to INLINE_CAPACITY bytes (15 on 32-bit targets) are kept in
+// the String8 itself and cost no allocation. Longer ones live in a
+// SharedBuffer that copies share until one of them is modified, with room
+// to grow so that a string built by many appends is reallocated only a
+// logarithmic number of times.
+//
+// A pointer returned by string() is only valid until the String8 is
+// modified, destroyed or moved, e.g. by a Vector<String8> growing.
 class String8
 {
 public:
@@ -60,6 +69,7 @@ public:
     inline  size_t              bytes() const;
     inline  bool                isEmpty() const;
     
+    //! the buffer holding the string, or NULL if it is held inline
     inline  const SharedBuffer* sharedBuffer() const;
     
             void                clear();
@@ -75,6 +85,7 @@ public:
             status_t            append(const char* other);
             status_t            append(const char* other, size_t numChars);
 
+            // the arguments must not point into this string
             status_t            appendFormat(const char* fmt, ...)
                     __attribute__((format (printf, 2, 3)));
             status_t            appendFormatV(const char* fmt, va_list args);
@@ -217,11 +228,42 @@ private:
             status_t            real_append(const char* other, size_t numChars);
             char*               find_extension(void) const;
 
-            const char* mString;
+            enum {
+                // bytes of the string kept in the object itself; the last
+                // one holds the tag
+                INLINE_SIZE = 4 * sizeof(void*),
+                INLINE_CAPACITY = INLINE_SIZE - 1,
+                // tag of a string kept in a SharedBuffer; an inline string's
+                // tag is INLINE_CAPACITY - length() instead, which doubles as
+                // the terminator of a full one
+                HEAP_TAG = 0xFF
+            };
+
+            struct Heap {
+                char* data;         // in a SharedBuffer of capacity + 1
+                size_t length;
+            };
+
+    inline  bool                isHeap() const;
+    inline  void                initEmpty();
+            void                release();
+            void                setLength(size_t length);
+            char*               initStorage(size_t length);
+            char*               editStorage(size_t capacity, bool grow = false);
+            void                swapStorage(String8& other);
+            bool                initFromUTF8(const char* in, size_t len);
+            bool                initFromUTF16(const char16_t* in, size_t len);
+            bool                initFromUTF32(const char32_t* in, size_t len);
+
+            union {
+                char            mInline[INLINE_SIZE];
+                Heap            mHeap;
+            };
 };
 
 // String8 can be trivially moved using memcpy() because moving does not
-// require any change to the underlying SharedBuffer contents or reference count.
+// require any change to the underlying SharedBuffer contents or reference
+// count, and an inline string holds no pointer to itself.
 ANDROID_TRIVIAL_MOVE_TRAIT(String8)
 
 TextOutput& operator<<(TextOutput& to, const String16& val);
@@ -239,18 +281,34 @@ inline int strictly_order_type(const String8& lhs, const String8& rhs)
     return compare_type(lhs, rhs) < 0;
 }
 
+template <> inline hash_t hash_type(const String8& value)
+{
+    return hash_string(value.string(), value.length());
+}
+
 inline const String8 String8::empty() {
     return String8();
 }
 
+inline bool String8::isHeap() const
+{
+    return uint8_t(mInline[INLINE_SIZE-1]) == HEAP_TAG;
+}
+
+inline void String8::initEmpty()
+{
+    mInline[0] = 0;
+    mInline[INLINE_SIZE-1] = INLINE_CAPACITY;
+}
+
 inline const char* String8::string() const
 {
-    return mString;
+    return isHeap() ? mHeap.data : mInline;
 }
 
 inline size_t String8::length() const
 {
-    return SharedBuffer::sizeFromData(mString)-1;
+    return isHeap() ? mHeap.length : INLINE_CAPACITY - uint8_t(mInline[INLINE_SIZE-1]);
 }
 
 inline size_t String8::size() const
@@ -265,12 +323,12 @@ inline bool String8::isEmpty() const
 
 inline size_t String8::bytes() const
 {
-    return SharedBuffer::sizeFromData(mString)-1;
+    return length();
 }
 
 inline const SharedBuffer* String8::sharedBuffer() const
 {
-    return SharedBuffer::bufferFromData(mString);
+    return isHeap() ? SharedBuffer::bufferFromData(mHeap.data) : NULL;
 }
 
 inline String8& String8::operator=(const String8& other)
@@ -313,72 +371,72 @@ inline String8 String8::operator+(const char* other) const
 
 inline int String8::compare(const String8& other) const
 {
-    return strcmp(mString, other.mString);
+    return strcmp(string(), other.string());
 }
 
 inline bool String8::operator<(const String8& other) const
 {
-    return strcmp(mString, other.mString) < 0;
+    return strcmp(string(), other.string()) < 0;
 }
 
 inline bool String8::operator<=(const String8& other) const
 {
-    return strcmp(mString, other.mString) <= 0;
+    return strcmp(string(), other.string()) <= 0;
 }
 
 inline bool String8::operator==(const String8& other) const
 {
-    return strcmp(mString, other.mString) == 0;
+    return strcmp(string(), other.string()) == 0;
 }
 
 inline bool String8::operator!=(const String8& other) const
 {
-    return strcmp(mString, other.mString) != 0;
+    return strcmp(string(), other.string()) != 0;
 }
 
 inline bool String8::operator>=(const String8& other) const
 {
-    return strcmp(mString, other.mString) >= 0;
+    return strcmp(string(), other.string()) >= 0;
 }
 
 inline bool String8::operator>(const String8& other) const
 {
-    return strcmp(mString, other.mString) > 0;
+    return strcmp(string(), other.string()) > 0;
 }
 
 inline bool String8::operator<(const char* other) const
 {
-    return strcmp(mString, other) < 0;
+    return strcmp(string(), other) < 0;
 }
 
 inline bool String8::operator<=(const char* other) const
 {
-    return strcmp(mString, other) <= 0;
+    return strcmp(string(), other) <= 0;
 }
 
 inline bool String8::operator==(const char* other) const
 {
-    return strcmp(mString, other) == 0;
+    return strcmp(string(), other) == 0;
 }
 
 inline bool String8::operator!=(const char* other) const
 {
-    return strcmp(mString, other) != 0;
+    return strcmp(string(), other) != 0;
 }
 
 inline bool String8::operator>=(const char* other) const
 {
-    return strcmp(mString, other) >= 0;
+    return strcmp(string(), other) >= 0;
 }
 
 inline bool String8::operator>(const char* other) const
 {
-    return strcmp(mString, other) > 0;
+    return strcmp(string(), other) > 0;
 }
 
 inline String8::operator const char*() const
 {
-    return mString;
+    return string();
 }
 
 }  // namespace android
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_STRING8_BUILDER_H
+#define ANDROID_STRING8_BUILDER_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/String8.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+
+/*
+ * Builds a long string out of many pieces, e.g. the output of a dump().
+ *
+ * The pieces are appended to a list of chunks, each about as large as
+ * everything before it, so nothing already appended is ever copied until
+ * toString() puts it all together in a String8 of exactly the right size.
+ *
+ * Not thread-safe.
+ */
+class String8Builder
+{
+public:
+                                String8Builder();
+                                ~String8Builder();
+
+            void                clear();
+
+    inline  size_t              length() const { return mLength; }
+    inline  bool                isEmpty() const { return mLength == 0; }
+
+            status_t            append(const String8& other);
+            status_t            append(const char* other);
+            status_t            append(const char* other, size_t numChars);
+
+            status_t            appendFormat(const char* fmt, ...)
+                    __attribute__((format (printf, 2, 3)));
+            status_t            appendFormatV(const char* fmt, va_list args);
+
+            // everything appended so far
+            String8             toString() const;
+
+private:
+                                String8Builder(const String8Builder&);
+            String8Builder&     operator=(const String8Builder&);
+
+            enum {
+                MIN_CHUNK_SIZE = 1024,
+                MAX_CHUNK_SIZE = 64 * 1024
+            };
+
+            // followed by size bytes of data
+            struct Chunk {
+                Chunk* next;
+                size_t size;
+                size_t used;
+
+                inline char* data() { return reinterpret_cast<char*>(this + 1); }
+                inline const char* data() const {
+                    return reinterpret_cast<const char*>(this + 1);
+                }
+            };
+
+            Chunk*              addChunk(size_t minimumSize);
+
+            Chunk*              mFirst;
+            Chunk*              mLast;
+            size_t              mLength;
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_STRING8_BUILDER_H
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_STRING_ATOM_H
+#define ANDROID_STRING_ATOM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String16.h>
+#include <utils/TypeHelpers.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+
+/*
+ * An interned String16.
+ *
+ * All StringAtoms made from equal strings share one buffer, kept by a
+ * process-wide table, so they compare by pointer. So do the String16s
+ * taken from them, since String16 compares shared buffers before
+ * characters.
+ *
+ * Meant for the strings a process compares over and over again, such as
+ * binder interface descriptors. The table never shrinks, so strings that
+ * come from other processes should only be matched against it with find().
+ *
+ * Looking up an atom takes no lock. Only the first atom made from a string
+ * copies it.
+ */
+class StringAtom
+{
+public:
+    // the empty string
+    inline                      StringAtom() { }
+    explicit                    StringAtom(const String16& str);
+    explicit                    StringAtom(const char16_t* str, size_t len);
+    explicit                    StringAtom(const char* str);
+
+    // Sets outAtom to the atom equal to str and returns true if there is
+    // one. Never adds to the table.
+    static  bool                find(const String16& str, StringAtom* outAtom);
+    static  bool                find(const char16_t* str, size_t len, StringAtom* outAtom);
+
+    inline  const String16&     string() const { return mString; }
+    inline  size_t              size() const { return mString.size(); }
+
+    inline  bool                operator==(const StringAtom& other) const;
+    inline  bool                operator!=(const StringAtom& other) const;
+
+private:
+            String16            mString;
+};
+
+// StringAtom can be trivially moved using memcpy() because moving does not
+// require any change to the underlying SharedBuffer contents or reference count.
+ANDROID_TRIVIAL_MOVE_TRAIT(StringAtom)
+
+// ---------------------------------------------------------------------------
+// No user servicable parts below.
+
+inline bool StringAtom::operator==(const StringAtom& other) const
+{
+    return mString.string() == other.mString.string();
+}
+
+inline bool StringAtom::operator!=(const StringAtom& other) const
+{
+    return mString.string() != other.mString.string();
+}
+
+template<> inline hash_t hash_type(const StringAtom& atom) {
+    return hash_type(uintptr_t(atom.string().string()));
+}
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_STRING_ATOM_H
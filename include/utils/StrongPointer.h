@@ -68,6 +68,10 @@ public:
     sp(const sp<T>& other);
     template<typename U> sp(U* other);
     template<typename U> sp(const sp<U>& other);
+#if __cplusplus >= 201103L
+    // moving takes the reference over without touching the reference count
+    sp(sp<T>&& other);
+#endif
 
     ~sp();
 
@@ -78,6 +82,9 @@ public:
 
     template<typename U> sp& operator = (const sp<U>& other);
     template<typename U> sp& operator = (U* other);
+#if __cplusplus >= 201103L
+    sp& operator = (sp<T>&& other);
+#endif
 
     //! Special optimization for use by ProcessState (and nobody else).
     void force_set(T* other);
@@ -143,6 +150,15 @@ sp<T>::sp(const sp<U>& other)
     if (m_ptr) m_ptr->incStrong(this);
   }
 
+#if __cplusplus >= 201103L
+template<typename T>
+sp<T>::sp(sp<T>&& other)
+: m_ptr(other.m_ptr)
+  {
+    other.m_ptr = 0;
+  }
+#endif
+
 template<typename T>
 sp<T>::~sp()
 {
@@ -158,6 +174,18 @@ sp<T>& sp<T>::operator = (const sp<T>& other) {
     return *this;
 }
 
+#if __cplusplus >= 201103L
+template<typename T>
+sp<T>& sp<T>::operator = (sp<T>&& other) {
+    if (this != &other) {
+        if (m_ptr) m_ptr->decStrong(this);
+        m_ptr = other.m_ptr;
+        other.m_ptr = 0;
+    }
+    return *this;
+}
+#endif
+
 template<typename T>
 sp<T>& sp<T>::operator = (T* other)
 {
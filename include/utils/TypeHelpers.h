@@ -258,6 +258,43 @@ template <typename K, typename V>
 struct trait_trivial_move< key_value_pair_t<K, V> >
 { enum { value = aggregate_traits<K,V>::has_trivial_move }; };
 
+// key_value_pair_t<> is moved a member at a time when it can't be moved with
+// memmove(), so that members with their own move_*_type(), like sp<> and
+// wp<>, don't fall back to copying.
+template<typename K, typename V> inline
+void move_forward_type(key_value_pair_t<K, V>* d,
+        const key_value_pair_t<K, V>* s, size_t n) {
+    if (traits< key_value_pair_t<K, V> >::has_trivial_move ||
+            (traits< key_value_pair_t<K, V> >::has_trivial_dtor &&
+             traits< key_value_pair_t<K, V> >::has_trivial_copy)) {
+        memmove(d, s, n*sizeof(key_value_pair_t<K, V>));
+    } else {
+        d += n;
+        s += n;
+        while (n--) {
+            --d, --s;
+            move_forward_type(&d->key, &s->key, 1);
+            move_forward_type(&d->value, &s->value, 1);
+        }
+    }
+}
+
+template<typename K, typename V> inline
+void move_backward_type(key_value_pair_t<K, V>* d,
+        const key_value_pair_t<K, V>* s, size_t n) {
+    if (traits< key_value_pair_t<K, V> >::has_trivial_move ||
+            (traits< key_value_pair_t<K, V> >::has_trivial_dtor &&
+             traits< key_value_pair_t<K, V> >::has_trivial_copy)) {
+        memmove(d, s, n*sizeof(key_value_pair_t<K, V>));
+    } else {
+        while (n--) {
+            move_backward_type(&d->key, &s->key, 1);
+            move_backward_type(&d->value, &s->value, 1);
+            d++, s++;
+        }
+    }
+}
+
 // ---------------------------------------------------------------------------
 
 /*
@@ -295,6 +332,17 @@ template <typename T> inline hash_t hash_type(const T*& value) {
     return hash_type(uintptr_t(value));
 }
 
+/* Hash code of a run of bytes (32-bit FNV-1a). hash_type() for String8 is
+ * hash_string() of its characters, so containers keyed by String8 can be
+ * searched with a plain C string. */
+inline hash_t hash_string(const char* s, size_t len) {
+    hash_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ uint8_t(s[i])) * 16777619u;
+    }
+    return hash;
+}
+
 }; // namespace android
 
 // ---------------------------------------------------------------------------
@@ -163,6 +163,24 @@ char16_t* utf8_to_utf16_no_null_terminator(const uint8_t* src, size_t srcLen, ch
  */
 void utf8_to_utf16(const uint8_t* src, size_t srcLen, char16_t* dst);
 
+/**
+ * Returns the UTF-16 length of UTF-8 string "src" if it is well-formed, or
+ * -1 if it has a stray or missing continuation byte, an overlong form, a
+ * surrogate or a code point past U+10FFFF. In that case the offset of the
+ * first bad sequence is stored in "bad_offset", if not NULL.
+ *
+ * Unlike utf8_to_utf16_length(), which only checks that the last sequence
+ * isn't cut short, this makes the input safe for utf8_to_utf16().
+ */
+ssize_t utf8_to_utf16_length_checked(const uint8_t* src, size_t src_len, size_t* bad_offset);
+
+/**
+ * Returns the UTF-8 length of UTF-16 string "src", or -1 if it has an
+ * unpaired surrogate, whose index is then stored in "bad_index", if not
+ * NULL. Returns 0 for an empty string.
+ */
+ssize_t utf16_to_utf8_length_checked(const char16_t* src, size_t src_len, size_t* bad_index);
+
 }
 
 #endif
@@ -20,6 +20,9 @@
 #include <new>
 #include <stdint.h>
 #include <sys/types.h>
+#if __cplusplus >= 201103L
+#include <utility>
+#endif
 
 #include <utils/Log.h>
 #include <utils/VectorImpl.h>
@@ -145,6 +148,15 @@ public:
     inline  ssize_t         add();
     //! same as push() but returns the index the item was added at (or an error)
             ssize_t         add(const TYPE& item);            
+#if __cplusplus >= 201103L
+    //! same as push(), but moves the item instead of copying it
+            void            push(TYPE&& item);
+    //! same as add(), but moves the item instead of copying it
+            ssize_t         add(TYPE&& item);
+    //! constructs an item in place at the top of the stack, returns its index (or an error)
+    template<typename... Args>
+            ssize_t         emplace(Args&&... args);
+#endif
     //! replace an item with a new one initialized with its default constructor
     inline  ssize_t         replaceAt(size_t index);
     //! replace an item with a new one
@@ -214,7 +226,8 @@ Vector<TYPE>::Vector()
     : VectorImpl(sizeof(TYPE),
                 ((traits<TYPE>::has_trivial_ctor   ? HAS_TRIVIAL_CTOR   : 0)
                 |(traits<TYPE>::has_trivial_dtor   ? HAS_TRIVIAL_DTOR   : 0)
-                |(traits<TYPE>::has_trivial_copy   ? HAS_TRIVIAL_COPY   : 0))
+                |(traits<TYPE>::has_trivial_copy   ? HAS_TRIVIAL_COPY   : 0)
+                |(traits<TYPE>::has_trivial_move   ? HAS_TRIVIAL_MOVE   : 0))
                 )
 {
 }
@@ -339,6 +352,33 @@ ssize_t Vector<TYPE>::add(const TYPE& item) {
     return VectorImpl::add(&item);
 }
 
+#if __cplusplus >= 201103L
+template<class TYPE> inline
+void Vector<TYPE>::push(TYPE&& item) {
+    add(std::move(item));
+}
+
+template<class TYPE> inline
+ssize_t Vector<TYPE>::add(TYPE&& item) {
+    ssize_t index = VectorImpl::add();
+    if (index >= 0) {
+        editItemAt(index) = std::move(item);
+    }
+    return index;
+}
+
+template<class TYPE> template<typename... Args> inline
+ssize_t Vector<TYPE>::emplace(Args&&... args) {
+    ssize_t index = VectorImpl::add();
+    if (index >= 0) {
+        TYPE* item = &editItemAt(index);
+        destroy_type(item, 1);
+        new(item) TYPE(std::forward<Args>(args)...);
+    }
+    return index;
+}
+#endif
+
 template<class TYPE> inline
 ssize_t Vector<TYPE>::replaceAt(const TYPE& item, size_t index) {
     return VectorImpl::replaceAt(&item, index);
@@ -27,7 +27,8 @@ sources := \
     Parcel.cpp \
     PermissionCache.cpp \
     ProcessState.cpp \
-    Static.cpp
+    Static.cpp \
+    TransactionStats.cpp
 
 ifeq ($(BOARD_NEEDS_MEMORYHEAPPMEM),true)
 sources += \
@@ -64,3 +65,7 @@ LOCAL_LDLIBS += -lpthread
 LOCAL_MODULE := libbinder
 LOCAL_SRC_FILES := $(sources)
 include $(BUILD_STATIC_LIBRARY)
+
+ifeq (,$(ONE_SHOT_MAKEFILE))
+include $(call first-makefiles-under,$(LOCAL_PATH))
+endif
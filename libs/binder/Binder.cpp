@@ -20,14 +20,50 @@
 #include <utils/misc.h>
 #include <binder/BpBinder.h>
 #include <binder/IInterface.h>
+#include <binder/IPCThreadState.h>
 #include <binder/Parcel.h>
+#include <binder/PermissionCache.h>
+#include <utils/String8.h>
 
 #include <stdio.h>
+#include <unistd.h>
 
 namespace android {
 
 // ---------------------------------------------------------------------------
 
+// Handles "dumpsys <service> --binder-stats [on|off]" for any native service:
+// the process's transaction stats and Parcel buffer pool counters.
+// This runs before the service's own dump(), so it checks the permission
+// every dump() checks itself.
+static status_t dumpTransactionStats(int fd, const Vector<String16>& args)
+{
+    if (!PermissionCache::checkCallingPermission(String16("android.permission.DUMP"))) {
+        String8 result;
+        result.appendFormat("Permission Denial: "
+                "can't dump binder stats from pid=%d, uid=%d\n",
+                IPCThreadState::self()->getCallingPid(),
+                IPCThreadState::self()->getCallingUid());
+        write(fd, result.string(), result.size());
+        return PERMISSION_DENIED;
+    }
+
+    if (args.size() > 1) {
+        if (args[1] == String16("on")) {
+            IPCThreadState::setTransactionStatsEnabled(true);
+        } else if (args[1] == String16("off")) {
+            IPCThreadState::setTransactionStatsEnabled(false);
+        }
+    }
+    String8 result;
+    IPCThreadState::dumpTransactionStats(result);
+    Parcel::dumpBufferPool(result);
+    write(fd, result.string(), result.size());
+    return NO_ERROR;
+}
+
+// ---------------------------------------------------------------------------
+
 IBinder::IBinder()
     : RefBase()
 {
@@ -198,6 +234,9 @@ status_t BBinder::onTransact(
             for (int i = 0; i < argc && data.dataAvail() > 0; i++) {
                args.add(data.readString16());
             }
+            if (args.size() && args[0] == String16("--binder-stats")) {
+                return dumpTransactionStats(fd, args);
+            }
             return dump(fd, args);
         }
 
@@ -21,6 +21,7 @@
 
 #include <binder/IPCThreadState.h>
 #include <utils/Log.h>
+#include <utils/StringAtom.h>
 
 #include <stdio.h>
 
@@ -112,6 +113,13 @@ const String16& BpBinder::getInterfaceDescriptor() const
                 INTERFACE_TRANSACTION, send, &reply);
         if (err == NO_ERROR) {
             String16 res(reply.readString16());
+            // share the buffer of a local descriptor equal to this one, so
+            // that comparing them is a pointer compare; the table isn't
+            // grown with strings from other processes
+            StringAtom atom;
+            if (StringAtom::find(res, &atom)) {
+                res = atom.string();
+            }
             Mutex::Autolock _l(mLock);
             // mDescriptorCache could have been assigned while the lock was
             // released.
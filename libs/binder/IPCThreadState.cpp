@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#define ATRACE_TAG ATRACE_TAG_BINDER
 #define LOG_TAG "IPCThreadState"
 
 #include <binder/IPCThreadState.h>
@@ -23,11 +24,14 @@
 #include <cutils/sched_policy.h>
 #include <utils/Debug.h>
 #include <utils/Log.h>
+#include <utils/String8.h>
 #include <utils/TextOutput.h>
+#include <utils/Trace.h>
 #include <utils/threads.h>
 
 #include <private/binder/binder_module.h>
 #include <private/binder/Static.h>
+#include <private/binder/TransactionStats.h>
 
 #include <sys/ioctl.h>
 #include <signal.h>
@@ -289,6 +293,26 @@ static const void* printCommand(TextOutput& out, const void* _cmd)
 }
 #endif
 
+// Limits on how much a one-way batch may queue before it is sent.  Each
+// queued transaction gets its own BR_TRANSACTION_COMPLETE, so the count
+// is also kept well within what fits in mIn.
+static const size_t ONEWAY_BATCH_MAX_TRANSACTIONS = 32;
+static const size_t ONEWAY_BATCH_MAX_BYTES = 64 * 1024;
+
+// Returns true if a trace section was started.
+static bool traceTransactionBegin(const char* direction, const char16_t* descriptor,
+        size_t descriptorLength, uint32_t code)
+{
+    if (!ATRACE_ENABLED()) {
+        return false;
+    }
+    char name[128];
+    snprintf(name, sizeof(name), "binder %s %s#%u", direction,
+            descriptor ? String8(descriptor, descriptorLength).string() : "", code);
+    Tracer::traceBegin(ATRACE_TAG, name);
+    return true;
+}
+
 static pthread_mutex_t gTLSMutex = PTHREAD_MUTEX_INITIALIZER;
 static bool gHaveTLS = false;
 static pthread_key_t gTLS = 0;
@@ -419,6 +443,11 @@ void IPCThreadState::flushCommands()
 {
     if (mProcess->mDriverFD <= 0)
         return;
+    const status_t err = flushOnewayBatch();
+    if (err != NO_ERROR) {
+        ALOGW("Queued oneway transactions failed: %d", err);
+        mLastError = err;
+    }
     talkWithDriver(false);
 }
 
@@ -509,6 +538,34 @@ void IPCThreadState::stopProcess(bool immediate)
 status_t IPCThreadState::transact(int32_t handle,
                                   uint32_t code, const Parcel& data,
                                   Parcel* reply, uint32_t flags)
+{
+    if (CC_LIKELY(!TransactionStats::isEnabled())) {
+        return sendTransaction(handle, code, data, reply, flags);
+    }
+
+    size_t descriptorLength = 0;
+    const char16_t* descriptor =
+            TransactionStats::peekInterfaceToken(data, code, &descriptorLength);
+    const bool traced = traceTransactionBegin("out", descriptor, descriptorLength, code);
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    const status_t err = sendTransaction(handle, code, data, reply, flags);
+
+    const nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    if (traced) {
+        Tracer::traceEnd(ATRACE_TAG);
+    }
+    if (!mStats) {
+        mStats = TransactionStats::create(mMyThreadId);
+    }
+    mStats->record(TransactionStats::OUTGOING, descriptor, descriptorLength, code,
+            data.dataSize(), reply ? reply->dataSize() : 0, latency, 0);
+    return err;
+}
+
+status_t IPCThreadState::sendTransaction(int32_t handle,
+                                         uint32_t code, const Parcel& data,
+                                         Parcel* reply, uint32_t flags)
 {
     status_t err = data.errorCheck();
 
@@ -524,7 +581,15 @@ status_t IPCThreadState::transact(int32_t handle,
     if (err == NO_ERROR) {
         LOG_ONEWAY(">>>> SEND from pid %d uid %d %s", getpid(), getuid(),
             (flags & TF_ONE_WAY) == 0 ? "READ REPLY" : "ONE WAY");
-        err = writeTransactionData(BC_TRANSACTION, flags, handle, code, data, NULL);
+        if ((flags & TF_ONE_WAY) != 0 && mOnewayBatchDepth > 0) {
+            return queueOnewayTransaction(handle, code, data, flags);
+        }
+        // Anything queued must complete first, so that the driver's
+        // responses are matched up with the right transactions.
+        err = flushOnewayBatch();
+        if (err == NO_ERROR) {
+            err = writeTransactionData(BC_TRANSACTION, flags, handle, code, data, NULL);
+        }
     }
     
     if (err != NO_ERROR) {
@@ -568,6 +633,82 @@ status_t IPCThreadState::transact(int32_t handle,
     return err;
 }
 
+void IPCThreadState::setTransactionStatsEnabled(bool enabled)
+{
+    TransactionStats::setEnabled(enabled);
+}
+
+void IPCThreadState::dumpTransactionStats(String8& result)
+{
+    TransactionStats::dump(result);
+}
+
+void IPCThreadState::beginOnewayBatch()
+{
+    mOnewayBatchDepth++;
+}
+
+status_t IPCThreadState::endOnewayBatch()
+{
+    ALOG_ASSERT(mOnewayBatchDepth > 0, "endOnewayBatch() without beginOnewayBatch()");
+    if (mOnewayBatchDepth > 0 && --mOnewayBatchDepth == 0) {
+        return flushOnewayBatch();
+    }
+    return NO_ERROR;
+}
+
+status_t IPCThreadState::flushOnewayBatch()
+{
+    if (mOnewayBatch.isEmpty()) {
+        return NO_ERROR;
+    }
+
+    // Take the queue first: anything sent while we wait is on its own.
+    Vector<Parcel*> batch(mOnewayBatch);
+    mOnewayBatch.clear();
+    mOnewayBatchBytes = 0;
+
+    // The first wait sends the whole queue in one BINDER_WRITE_READ; the
+    // driver answers each transaction, and the remaining waits normally
+    // just consume those answers from mIn.
+    status_t result = NO_ERROR;
+    const size_t N = batch.size();
+    for (size_t i=0; i<N; i++) {
+        const status_t err = waitForResponse(NULL, NULL);
+        if (err != NO_ERROR && result == NO_ERROR) {
+            result = err;
+        }
+    }
+    for (size_t i=0; i<N; i++) {
+        delete batch[i];
+    }
+    return result;
+}
+
+status_t IPCThreadState::queueOnewayTransaction(int32_t handle, uint32_t code,
+    const Parcel& data, uint32_t flags)
+{
+    // The caller's parcel is usually gone before the batch is sent, so the
+    // driver is pointed at a copy that lives until then.
+    Parcel* copy = new Parcel;
+    status_t err = copy->appendFrom(&data, 0, data.dataSize());
+    if (err == NO_ERROR) {
+        err = writeTransactionData(BC_TRANSACTION, flags, handle, code, *copy, NULL);
+    }
+    if (err != NO_ERROR) {
+        delete copy;
+        return (mLastError = err);
+    }
+
+    mOnewayBatch.push(copy);
+    mOnewayBatchBytes += copy->dataSize();
+    if (mOnewayBatch.size() >= ONEWAY_BATCH_MAX_TRANSACTIONS
+            || mOnewayBatchBytes >= ONEWAY_BATCH_MAX_BYTES) {
+        return flushOnewayBatch();
+    }
+    return NO_ERROR;
+}
+
 void IPCThreadState::incStrongHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::incStrongHandle(%d)\n", handle);
@@ -599,6 +740,13 @@ void IPCThreadState::decWeakHandle(int32_t handle)
 status_t IPCThreadState::attemptIncStrongHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::attemptIncStrongHandle(%d)\n", handle);
+    // Send the batch first, so that waiting for the batch's answers can't
+    // take our BR_ACQUIRE_RESULT.
+    const status_t batchErr = flushOnewayBatch();
+    if (batchErr != NO_ERROR) {
+        ALOGW("Queued oneway transactions failed: %d", batchErr);
+        mLastError = batchErr;
+    }
     mOut.writeInt32(BC_ATTEMPT_ACQUIRE);
     mOut.writeInt32(0); // xxx was thread priority
     mOut.writeInt32(handle);
@@ -642,7 +790,11 @@ IPCThreadState::IPCThreadState()
     : mProcess(ProcessState::self()),
       mMyThreadId(androidGetTid()),
       mStrictModePolicy(0),
-      mLastTransactionBinderFlags(0)
+      mLastTransactionBinderFlags(0),
+      mOnewayBatchBytes(0),
+      mOnewayBatchDepth(0),
+      mStats(NULL),
+      mInReceivedTime(0)
 {
     pthread_setspecific(gTLS, this);
     clearCaller();
@@ -653,16 +805,24 @@ IPCThreadState::IPCThreadState()
 
 IPCThreadState::~IPCThreadState()
 {
+    for (size_t i=0; i<mOnewayBatch.size(); i++) {
+        delete mOnewayBatch[i];
+    }
+    TransactionStats::destroy(mStats);
 }
 
 status_t IPCThreadState::sendReply(const Parcel& reply, uint32_t flags)
 {
     status_t err;
     status_t statusBuffer;
+    // The reply goes out even if the batch failed, or the caller would
+    // never be released; the batch's error is reported afterwards.
+    const status_t batchErr = flushOnewayBatch();
     err = writeTransactionData(BC_REPLY, flags, -1, 0, reply, &statusBuffer);
     if (err < NO_ERROR) return err;
     
-    return waitForResponse(NULL, NULL);
+    err = waitForResponse(NULL, NULL);
+    return err == NO_ERROR ? batchErr : err;
 }
 
 status_t IPCThreadState::waitForResponse(Parcel *reply, status_t *acquireResult)
@@ -763,7 +923,18 @@ status_t IPCThreadState::talkWithDriver(bool doReceive)
     }
     
     binder_write_read bwr;
-    
+
+    // Queued one-way transactions would go out with this write, and only
+    // flushOnewayBatch() knows to wait for their BR_TRANSACTION_COMPLETEs.
+    // It clears the queue before it reads, so this doesn't recurse.
+    if (doReceive && mIn.dataPosition() >= mIn.dataSize() && !mOnewayBatch.isEmpty()) {
+        const status_t err = flushOnewayBatch();
+        if (err != NO_ERROR) {
+            ALOGW("Queued oneway transactions failed: %d", err);
+            mLastError = err;
+        }
+    }
+
     // Is the read buffer empty?
     const bool needRead = mIn.dataPosition() >= mIn.dataSize();
     
@@ -840,6 +1011,10 @@ status_t IPCThreadState::talkWithDriver(bool doReceive)
         if (bwr.read_consumed > 0) {
             mIn.setDataSize(bwr.read_consumed);
             mIn.setDataPosition(0);
+            // Stamped even while stats are off, so that turning them on
+            // while commands are pending doesn't measure from a stale time.
+            // It costs one clock read next to the ioctl.
+            mInReceivedTime = systemTime(SYSTEM_TIME_MONOTONIC);
         }
         IF_LOG_COMMANDS() {
             TextOutput::Bundle _b(alog);
@@ -869,10 +1044,12 @@ status_t IPCThreadState::writeTransactionData(int32_t cmd, uint32_t binderFlags,
     tr.sender_pid = 0;
     tr.sender_euid = 0;
     
+    // Fetch the data first: this gathers any borrowed segments, which can fail.
+    const uint8_t* ipcData = data.ipcData();
     const status_t err = data.errorCheck();
     if (err == NO_ERROR) {
         tr.data_size = data.ipcDataSize();
-        tr.data.ptr.buffer = data.ipcData();
+        tr.data.ptr.buffer = ipcData;
         tr.offsets_size = data.ipcObjectsCount()*sizeof(size_t);
         tr.data.ptr.offsets = data.ipcObjects();
     } else if (statusBuffer) {
@@ -1022,6 +1199,26 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
 
             //ALOGI(">>>> TRANSACT from pid %d uid %d\n", mCallingPid, mCallingUid);
             
+            // The driver doesn't say when the transaction was sent, so the
+            // dispatch delay only covers the time since it was read.
+            nsecs_t dispatchTime = 0;
+            const char16_t* descriptor = NULL;
+            size_t descriptorLength = 0;
+            bool traced = false;
+            if (CC_UNLIKELY(TransactionStats::isEnabled())) {
+                dispatchTime = systemTime(SYSTEM_TIME_MONOTONIC);
+                BBinder* target = tr.target.ptr
+                        ? (BBinder*)tr.cookie : the_context_object.get();
+                if (target && target->getInterfaceDescriptor().size()) {
+                    descriptor = target->getInterfaceDescriptor().string();
+                    descriptorLength = target->getInterfaceDescriptor().size();
+                } else {
+                    descriptor = TransactionStats::peekInterfaceToken(buffer, tr.code,
+                            &descriptorLength);
+                }
+                traced = traceTransactionBegin("in", descriptor, descriptorLength, tr.code);
+            }
+
             Parcel reply;
             IF_LOG_TRANSACTIONS() {
                 TextOutput::Bundle _b(alog);
@@ -1053,6 +1250,20 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
             } else {
                 LOG_ONEWAY("NOT sending reply to %d!", mCallingPid);
             }
+
+            if (dispatchTime) {
+                if (traced) {
+                    Tracer::traceEnd(ATRACE_TAG);
+                }
+                if (!mStats) {
+                    mStats = TransactionStats::create(mMyThreadId);
+                }
+                mStats->record(TransactionStats::INCOMING,
+                        descriptor, descriptorLength, tr.code,
+                        buffer.dataSize(), reply.dataSize(),
+                        systemTime(SYSTEM_TIME_MONOTONIC) - dispatchTime,
+                        dispatchTime - mInReceivedTime);
+            }
             
             mCallingPid = origPid;
             mCallingUid = origUid;
@@ -30,6 +30,7 @@
 #include <utils/TextOutput.h>
 #include <utils/misc.h>
 #include <utils/Flattenable.h>
+#include <utils/threads.h>
 #include <cutils/ashmem.h>
 
 #include <private/binder/binder_module.h>
@@ -37,6 +38,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <sys/mman.h>
 
 #ifndef INT32_MAX
@@ -283,6 +285,203 @@ status_t unflatten_binder(const sp<ProcessState>& proc,
 
 // ---------------------------------------------------------------------------
 
+// Parcels are created and destroyed for every transaction, so their data and
+// object arrays are drawn from a small per-thread pool of power-of-two sized
+// buffers instead of going to the allocator each time.  A buffer is only
+// taken back by the pool if its capacity is exactly one of the size classes,
+// so anything allocated elsewhere is simply freed as before.
+
+static const size_t POOL_MIN_BUFFER_SIZE = 256;
+static const size_t POOL_CLASS_COUNT = 7;       // 256 bytes .. 16KB
+static const size_t POOL_CLASS_DEPTH = 4;
+static const size_t POOL_MAX_CACHED_BYTES = 64 * 1024;
+
+struct BufferPool
+{
+    void* buffers[POOL_CLASS_COUNT][POOL_CLASS_DEPTH];
+    size_t counts[POOL_CLASS_COUNT];
+    pid_t tid;
+    Parcel::BufferPoolStats stats;
+    BufferPool* prev;
+    BufferPool* next;
+};
+
+static pthread_once_t gBufferPoolOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gBufferPoolKey;
+static Mutex gBufferPoolLock;
+static BufferPool* gBufferPools = NULL;
+static Parcel::BufferPoolStats gRetiredPoolStats;
+
+static void destroy_buffer_pool(void* p)
+{
+    BufferPool* pool = static_cast<BufferPool*>(p);
+    for (size_t i=0; i<POOL_CLASS_COUNT; i++) {
+        for (size_t j=0; j<pool->counts[i]; j++) {
+            free(pool->buffers[i][j]);
+        }
+    }
+
+    Mutex::Autolock _l(gBufferPoolLock);
+    gRetiredPoolStats.hits += pool->stats.hits;
+    gRetiredPoolStats.misses += pool->stats.misses;
+    gRetiredPoolStats.oversized += pool->stats.oversized;
+    if (gRetiredPoolStats.highWaterBytes < pool->stats.highWaterBytes) {
+        gRetiredPoolStats.highWaterBytes = pool->stats.highWaterBytes;
+    }
+    if (pool->prev) pool->prev->next = pool->next;
+    else gBufferPools = pool->next;
+    if (pool->next) pool->next->prev = pool->prev;
+    delete pool;
+}
+
+static void create_buffer_pool_key()
+{
+    pthread_key_create(&gBufferPoolKey, destroy_buffer_pool);
+}
+
+static BufferPool* get_buffer_pool(bool create)
+{
+    pthread_once(&gBufferPoolOnce, create_buffer_pool_key);
+    BufferPool* pool = static_cast<BufferPool*>(pthread_getspecific(gBufferPoolKey));
+    if (pool || !create) {
+        return pool;
+    }
+
+    pool = new BufferPool;
+    memset(pool, 0, sizeof(*pool));
+    pool->tid = androidGetTid();
+    if (pthread_setspecific(gBufferPoolKey, pool) != 0) {
+        delete pool;
+        return NULL;
+    }
+    Mutex::Autolock _l(gBufferPoolLock);
+    pool->next = gBufferPools;
+    if (gBufferPools) gBufferPools->prev = pool;
+    gBufferPools = pool;
+    return pool;
+}
+
+// Returns the size class that can hold 'size' bytes, or -1 if it is too big.
+static ssize_t buffer_class_for(size_t size)
+{
+    size_t classSize = POOL_MIN_BUFFER_SIZE;
+    for (size_t i=0; i<POOL_CLASS_COUNT; i++, classSize <<= 1) {
+        if (size <= classSize) return i;
+    }
+    return -1;
+}
+
+// Returns the size class whose size is exactly 'capacity', or -1.
+static ssize_t buffer_class_of(size_t capacity)
+{
+    const ssize_t i = buffer_class_for(capacity);
+    return (i >= 0 && (POOL_MIN_BUFFER_SIZE << i) == capacity) ? i : -1;
+}
+
+// Allocates at least *size bytes, and updates *size with the usable capacity.
+static void* alloc_buffer(size_t* size)
+{
+    const ssize_t i = buffer_class_for(*size);
+    BufferPool* pool = get_buffer_pool(true);
+    if (i < 0) {
+        if (pool) pool->stats.oversized++;
+        return malloc(*size);
+    }
+
+    *size = POOL_MIN_BUFFER_SIZE << i;
+    if (pool && pool->counts[i] > 0) {
+        pool->stats.hits++;
+        pool->stats.cachedBytes -= *size;
+        return pool->buffers[i][--pool->counts[i]];
+    }
+    if (pool) pool->stats.misses++;
+    return malloc(*size);
+}
+
+static void free_buffer(void* buffer, size_t capacity)
+{
+    if (!buffer) return;
+
+    // Don't resurrect the pool of a thread that is going away.
+    BufferPool* pool = get_buffer_pool(false);
+    const ssize_t i = buffer_class_of(capacity);
+    if (pool && i >= 0 && pool->counts[i] < POOL_CLASS_DEPTH
+            && pool->stats.cachedBytes + capacity <= POOL_MAX_CACHED_BYTES) {
+        pool->buffers[i][pool->counts[i]++] = buffer;
+        pool->stats.cachedBytes += capacity;
+        if (pool->stats.highWaterBytes < pool->stats.cachedBytes) {
+            pool->stats.highWaterBytes = pool->stats.cachedBytes;
+        }
+        return;
+    }
+    free(buffer);
+}
+
+// Like realloc(), but keeps the first 'used' bytes of a buffer of the given
+// capacity.  Returns NULL and leaves the old buffer alone on failure.
+static void* realloc_buffer(void* buffer, size_t capacity, size_t used, size_t* size)
+{
+    const ssize_t i = buffer_class_for(*size);
+    if (i < 0 && buffer_class_of(capacity) < 0) {
+        BufferPool* pool = get_buffer_pool(true);
+        if (pool) pool->stats.oversized++;
+        return realloc(buffer, *size);
+    }
+    if (buffer && i >= 0 && (POOL_MIN_BUFFER_SIZE << i) == capacity) {
+        *size = capacity;
+        return buffer;
+    }
+
+    void* data = alloc_buffer(size);
+    if (data && buffer) {
+        if (used > capacity) used = capacity;
+        memcpy(data, buffer, used < *size ? used : *size);
+        free_buffer(buffer, capacity);
+    }
+    return data;
+}
+
+void Parcel::getBufferPoolStats(BufferPoolStats* stats)
+{
+    // The live counters belong to their threads and are read without
+    // synchronization; they are only meant for diagnostics.
+    Mutex::Autolock _l(gBufferPoolLock);
+    *stats = gRetiredPoolStats;
+    stats->cachedBytes = 0;
+    for (const BufferPool* pool = gBufferPools; pool; pool = pool->next) {
+        stats->hits += pool->stats.hits;
+        stats->misses += pool->stats.misses;
+        stats->oversized += pool->stats.oversized;
+        stats->cachedBytes += pool->stats.cachedBytes;
+        if (stats->highWaterBytes < pool->stats.highWaterBytes) {
+            stats->highWaterBytes = pool->stats.highWaterBytes;
+        }
+    }
+}
+
+void Parcel::dumpBufferPool(String8& result)
+{
+    BufferPoolStats total;
+    getBufferPoolStats(&total);
+    result.appendFormat("Parcel buffer pool: hits=%lu misses=%lu oversized=%lu "
+            "cached=%lu bytes high-water=%lu bytes\n",
+            (unsigned long) total.hits, (unsigned long) total.misses,
+            (unsigned long) total.oversized, (unsigned long) total.cachedBytes,
+            (unsigned long) total.highWaterBytes);
+
+    Mutex::Autolock _l(gBufferPoolLock);
+    for (const BufferPool* pool = gBufferPools; pool; pool = pool->next) {
+        result.appendFormat("  tid %d: hits=%lu misses=%lu oversized=%lu "
+                "cached=%lu bytes high-water=%lu bytes\n",
+                pool->tid, (unsigned long) pool->stats.hits,
+                (unsigned long) pool->stats.misses, (unsigned long) pool->stats.oversized,
+                (unsigned long) pool->stats.cachedBytes,
+                (unsigned long) pool->stats.highWaterBytes);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
 Parcel::Parcel()
 {
     initState();
@@ -295,6 +494,7 @@ Parcel::~Parcel()
 
 const uint8_t* Parcel::data() const
 {
+    flushSegments();
     return mData;
 }
 
@@ -326,7 +526,10 @@ size_t Parcel::dataCapacity() const
 
 status_t Parcel::setDataSize(size_t size)
 {
-    status_t err;
+    status_t err = flushSegments();
+    if (err != NO_ERROR) {
+        return err;
+    }
     err = continueWrite(size);
     if (err == NO_ERROR) {
         mDataSize = size;
@@ -337,13 +540,20 @@ status_t Parcel::setDataSize(size_t size)
 
 void Parcel::setDataPosition(size_t pos) const
 {
+    flushSegments();
     mDataPos = pos;
     mNextObjectHint = 0;
 }
 
 status_t Parcel::setDataCapacity(size_t size)
 {
-    if (size > mDataCapacity) return continueWrite(size);
+    if (size > mDataCapacity) {
+        status_t err = flushSegments();
+        if (err != NO_ERROR) {
+            return err;
+        }
+        return continueWrite(size);
+    }
     return NO_ERROR;
 }
 
@@ -362,7 +572,7 @@ status_t Parcel::appendFrom(const Parcel *parcel, size_t offset, size_t len)
 {
     const sp<ProcessState> proc(ProcessState::self());
     status_t err;
-    const uint8_t *data = parcel->mData;
+    const uint8_t *data = parcel->data();
     const size_t *objects = parcel->mObjects;
     size_t size = parcel->mObjectsSize;
     int startPos = mDataPos;
@@ -409,14 +619,14 @@ status_t Parcel::appendFrom(const Parcel *parcel, size_t offset, size_t len)
     if (numObjects > 0) {
         // grow objects
         if (mObjectsCapacity < mObjectsSize + numObjects) {
-            int newSize = ((mObjectsSize + numObjects)*3)/2;
-            size_t *objects =
-                (size_t*)realloc(mObjects, newSize*sizeof(size_t));
+            size_t newSize = (((mObjectsSize + numObjects)*3)/2)*sizeof(size_t);
+            size_t *objects = (size_t*)realloc_buffer(mObjects,
+                    mObjectsCapacity*sizeof(size_t), mObjectsSize*sizeof(size_t), &newSize);
             if (objects == (size_t*)0) {
                 return NO_MEMORY;
             }
             mObjects = objects;
-            mObjectsCapacity = newSize;
+            mObjectsCapacity = newSize/sizeof(size_t);
         }
         
         // append and acquire objects
@@ -500,12 +710,15 @@ bool Parcel::enforceInterface(const String16& interface,
     } else {
       threadState->setStrictModePolicy(strictPolicy);
     }
-    const String16 str(readString16());
-    if (str == interface) {
+    // compare in place, without copying the token into a String16
+    size_t len;
+    const char16_t* str = readString16Inplace(&len);
+    if (str != NULL && len == interface.size()
+            && !memcmp(str, interface.string(), len * sizeof(char16_t))) {
         return true;
     } else {
         ALOGW("**** enforceInterface() expected '%s' but read '%s'\n",
-                String8(interface).string(), String8(str).string());
+                String8(interface).string(), str ? String8(str, len).string() : "");
         return false;
     }
 }
@@ -572,6 +785,34 @@ status_t Parcel::write(const void* data, size_t len)
     return mError;
 }
 
+status_t Parcel::writeBorrowed(const void* data, size_t len)
+{
+    if (len == 0) {
+        return NO_ERROR;
+    }
+
+    // Only plain appends to a parcel we own can be deferred.
+    if (mOwner || mDataPos != mDataSize) {
+        return write(data, len);
+    }
+
+    const size_t padded = PAD_SIZE(len);
+
+    // sanity check for integer overflow
+    if (mDataPos+padded < mDataPos) {
+        return BAD_VALUE;
+    }
+
+    Segment segment;
+    segment.offset = mDataPos;
+    segment.data = data;
+    segment.len = len;
+    if (mSegments.add(segment) < 0) {
+        return write(data, len);
+    }
+    return finishWrite(padded);
+}
+
 void* Parcel::writeInplace(size_t len)
 {
     const size_t padded = PAD_SIZE(len);
@@ -848,11 +1089,12 @@ restart_write:
         if (err != NO_ERROR) return err;
     }
     if (!enoughObjects) {
-        size_t newSize = ((mObjectsSize+2)*3)/2;
-        size_t* objects = (size_t*)realloc(mObjects, newSize*sizeof(size_t));
+        size_t newSize = (((mObjectsSize+2)*3)/2)*sizeof(size_t);
+        size_t* objects = (size_t*)realloc_buffer(mObjects,
+                mObjectsCapacity*sizeof(size_t), mObjectsSize*sizeof(size_t), &newSize);
         if (objects == NULL) return NO_MEMORY;
         mObjects = objects;
-        mObjectsCapacity = newSize;
+        mObjectsCapacity = newSize/sizeof(size_t);
     }
     
     goto restart_write;
@@ -1241,6 +1483,7 @@ void Parcel::closeFileDescriptors()
 
 const uint8_t* Parcel::ipcData() const
 {
+    flushSegments();
     return mData;
 }
 
@@ -1339,22 +1582,25 @@ void Parcel::freeData()
 
 void Parcel::freeDataNoInit()
 {
+    mSegments.clear();
     if (mOwner) {
         //ALOGI("Freeing data ref of %p (pid=%d)\n", this, getpid());
         mOwner(this, mData, mDataSize, mObjects, mObjectsSize, mOwnerCookie);
     } else {
         releaseObjects();
-        if (mData) free(mData);
-        if (mObjects) free(mObjects);
+        free_buffer(mData, mDataCapacity);
+        free_buffer(mObjects, mObjectsCapacity*sizeof(size_t));
     }
 }
 
 status_t Parcel::growData(size_t len)
 {
     size_t newSize = ((mDataSize+len)*3)/2;
-    return (newSize <= mDataSize)
-            ? (status_t) NO_MEMORY
-            : continueWrite(newSize);
+    if (newSize <= mDataSize) {
+        return NO_MEMORY;
+    }
+    // Gathering borrowed segments grows the storage in the same step.
+    return mSegments.isEmpty() ? continueWrite(newSize) : gatherSegments(newSize);
 }
 
 status_t Parcel::restartWrite(size_t desired)
@@ -1364,24 +1610,26 @@ status_t Parcel::restartWrite(size_t desired)
         return continueWrite(desired);
     }
     
-    uint8_t* data = (uint8_t*)realloc(mData, desired);
+    size_t capacity = desired;
+    uint8_t* data = (uint8_t*)realloc_buffer(mData, mDataCapacity, 0, &capacity);
     if (!data && desired > mDataCapacity) {
         mError = NO_MEMORY;
         return NO_MEMORY;
     }
     
     releaseObjects();
+    mSegments.clear();
     
     if (data) {
         mData = data;
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
     
     mDataSize = mDataPos = 0;
     ALOGV("restartWrite Setting data size of %p to %d\n", this, mDataSize);
     ALOGV("restartWrite Setting data pos of %p to %d\n", this, mDataPos);
         
-    free(mObjects);
+    free_buffer(mObjects, mObjectsCapacity*sizeof(size_t));
     mObjects = NULL;
     mObjectsSize = mObjectsCapacity = 0;
     mNextObjectHint = 0;
@@ -1418,16 +1666,19 @@ status_t Parcel::continueWrite(size_t desired)
 
         // If there is a different owner, we need to take
         // posession.
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity = desired;
+        uint8_t* data = (uint8_t*)alloc_buffer(&capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
         }
         size_t* objects = NULL;
+        size_t objectsCapacity = objectsSize*sizeof(size_t);
         
         if (objectsSize) {
-            objects = (size_t*)malloc(objectsSize*sizeof(size_t));
+            objects = (size_t*)alloc_buffer(&objectsCapacity);
             if (!objects) {
+                free_buffer(data, capacity);
                 mError = NO_MEMORY;
                 return NO_MEMORY;
             }
@@ -1454,8 +1705,9 @@ status_t Parcel::continueWrite(size_t desired)
         mObjects = objects;
         mDataSize = (mDataSize < desired) ? mDataSize : desired;
         ALOGV("continueWrite Setting data size of %p to %d\n", this, mDataSize);
-        mDataCapacity = desired;
-        mObjectsSize = mObjectsCapacity = objectsSize;
+        mDataCapacity = capacity;
+        mObjectsSize = objectsSize;
+        mObjectsCapacity = objects ? objectsCapacity/sizeof(size_t) : 0;
         mNextObjectHint = 0;
 
     } else if (mData) {
@@ -1471,21 +1723,19 @@ status_t Parcel::continueWrite(size_t desired)
                 }
                 release_object(proc, *flat, this);
             }
-            size_t* objects =
-                (size_t*)realloc(mObjects, objectsSize*sizeof(size_t));
-            if (objects) {
-                mObjects = objects;
-            }
+            // The objects array keeps its capacity; it is handed back to
+            // the buffer pool when the parcel is freed.
             mObjectsSize = objectsSize;
             mNextObjectHint = 0;
         }
 
         // We own the data, so we can just do a realloc().
         if (desired > mDataCapacity) {
-            uint8_t* data = (uint8_t*)realloc(mData, desired);
+            size_t capacity = desired;
+            uint8_t* data = (uint8_t*)realloc_buffer(mData, mDataCapacity, mDataSize, &capacity);
             if (data) {
                 mData = data;
-                mDataCapacity = desired;
+                mDataCapacity = capacity;
             } else if (desired > mDataCapacity) {
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -1503,7 +1753,8 @@ status_t Parcel::continueWrite(size_t desired)
         
     } else {
         // This is the first data.  Easy!
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity = desired;
+        uint8_t* data = (uint8_t*)alloc_buffer(&capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -1518,7 +1769,7 @@ status_t Parcel::continueWrite(size_t desired)
         mDataSize = mDataPos = 0;
         ALOGV("continueWrite Setting data size of %p to %d\n", this, mDataSize);
         ALOGV("continueWrite Setting data pos of %p to %d\n", this, mDataPos);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
 
     return NO_ERROR;
@@ -1543,6 +1794,45 @@ void Parcel::initState()
     mOwner = NULL;
 }
 
+status_t Parcel::gatherSegments(size_t capacity) const
+{
+    // Borrowed segments are only recorded on parcels we own (see writeBorrowed()),
+    // so the storage can simply be extended to cover them.  This runs on const
+    // paths such as data() and ipcData(), hence the cast.
+    Parcel* self = const_cast<Parcel*>(this);
+    if (capacity < mDataSize) {
+        capacity = mDataSize;
+    }
+    if (mDataCapacity < capacity) {
+        uint8_t* data = (uint8_t*)realloc_buffer(mData, mDataCapacity, mDataSize, &capacity);
+        if (!data) {
+            // The borrowed bytes were never copied: cut the parcel back to
+            // the owned data in front of the first of them.
+            const size_t owned = mSegments.itemAt(0).offset;
+            mSegments.clear();
+            if (mData) {
+                self->continueWrite(owned);
+            } else {
+                self->mDataSize = self->mDataPos = 0;
+            }
+            self->mError = NO_MEMORY;
+            return NO_MEMORY;
+        }
+        self->mData = data;
+        self->mDataCapacity = capacity;
+    }
+
+    const size_t N = mSegments.size();
+    for (size_t i=0; i<N; i++) {
+        const Segment& segment = mSegments.itemAt(i);
+        uint8_t* const dest = mData + segment.offset;
+        memcpy(dest, segment.data, segment.len);
+        memset(dest + segment.len, 0, PAD_SIZE(segment.len) - segment.len);
+    }
+    mSegments.clear();
+    return NO_ERROR;
+}
+
 void Parcel::scanForFds() const
 {
     bool hasFds = false;
@@ -17,6 +17,7 @@
 #define LOG_TAG "ProcessState"
 
 #include <cutils/process_name.h>
+#include <cutils/properties.h>
 
 #include <binder/ProcessState.h>
 
@@ -360,6 +361,12 @@ ProcessState::ProcessState()
     }
 
     LOG_ALWAYS_FATAL_IF(mDriverFD < 0, "Binder driver could not be opened.  Terminating.");
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.binder.stats", value, "0");
+    if (atoi(value)) {
+        IPCThreadState::setTransactionStatsEnabled(true);
+    }
 }
 
 ProcessState::~ProcessState()
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TransactionStats"
+
+#include <private/binder/TransactionStats.h>
+
+#include <binder/IBinder.h>
+#include <binder/Parcel.h>
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+volatile int32_t TransactionStats::sEnabled = 0;
+
+static Mutex gStatsLock;
+static TransactionStats* gLiveStats = NULL;
+static TransactionStats* gRetiredStats = NULL;
+
+static uint32_t hashDescriptor(const char16_t* s, size_t len, uint32_t code)
+{
+    // FNV-1a over the descriptor characters and the code.
+    uint32_t hash = 2166136261u;
+    for (size_t i=0; i<len; i++) {
+        hash = (hash ^ s[i]) * 16777619u;
+    }
+    return (hash ^ code) * 16777619u;
+}
+
+static size_t timeBucket(nsecs_t t, size_t n)
+{
+    uint64_t us = t > 0 ? uint64_t(ns2us(t)) : 0;
+    size_t i = 0;
+    while (us > 1 && i < n-1) {
+        us >>= 1;
+        i++;
+    }
+    return i;
+}
+
+static size_t sizeBucket(size_t size, size_t n)
+{
+    size >>= 6;
+    size_t i = 0;
+    while (size > 1 && i < n-1) {
+        size >>= 1;
+        i++;
+    }
+    return i;
+}
+
+// Returns the upper bound, in microseconds, of the bucket holding the given
+// percentile.
+static uint64_t percentile(const uint32_t* buckets, size_t n, uint32_t count, uint32_t pct)
+{
+    const uint64_t target = (uint64_t(count) * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i=0; i<n; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return uint64_t(2) << i;
+        }
+    }
+    return uint64_t(2) << (n - 1);
+}
+
+// ---------------------------------------------------------------------------
+
+void TransactionStats::setEnabled(bool enabled)
+{
+    android_atomic_release_store(enabled ? 1 : 0, &sEnabled);
+}
+
+TransactionStats* TransactionStats::create(pid_t tid)
+{
+    TransactionStats* stats = new TransactionStats(tid, THREAD_CAPACITY);
+    Mutex::Autolock _l(gStatsLock);
+    stats->mNext = gLiveStats;
+    if (gLiveStats) gLiveStats->mPrev = stats;
+    gLiveStats = stats;
+    return stats;
+}
+
+void TransactionStats::destroy(TransactionStats* stats)
+{
+    if (!stats) return;
+
+    Mutex::Autolock _l(gStatsLock);
+    if (stats->mPrev) stats->mPrev->mNext = stats->mNext;
+    else gLiveStats = stats->mNext;
+    if (stats->mNext) stats->mNext->mPrev = stats->mPrev;
+
+    if (!gRetiredStats) {
+        gRetiredStats = new TransactionStats(-1, PROCESS_CAPACITY);
+    }
+    gRetiredStats->merge(*stats);
+    delete stats;
+}
+
+TransactionStats::TransactionStats(pid_t tid, size_t capacity)
+    : mTid(tid), mCapacity(capacity), mEntries(new Entry[capacity]),
+      mDropped(0), mPrev(NULL), mNext(NULL)
+{
+    for (size_t i=0; i<capacity; i++) {
+        Entry& e = mEntries[i];
+        e.used = 0;
+        e.hash = e.code = 0;
+        e.direction = 0;
+        e.count = 0;
+        e.totalLatency = 0;
+        e.totalDataSize = e.totalReplySize = 0;
+        memset(e.latency, 0, sizeof(e.latency));
+        memset(e.dispatchDelay, 0, sizeof(e.dispatchDelay));
+        memset(e.dataSize, 0, sizeof(e.dataSize));
+    }
+}
+
+TransactionStats::~TransactionStats()
+{
+    delete[] mEntries;
+}
+
+const char16_t* TransactionStats::peekInterfaceToken(const Parcel& data, uint32_t code,
+        size_t* outLength)
+{
+    // Only user transactions start with an interface token.
+    if (code < IBinder::FIRST_CALL_TRANSACTION || code > IBinder::LAST_CALL_TRANSACTION
+            || data.dataSize() < 2*sizeof(int32_t)) {
+        return NULL;
+    }
+    const size_t pos = data.dataPosition();
+    data.setDataPosition(sizeof(int32_t));  // skip the strict mode policy
+    const char16_t* descriptor = data.readString16Inplace(outLength);
+    data.setDataPosition(pos);
+    return descriptor;
+}
+
+TransactionStats::Entry* TransactionStats::lookup(uint32_t hash, int32_t direction,
+        uint32_t code, const char16_t* descriptor, size_t descriptorLength)
+{
+    hash ^= direction;
+    for (size_t probe=0; probe<mCapacity; probe++) {
+        Entry& e = mEntries[(hash + probe) % mCapacity];
+        if (!e.used) {
+            // Only this thread writes the table; publish the key after it
+            // is complete so that dump() never sees half of it.
+            e.hash = hash;
+            e.code = code;
+            e.direction = direction;
+            e.descriptor.setTo(descriptor, descriptorLength);
+            android_atomic_release_store(1, &e.used);
+            return &e;
+        }
+        if (e.hash == hash && e.code == code && e.direction == direction
+                && e.descriptor.size() == descriptorLength
+                && !memcmp(e.descriptor.string(), descriptor,
+                        descriptorLength*sizeof(char16_t))) {
+            return &e;
+        }
+    }
+    return NULL;
+}
+
+void TransactionStats::record(Direction direction, const char16_t* descriptor,
+        size_t descriptorLength, uint32_t code, size_t dataSize, size_t replySize,
+        nsecs_t latency, nsecs_t dispatchDelay)
+{
+    static const char16_t kNone[] = { 0 };
+    if (!descriptor) {
+        descriptor = kNone;
+        descriptorLength = 0;
+    }
+
+    Entry* e = lookup(hashDescriptor(descriptor, descriptorLength, code), direction, code,
+            descriptor, descriptorLength);
+    if (!e) {
+        mDropped++;
+        return;
+    }
+    e->count++;
+    e->totalLatency += latency;
+    e->totalDataSize += dataSize;
+    e->totalReplySize += replySize;
+    e->latency[timeBucket(latency, TIME_BUCKETS)]++;
+    e->dataSize[sizeBucket(dataSize, SIZE_BUCKETS)]++;
+    if (direction == INCOMING) {
+        e->dispatchDelay[timeBucket(dispatchDelay, TIME_BUCKETS)]++;
+    }
+}
+
+void TransactionStats::merge(const TransactionStats& other)
+{
+    for (size_t i=0; i<other.mCapacity; i++) {
+        const Entry& src = other.mEntries[i];
+        if (!android_atomic_acquire_load(&src.used)) continue;
+
+        Entry* e = lookup(src.hash ^ src.direction, src.direction, src.code,
+                src.descriptor.string(), src.descriptor.size());
+        if (!e) {
+            mDropped += src.count;
+            continue;
+        }
+        e->count += src.count;
+        e->totalLatency += src.totalLatency;
+        e->totalDataSize += src.totalDataSize;
+        e->totalReplySize += src.totalReplySize;
+        for (size_t j=0; j<TIME_BUCKETS; j++) {
+            e->latency[j] += src.latency[j];
+            e->dispatchDelay[j] += src.dispatchDelay[j];
+        }
+        for (size_t j=0; j<SIZE_BUCKETS; j++) {
+            e->dataSize[j] += src.dataSize[j];
+        }
+    }
+    mDropped += other.mDropped;
+}
+
+void TransactionStats::print(String8& result) const
+{
+    const size_t SIZE = 512;
+    char buffer[SIZE];
+
+    for (size_t i=0; i<mCapacity; i++) {
+        const Entry& e = mEntries[i];
+        if (!e.used || !e.count) continue;
+
+        const String8 descriptor(e.descriptor);
+        snprintf(buffer, SIZE, "  %s %s#%u: count=%u avg=%lldus p50<=%lluus "
+                "p90<=%lluus p99<=%lluus data=%llu reply=%llu",
+                e.direction == OUTGOING ? "out" : "in ",
+                descriptor.size() ? descriptor.string() : "<none>", e.code, e.count,
+                (long long) ns2us(e.totalLatency / e.count),
+                (unsigned long long) percentile(e.latency, TIME_BUCKETS, e.count, 50),
+                (unsigned long long) percentile(e.latency, TIME_BUCKETS, e.count, 90),
+                (unsigned long long) percentile(e.latency, TIME_BUCKETS, e.count, 99),
+                (unsigned long long) (e.totalDataSize / e.count),
+                (unsigned long long) (e.totalReplySize / e.count));
+        result.append(buffer);
+        if (e.direction == INCOMING) {
+            snprintf(buffer, SIZE, " dispatch p50<=%lluus p99<=%lluus",
+                    (unsigned long long) percentile(e.dispatchDelay, TIME_BUCKETS, e.count, 50),
+                    (unsigned long long) percentile(e.dispatchDelay, TIME_BUCKETS, e.count, 99));
+            result.append(buffer);
+        }
+        result.append("\n");
+    }
+}
+
+void TransactionStats::dump(String8& result)
+{
+    const size_t SIZE = 128;
+    char buffer[SIZE];
+
+    TransactionStats total(-1, PROCESS_CAPACITY);
+    size_t threads = 0;
+    {
+        Mutex::Autolock _l(gStatsLock);
+        for (const TransactionStats* stats = gLiveStats; stats; stats = stats->mNext) {
+            total.merge(*stats);
+            threads++;
+        }
+        if (gRetiredStats) {
+            total.merge(*gRetiredStats);
+        }
+    }
+
+    snprintf(buffer, SIZE, "Binder transaction stats (%s, %d live threads, %u dropped):\n",
+            isEnabled() ? "enabled" : "disabled", int(threads), total.mDropped);
+    result.append(buffer);
+    total.print(result);
+}
+
+}; // namespace android
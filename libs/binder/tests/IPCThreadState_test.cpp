@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "IPCThreadState_test"
+#include <binder/IPCThreadState.h>
+#include <binder/Parcel.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include <private/binder/binder_module.h>
+
+#include <gtest/gtest.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------
+// A stand-in for the driver's BINDER_WRITE_READ.  Defining ioctl() here
+// interposes it for libbinder too; every other request still goes to the
+// real driver.  One-way transactions are recorded and answered with
+// BR_TRANSACTION_COMPLETE, the way the driver does.  With gFinishLooper
+// set, reads end with BR_FINISHED, which makes joinThreadPool(false) return.
+
+using namespace android;
+
+static size_t gWriteReadCount;
+static size_t gPendingCompletes;
+static bool gFinishLooper;
+static size_t gLooperCommands;
+static Vector<int32_t> gTransactionValues;
+
+static void handleWriteRead(binder_write_read* bwr)
+{
+    gWriteReadCount++;
+
+    const uint8_t* cmds = reinterpret_cast<const uint8_t*>(bwr->write_buffer);
+    size_t pos = bwr->write_consumed;
+    while (pos + sizeof(uint32_t) <= size_t(bwr->write_size)) {
+        const uint32_t cmd = *reinterpret_cast<const uint32_t*>(cmds + pos);
+        pos += sizeof(uint32_t);
+        if (cmd == BC_ENTER_LOOPER || cmd == BC_REGISTER_LOOPER) {
+            gLooperCommands++;
+        } else if (cmd == BC_TRANSACTION) {
+            const binder_transaction_data* tr =
+                    reinterpret_cast<const binder_transaction_data*>(cmds + pos);
+            if (tr->flags & TF_ONE_WAY) {
+                gTransactionValues.push(
+                        *static_cast<const int32_t*>(tr->data.ptr.buffer));
+                gPendingCompletes++;
+            }
+        }
+        pos += _IOC_SIZE(cmd);
+    }
+    bwr->write_consumed = pos;
+
+    uint32_t* out = reinterpret_cast<uint32_t*>(bwr->read_buffer);
+    size_t consumed = bwr->read_consumed;
+    while (gPendingCompletes > 0
+            && consumed + sizeof(uint32_t) <= size_t(bwr->read_size)) {
+        out[consumed / sizeof(uint32_t)] = BR_TRANSACTION_COMPLETE;
+        consumed += sizeof(uint32_t);
+        gPendingCompletes--;
+    }
+    if (gFinishLooper && bwr->read_size > 0
+            && consumed + sizeof(uint32_t) <= size_t(bwr->read_size)) {
+        out[consumed / sizeof(uint32_t)] = BR_FINISHED;
+        consumed += sizeof(uint32_t);
+    }
+    bwr->read_consumed = consumed;
+}
+
+extern "C" int ioctl(int fd, int request, ...)
+{
+    va_list args;
+    va_start(args, request);
+    void* arg = va_arg(args, void*);
+    va_end(args);
+
+    if (request == int(BINDER_WRITE_READ)) {
+        handleWriteRead(static_cast<binder_write_read*>(arg));
+        return 0;
+    }
+    return syscall(__NR_ioctl, fd, request, arg);
+}
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+
+enum {
+    BURST_SIZE = 10,
+    TEST_HANDLE = 1,
+    TEST_CODE = IBinder::FIRST_CALL_TRANSACTION,
+};
+
+class IPCThreadStateTest : public testing::Test {
+protected:
+    IPCThreadState* mState;
+
+    virtual void SetUp() {
+        mState = IPCThreadState::self();
+        gWriteReadCount = 0;
+        gPendingCompletes = 0;
+        gFinishLooper = false;
+        gLooperCommands = 0;
+        gTransactionValues.clear();
+    }
+
+    virtual void TearDown() {
+        gFinishLooper = false;
+    }
+
+    status_t sendOneway(int32_t value) {
+        // The parcel goes away as soon as transact() returns, as it does
+        // in generated proxies.
+        Parcel data;
+        data.writeInt32(value);
+        return mState->transact(TEST_HANDLE, TEST_CODE, data, NULL, IBinder::FLAG_ONEWAY);
+    }
+
+    void expectValuesInOrder(size_t count) {
+        ASSERT_EQ(count, gTransactionValues.size());
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(int32_t(i), gTransactionValues[i]);
+        }
+    }
+};
+
+TEST_F(IPCThreadStateTest, Transact_WhenOnewayIsNotBatched_UsesOneWriteReadPerCall) {
+    for (int32_t i = 0; i < BURST_SIZE; i++) {
+        EXPECT_EQ(NO_ERROR, sendOneway(i));
+    }
+
+    EXPECT_EQ(size_t(BURST_SIZE), gWriteReadCount);
+    expectValuesInOrder(BURST_SIZE);
+}
+
+TEST_F(IPCThreadStateTest, Transact_WhenOnewayIsBatched_SendsBurstInOneWriteRead) {
+    {
+        IPCThreadState::OnewayBatch batch;
+        for (int32_t i = 0; i < BURST_SIZE; i++) {
+            EXPECT_EQ(NO_ERROR, sendOneway(i));
+        }
+        EXPECT_EQ(size_t(0), gWriteReadCount)
+                << "nothing should be sent while the batch is open";
+    }
+
+    EXPECT_EQ(size_t(1), gWriteReadCount);
+    EXPECT_EQ(size_t(0), gPendingCompletes)
+            << "every BR_TRANSACTION_COMPLETE should have been consumed";
+    expectValuesInOrder(BURST_SIZE);
+    printf("%d one-way calls: %d BINDER_WRITE_READ saved\n",
+            BURST_SIZE, int(BURST_SIZE - gWriteReadCount));
+}
+
+TEST_F(IPCThreadStateTest, Transact_WhenBatchesAreNested_SendsWhenOutermostEnds) {
+    mState->beginOnewayBatch();
+    EXPECT_EQ(NO_ERROR, sendOneway(0));
+    mState->beginOnewayBatch();
+    EXPECT_EQ(NO_ERROR, sendOneway(1));
+    EXPECT_EQ(NO_ERROR, mState->endOnewayBatch());
+    EXPECT_EQ(size_t(0), gWriteReadCount);
+    EXPECT_EQ(NO_ERROR, mState->endOnewayBatch());
+
+    EXPECT_EQ(size_t(1), gWriteReadCount);
+    expectValuesInOrder(2);
+}
+
+TEST_F(IPCThreadStateTest, Transact_WhenBatchGrowsLarge_FlushesAutomatically) {
+    const size_t count = 100;
+    {
+        IPCThreadState::OnewayBatch batch;
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(NO_ERROR, sendOneway(int32_t(i)));
+        }
+        EXPECT_LT(size_t(0), gWriteReadCount);
+    }
+
+    EXPECT_GT(count / 2, gWriteReadCount);
+    EXPECT_EQ(size_t(0), gPendingCompletes);
+    expectValuesInOrder(count);
+}
+
+TEST_F(IPCThreadStateTest, FlushCommands_WhenBatchIsOpen_SendsQueuedTransactions) {
+    IPCThreadState::OnewayBatch batch;
+    EXPECT_EQ(NO_ERROR, sendOneway(0));
+    EXPECT_EQ(NO_ERROR, sendOneway(1));
+    mState->flushCommands();
+
+    EXPECT_EQ(size_t(1), gWriteReadCount);
+    expectValuesInOrder(2);
+}
+
+TEST_F(IPCThreadStateTest, JoinThreadPool_WhenBatchIsOpen_SendsQueuedTransactionsFirst) {
+    mState->beginOnewayBatch();
+    EXPECT_EQ(NO_ERROR, sendOneway(0));
+    EXPECT_EQ(NO_ERROR, sendOneway(1));
+
+    // The looper must not see the queued transactions' completes: before
+    // the fix it logged them as bad commands, and ending the batch then
+    // waited for completes that had already been read.
+    gFinishLooper = true;
+    mState->joinThreadPool(false);
+
+    EXPECT_EQ(size_t(1), gLooperCommands);
+    EXPECT_EQ(size_t(0), gPendingCompletes);
+    expectValuesInOrder(2);
+    const size_t writeReads = gWriteReadCount;
+    EXPECT_EQ(NO_ERROR, mState->endOnewayBatch());
+    EXPECT_EQ(writeReads, gWriteReadCount) << "the batch should already be empty";
+}
+
+TEST_F(IPCThreadStateTest, TransactionStats_WhenEnabled_RecordsCallsPerInterfaceAndCode) {
+    IPCThreadState::setTransactionStatsEnabled(true);
+    for (int32_t i = 0; i < 3; i++) {
+        Parcel data;
+        data.writeInterfaceToken(String16("android.test.IStatsTest"));
+        data.writeInt32(i);
+        EXPECT_EQ(NO_ERROR, mState->transact(TEST_HANDLE, TEST_CODE + 1, data, NULL,
+                IBinder::FLAG_ONEWAY));
+    }
+    IPCThreadState::setTransactionStatsEnabled(false);
+    EXPECT_EQ(NO_ERROR, sendOneway(0));
+
+    String8 result;
+    IPCThreadState::dumpTransactionStats(result);
+    char expected[64];
+    snprintf(expected, sizeof(expected), "out android.test.IStatsTest#%d: count=3 ",
+            TEST_CODE + 1);
+    EXPECT_TRUE(strstr(result.string(), expected) != NULL) << result.string();
+}
+
+} // namespace android
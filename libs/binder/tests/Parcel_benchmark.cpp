@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <binder/IPCThreadState.h>
+#include <binder/Parcel.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace android {
+
+// Compares the throughput of the ways a parcel can be built from a payload
+// that is handed over in chunks, the way flattened structures are written.
+class ParcelBenchmark : public testing::Test {
+protected:
+    enum {
+        CHUNK_SIZE = 4 * 1024,
+        MIN_SIZE = 4 * 1024,
+        MAX_SIZE = 1024 * 1024,
+        TOTAL_BYTES = 256 * 1024 * 1024,
+    };
+
+    enum Mode {
+        MODE_COPY,
+        MODE_COPY_RESERVED,
+        MODE_BORROWED,
+        MODE_BORROWED_RESERVED,
+    };
+
+    uint8_t* mPayload;
+
+    virtual void SetUp() {
+        mPayload = (uint8_t*)malloc(MAX_SIZE);
+        for (size_t i = 0; i < MAX_SIZE; i++) {
+            mPayload[i] = uint8_t(i * 7);
+        }
+    }
+
+    virtual void TearDown() {
+        free(mPayload);
+    }
+
+    void build(Parcel& parcel, Mode mode, size_t size) {
+        if (mode == MODE_COPY_RESERVED || mode == MODE_BORROWED_RESERVED) {
+            parcel.setDataCapacity(sizeof(int32_t) * (size / CHUNK_SIZE) + size);
+        }
+        for (size_t offset = 0; offset < size; offset += CHUNK_SIZE) {
+            parcel.writeInt32(CHUNK_SIZE);
+            if (mode == MODE_BORROWED || mode == MODE_BORROWED_RESERVED) {
+                parcel.writeBorrowed(mPayload + offset, CHUNK_SIZE);
+            } else {
+                parcel.write(mPayload + offset, CHUNK_SIZE);
+            }
+        }
+        // This is what IPCThreadState hands to the driver.
+        parcel.ipcData();
+    }
+
+    void run(Mode mode, const char* name) {
+        for (size_t size = MIN_SIZE; size <= MAX_SIZE; size *= 4) {
+            const size_t iterations = TOTAL_BYTES / size;
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            for (size_t i = 0; i < iterations; i++) {
+                Parcel parcel;
+                build(parcel, mode, size);
+            }
+            nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            printf("%-18s %8d bytes: %8.1f MB/s\n", name, int(size),
+                    double(iterations * size) / (1024 * 1024) / (double(elapsed) / 1e9));
+        }
+
+        // Make sure the parcel contents come out the same regardless of how it was built.
+        Parcel parcel;
+        build(parcel, mode, MAX_SIZE);
+        parcel.setDataPosition(0);
+        for (size_t offset = 0; offset < MAX_SIZE; offset += CHUNK_SIZE) {
+            ASSERT_EQ(CHUNK_SIZE, parcel.readInt32());
+            const void* chunk = parcel.readInplace(CHUNK_SIZE);
+            ASSERT_TRUE(chunk != NULL);
+            ASSERT_EQ(0, memcmp(mPayload + offset, chunk, CHUNK_SIZE));
+        }
+    }
+};
+
+TEST_F(ParcelBenchmark, Copy) {
+    run(MODE_COPY, "copy");
+}
+
+TEST_F(ParcelBenchmark, CopyReserved) {
+    run(MODE_COPY_RESERVED, "copy+reserve");
+}
+
+TEST_F(ParcelBenchmark, Borrowed) {
+    run(MODE_BORROWED, "borrowed");
+}
+
+TEST_F(ParcelBenchmark, BorrowedReserved) {
+    run(MODE_BORROWED_RESERVED, "borrowed+reserve");
+}
+
+// Checks the interface token of an incoming transaction, as every
+// CHECK_INTERFACE() does.
+TEST(ParcelInterfaceBenchmark, EnforceInterface) {
+    const int iterations = 1000000;
+    const String16 descriptor("android.gui.IGraphicBufferProducer");
+    Parcel parcel;
+    parcel.writeInt32(0);   // strict mode policy
+    parcel.writeString16(descriptor);
+
+    IPCThreadState* self = IPCThreadState::self();
+    int matched = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        parcel.setDataPosition(0);
+        matched += parcel.enforceInterface(descriptor, self);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    EXPECT_EQ(iterations, matched);
+    printf("enforceInterface: %6.1f ns\n", double(elapsed) / iterations);
+}
+
+} // namespace android
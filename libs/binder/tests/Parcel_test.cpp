@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Parcel_test"
+#include <binder/IPCThreadState.h>
+#include <binder/Parcel.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <string.h>
+
+namespace android {
+
+class ParcelTest : public testing::Test {
+protected:
+    // Runs 'func' on a fresh thread so that it starts with an empty buffer pool.
+    static void runOnNewThread(void* (*func)(void*), void* arg) {
+        pthread_t thread;
+        ASSERT_EQ(0, pthread_create(&thread, NULL, func, arg));
+        ASSERT_EQ(0, pthread_join(thread, NULL));
+    }
+};
+
+struct PoolResult {
+    Parcel::BufferPoolStats before;
+    Parcel::BufferPoolStats after;
+    int32_t lastValue;
+};
+
+static void* writeAndFreeParcels(void* arg) {
+    PoolResult* result = static_cast<PoolResult*>(arg);
+    Parcel::getBufferPoolStats(&result->before);
+    for (int32_t i = 0; i < 100; i++) {
+        Parcel data, reply;
+        data.writeInt32(i);
+        data.writeString16(String16("android.os.IServiceManager"));
+        reply.writeInt32(i);
+        reply.setDataPosition(0);
+        result->lastValue = reply.readInt32();
+    }
+    Parcel::getBufferPoolStats(&result->after);
+    return NULL;
+}
+
+TEST_F(ParcelTest, BufferPool_WhenParcelsAreRecycled_ReusesBuffers) {
+    PoolResult result;
+    runOnNewThread(writeAndFreeParcels, &result);
+
+    EXPECT_EQ(99, result.lastValue);
+    EXPECT_EQ(size_t(2), result.after.misses - result.before.misses)
+            << "only the first data and reply buffers should come from the allocator";
+    EXPECT_EQ(size_t(198), result.after.hits - result.before.hits)
+            << "every later parcel should be served from the pool";
+    EXPECT_LT(size_t(0), result.after.highWaterBytes);
+}
+
+static void* growParcel(void* arg) {
+    PoolResult* result = static_cast<PoolResult*>(arg);
+    Parcel::getBufferPoolStats(&result->before);
+    Parcel parcel;
+    for (int32_t i = 0; i < 64 * 1024; i++) {
+        parcel.writeInt32(i);
+    }
+    parcel.setDataPosition((64 * 1024 - 1) * sizeof(int32_t));
+    result->lastValue = parcel.readInt32();
+    Parcel::getBufferPoolStats(&result->after);
+    return NULL;
+}
+
+TEST_F(ParcelTest, BufferPool_WhenParcelOutgrowsLargestClass_KeepsContents) {
+    PoolResult result;
+    runOnNewThread(growParcel, &result);
+
+    EXPECT_EQ(64 * 1024 - 1, result.lastValue);
+    EXPECT_LT(result.before.oversized, result.after.oversized);
+}
+
+TEST_F(ParcelTest, BufferPool_Dump_ReportsCounters) {
+    {
+        Parcel parcel;
+        parcel.writeInt32(1);
+    }
+    String8 result;
+    Parcel::dumpBufferPool(result);
+    EXPECT_TRUE(strstr(result.string(), "Parcel buffer pool: hits=") != NULL)
+            << result.string();
+    EXPECT_TRUE(strstr(result.string(), "high-water=") != NULL)
+            << result.string();
+}
+
+// The interface token, as writeInterfaceToken() writes it.
+static void writeToken(Parcel& parcel, const String16& descriptor) {
+    parcel.writeInt32(0);   // strict mode policy
+    parcel.writeString16(descriptor);
+}
+
+TEST_F(ParcelTest, EnforceInterface_WhenDescriptorMatches_ReturnsTrue) {
+    Parcel parcel;
+    writeToken(parcel, String16("android.os.IServiceManager"));
+    parcel.writeInt32(42);
+    parcel.setDataPosition(0);
+
+    EXPECT_TRUE(parcel.enforceInterface(String16("android.os.IServiceManager"),
+            IPCThreadState::self()));
+    EXPECT_EQ(42, parcel.readInt32());
+}
+
+TEST_F(ParcelTest, EnforceInterface_WhenDescriptorDiffers_ReturnsFalse) {
+    const char* const tokens[] = {
+        "android.os.IServiceManagel", "android.os.IServiceManage", "",
+    };
+    for (size_t i = 0; i < sizeof(tokens) / sizeof(tokens[0]); i++) {
+        Parcel parcel;
+        writeToken(parcel, String16(tokens[i]));
+        parcel.setDataPosition(0);
+        EXPECT_FALSE(parcel.enforceInterface(String16("android.os.IServiceManager"),
+                IPCThreadState::self())) << tokens[i];
+    }
+}
+
+TEST_F(ParcelTest, EnforceInterface_WhenTokenIsMissing_ReturnsFalse) {
+    Parcel parcel;
+    parcel.writeInt32(0);
+    parcel.setDataPosition(0);
+    EXPECT_FALSE(parcel.enforceInterface(String16("android.os.IServiceManager"),
+            IPCThreadState::self()));
+}
+
+} // namespace android
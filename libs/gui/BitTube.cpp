@@ -16,11 +16,20 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 
+#include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <cutils/ashmem.h>
+#include <cutils/atomic.h>
+
 #include <utils/Errors.h>
 
 #include <binder/Parcel.h>
@@ -30,45 +39,92 @@
 namespace android {
 // ----------------------------------------------------------------------------
 
-// Socket buffer size.  The default is typically about 128KB, which is much larger than
-// we really need.  So we make it smaller.
-static const size_t SOCKET_BUFFER_SIZE = 4 * 1024;
+// Objects sent or received per sendmmsg()/recvmmsg() call.
+static const size_t MAX_BATCH = 32;
+
+static inline size_t min(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+#if defined(__NR_sendmmsg) && defined(__NR_recvmmsg)
+#define HAVE_MMSG 1
+// Not every libc declares struct mmsghdr; this is the kernel's layout.
+struct bittube_mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+// Cleared the first time the kernel says it doesn't have the calls.
+static volatile int32_t gHaveMmsg = 1;
+#endif
 
+// Header of the SHARED_RING memory. head and tail count the bytes written
+// and read, wrapping at 2^32, so the capacity is a power of two. They are on
+// separate cache lines since the producer only writes head and the consumer
+// only writes tail.
+struct BitTube::SharedRing {
+    volatile int32_t head;
+    uint32_t capacity;
+    uint8_t reserved0[56];
+    volatile int32_t tail;
+    uint8_t reserved1[60];
+
+    uint8_t* data() { return reinterpret_cast<uint8_t*>(this + 1); }
+};
 
 BitTube::BitTube()
-    : mSendFd(-1), mReceiveFd(-1)
+    : mSendFd(-1), mReceiveFd(-1), mBufferSize(0),
+      mRingFd(-1), mRing(NULL), mRingMapSize(0),
+      mRingCapacity(0), mRingHead(0), mRingTail(0)
 {
-    int sockets[2];
-    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) == 0) {
-        int size = SOCKET_BUFFER_SIZE;
-        setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
-        setsockopt(sockets[0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
-        setsockopt(sockets[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
-        setsockopt(sockets[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
-        fcntl(sockets[0], F_SETFL, O_NONBLOCK);
-        fcntl(sockets[1], F_SETFL, O_NONBLOCK);
-        mReceiveFd = sockets[0];
-        mSendFd = sockets[1];
-    } else {
-        mReceiveFd = -errno;
-        ALOGE("BitTube: pipe creation failed (%s)", strerror(-mReceiveFd));
-    }
+    init(DEFAULT_BUFFER_SIZE, SOCKET);
+}
+
+BitTube::BitTube(size_t size, Transport transport)
+    : mSendFd(-1), mReceiveFd(-1), mBufferSize(0),
+      mRingFd(-1), mRing(NULL), mRingMapSize(0),
+      mRingCapacity(0), mRingHead(0), mRingTail(0)
+{
+    init(size, transport);
 }
 
 BitTube::BitTube(const Parcel& data)
-    : mSendFd(-1), mReceiveFd(-1)
+    : mSendFd(-1), mReceiveFd(-1), mBufferSize(0),
+      mRingFd(-1), mRing(NULL), mRingMapSize(0),
+      mRingCapacity(0), mRingHead(0), mRingTail(0)
 {
     mReceiveFd = dup(data.readFileDescriptor());
-    if (mReceiveFd >= 0) {
-        int size = SOCKET_BUFFER_SIZE;
-        setsockopt(mReceiveFd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
-        setsockopt(mReceiveFd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
-        fcntl(mReceiveFd, F_SETFL, O_NONBLOCK);
-    } else {
+    if (mReceiveFd < 0) {
         mReceiveFd = -errno;
         ALOGE("BitTube(Parcel): can't dup filedescriptor (%s)",
                 strerror(-mReceiveFd));
+        return;
     }
+
+    // older writers stop after the file descriptor, which reads as a
+    // default sized socket.
+    const int32_t transport = data.readInt32();
+    const int32_t size = data.readInt32();
+    mBufferSize = size > 0 ? size : DEFAULT_BUFFER_SIZE;
+
+    if (transport == SHARED_RING) {
+        // the eventfd is already non-blocking
+        const int fd = dup(data.readFileDescriptor());
+        const status_t err = fd >= 0 ? mapRing(fd, 0) : status_t(-errno);
+        if (err != NO_ERROR) {
+            ALOGE("BitTube(Parcel): can't map the ring (%s)", strerror(-err));
+            if (fd >= 0 && mRingFd < 0) {
+                close(fd);
+            }
+            close(mReceiveFd);
+            mReceiveFd = err;
+        }
+        return;
+    }
+
+    int bufsize = mBufferSize;
+    setsockopt(mReceiveFd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    setsockopt(mReceiveFd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    fcntl(mReceiveFd, F_SETFL, O_NONBLOCK);
 }
 
 BitTube::~BitTube()
@@ -78,6 +134,94 @@ BitTube::~BitTube()
 
     if (mReceiveFd >= 0)
         close(mReceiveFd);
+
+    if (mRing)
+        munmap(mRing, mRingMapSize);
+
+    if (mRingFd >= 0)
+        close(mRingFd);
+}
+
+void BitTube::init(size_t size, Transport transport)
+{
+    if (size > MAX_BUFFER_SIZE) {
+        // the ring capacity is rounded up to a power of two, and the
+        // socket buffer size must fit in an int
+        mReceiveFd = BAD_VALUE;
+        ALOGE("BitTube: buffer size %lu is too large", (unsigned long) size);
+        return;
+    }
+    mBufferSize = size;
+
+    if (transport == SHARED_RING) {
+        uint32_t capacity = 64;
+        while (capacity < size) {
+            capacity <<= 1;
+        }
+        const int fd = ashmem_create_region("BitTube",
+                sizeof(SharedRing) + capacity);
+        status_t err = fd >= 0 ? mapRing(fd, capacity) : status_t(-errno);
+        if (err == NO_ERROR) {
+            mSendFd = eventfd(0, EFD_NONBLOCK);
+            mReceiveFd = mSendFd >= 0 ? dup(mSendFd) : -1;
+            if (mReceiveFd < 0) {
+                err = -errno;
+            }
+        } else if (fd >= 0 && mRingFd < 0) {
+            close(fd);
+        }
+        if (err != NO_ERROR) {
+            mReceiveFd = err;
+            ALOGE("BitTube: ring creation failed (%s)", strerror(-err));
+        }
+        return;
+    }
+
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) == 0) {
+        int bufsize = size;
+        setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+        setsockopt(sockets[0], SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+        setsockopt(sockets[1], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+        setsockopt(sockets[1], SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+        fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+        fcntl(sockets[1], F_SETFL, O_NONBLOCK);
+        mReceiveFd = sockets[0];
+        mSendFd = sockets[1];
+    } else {
+        mReceiveFd = -errno;
+        ALOGE("BitTube: pipe creation failed (%s)", strerror(-mReceiveFd));
+    }
+}
+
+// Maps the ring in 'fd'. The creator passes the capacity; the other side
+// reads it from the header and checks that it fits in the mapping.
+status_t BitTube::mapRing(int fd, uint32_t capacity)
+{
+    const int size = ashmem_get_size_region(fd);
+    if (size < int(sizeof(SharedRing))) {
+        return BAD_VALUE;
+    }
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        return -errno;
+    }
+    SharedRing* ring = static_cast<SharedRing*>(base);
+    if (capacity) {
+        ring->capacity = capacity;
+    } else {
+        capacity = ring->capacity;
+    }
+    if (!capacity || (capacity & (capacity - 1)) ||
+            capacity > size - sizeof(SharedRing)) {
+        munmap(base, size);
+        return BAD_VALUE;
+    }
+    mRingFd = fd;
+    mRing = ring;
+    mRingMapSize = size;
+    mRingCapacity = capacity;
+    return NO_ERROR;
 }
 
 status_t BitTube::initCheck() const
@@ -95,6 +239,11 @@ int BitTube::getFd() const
 
 ssize_t BitTube::write(void const* vaddr, size_t size)
 {
+    if (mRing) {
+        ssize_t n = writeRing(vaddr, 1, size);
+        return n > 0 ? ssize_t(size) : n;
+    }
+
     ssize_t err, len;
     do {
         len = ::send(mSendFd, vaddr, size, MSG_DONTWAIT | MSG_NOSIGNAL);
@@ -106,6 +255,11 @@ ssize_t BitTube::write(void const* vaddr, size_t size)
 
 ssize_t BitTube::read(void* vaddr, size_t size)
 {
+    if (mRing) {
+        ssize_t n = readRing(vaddr, 1, size);
+        return n > 0 ? ssize_t(size) : n;
+    }
+
     ssize_t err, len;
     do {
         len = ::recv(mReceiveFd, vaddr, size, MSG_DONTWAIT);
@@ -127,18 +281,206 @@ status_t BitTube::writeToParcel(Parcel* reply) const
     status_t result = reply->writeDupFileDescriptor(mReceiveFd);
     close(mReceiveFd);
     mReceiveFd = -1;
+    if (result == NO_ERROR) {
+        result = reply->writeInt32(mRing ? SHARED_RING : SOCKET);
+    }
+    if (result == NO_ERROR) {
+        result = reply->writeInt32(mBufferSize);
+    }
+    if (result == NO_ERROR && mRing) {
+        result = reply->writeDupFileDescriptor(mRingFd);
+    }
     return result;
 }
 
+static void ringDoorbell(int fd)
+{
+    const uint64_t one = 1;
+    ssize_t len;
+    do {
+        len = ::write(fd, &one, sizeof(one));
+    } while (len < 0 && errno == EINTR);
+    // EAGAIN means the counter is saturated, so the fd is readable anyway
+}
+
+ssize_t BitTube::writeRing(void const* vaddr, size_t count, size_t objSize)
+{
+    const uint32_t head = mRingHead;
+    const uint32_t used = head - uint32_t(android_atomic_acquire_load(&mRing->tail));
+    if (used > mRingCapacity) {
+        // the other side broke the ring
+        return -EPIPE;
+    }
+    const size_t n = min(count, (mRingCapacity - used) / objSize);
+    if (!n) {
+        return -EAGAIN;
+    }
+
+    const size_t size = n * objSize;
+    const size_t offset = head & (mRingCapacity - 1);
+    const size_t first = min(size, mRingCapacity - offset);
+    memcpy(mRing->data() + offset, vaddr, first);
+    memcpy(mRing->data(), static_cast<const uint8_t*>(vaddr) + first, size - first);
+    mRingHead = head + size;
+    android_atomic_release_store(mRingHead, &mRing->head);
+
+    // Ring the doorbell if the reader had read everything, since it may be
+    // waiting for it. The reader stores tail and then checks head, and we
+    // store head and then check tail, so with the barriers in between at
+    // least one of us sees the other's update and nothing is left unsignaled.
+    __sync_synchronize();
+    if (uint32_t(android_atomic_acquire_load(&mRing->tail)) == head) {
+        ringDoorbell(mSendFd);
+    }
+    return n;
+}
+
+ssize_t BitTube::readRing(void* vaddr, size_t count, size_t objSize)
+{
+    // clear the doorbell before looking, so that anything written from
+    // here on rings it again
+    uint64_t value;
+    ssize_t len;
+    do {
+        len = ::read(mReceiveFd, &value, sizeof(value));
+    } while (len < 0 && errno == EINTR);
+
+    const uint32_t tail = mRingTail;
+    const uint32_t avail = uint32_t(android_atomic_acquire_load(&mRing->head)) - tail;
+    if (avail > mRingCapacity) {
+        return -EPIPE;
+    }
+    const size_t n = min(count, avail / objSize);
+    if (n) {
+        const size_t size = n * objSize;
+        const size_t offset = tail & (mRingCapacity - 1);
+        const size_t first = min(size, mRingCapacity - offset);
+        memcpy(vaddr, mRing->data() + offset, first);
+        memcpy(static_cast<uint8_t*>(vaddr) + first, mRing->data(), size - first);
+        mRingTail = tail + size;
+        android_atomic_release_store(mRingTail, &mRing->tail);
+    }
+
+    // keep the fd readable while objects are left, like the socket
+    __sync_synchronize();
+    if (uint32_t(android_atomic_acquire_load(&mRing->head)) != mRingTail) {
+        ringDoorbell(mReceiveFd);
+    }
+    return n;
+}
+
+ssize_t BitTube::sendBatch(void const* events, size_t count, size_t objSize)
+{
+#ifdef HAVE_MMSG
+    if (!gHaveMmsg) {
+        return -ENOSYS;
+    }
+
+    struct bittube_mmsghdr msgs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    size_t numObjects = 0;
+    while (numObjects < count) {
+        const size_t n = min(count - numObjects, MAX_BATCH);
+        const char* vaddr = reinterpret_cast<const char*>(events) + objSize * numObjects;
+        memset(msgs, 0, n * sizeof(msgs[0]));
+        for (size_t i=0 ; i<n ; i++) {
+            iovs[i].iov_base = const_cast<char*>(vaddr + objSize * i);
+            iovs[i].iov_len = objSize;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent;
+        do {
+            sent = syscall(__NR_sendmmsg, mSendFd, msgs, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (sent < 0 && errno == EINTR);
+        if (sent < 0) {
+            const int err = errno;
+            if (err == ENOSYS) {
+                android_atomic_release_store(0, &gHaveMmsg);
+            }
+            // report what was sent, or the error if nothing was
+            return numObjects ? ssize_t(numObjects) : -err;
+        }
+        numObjects += sent;
+        if (size_t(sent) < n) {
+            // no more space
+            break;
+        }
+    }
+    return numObjects;
+#else
+    return -ENOSYS;
+#endif
+}
+
+ssize_t BitTube::recvBatch(void* events, size_t count, size_t objSize)
+{
+#ifdef HAVE_MMSG
+    if (!gHaveMmsg) {
+        return -ENOSYS;
+    }
+
+    struct bittube_mmsghdr msgs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    size_t numObjects = 0;
+    while (numObjects < count) {
+        const size_t n = min(count - numObjects, MAX_BATCH);
+        char* vaddr = reinterpret_cast<char*>(events) + objSize * numObjects;
+        memset(msgs, 0, n * sizeof(msgs[0]));
+        for (size_t i=0 ; i<n ; i++) {
+            iovs[i].iov_base = vaddr + objSize * i;
+            iovs[i].iov_len = objSize;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int received;
+        do {
+            received = syscall(__NR_recvmmsg, mReceiveFd, msgs, n, MSG_DONTWAIT, NULL);
+        } while (received < 0 && errno == EINTR);
+        if (received < 0) {
+            const int err = errno;
+            if (err == ENOSYS) {
+                android_atomic_release_store(0, &gHaveMmsg);
+            }
+            if (err == EAGAIN || err == EWOULDBLOCK) {
+                // no more messages
+                return numObjects;
+            }
+            return numObjects ? ssize_t(numObjects) : -err;
+        }
+        numObjects += received;
+        if (size_t(received) < n) {
+            break;
+        }
+    }
+    return numObjects;
+#else
+    return -ENOSYS;
+#endif
+}
 
 ssize_t BitTube::sendObjects(const sp<BitTube>& tube,
         void const* events, size_t count, size_t objSize)
 {
+    if (tube->mRing) {
+        return tube->writeRing(events, count, objSize);
+    }
+
+    if (count > 1) {
+        ssize_t numObjects = tube->sendBatch(events, count, objSize);
+        if (numObjects != -ENOSYS) {
+            return numObjects;
+        }
+    }
+
     ssize_t numObjects = 0;
     for (size_t i=0 ; i<count ; i++) {
         const char* vaddr = reinterpret_cast<const char*>(events) + objSize * i;
         ssize_t size = tube->write(vaddr, objSize);
-        if (size < 0) {
+        if (size == -EAGAIN && numObjects) {
+            // no more space
+            break;
+        } else if (size < 0) {
             // error occurred
             return size;
         } else if (size == 0) {
@@ -153,6 +495,17 @@ ssize_t BitTube::sendObjects(const sp<BitTube>& tube,
 ssize_t BitTube::recvObjects(const sp<BitTube>& tube,
         void* events, size_t count, size_t objSize)
 {
+    if (tube->mRing) {
+        return tube->readRing(events, count, objSize);
+    }
+
+    if (count > 1) {
+        ssize_t numObjects = tube->recvBatch(events, count, objSize);
+        if (numObjects != -ENOSYS) {
+            return numObjects;
+        }
+    }
+
     ssize_t numObjects = 0;
     for (size_t i=0 ; i<count ; i++) {
         char* vaddr = reinterpret_cast<char*>(events) + objSize * i;
@@ -174,6 +174,8 @@ BufferQueue::BufferQueue(  bool allowSynchronousMode, int bufferCount ) :
     mSynchronousMode(false),
     mAllowSynchronousMode(allowSynchronousMode),
     mConnectedApi(NO_CONNECTED_API),
+    mDequeueWaiters(0),
+    mDrainWaiters(0),
     mAbandoned(false),
     mFrameCounter(0),
     mBufferHasBeenQueued(false),
@@ -212,7 +214,7 @@ status_t BufferQueue::setBufferCountServerLocked(int bufferCount) {
         // easy, we just have more buffers
         mBufferCount = bufferCount;
         mServerBufferCount = bufferCount;
-        mDequeueCondition.broadcast();
+        stateChangedLocked();
     } else {
         // we're here because we're either
         // - reducing the number of available buffers
@@ -229,11 +231,32 @@ status_t BufferQueue::setBufferCountServerLocked(int bufferCount) {
         // dequeueBuffer.
 
         mServerBufferCount = bufferCount;
-        mDequeueCondition.broadcast();
+        stateChangedLocked();
     }
     return OK;
 }
 
+void BufferQueue::slotFreedLocked() {
+    if (mDequeueWaiters) {
+        mDequeueCondition.broadcast();
+    }
+}
+
+void BufferQueue::queueDrainedLocked() {
+    if (mDrainWaiters && mQueue.isEmpty()) {
+        mDrainCondition.broadcast();
+    }
+}
+
+void BufferQueue::stateChangedLocked() {
+    if (mDequeueWaiters) {
+        mDequeueCondition.broadcast();
+    }
+    if (mDrainWaiters) {
+        mDrainCondition.broadcast();
+    }
+}
+
 bool BufferQueue::isSynchronousMode() const {
     Mutex::Autolock lock(mMutex);
     return mSynchronousMode;
@@ -308,7 +331,7 @@ status_t BufferQueue::setBufferCount(int bufferCount) {
         mClientBufferCount = bufferCount;
         mBufferHasBeenQueued = false;
         mQueue.clear();
-        mDequeueCondition.broadcast();
+        stateChangedLocked();
         listener = mConsumerListener;
     } // scope for lock
 
@@ -427,7 +450,7 @@ status_t BufferQueue::dequeueBuffer(int *outBuf, uint32_t w, uint32_t h,
             //   changed since)
             //
             // As long as this condition is true AND the FIFO is not empty, we
-            // wait on mDequeueCondition.
+            // wait on mDrainCondition.
 
             const int minBufferCountNeeded = mSynchronousMode ?
                     mMinSyncBufferSlots : mMinAsyncBufferSlots;
@@ -438,7 +461,9 @@ status_t BufferQueue::dequeueBuffer(int *outBuf, uint32_t w, uint32_t h,
 
             if (!mQueue.isEmpty() && numberOfBuffersNeedsToChange) {
                 // wait for the FIFO to drain
-                mDequeueCondition.wait(mMutex);
+                mDrainWaiters++;
+                mDrainCondition.wait(mMutex);
+                mDrainWaiters--;
                 // NOTE: we continue here because we need to reevaluate our
                 // whole state (eg: we could be abandoned or disconnected)
                 continue;
@@ -514,7 +539,9 @@ status_t BufferQueue::dequeueBuffer(int *outBuf, uint32_t w, uint32_t h,
             // if no buffer is found, wait for a buffer to be released
             tryAgain = found == INVALID_BUFFER_SLOT;
             if (tryAgain) {
+                mDequeueWaiters++;
                 mDequeueCondition.wait(mMutex);
+                mDequeueWaiters--;
             }
         }
 
@@ -658,7 +685,7 @@ status_t BufferQueue::setSynchronousMode(bool enabled) {
         // - if the client set the number of buffers, we're guaranteed that
         // we have at least 3 (because we don't allow less)
         mSynchronousMode = enabled;
-        mDequeueCondition.broadcast();
+        stateChangedLocked();
     }
     return err;
 }
@@ -729,7 +756,7 @@ status_t BufferQueue::queueBuffer(int buf,
             listener = mConsumerListener;
         } else {
             // In asynchronous mode we only keep the most recent buffer.
-            if (mQueue.empty()) {
+            if (mQueue.isEmpty()) {
                 mQueue.push_back(buf);
 
                 // Asynchronous mode only signals that a frame should be
@@ -737,11 +764,12 @@ status_t BufferQueue::queueBuffer(int buf,
                 // pending then the consumer would have already been notified.
                 listener = mConsumerListener;
             } else {
-                Fifo::iterator front(mQueue.begin());
+                int& front(mQueue.editFront());
                 // buffer currently queued is freed
-                mSlots[*front].mBufferState = BufferSlot::FREE;
+                mSlots[front].mBufferState = BufferSlot::FREE;
                 // and we record the new buffer index in the queued list
-                *front = buf;
+                front = buf;
+                slotFreedLocked();
             }
         }
 
@@ -766,7 +794,6 @@ status_t BufferQueue::queueBuffer(int buf,
         mSlots[buf].mFrameNumber = mFrameCounter;
 
         mBufferHasBeenQueued = true;
-        mDequeueCondition.broadcast();
 
         output->inflate(mDefaultWidth, mDefaultHeight, mTransformHint,
                 mQueue.size());
@@ -802,7 +829,7 @@ void BufferQueue::cancelBuffer(int buf) {
     }
     mSlots[buf].mBufferState = BufferSlot::FREE;
     mSlots[buf].mFrameNumber = 0;
-    mDequeueCondition.broadcast();
+    slotFreedLocked();
 }
 
 status_t BufferQueue::connect(int api, QueueBufferOutput* output) {
@@ -873,7 +900,7 @@ status_t BufferQueue::disconnect(int api) {
 #ifdef QCOM_HARDWARE
                     mNextBufferInfo.set(0, 0, 0);
 #endif
-                    mDequeueCondition.broadcast();
+                    stateChangedLocked();
                     listener = mConsumerListener;
                 } else {
                     ST_LOGE("disconnect: connected to another api (cur=%d, req=%d)",
@@ -907,11 +934,9 @@ void BufferQueue::dump(String8& result, const char* prefix,
     Mutex::Autolock _l(mMutex);
 
     String8 fifo;
-    int fifoSize = 0;
-    Fifo::const_iterator i(mQueue.begin());
-    while (i != mQueue.end()) {
-       snprintf(buffer, SIZE, "%02d ", *i++);
-       fifoSize++;
+    int fifoSize = mQueue.size();
+    for (int i=0 ; i<fifoSize ; i++) {
+       snprintf(buffer, SIZE, "%02d ", mQueue[i]);
        fifo.append(buffer);
     }
 
@@ -993,9 +1018,8 @@ status_t BufferQueue::acquireBuffer(BufferItem *buffer) {
     // check if queue is empty
     // In asynchronous mode the list is guaranteed to be one buffer
     // deep, while in synchronous mode we use the oldest buffer.
-    if (!mQueue.empty()) {
-        Fifo::iterator front(mQueue.begin());
-        int buf = *front;
+    if (!mQueue.isEmpty()) {
+        int buf = mQueue.front();
 
         ATRACE_BUFFER_INDEX(buf);
 
@@ -1013,8 +1037,8 @@ status_t BufferQueue::acquireBuffer(BufferItem *buffer) {
         mSlots[buf].mAcquireCalled = true;
 
         mSlots[buf].mBufferState = BufferSlot::ACQUIRED;
-        mQueue.erase(front);
-        mDequeueCondition.broadcast();
+        mQueue.pop_front();
+        queueDrainedLocked();
 
         ATRACE_INT(mConsumerName.string(), mQueue.size());
     } else {
@@ -1050,7 +1074,7 @@ status_t BufferQueue::releaseBuffer(int buf, EGLDisplay display,
         return -EINVAL;
     }
 
-    mDequeueCondition.broadcast();
+    slotFreedLocked();
     return OK;
 }
 
@@ -1081,7 +1105,7 @@ status_t BufferQueue::consumerDisconnect() {
     mConsumerListener = NULL;
     mQueue.clear();
     freeAllBuffersLocked();
-    mDequeueCondition.broadcast();
+    stateChangedLocked();
     return OK;
 }
 
@@ -1129,9 +1153,8 @@ status_t BufferQueue::setBufferCountServer(int bufferCount) {
 
 void BufferQueue::freeAllBuffersExceptHeadLocked() {
     int head = -1;
-    if (!mQueue.empty()) {
-        Fifo::iterator front(mQueue.begin());
-        head = *front;
+    if (!mQueue.isEmpty()) {
+        head = mQueue.front();
     }
     mBufferHasBeenQueued = false;
     for (int i = 0; i < NUM_BUFFER_SLOTS; i++) {
@@ -1143,7 +1166,9 @@ void BufferQueue::freeAllBuffersExceptHeadLocked() {
 
 status_t BufferQueue::drainQueueLocked() {
     while (mSynchronousMode && !mQueue.isEmpty()) {
-        mDequeueCondition.wait(mMutex);
+        mDrainWaiters++;
+        mDrainCondition.wait(mMutex);
+        mDrainWaiters--;
         if (mAbandoned) {
             ST_LOGE("drainQueueLocked: BufferQueue has been abandoned!");
             return NO_INIT;
@@ -31,6 +31,58 @@ LOCAL_C_INCLUDES := \
 # to integrate with auto-test framework.
 include $(BUILD_NATIVE_TEST)
 
+# Frame handoff latency through a BufferQueue at 60/120/240 Hz.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := BufferQueue_benchmark
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+    BufferQueue_benchmark.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libEGL \
+	libbinder \
+	libcutils \
+	libgui \
+	libstlport \
+	libui \
+	libutils \
+
+LOCAL_C_INCLUDES := \
+    bionic \
+    bionic/libstdc++/include \
+    external/gtest/include \
+    external/stlport/stlport \
+
+include $(BUILD_NATIVE_TEST)
+
+# Event throughput through a BitTube for each transport.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := BitTube_benchmark
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+    BitTube_benchmark.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libbinder \
+	libcutils \
+	libgui \
+	libstlport \
+	libutils \
+
+LOCAL_C_INCLUDES := \
+    bionic \
+    bionic/libstdc++/include \
+    external/gtest/include \
+    external/stlport/stlport \
+
+include $(BUILD_NATIVE_TEST)
+
 # Include subdirectory makefiles
 # ============================================================
 
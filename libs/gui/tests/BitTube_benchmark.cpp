@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BitTube_benchmark"
+//#define LOG_NDEBUG 0
+
+#include <gtest/gtest.h>
+#include <binder/Parcel.h>
+#include <gui/BitTube.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+
+namespace android {
+
+// Streams small events from a producer thread to the test thread through a
+// BitTube, the way EventThread and the sensor service use it, and reports
+// events per second for each transport.
+class BitTubeBenchmark : public ::testing::Test {
+protected:
+    enum {
+        EVENTS_PER_RUN = 200000,
+        // events the consumer asks for per recvObjects()
+        RECV_BATCH = 64,
+    };
+
+    // the size of a DisplayEventReceiver::Event
+    struct Event {
+        uint32_t seq;
+        uint32_t type;
+        nsecs_t timestamp;
+        uint32_t data[2];
+    };
+
+    class ProducerThread : public Thread {
+    public:
+        ProducerThread(const sp<BitTube>& tube, size_t batch)
+            : Thread(false), mTube(tube), mBatch(batch), mSeq(0), mFull(0) { }
+
+        uint32_t mFull;
+
+    private:
+        virtual bool threadLoop() {
+            Event events[RECV_BATCH];
+            const size_t n = mBatch < EVENTS_PER_RUN - mSeq ?
+                    mBatch : EVENTS_PER_RUN - mSeq;
+            for (size_t i=0 ; i<n ; i++) {
+                events[i].seq = mSeq + i;
+                events[i].type = 0;
+                events[i].timestamp = 0;
+            }
+            size_t sent = 0;
+            while (sent < n) {
+                ssize_t count = BitTube::sendObjects(mTube, events + sent, n - sent);
+                if (count == -EAGAIN) {
+                    // the consumer is behind
+                    mFull++;
+                    sched_yield();
+                    continue;
+                }
+                if (count < 0) {
+                    return false;
+                }
+                sent += count;
+            }
+            mSeq += n;
+            return mSeq < EVENTS_PER_RUN;
+        }
+
+        sp<BitTube> mTube;
+        size_t mBatch;
+        uint32_t mSeq;
+    };
+
+    // Returns false if an event was lost or out of order.
+    static bool drain(const sp<BitTube>& tube, uint32_t* seq) {
+        Event events[RECV_BATCH];
+        ssize_t n;
+        while ((n = BitTube::recvObjects(tube, events, RECV_BATCH)) > 0) {
+            for (ssize_t i=0 ; i<n ; i++) {
+                if (events[i].seq != (*seq)++) {
+                    return false;
+                }
+            }
+        }
+        return n == 0;
+    }
+
+    void run(const char* what, const sp<BitTube>& tube, size_t batch) {
+        ASSERT_EQ(NO_ERROR, tube->initCheck());
+
+        sp<ProducerThread> producer = new ProducerThread(tube, batch);
+        const nsecs_t start = systemTime();
+        ASSERT_EQ(NO_ERROR, producer->run("BitTubeProducer"));
+
+        uint32_t seq = 0;
+        while (seq < EVENTS_PER_RUN) {
+            struct pollfd fd;
+            fd.fd = tube->getFd();
+            fd.events = POLLIN;
+            fd.revents = 0;
+            ASSERT_LE(0, poll(&fd, 1, 1000));
+            ASSERT_TRUE(fd.revents & POLLIN) << what << ": stalled at " << seq;
+            ASSERT_TRUE(drain(tube, &seq)) << what << ": lost event " << seq;
+        }
+        const nsecs_t duration = systemTime() - start;
+        producer->join();
+
+        printf("%-24s batch=%2d: %9.0f events/s (producer waited %u times)\n",
+                what, int(batch), EVENTS_PER_RUN * 1e9 / duration,
+                producer->mFull);
+    }
+};
+
+TEST_F(BitTubeBenchmark, Socket4K) {
+    run("socket 4KB", new BitTube(), 1);
+    run("socket 4KB", new BitTube(), 8);
+}
+
+TEST_F(BitTubeBenchmark, Socket64K) {
+    run("socket 64KB", new BitTube(64 * 1024), 1);
+    run("socket 64KB", new BitTube(64 * 1024), 8);
+}
+
+TEST_F(BitTubeBenchmark, SharedRing) {
+    run("shared ring 4KB", new BitTube(4 * 1024, BitTube::SHARED_RING), 1);
+    run("shared ring 4KB", new BitTube(4 * 1024, BitTube::SHARED_RING), 8);
+}
+
+TEST_F(BitTubeBenchmark, SharedRingThroughParcel) {
+    sp<BitTube> tube = new BitTube(4 * 1024, BitTube::SHARED_RING);
+    Parcel parcel;
+    ASSERT_EQ(NO_ERROR, tube->writeToParcel(&parcel));
+    parcel.setDataPosition(0);
+    sp<BitTube> receiver = new BitTube(parcel);
+    ASSERT_EQ(NO_ERROR, receiver->initCheck());
+
+    Event in[3] = { { 1 }, { 2 }, { 3 } };
+    Event out[4];
+    EXPECT_EQ(3, BitTube::sendObjects(tube, in, 3));
+    EXPECT_EQ(3, BitTube::recvObjects(receiver, out, 4));
+    EXPECT_EQ(3u, out[2].seq);
+    EXPECT_EQ(0, BitTube::recvObjects(receiver, out, 4));
+}
+
+} // namespace android
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferQueue_benchmark"
+//#define LOG_NDEBUG 0
+
+#include <gtest/gtest.h>
+#include <gui/BufferQueue.h>
+#include <gui/SurfaceTextureClient.h>
+#include <system/window.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+namespace android {
+
+// Streams frames from a producer (a SurfaceTextureClient on the test thread)
+// to a consumer thread through a BufferQueue at display-like rates, and
+// reports how long a frame takes from queueBuffer() to being acquired, and
+// how long the producer is blocked in dequeueBuffer().
+class BufferQueueBenchmark : public ::testing::Test {
+protected:
+    enum {
+        WIDTH = 64,
+        HEIGHT = 64,
+        FRAMES_PER_RUN = 240,
+    };
+
+    struct FrameListener : public BufferQueue::ConsumerListener {
+        Mutex mMutex;
+        Condition mCondition;
+        int mPending;
+        bool mDone;
+
+        FrameListener() : mPending(0), mDone(false) { }
+
+        virtual void onFrameAvailable() {
+            Mutex::Autolock lock(mMutex);
+            mPending++;
+            mCondition.signal();
+        }
+
+        virtual void onBuffersReleased() { }
+
+        // Returns false once the producer is done and every frame was seen.
+        bool waitForFrame() {
+            Mutex::Autolock lock(mMutex);
+            while (!mPending && !mDone) {
+                mCondition.wait(mMutex);
+            }
+            if (!mPending) {
+                return false;
+            }
+            mPending--;
+            return true;
+        }
+
+        void finish() {
+            Mutex::Autolock lock(mMutex);
+            mDone = true;
+            mCondition.signal();
+        }
+    };
+
+    class ConsumerThread : public Thread {
+    public:
+        ConsumerThread(const sp<BufferQueue>& bq, const sp<FrameListener>& listener)
+            : Thread(false), mBQ(bq), mListener(listener) { }
+
+        Vector<nsecs_t> mLatencies;
+
+    private:
+        virtual bool threadLoop() {
+            if (!mListener->waitForFrame()) {
+                return false;
+            }
+            BufferQueue::BufferItem item;
+            // In asynchronous mode several notifications can collapse into
+            // a single queued buffer.
+            if (mBQ->acquireBuffer(&item) == NO_ERROR) {
+                mLatencies.push(systemTime() - item.mTimestamp);
+                mBQ->releaseBuffer(item.mBuf, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR);
+            }
+            return true;
+        }
+
+        sp<BufferQueue> mBQ;
+        sp<FrameListener> mListener;
+    };
+
+    sp<BufferQueue> mBQ;
+    sp<FrameListener> mListener;
+    sp<SurfaceTextureClient> mSTC;
+    sp<ANativeWindow> mANW;
+
+    virtual void SetUp() {
+        mBQ = new BufferQueue(true);
+        mListener = new FrameListener();
+        ASSERT_EQ(NO_ERROR, mBQ->consumerConnect(mListener));
+        mBQ->setDefaultBufferSize(WIDTH, HEIGHT);
+        mBQ->setConsumerName(String8("BufferQueue_benchmark"));
+
+        mSTC = new SurfaceTextureClient(static_cast<sp<ISurfaceTexture> >(mBQ));
+        mANW = mSTC;
+        ASSERT_EQ(NO_ERROR, native_window_api_connect(mANW.get(),
+                NATIVE_WINDOW_API_CPU));
+        ASSERT_EQ(NO_ERROR, native_window_set_usage(mANW.get(),
+                GRALLOC_USAGE_SW_WRITE_OFTEN));
+    }
+
+    virtual void TearDown() {
+        native_window_api_disconnect(mANW.get(), NATIVE_WINDOW_API_CPU);
+        mANW.clear();
+        mSTC.clear();
+        mBQ->consumerDisconnect();
+        mBQ.clear();
+        mListener.clear();
+    }
+
+    static void sleepUntil(nsecs_t when) {
+        struct timespec ts;
+        ts.tv_sec = when / 1000000000;
+        ts.tv_nsec = when % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+    }
+
+    static int compare(const nsecs_t* lhs, const nsecs_t* rhs) {
+        return *lhs < *rhs ? -1 : (*lhs > *rhs ? 1 : 0);
+    }
+
+    static void report(const char* what, int hz, const char* mode,
+            Vector<nsecs_t>& samples) {
+        if (samples.isEmpty()) {
+            printf("%4d Hz %-5s %-8s: no samples\n", hz, mode, what);
+            return;
+        }
+        samples.sort(compare);
+        const size_t n = samples.size();
+        printf("%4d Hz %-5s %-8s: n=%4d p50=%7.1fus p90=%7.1fus p99=%7.1fus "
+                "max=%7.1fus\n", hz, mode, what, int(n),
+                samples[n / 2] / 1000.0,
+                samples[(n * 90) / 100] / 1000.0,
+                samples[(n * 99) / 100] / 1000.0,
+                samples[n - 1] / 1000.0);
+    }
+
+    // Produces FRAMES_PER_RUN frames, one every 1/hz seconds, or as fast as
+    // possible when hz is 0.
+    void run(int hz, bool synchronous) {
+        // A swap interval of 0 puts the queue in asynchronous mode.
+        ASSERT_EQ(NO_ERROR, mANW->setSwapInterval(mANW.get(), synchronous ? 1 : 0));
+        {
+            Mutex::Autolock lock(mListener->mMutex);
+            mListener->mPending = 0;
+            mListener->mDone = false;
+        }
+        sp<ConsumerThread> consumer = new ConsumerThread(mBQ, mListener);
+        ASSERT_EQ(NO_ERROR, consumer->run("BufferQueueConsumer"));
+
+        Vector<nsecs_t> dequeueTimes;
+        const nsecs_t period = hz ? 1000000000LL / hz : 0;
+        nsecs_t next = systemTime();
+        for (int i = 0; i < FRAMES_PER_RUN; i++) {
+            if (period) {
+                next += period;
+                sleepUntil(next);
+            }
+
+            ANativeWindowBuffer* buf;
+            const nsecs_t start = systemTime();
+            ASSERT_EQ(NO_ERROR, mANW->dequeueBuffer(mANW.get(), &buf));
+            dequeueTimes.push(systemTime() - start);
+
+            ASSERT_EQ(NO_ERROR, native_window_set_buffers_timestamp(mANW.get(),
+                    systemTime()));
+            ASSERT_EQ(NO_ERROR, mANW->queueBuffer(mANW.get(), buf));
+        }
+
+        mListener->finish();
+        consumer->join();
+
+        const char* mode = synchronous ? "sync" : "async";
+        report("handoff", hz, mode, consumer->mLatencies);
+        report("dequeue", hz, mode, dequeueTimes);
+    }
+};
+
+TEST_F(BufferQueueBenchmark, Handoff60Hz) {
+    run(60, true);
+    run(60, false);
+}
+
+TEST_F(BufferQueueBenchmark, Handoff120Hz) {
+    run(120, true);
+    run(120, false);
+}
+
+TEST_F(BufferQueueBenchmark, Handoff240Hz) {
+    run(240, true);
+    run(240, false);
+}
+
+TEST_F(BufferQueueBenchmark, HandoffUnthrottled) {
+    run(0, true);
+    run(0, false);
+}
+
+} // namespace android
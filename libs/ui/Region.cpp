@@ -49,24 +49,28 @@ enum {
 // ----------------------------------------------------------------------------
 
 Region::Region()
-    : mBounds(0,0)
+    : mBounds(0,0), mInlineCount(0)
 {
 }
 
 Region::Region(const Region& rhs)
-    : mBounds(rhs.mBounds), mStorage(rhs.mStorage)
+    : mBounds(rhs.mBounds), mStorage(rhs.mStorage), mInlineCount(rhs.mInlineCount)
 {
+    for (size_t i=0 ; i<mInlineCount ; i++) {
+        mInline[i] = rhs.mInline[i];
+    }
 #if VALIDATE_REGIONS
     validate(rhs, "rhs copy-ctor");
 #endif
 }
 
 Region::Region(const Rect& rhs)
-    : mBounds(rhs)
+    : mBounds(rhs), mInlineCount(0)
 {
 }
 
 Region::Region(const void* buffer)
+    : mInlineCount(0)
 {
     status_t err = read(buffer);
     ALOGE_IF(err<0, "error %s reading Region from buffer", strerror(err));
@@ -84,12 +88,17 @@ Region& Region::operator = (const Region& rhs)
 #endif
     mBounds = rhs.mBounds;
     mStorage = rhs.mStorage;
+    mInlineCount = rhs.mInlineCount;
+    for (size_t i=0 ; i<mInlineCount ; i++) {
+        mInline[i] = rhs.mInline[i];
+    }
     return *this;
 }
 
 Region& Region::makeBoundsSelf()
 {
     mStorage.clear();
+    mInlineCount = 0;
     return *this;
 }
 
@@ -97,25 +106,41 @@ void Region::clear()
 {
     mBounds.clear();
     mStorage.clear();
+    mInlineCount = 0;
 }
 
 void Region::set(const Rect& r)
 {
     mBounds = r;
     mStorage.clear();
+    mInlineCount = 0;
 }
 
 void Region::set(uint32_t w, uint32_t h)
 {
     mBounds = Rect(int(w), int(h));
     mStorage.clear();
+    mInlineCount = 0;
 }
 
 // ----------------------------------------------------------------------------
 
+void Region::spillInline()
+{
+    mStorage.appendArray(mInline, mInlineCount);
+    mInlineCount = 0;
+}
+
 void Region::addRectUnchecked(int l, int t, int r, int b)
 {
-    mStorage.add(Rect(l,t,r,b));
+    if (mStorage.isEmpty() && mInlineCount < INLINE_RECTS) {
+        mInline[mInlineCount++] = Rect(l,t,r,b);
+    } else {
+        if (mInlineCount) {
+            spillInline();
+        }
+        mStorage.add(Rect(l,t,r,b));
+    }
 #if VALIDATE_REGIONS
     validate(*this, "addRectUnchecked");
 #endif
@@ -256,66 +281,115 @@ const Region Region::operation(const Region& rhs, int dx, int dy, int op) const
 
 // This is our region rasterizer, which merges rects and spans together
 // to obtain an optimal region.
+//
+// The current span is appended directly after the previous one, so merging
+// two spans only means extending the previous one and dropping the new one.
+// Output stays on the stack until it outgrows the region's inline storage,
+// and is only handed to the destination region when the rasterizer goes
+// away, so the destination may safely alias one of the operands.
 class Region::rasterizer : public region_operator<Rect>::region_rasterizer 
 {
-    Rect& bounds;
-    Vector<Rect>& storage;
-    Rect* head;
-    Rect* tail;
-    Vector<Rect> span;
-    Rect* cur;
+    Region& dst;
+    Rect bounds;
+    Rect local[INLINE_RECTS];
+    size_t count;
+    bool spilled;
+    Vector<Rect> storage;
+    size_t head;
+    size_t tail;
 public:
     rasterizer(Region& reg) 
-        : bounds(reg.mBounds), storage(reg.mStorage), head(), tail(), cur() {
+        : dst(reg), count(0), spilled(false), head(0), tail(0) {
         bounds.top = bounds.bottom = 0;
         bounds.left   = INT_MAX;
         bounds.right  = INT_MIN;
-        storage.clear();
     }
 
     ~rasterizer() {
-        if (span.size()) {
+        if (tail != size()) {
             flushSpan();
         }
-        if (storage.size()) {
-            bounds.top = storage.itemAt(0).top;
-            bounds.bottom = storage.top().bottom;
-            if (storage.size() == 1) {
-                storage.clear();
-            }
+        const size_t n = size();
+        if (n) {
+            bounds.top = at(0).top;
+            bounds.bottom = at(n - 1).bottom;
         } else {
             bounds.left  = 0;
             bounds.right = 0;
         }
+        dst.mBounds = bounds;
+        dst.mInlineCount = 0;
+        if (n <= 1) {
+            dst.mStorage.clear();
+        } else if (n <= INLINE_RECTS) {
+            const Rect* const rects = spilled ? storage.array() : local;
+            for (size_t i=0 ; i<n ; i++) {
+                dst.mInline[i] = rects[i];
+            }
+            dst.mInlineCount = n;
+            dst.mStorage.clear();
+        } else {
+            dst.mStorage = storage;
+        }
     }
     
     virtual void operator()(const Rect& rect) {
         //ALOGD(">>> %3d, %3d, %3d, %3d",
         //        rect.left, rect.top, rect.right, rect.bottom);
-        if (span.size()) {
-            if (cur->top != rect.top) {
+        const size_t n = size();
+        if (tail != n) {
+            Rect& cur = at(n - 1);
+            if (cur.top != rect.top) {
                 flushSpan();
-            } else if (cur->right == rect.left) {
-                cur->right = rect.right;
+            } else if (cur.right == rect.left) {
+                cur.right = rect.right;
                 return;
             }
         }
-        span.add(rect);
-        cur = span.editArray() + (span.size() - 1);
+        append(rect);
     }
 private:
     template<typename T> 
     static inline T min(T rhs, T lhs) { return rhs < lhs ? rhs : lhs; }
     template<typename T> 
     static inline T max(T rhs, T lhs) { return rhs > lhs ? rhs : lhs; }
+
+    inline size_t size() const {
+        return spilled ? storage.size() : count;
+    }
+    inline Rect& at(size_t i) {
+        return spilled ? storage.editItemAt(i) : local[i];
+    }
+    void append(const Rect& rect) {
+        if (!spilled) {
+            if (count < INLINE_RECTS) {
+                local[count++] = rect;
+                return;
+            }
+            storage.appendArray(local, count);
+            spilled = true;
+        }
+        storage.add(rect);
+    }
+    void truncate(size_t n) {
+        if (spilled) {
+            storage.removeItemsAt(n, storage.size() - n);
+        } else {
+            count = n;
+        }
+    }
+
+    // The span being built is [tail, size()), the previous one [head, tail).
     void flushSpan() {
+        const size_t n = size();
+        Rect* const rects = spilled ? storage.editArray() : local;
         bool merge = false;
-        if (tail-head == ssize_t(span.size())) {
-            Rect const* p = span.editArray();
-            Rect const* q = head;
+        if (tail-head == n-tail) {
+            Rect const* p = rects + tail;
+            Rect const* q = rects + head;
             if (p->top == q->bottom) {
                 merge = true;
-                while (q != tail) {
+                while (q != rects + tail) {
                     if ((p->left != q->left) || (p->right != q->right)) {
                         merge = false;
                         break;
@@ -325,20 +399,17 @@ private:
             }
         }
         if (merge) {
-            const int bottom = span[0].bottom;
-            Rect* r = head;
-            while (r != tail) {
-                r->bottom = bottom;
-                r++;
+            const int bottom = rects[tail].bottom;
+            for (size_t i=head ; i<tail ; i++) {
+                rects[i].bottom = bottom;
             }
+            truncate(tail);
         } else {
-            bounds.left = min(span.itemAt(0).left, bounds.left);
-            bounds.right = max(span.top().right, bounds.right);
-            storage.appendVector(span);
-            tail = storage.editArray() + storage.size();
-            head = tail - span.size();
+            bounds.left = min(rects[tail].left, bounds.left);
+            bounds.right = max(rects[n - 1].right, bounds.right);
+            head = tail;
+            tail = n;
         }
-        span.clear();
     }
 };
 
@@ -384,6 +455,127 @@ bool Region::validate(const Region& reg, const char* name)
     return result;
 }
 
+// Returns whether every point of 'rect' is in 'reg'.  Bands are sorted in
+// Y, so this walks down from rect.top looking for one rect per band that
+// spans rect horizontally, and gives up at the first gap.
+static bool regionContains(const Region& reg, const Rect& rect)
+{
+    int y = rect.top;
+    Region::const_iterator cur = reg.begin();
+    Region::const_iterator const tail = reg.end();
+    for ( ; cur != tail ; cur++) {
+        if (cur->bottom <= y) {
+            continue;
+        }
+        if (cur->top > y) {
+            return false;
+        }
+        if (cur->left <= rect.left && cur->right >= rect.right) {
+            y = cur->bottom;
+            if (y >= rect.bottom) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static inline bool rectContains(const Rect& outer, const Rect& inner)
+{
+    return outer.left <= inner.left && outer.top <= inner.top &&
+            outer.right >= inner.right && outer.bottom >= inner.bottom;
+}
+
+bool Region::quick_operation(int op, Region& dst,
+        const Region& lhs,
+        const Region& rhs, int dx, int dy)
+{
+    const Rect& lb(lhs.mBounds);
+    const Rect rb(rhs.mBounds.left + dx, rhs.mBounds.top + dy,
+            rhs.mBounds.right + dx, rhs.mBounds.bottom + dy);
+
+    // one of the operands is empty
+    if (lb.isEmpty()) {
+        if (op == op_and || op == op_nand) {
+            dst.clear();
+        } else {
+            translate(dst, rhs, dx, dy);
+        }
+        return true;
+    }
+    if (rb.isEmpty()) {
+        if (op == op_and) {
+            dst.clear();
+        } else {
+            dst = lhs;
+        }
+        return true;
+    }
+
+    // the bounds don't overlap
+    Rect common;
+    if (!lb.intersect(rb, &common)) {
+        if (op == op_and) {
+            dst.clear();
+            return true;
+        }
+        if (op == op_nand) {
+            dst = lhs;
+            return true;
+        }
+        return false;
+    }
+
+    if (rhs.isRect() && rectContains(rb, lb)) {
+        switch (op) {
+            case op_and:  dst = lhs;        return true;
+            case op_nand: dst.clear();      return true;
+            case op_or:   dst.set(rb);      return true;
+        }
+        return false;
+    }
+
+    if (lhs.isRect() && rectContains(lb, rb)) {
+        switch (op) {
+            case op_and:  translate(dst, rhs, dx, dy);  return true;
+            case op_or:   dst = lhs;                    return true;
+        }
+        if (op == op_xor || !rhs.isRect()) {
+            return false;
+        }
+    }
+
+    if (lhs.isRect() && rhs.isRect()) {
+        switch (op) {
+            case op_and:
+                dst.set(common);
+                return true;
+            case op_or:
+                // the two rects line up and touch or overlap
+                if ((lb.left == rb.left && lb.right == rb.right &&
+                        lb.top <= rb.bottom && rb.top <= lb.bottom) ||
+                    (lb.top == rb.top && lb.bottom == rb.bottom &&
+                        lb.left <= rb.right && rb.left <= lb.right)) {
+                    dst.set(Rect(
+                            lb.left   < rb.left   ? lb.left   : rb.left,
+                            lb.top    < rb.top    ? lb.top    : rb.top,
+                            lb.right  > rb.right  ? lb.right  : rb.right,
+                            lb.bottom > rb.bottom ? lb.bottom : rb.bottom));
+                    return true;
+                }
+                break;
+        }
+        return false;
+    }
+
+    if (op == op_or && rhs.isRect() && regionContains(lhs, rb)) {
+        dst = lhs;
+        return true;
+    }
+
+    return false;
+}
+
 void Region::boolean_operation(int op, Region& dst,
         const Region& lhs,
         const Region& rhs, int dx, int dy)
@@ -394,6 +586,12 @@ void Region::boolean_operation(int op, Region& dst,
     validate(dst, "boolean_operation (before): dst");
 #endif
 
+#if !VALIDATE_WITH_CORECG
+    if (quick_operation(op, dst, lhs, rhs, dx, dy)) {
+        return;
+    }
+#endif
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -507,6 +705,10 @@ void Region::boolean_operation(int op, Region& dst,
 #if VALIDATE_WITH_CORECG || VALIDATE_REGIONS
     boolean_operation(op, dst, lhs, Region(rhs), dx, dy);
 #else
+    if (quick_operation(op, dst, lhs, Region(rhs), dx, dy)) {
+        return;
+    }
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -540,8 +742,15 @@ void Region::translate(Region& reg, int dx, int dy)
         validate(reg, "translate (before)");
 #endif
         reg.mBounds.translate(dx, dy);
-        size_t count = reg.mStorage.size();
-        Rect* rects = reg.mStorage.editArray();
+        size_t count;
+        Rect* rects;
+        if (reg.mInlineCount) {
+            count = reg.mInlineCount;
+            rects = reg.mInline;
+        } else {
+            count = reg.mStorage.size();
+            rects = reg.mStorage.editArray();
+        }
         while (count) {
             rects->translate(dx, dy);
             rects++;
@@ -566,7 +775,7 @@ ssize_t Region::write(void* buffer, size_t size) const
 #if VALIDATE_REGIONS
     validate(*this, "write(buffer)");
 #endif
-    const size_t count = mStorage.size();
+    const size_t count = isRect() ? 0 : end() - begin();
     const size_t sizeNeeded = sizeof(int32_t) + (1+count)*sizeof(Rect);
     if (buffer != NULL) {
         if (sizeNeeded > size) return NO_MEMORY;
@@ -574,7 +783,7 @@ ssize_t Region::write(void* buffer, size_t size) const
         *p = count;
         memcpy(p+1, &mBounds, sizeof(Rect));
         if (count) {
-            memcpy(p+5, mStorage.array(), count*sizeof(Rect));
+            memcpy(p+5, begin(), count*sizeof(Rect));
         }
     }
     return ssize_t(sizeNeeded);
@@ -586,7 +795,11 @@ ssize_t Region::read(const void* buffer)
     const size_t count = *p;
     memcpy(&mBounds, p+1, sizeof(Rect));
     mStorage.clear();
-    if (count) {
+    mInlineCount = 0;
+    if (count <= INLINE_RECTS) {
+        memcpy(mInline, p+5, count*sizeof(Rect));
+        mInlineCount = count;
+    } else {
         mStorage.insertAt(0, count);
         memcpy(mStorage.editArray(), p+5, count*sizeof(Rect));
     }
@@ -615,10 +828,16 @@ bool Region::isEmpty(void* buffer)
 // ----------------------------------------------------------------------------
 
 Region::const_iterator Region::begin() const {
+    if (mInlineCount) {
+        return mInline;
+    }
     return isRect() ? &mBounds : mStorage.array();
 }
 
 Region::const_iterator Region::end() const {
+    if (mInlineCount) {
+        return mInline + mInlineCount;
+    }
     if (isRect()) {
         if (isEmpty()) {
             return &mBounds;
@@ -639,6 +858,11 @@ Rect const* Region::getArray(size_t* count) const {
 
 size_t Region::getRects(Vector<Rect>& rectList) const
 {
+    if (mInlineCount) {
+        rectList.clear();
+        rectList.appendArray(mInline, mInlineCount);
+        return rectList.size();
+    }
     rectList = mStorage;
     if (rectList.isEmpty()) {
         rectList.clear();
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Region_test"
+#include <ui/Rect.h>
+#include <ui/Region.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+enum {
+    GRID = 16,
+    ITERATIONS = 2000,
+};
+
+// A region rasterized onto a small pixel grid, used as the reference the
+// real operations are checked against.
+struct Bitmap {
+    bool px[GRID][GRID];
+
+    Bitmap() { memset(px, 0, sizeof(px)); }
+
+    explicit Bitmap(const Region& reg) {
+        memset(px, 0, sizeof(px));
+        for (Region::const_iterator r = reg.begin(); r != reg.end(); r++) {
+            for (int y = r->top; y < r->bottom; y++) {
+                for (int x = r->left; x < r->right; x++) {
+                    px[y][x] = true;
+                }
+            }
+        }
+    }
+
+    bool operator == (const Bitmap& rhs) const {
+        return !memcmp(px, rhs.px, sizeof(px));
+    }
+};
+
+class RegionTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        srand(1);
+    }
+
+    static Rect randomRect(int max) {
+        int l = rand() % max, t = rand() % max;
+        int r = l + 1 + rand() % (max - l), b = t + 1 + rand() % (max - t);
+        return Rect(l, t, r, b);
+    }
+
+    // Mostly one or two rects, which is what SurfaceFlinger deals with the
+    // most, with the occasional empty or ragged region.
+    static Region randomRegion() {
+        Region reg;
+        const int n = rand() % 5;
+        for (int i = 0; i < n; i++) {
+            const Rect r(randomRect(GRID / 2 + 2));
+            if (rand() % 4) {
+                reg.orSelf(r);
+            } else {
+                reg.subtractSelf(r);
+            }
+        }
+        return reg;
+    }
+
+    static Bitmap combine(const Bitmap& a, const Bitmap& b, char op) {
+        Bitmap out;
+        for (int y = 0; y < GRID; y++) {
+            for (int x = 0; x < GRID; x++) {
+                const bool p = a.px[y][x], q = b.px[y][x];
+                switch (op) {
+                    case '|': out.px[y][x] = p || q; break;
+                    case '&': out.px[y][x] = p && q; break;
+                    case '-': out.px[y][x] = p && !q; break;
+                    case '^': out.px[y][x] = p != q; break;
+                }
+            }
+        }
+        return out;
+    }
+
+    // Checks the invariants the rest of the framework relies on: bands are
+    // sorted and don't overlap, rects within a band are sorted, and the
+    // bounds are tight.
+    static void expectCanonical(const Region& reg) {
+        Region::const_iterator cur = reg.begin();
+        Region::const_iterator const tail = reg.end();
+        if (cur == tail) {
+            EXPECT_TRUE(reg.isEmpty());
+            return;
+        }
+        Rect b(*cur);
+        for (Region::const_iterator prev = cur++; cur != tail; prev = cur++) {
+            EXPECT_FALSE(cur->isEmpty());
+            if (cur->top == prev->top) {
+                EXPECT_EQ(prev->bottom, cur->bottom);
+                EXPECT_LT(prev->right, cur->left) << "adjacent rects should be merged";
+            } else {
+                EXPECT_LE(prev->bottom, cur->top);
+            }
+            if (cur->left < b.left) b.left = cur->left;
+            if (cur->right > b.right) b.right = cur->right;
+            b.bottom = cur->bottom;
+        }
+        EXPECT_TRUE(b == reg.getBounds());
+    }
+
+    static void check(const Region& lhs, const Region& rhs, char op) {
+        Region result;
+        switch (op) {
+            case '|': result = lhs | rhs; break;
+            case '&': result = lhs & rhs; break;
+            case '-': result = lhs - rhs; break;
+            case '^': result = lhs ^ rhs; break;
+        }
+        const Bitmap expected(combine(Bitmap(lhs), Bitmap(rhs), op));
+        EXPECT_TRUE(Bitmap(result) == expected) << dump(lhs, rhs, result, op);
+        expectCanonical(result);
+
+        // the in-place version may run with dst aliasing an operand
+        Region self(lhs);
+        switch (op) {
+            case '|': self |= rhs; break;
+            case '&': self &= rhs; break;
+            case '-': self -= rhs; break;
+            case '^': self ^= rhs; break;
+        }
+        EXPECT_TRUE(Bitmap(self) == expected) << dump(lhs, rhs, self, op);
+    }
+
+    static String8 dump(const Region& lhs, const Region& rhs, const Region& result,
+            char op) {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "op '%c'\n", op);
+        String8 out(buffer);
+        lhs.dump(out, "lhs");
+        rhs.dump(out, "rhs");
+        result.dump(out, "result");
+        return out;
+    }
+};
+
+TEST_F(RegionTest, Operations_OnRandomRegions_MatchPixelReference) {
+    const char ops[] = { '|', '&', '-', '^' };
+    for (int i = 0; i < ITERATIONS; i++) {
+        const Region lhs(randomRegion());
+        const Region rhs(randomRegion());
+        for (size_t j = 0; j < sizeof(ops); j++) {
+            check(lhs, rhs, ops[j]);
+        }
+    }
+}
+
+TEST_F(RegionTest, Operations_OnRandomRects_MatchPixelReference) {
+    const char ops[] = { '|', '&', '-', '^' };
+    for (int i = 0; i < ITERATIONS; i++) {
+        const Region lhs(randomRect(GRID / 2 + 2));
+        const Region rhs(randomRect(GRID / 2 + 2));
+        for (size_t j = 0; j < sizeof(ops); j++) {
+            check(lhs, rhs, ops[j]);
+        }
+    }
+}
+
+TEST_F(RegionTest, Operations_WithSelf_MatchPixelReference) {
+    for (int i = 0; i < ITERATIONS / 10; i++) {
+        const Region reg(randomRegion());
+        Region r(reg);
+        r |= r;
+        EXPECT_TRUE(Bitmap(r) == Bitmap(reg));
+        r = reg;
+        r &= r;
+        EXPECT_TRUE(Bitmap(r) == Bitmap(reg));
+        r = reg;
+        r -= r;
+        EXPECT_TRUE(r.isEmpty());
+    }
+}
+
+TEST_F(RegionTest, Merge_WhenRectsLineUp_StaysARect) {
+    Region reg(Rect(0, 0, 10, 10));
+    reg.orSelf(Rect(0, 10, 10, 20));
+    EXPECT_TRUE(reg.isRect());
+    EXPECT_TRUE(Rect(0, 0, 10, 20) == reg.getBounds());
+    reg.orSelf(Rect(10, 0, 15, 20));
+    EXPECT_TRUE(reg.isRect());
+    EXPECT_TRUE(Rect(0, 0, 15, 20) == reg.getBounds());
+}
+
+TEST_F(RegionTest, Subtract_WhenResultIsSmall_KeepsRectsInline) {
+    // a hole in the middle leaves four rects
+    Region reg(Rect(0, 0, 12, 12));
+    reg.subtractSelf(Rect(4, 4, 8, 8));
+    size_t count;
+    const Rect* rects = reg.getArray(&count);
+    ASSERT_EQ(size_t(4), count);
+    EXPECT_TRUE(Rect(0, 0, 12, 4) == rects[0]);
+    EXPECT_TRUE(Rect(0, 4, 4, 8) == rects[1]);
+    EXPECT_TRUE(Rect(8, 4, 12, 8) == rects[2]);
+    EXPECT_TRUE(Rect(0, 8, 12, 12) == rects[3]);
+    EXPECT_TRUE(rects >= reinterpret_cast<const Rect*>(&reg) &&
+            rects < reinterpret_cast<const Rect*>(&reg + 1))
+            << "a four rect region should not need the heap";
+
+    // a second hole needs more than the inline storage
+    reg.subtractSelf(Rect(1, 9, 2, 10));
+    Region copy(reg);
+    EXPECT_TRUE(Bitmap(copy) == Bitmap(reg));
+    expectCanonical(reg);
+    EXPECT_EQ(size_t(7), size_t(reg.end() - reg.begin()));
+}
+
+TEST_F(RegionTest, Flatten_RoundTripsInlineAndHeapRegions) {
+    for (int i = 0; i < ITERATIONS / 10; i++) {
+        const Region reg(randomRegion());
+        const ssize_t size = reg.write(NULL, 0);
+        ASSERT_LT(0, size);
+        uint8_t* buffer = new uint8_t[size];
+        ASSERT_EQ(size, reg.write(buffer, size));
+        Region copy;
+        EXPECT_EQ(size, copy.read(buffer));
+        delete[] buffer;
+        EXPECT_TRUE(Bitmap(copy) == Bitmap(reg));
+        EXPECT_EQ(reg.end() - reg.begin(), copy.end() - copy.begin());
+        EXPECT_TRUE(reg.getBounds() == copy.getBounds());
+    }
+}
+
+TEST_F(RegionTest, Translate_MovesInlineRects) {
+    Region reg(Rect(0, 0, 12, 12));
+    reg.subtractSelf(Rect(4, 4, 8, 8));
+    const Region moved(reg.translate(3, 2));
+    EXPECT_TRUE(Rect(3, 2, 15, 14) == moved.getBounds());
+    const Region back(moved.translate(-3, -2));
+    EXPECT_TRUE(Bitmap(back) == Bitmap(reg));
+}
+
+} // namespace android
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RegionBenchmark"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <utils/Timers.h>
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+using namespace android;
+
+// Measures Region throughput on the window stacks SurfaceFlinger sees, by
+// running the same sequence of operations computeVisibleRegions() does.
+
+struct Window {
+    Rect bounds;
+    bool opaque;
+    Region transparent;
+    Region visible;
+    Region covered;
+};
+
+static const Rect kScreen(0, 0, 720, 1280);
+
+static void setupStack(Window* windows, size_t count, bool dialogs)
+{
+    for (size_t i=0 ; i<count ; i++) {
+        Window& w(windows[i]);
+        w.visible.clear();
+        w.covered.clear();
+        w.transparent.clear();
+        if (i == 0) {
+            // wallpaper, larger than the screen
+            w.bounds = Rect(-360, 0, 1080, 1280);
+            w.opaque = true;
+        } else if (i == count - 1) {
+            // navigation bar
+            w.bounds = Rect(0, 1184, 720, 1280);
+            w.opaque = false;
+        } else if (i == count - 2) {
+            // status bar
+            w.bounds = Rect(0, 0, 720, 50);
+            w.opaque = false;
+        } else if (dialogs && (i & 1)) {
+            // a dialog with rounded corners
+            w.bounds = Rect(60, 400, 660, 880);
+            w.opaque = false;
+            w.transparent.orSelf(Rect(60, 400, 68, 408));
+            w.transparent.orSelf(Rect(652, 400, 660, 408));
+            w.transparent.orSelf(Rect(60, 872, 68, 880));
+            w.transparent.orSelf(Rect(652, 872, 660, 880));
+        } else {
+            // a full screen app
+            w.bounds = Rect(0, 50, 720, 1184);
+            w.opaque = true;
+        }
+    }
+}
+
+static size_t computeVisibleRegions(Window* windows, size_t count, Region& dirtyRegion)
+{
+    size_t ops = 0;
+    const Region screenRegion(kScreen);
+    Region aboveOpaqueLayers;
+    Region aboveCoveredLayers;
+    Region dirty;
+
+    size_t i = count;
+    while (i--) {
+        Window& w(windows[i]);
+        Region opaqueRegion;
+        Region visibleRegion;
+        Region coveredRegion;
+
+        visibleRegion.set(w.bounds);
+        visibleRegion.andSelf(screenRegion);
+        ops++;
+        if (!visibleRegion.isEmpty()) {
+            if (!w.opaque) {
+                visibleRegion.subtractSelf(w.transparent);
+                ops++;
+            } else {
+                opaqueRegion = visibleRegion;
+            }
+        }
+
+        coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
+        aboveCoveredLayers.orSelf(visibleRegion);
+        visibleRegion.subtractSelf(aboveOpaqueLayers);
+        ops += 3;
+
+        const Region newExposed = visibleRegion - coveredRegion;
+        const Region oldExposed = w.visible - w.covered;
+        dirty = (visibleRegion & w.covered) | (newExposed - oldExposed);
+        dirty.subtractSelf(aboveOpaqueLayers);
+        dirtyRegion.orSelf(dirty);
+        aboveOpaqueLayers.orSelf(opaqueRegion);
+        ops += 7;
+
+        w.visible = visibleRegion;
+        w.covered = coveredRegion;
+    }
+    return ops;
+}
+
+static void report(const char* name, size_t ops, nsecs_t elapsed)
+{
+    printf("%-32s %10.0f ops/s  (%6.1f ns/op)\n", name,
+            ops / (elapsed / 1e9), double(elapsed) / ops);
+}
+
+static void benchmarkStack(const char* name, size_t count, bool dialogs, int frames)
+{
+    Window* windows = new Window[count];
+    setupStack(windows, count, dialogs);
+
+    size_t ops = 0;
+    const nsecs_t start = systemTime();
+    for (int f=0 ; f<frames ; f++) {
+        Region dirtyRegion;
+        ops += computeVisibleRegions(windows, count, dirtyRegion);
+        dirtyRegion.andSelf(kScreen);
+        ops++;
+    }
+    report(name, ops, systemTime() - start);
+    delete[] windows;
+}
+
+static void benchmarkRects(int iterations)
+{
+    const Region a(Rect(0, 0, 720, 1184));
+    const Region b(Rect(100, 300, 620, 900));
+    const Region c(Rect(0, 1184, 720, 1280));
+    Region r;
+    size_t checksum = 0;
+
+    nsecs_t start = systemTime();
+    for (int i=0 ; i<iterations ; i++) {
+        r = a & b;
+        checksum += r.getBounds().width();
+    }
+    report("rect & rect", iterations, systemTime() - start);
+
+    start = systemTime();
+    for (int i=0 ; i<iterations ; i++) {
+        r = a | b;
+        checksum += r.getBounds().width();
+    }
+    report("rect | contained rect", iterations, systemTime() - start);
+
+    start = systemTime();
+    for (int i=0 ; i<iterations ; i++) {
+        r = a - c;
+        checksum += r.getBounds().width();
+    }
+    report("rect - disjoint rect", iterations, systemTime() - start);
+
+    start = systemTime();
+    for (int i=0 ; i<iterations ; i++) {
+        r = a - b;
+        checksum += r.getBounds().width();
+    }
+    report("rect - rect (4 rects)", iterations, systemTime() - start);
+
+    const Region holes(a - b);
+    start = systemTime();
+    for (int i=0 ; i<iterations ; i++) {
+        r = holes.merge(Rect(0, 0, 50, 50));
+        checksum += r.getBounds().width();
+    }
+    report("region | contained rect", iterations, systemTime() - start);
+
+    if (checksum == 0) {
+        printf("unexpected checksum\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int frames = argc > 1 ? atoi(argv[1]) : 100000;
+    benchmarkRects(frames * 10);
+    benchmarkStack("stack: 1 app", 4, false, frames);
+    benchmarkStack("stack: 3 apps", 6, false, frames);
+    benchmarkStack("stack: apps and dialogs", 8, true, frames);
+    return 0;
+}
@@ -32,8 +32,10 @@ commonSources:= \
 	Static.cpp \
 	StopWatch.cpp \
 	String8.cpp \
+	String8Builder.cpp \
 	String16.cpp \
 	StringArray.cpp \
+	StringAtom.cpp \
 	SystemClock.cpp \
 	TextOutput.cpp \
 	Threads.cpp \
@@ -22,6 +22,7 @@
 
 #include <utils/BlobCache.h>
 #include <utils/Errors.h>
+#include <utils/FileMap.h>
 #include <utils/Log.h>
 
 namespace android {
@@ -35,20 +36,27 @@ static const uint32_t blobCacheVersion = 1;
 // BlobCache::Header::mDeviceVersion value
 static const uint32_t blobCacheDeviceVersion = 1;
 
+// Number of hash buckets allocated by the first insertion.
+static const size_t initialBucketCount = 64;
+
 BlobCache::BlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize):
         mMaxKeySize(maxKeySize),
         mMaxValueSize(maxValueSize),
         mMaxTotalSize(maxTotalSize),
-        mTotalSize(0) {
-    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-#ifdef _WIN32
-    srand(now);
-#else
-    mRandState[0] = (now >> 0) & 0xFFFF;
-    mRandState[1] = (now >> 16) & 0xFFFF;
-    mRandState[2] = (now >> 32) & 0xFFFF;
-#endif
-    ALOGV("initializing random seed using %lld", now);
+        mTotalSize(0),
+        mBuckets(NULL),
+        mBucketCount(0),
+        mNumEntries(0),
+        mOldest(NULL),
+        mNewest(NULL),
+        mMap(NULL),
+        mMappedSize(0) {
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+BlobCache::~BlobCache() {
+    removeAll();
+    free(mBuckets);
 }
 
 void BlobCache::set(const void* key, size_t keySize, const void* value,
@@ -56,16 +64,19 @@ void BlobCache::set(const void* key, size_t keySize, const void* value,
     if (mMaxKeySize < keySize) {
         ALOGV("set: not caching because the key is too large: %d (limit: %d)",
                 keySize, mMaxKeySize);
+        mStats.rejections++;
         return;
     }
     if (mMaxValueSize < valueSize) {
         ALOGV("set: not caching because the value is too large: %d (limit: %d)",
                 valueSize, mMaxValueSize);
+        mStats.rejections++;
         return;
     }
     if (mMaxTotalSize < keySize + valueSize) {
         ALOGV("set: not caching because the combined key/value size is too "
                 "large: %d (limit: %d)", keySize + valueSize, mMaxTotalSize);
+        mStats.rejections++;
         return;
     }
     if (keySize == 0) {
@@ -77,56 +88,67 @@ void BlobCache::set(const void* key, size_t keySize, const void* value,
         return;
     }
 
-    sp<Blob> dummyKey(new Blob(key, keySize, false));
-    CacheEntry dummyEntry(dummyKey, NULL);
+    store(key, keySize, value, valueSize, true);
+}
 
+void BlobCache::store(const void* key, size_t keySize, const void* value,
+        size_t valueSize, bool copyData) {
+    const uint32_t hash = hashKey(key, keySize);
     while (true) {
-        ssize_t index = mCacheEntries.indexOf(dummyEntry);
-        if (index < 0) {
-            // Create a new cache entry.
-            sp<Blob> keyBlob(new Blob(key, keySize, true));
-            sp<Blob> valueBlob(new Blob(value, valueSize, true));
-            size_t newTotalSize = mTotalSize + keySize + valueSize;
-            if (mMaxTotalSize < newTotalSize) {
-                if (isCleanable()) {
-                    // Clean the cache and try again.
-                    clean();
-                    continue;
-                } else {
-                    ALOGV("set: not caching new key/value pair because the "
-                            "total cache size limit would be exceeded: %d "
-                            "(limit: %d)",
-                            keySize + valueSize, mMaxTotalSize);
-                    break;
-                }
+        Entry* old = find(key, keySize, hash);
+        size_t newTotalSize = mTotalSize + keySize + valueSize;
+        if (old) {
+            newTotalSize -= old->mKeySize + old->mValueSize;
+        }
+        if (mMaxTotalSize < newTotalSize) {
+            if (isCleanable()) {
+                // Clean the cache and try again.  This may evict 'old'.
+                clean();
+                continue;
+            }
+            ALOGV("set: not caching new key/value pair because the "
+                    "total cache size limit would be exceeded: %d "
+                    "(limit: %d)", keySize + valueSize, mMaxTotalSize);
+            mStats.rejections++;
+            return;
+        }
+
+        Entry* e;
+        if (copyData) {
+            e = static_cast<Entry*>(malloc(sizeof(Entry) + keySize + valueSize));
+            if (e == NULL) {
+                ALOGE("set: unable to allocate a %d byte cache entry",
+                        sizeof(Entry) + keySize + valueSize);
+                return;
             }
-            mCacheEntries.add(CacheEntry(keyBlob, valueBlob));
-            mTotalSize = newTotalSize;
-            ALOGV("set: created new cache entry with %d byte key and %d byte value",
-                    keySize, valueSize);
+            uint8_t* data = reinterpret_cast<uint8_t*>(e + 1);
+            memcpy(data, key, keySize);
+            memcpy(data + keySize, value, valueSize);
+            e->mKey = data;
+            e->mValue = data + keySize;
         } else {
-            // Update the existing cache entry.
-            sp<Blob> valueBlob(new Blob(value, valueSize, true));
-            sp<Blob> oldValueBlob(mCacheEntries[index].getValue());
-            size_t newTotalSize = mTotalSize + valueSize - oldValueBlob->getSize();
-            if (mMaxTotalSize < newTotalSize) {
-                if (isCleanable()) {
-                    // Clean the cache and try again.
-                    clean();
-                    continue;
-                } else {
-                    ALOGV("set: not caching new value because the total cache "
-                            "size limit would be exceeded: %d (limit: %d)",
-                            keySize + valueSize, mMaxTotalSize);
-                    break;
-                }
+            e = static_cast<Entry*>(malloc(sizeof(Entry)));
+            if (e == NULL) {
+                ALOGE("set: unable to allocate a cache entry");
+                return;
             }
-            mCacheEntries.editItemAt(index).setValue(valueBlob);
-            mTotalSize = newTotalSize;
-            ALOGV("set: updated existing cache entry with %d byte key and %d byte "
-                    "value", keySize, valueSize);
+            e->mKey = static_cast<const uint8_t*>(key);
+            e->mValue = static_cast<const uint8_t*>(value);
+            mMappedSize += keySize + valueSize;
         }
-        break;
+        e->mHash = hash;
+        e->mKeySize = keySize;
+        e->mValueSize = valueSize;
+
+        if (old) {
+            removeEntry(old);
+        }
+        link(e);
+        mTotalSize += keySize + valueSize;
+        mStats.insertions++;
+        ALOGV("set: stored cache entry with %d byte key and %d byte value",
+                keySize, valueSize);
+        return;
     }
 }
 
@@ -135,23 +157,24 @@ size_t BlobCache::get(const void* key, size_t keySize, void* value,
     if (mMaxKeySize < keySize) {
         ALOGV("get: not searching because the key is too large: %d (limit %d)",
                 keySize, mMaxKeySize);
+        mStats.misses++;
         return 0;
     }
-    sp<Blob> dummyKey(new Blob(key, keySize, false));
-    CacheEntry dummyEntry(dummyKey, NULL);
-    ssize_t index = mCacheEntries.indexOf(dummyEntry);
-    if (index < 0) {
+    Entry* e = find(key, keySize, hashKey(key, keySize));
+    if (e == NULL) {
         ALOGV("get: no cache entry found for key of size %d", keySize);
+        mStats.misses++;
         return 0;
     }
+    mStats.hits++;
+    touch(e);
 
     // The key was found. Return the value if the caller's buffer is large
     // enough.
-    sp<Blob> valueBlob(mCacheEntries[index].getValue());
-    size_t valueBlobSize = valueBlob->getSize();
+    size_t valueBlobSize = e->mValueSize;
     if (valueBlobSize <= valueSize) {
         ALOGV("get: copying %d bytes to caller's buffer", valueBlobSize);
-        memcpy(value, valueBlob->getData(), valueBlobSize);
+        memcpy(value, e->mValue, valueBlobSize);
     } else {
         ALOGV("get: caller's buffer is too small for value: %d (needs %d)",
                 valueSize, valueBlobSize);
@@ -159,19 +182,22 @@ size_t BlobCache::get(const void* key, size_t keySize, void* value,
     return valueBlobSize;
 }
 
+void BlobCache::getStats(Stats* stats) const {
+    *stats = mStats;
+    stats->entries = mNumEntries;
+    stats->totalSize = mTotalSize;
+    stats->mappedSize = mMappedSize;
+}
+
 static inline size_t align4(size_t size) {
     return (size + 3) & ~3;
 }
 
 size_t BlobCache::getFlattenedSize() const {
     size_t size = sizeof(Header);
-    for (size_t i = 0; i < mCacheEntries.size(); i++) {
-        const CacheEntry& e(mCacheEntries[i]);
-        sp<Blob> keyBlob = e.getKey();
-        sp<Blob> valueBlob = e.getValue();
+    for (const Entry* e = mOldest; e; e = e->mNewer) {
         size = align4(size);
-        size += sizeof(EntryHeader) + keyBlob->getSize() +
-                valueBlob->getSize();
+        size += sizeof(EntryHeader) + e->mKeySize + e->mValueSize;
     }
     return size;
 }
@@ -196,17 +222,15 @@ status_t BlobCache::flatten(void* buffer, size_t size, int fds[], size_t count)
     header->mMagicNumber = blobCacheMagic;
     header->mBlobCacheVersion = blobCacheVersion;
     header->mDeviceVersion = blobCacheDeviceVersion;
-    header->mNumEntries = mCacheEntries.size();
+    header->mNumEntries = mNumEntries;
 
-    // Write cache entries
+    // Write cache entries from the least to the most recently used, so that
+    // unflattening them in order restores the eviction order.
     uint8_t* byteBuffer = reinterpret_cast<uint8_t*>(buffer);
     off_t byteOffset = align4(sizeof(Header));
-    for (size_t i = 0; i < mCacheEntries.size(); i++) {
-        const CacheEntry& e(mCacheEntries[i]);
-        sp<Blob> keyBlob = e.getKey();
-        sp<Blob> valueBlob = e.getValue();
-        size_t keySize = keyBlob->getSize();
-        size_t valueSize = valueBlob->getSize();
+    for (const Entry* e = mOldest; e; e = e->mNewer) {
+        size_t keySize = e->mKeySize;
+        size_t valueSize = e->mValueSize;
 
         size_t entrySize = sizeof(EntryHeader) + keySize + valueSize;
         if (byteOffset + entrySize > size) {
@@ -219,8 +243,8 @@ status_t BlobCache::flatten(void* buffer, size_t size, int fds[], size_t count)
         eheader->mKeySize = keySize;
         eheader->mValueSize = valueSize;
 
-        memcpy(eheader->mData, keyBlob->getData(), keySize);
-        memcpy(eheader->mData + keySize, valueBlob->getData(), valueSize);
+        memcpy(eheader->mData, e->mKey, keySize);
+        memcpy(eheader->mData + keySize, e->mValue, valueSize);
 
         byteOffset += align4(entrySize);
     }
@@ -230,13 +254,37 @@ status_t BlobCache::flatten(void* buffer, size_t size, int fds[], size_t count)
 
 status_t BlobCache::unflatten(void const* buffer, size_t size, int fds[],
         size_t count) {
-    // All errors should result in the BlobCache being in an empty state.
-    mCacheEntries.clear();
-
     if (count != 0) {
+        removeAll();
         ALOGE("unflatten: nonzero fd count: %zu", count);
         return BAD_VALUE;
     }
+    return load(buffer, size, true);
+}
+
+status_t BlobCache::unflattenMapped(FileMap* map, size_t offset) {
+    if (offset > map->getDataLength()) {
+        removeAll();
+        ALOGE("unflattenMapped: offset %d is beyond the end of the map",
+                offset);
+        return BAD_VALUE;
+    }
+    // Hold the map before dropping the old contents, in case it is the map
+    // they refer to.
+    map->acquire();
+    status_t err = load(static_cast<const uint8_t*>(map->getDataPtr()) + offset,
+            map->getDataLength() - offset, false);
+    if (mMappedSize) {
+        mMap = map;
+    } else {
+        map->release();
+    }
+    return err;
+}
+
+status_t BlobCache::load(const void* buffer, size_t size, bool copyData) {
+    // All errors should result in the BlobCache being in an empty state.
+    removeAll();
 
     // Read the cache header
     if (size < sizeof(Header)) {
@@ -260,7 +308,7 @@ status_t BlobCache::unflatten(void const* buffer, size_t size, int fds[],
     size_t numEntries = header->mNumEntries;
     for (size_t i = 0; i < numEntries; i++) {
         if (byteOffset + sizeof(EntryHeader) > size) {
-            mCacheEntries.clear();
+            removeAll();
             ALOGE("unflatten: not enough room for cache entry headers");
             return BAD_VALUE;
         }
@@ -272,13 +320,21 @@ status_t BlobCache::unflatten(void const* buffer, size_t size, int fds[],
         size_t entrySize = sizeof(EntryHeader) + keySize + valueSize;
 
         if (byteOffset + entrySize > size) {
-            mCacheEntries.clear();
+            removeAll();
             ALOGE("unflatten: not enough room for cache entry headers");
             return BAD_VALUE;
         }
 
+        // Apply the same limits as set, in case they changed since the
+        // cache was saved.
         const uint8_t* data = eheader->mData;
-        set(data, keySize, data + keySize, valueSize);
+        if (keySize == 0 || valueSize == 0 || mMaxKeySize < keySize ||
+                mMaxValueSize < valueSize ||
+                mMaxTotalSize < keySize + valueSize) {
+            mStats.rejections++;
+        } else {
+            store(data, keySize, data + keySize, valueSize, copyData);
+        }
 
         byteOffset += align4(entrySize);
     }
@@ -286,93 +342,152 @@ status_t BlobCache::unflatten(void const* buffer, size_t size, int fds[],
     return OK;
 }
 
-long int BlobCache::blob_random() {
-#ifdef _WIN32
-    return rand();
-#else
-    return nrand48(mRandState);
-#endif
-}
-
-void BlobCache::clean() {
-    // Remove a random cache entry until the total cache size gets below half
-    // the maximum total cache size.
-    while (mTotalSize > mMaxTotalSize / 2) {
-        size_t i = size_t(blob_random() % (mCacheEntries.size()));
-        const CacheEntry& entry(mCacheEntries[i]);
-        mTotalSize -= entry.getKey()->getSize() + entry.getValue()->getSize();
-        mCacheEntries.removeAt(i);
+uint32_t BlobCache::hashKey(const void* key, size_t keySize) {
+    // FNV-1a
+    const uint8_t* bytes = static_cast<const uint8_t*>(key);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < keySize; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
     }
+    return hash;
 }
 
-bool BlobCache::isCleanable() const {
-    return mTotalSize > mMaxTotalSize / 2;
-}
-
-BlobCache::Blob::Blob(const void* data, size_t size, bool copyData):
-        mData(copyData ? malloc(size) : data),
-        mSize(size),
-        mOwnsData(copyData) {
-    if (data != NULL && copyData) {
-        memcpy(const_cast<void*>(mData), data, size);
+BlobCache::Entry* BlobCache::find(const void* key, size_t keySize,
+        uint32_t hash) const {
+    if (mBuckets == NULL) {
+        return NULL;
     }
-}
-
-BlobCache::Blob::~Blob() {
-    if (mOwnsData) {
-        free(const_cast<void*>(mData));
+    for (Entry* e = mBuckets[hash & (mBucketCount - 1)]; e; e = e->mHashNext) {
+        if (e->mHash == hash && e->mKeySize == keySize &&
+                !memcmp(e->mKey, key, keySize)) {
+            return e;
+        }
     }
+    return NULL;
 }
 
-bool BlobCache::Blob::operator<(const Blob& rhs) const {
-    if (mSize == rhs.mSize) {
-        return memcmp(mData, rhs.mData, mSize) < 0;
+void BlobCache::link(Entry* e) {
+    if (mNumEntries >= mBucketCount) {
+        grow();
+    }
+    Entry** bucket = &mBuckets[e->mHash & (mBucketCount - 1)];
+    e->mHashNext = *bucket;
+    *bucket = e;
+
+    e->mOlder = mNewest;
+    e->mNewer = NULL;
+    if (mNewest) {
+        mNewest->mNewer = e;
     } else {
-        return mSize < rhs.mSize;
+        mOldest = e;
     }
+    mNewest = e;
+    mNumEntries++;
 }
 
-const void* BlobCache::Blob::getData() const {
-    return mData;
-}
-
-size_t BlobCache::Blob::getSize() const {
-    return mSize;
-}
-
-BlobCache::CacheEntry::CacheEntry() {
-}
+void BlobCache::unlink(Entry* e) {
+    Entry** p = &mBuckets[e->mHash & (mBucketCount - 1)];
+    while (*p != e) {
+        p = &(*p)->mHashNext;
+    }
+    *p = e->mHashNext;
 
-BlobCache::CacheEntry::CacheEntry(const sp<Blob>& key, const sp<Blob>& value):
-        mKey(key),
-        mValue(value) {
+    if (e->mOlder) {
+        e->mOlder->mNewer = e->mNewer;
+    } else {
+        mOldest = e->mNewer;
+    }
+    if (e->mNewer) {
+        e->mNewer->mOlder = e->mOlder;
+    } else {
+        mNewest = e->mOlder;
+    }
+    mNumEntries--;
 }
 
-BlobCache::CacheEntry::CacheEntry(const CacheEntry& ce):
-        mKey(ce.mKey),
-        mValue(ce.mValue) {
+void BlobCache::touch(Entry* e) {
+    if (e == mNewest) {
+        return;
+    }
+    // Move 'e' to the newest end of the list; its bucket is unchanged.
+    if (e->mOlder) {
+        e->mOlder->mNewer = e->mNewer;
+    } else {
+        mOldest = e->mNewer;
+    }
+    e->mNewer->mOlder = e->mOlder;
+    e->mOlder = mNewest;
+    e->mNewer = NULL;
+    mNewest->mNewer = e;
+    mNewest = e;
 }
 
-bool BlobCache::CacheEntry::operator<(const CacheEntry& rhs) const {
-    return *mKey < *rhs.mKey;
+void BlobCache::removeEntry(Entry* e) {
+    unlink(e);
+    mTotalSize -= e->mKeySize + e->mValueSize;
+    if (e->isMapped()) {
+        mMappedSize -= e->mKeySize + e->mValueSize;
+    }
+    free(e);
 }
 
-const BlobCache::CacheEntry& BlobCache::CacheEntry::operator=(const CacheEntry& rhs) {
-    mKey = rhs.mKey;
-    mValue = rhs.mValue;
-    return *this;
+void BlobCache::removeAll() {
+    Entry* e = mOldest;
+    while (e) {
+        Entry* next = e->mNewer;
+        free(e);
+        e = next;
+    }
+    if (mBuckets) {
+        memset(mBuckets, 0, mBucketCount * sizeof(Entry*));
+    }
+    mNumEntries = 0;
+    mOldest = mNewest = NULL;
+    mTotalSize = 0;
+    mMappedSize = 0;
+    if (mMap) {
+        mMap->release();
+        mMap = NULL;
+    }
 }
 
-sp<BlobCache::Blob> BlobCache::CacheEntry::getKey() const {
-    return mKey;
+void BlobCache::grow() {
+    size_t count = mBucketCount ? mBucketCount * 2 : initialBucketCount;
+    Entry** buckets = static_cast<Entry**>(calloc(count, sizeof(Entry*)));
+    if (buckets == NULL) {
+        // Keep using the current table; chains just get longer.
+        if (mBuckets) {
+            return;
+        }
+        LOG_ALWAYS_FATAL("BlobCache: unable to allocate hash buckets");
+    }
+    for (Entry* e = mOldest; e; e = e->mNewer) {
+        Entry** bucket = &buckets[e->mHash & (count - 1)];
+        e->mHashNext = *bucket;
+        *bucket = e;
+    }
+    free(mBuckets);
+    mBuckets = buckets;
+    mBucketCount = count;
 }
 
-sp<BlobCache::Blob> BlobCache::CacheEntry::getValue() const {
-    return mValue;
+void BlobCache::clean() {
+    // Remove the least recently used entries until the total cache size gets
+    // below half the maximum total cache size.
+    while (mTotalSize > mMaxTotalSize / 2 && mOldest) {
+        Entry* e = mOldest;
+        mStats.evictions++;
+        mStats.evictedBytes += e->mKeySize + e->mValueSize;
+        removeEntry(e);
+    }
+    if (mMappedSize == 0 && mMap) {
+        mMap->release();
+        mMap = NULL;
+    }
 }
 
-void BlobCache::CacheEntry::setValue(const sp<Blob>& value) {
-    mValue = value;
+bool BlobCache::isCleanable() const {
+    return mTotalSize > mMaxTotalSize / 2;
 }
 
 } // namespace android
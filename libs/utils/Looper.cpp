@@ -13,6 +13,7 @@
 // Debugs callback registration and invocation.
 #define DEBUG_CALLBACKS 0
 
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 #include <utils/Looper.h>
 #include <utils/Timers.h>
@@ -20,6 +21,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 
 namespace android {
@@ -67,39 +70,31 @@ static pthread_once_t gTLSOnce = PTHREAD_ONCE_INIT;
 static pthread_key_t gTLSKey = 0;
 
 Looper::Looper(bool allowNonCallbacks) :
-        mAllowNonCallbacks(allowNonCallbacks), mSendingMessage(false),
+        mAllowNonCallbacks(allowNonCallbacks), mWakePending(0), mTimerFd(-1),
+        mFreeEnvelope(-1), mNextMessageSeq(0), mTimerUptime(LLONG_MAX), mSendingMessage(false),
+        mRequestCount(0),
         mResponseIndex(0), mNextMessageUptime(LLONG_MAX) {
-    int wakeFds[2];
-    int result = pipe(wakeFds);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not create wake pipe.  errno=%d", errno);
+    mWakeEventFd = eventfd(0, EFD_NONBLOCK);
+    LOG_ALWAYS_FATAL_IF(mWakeEventFd < 0, "Could not create wake event fd.  errno=%d", errno);
 
-    mWakeReadPipeFd = wakeFds[0];
-    mWakeWritePipeFd = wakeFds[1];
-
-    result = fcntl(mWakeReadPipeFd, F_SETFL, O_NONBLOCK);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake read pipe non-blocking.  errno=%d",
-            errno);
-
-    result = fcntl(mWakeWritePipeFd, F_SETFL, O_NONBLOCK);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake write pipe non-blocking.  errno=%d",
-            errno);
-
-    // Allocate the epoll instance and register the wake pipe.
+    // Allocate the epoll instance and register the wake event fd.
     mEpollFd = epoll_create(EPOLL_SIZE_HINT);
     LOG_ALWAYS_FATAL_IF(mEpollFd < 0, "Could not create epoll instance.  errno=%d", errno);
 
     struct epoll_event eventItem;
     memset(& eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
     eventItem.events = EPOLLIN;
-    eventItem.data.fd = mWakeReadPipeFd;
-    result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeReadPipeFd, & eventItem);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake read pipe to epoll instance.  errno=%d",
+    eventItem.data.fd = mWakeEventFd;
+    int result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeEventFd, & eventItem);
+    LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake event fd to epoll instance.  errno=%d",
             errno);
 }
 
 Looper::~Looper() {
-    close(mWakeReadPipeFd);
-    close(mWakeWritePipeFd);
+    close(mWakeEventFd);
+    if (mTimerFd >= 0) {
+        close(mTimerFd);
+    }
     close(mEpollFd);
 }
 
@@ -154,6 +149,35 @@ bool Looper::getAllowNonCallbacks() const {
     return mAllowNonCallbacks;
 }
 
+bool Looper::enableMessageTimer() {
+    AutoMutex _l(mLock);
+
+    if (mTimerFd >= 0) {
+        return true;
+    }
+
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timerFd < 0) {
+        ALOGW("Could not create message timer.  errno=%d", errno);
+        return false;
+    }
+
+    struct epoll_event eventItem;
+    memset(& eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
+    eventItem.events = EPOLLIN;
+    eventItem.data.fd = timerFd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, timerFd, & eventItem) != 0) {
+        ALOGW("Could not add message timer to epoll instance.  errno=%d", errno);
+        close(timerFd);
+        return false;
+    }
+
+    mTimerFd = timerFd;
+    mTimerUptime = LLONG_MAX;
+    updateTimerLocked();
+    return true;
+}
+
 int Looper::pollOnce(int timeoutMillis, int* outFd, int* outEvents, void** outData) {
     int result = 0;
     for (;;) {
@@ -196,7 +220,8 @@ int Looper::pollInner(int timeoutMillis) {
 #endif
 
     // Adjust the timeout based on when the next message is due.
-    if (timeoutMillis != 0 && mNextMessageUptime != LLONG_MAX) {
+    // Not needed when the message timer is armed since it wakes the poll by itself.
+    if (mTimerFd < 0 && timeoutMillis != 0 && mNextMessageUptime != LLONG_MAX) {
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
         int messageTimeoutMillis = toMillisecondTimeoutDelay(now, mNextMessageUptime);
         if (messageTimeoutMillis >= 0
@@ -247,21 +272,28 @@ int Looper::pollInner(int timeoutMillis) {
     for (int i = 0; i < eventCount; i++) {
         int fd = eventItems[i].data.fd;
         uint32_t epollEvents = eventItems[i].events;
-        if (fd == mWakeReadPipeFd) {
+        if (fd == mWakeEventFd) {
             if (epollEvents & EPOLLIN) {
                 awoken();
             } else {
-                ALOGW("Ignoring unexpected epoll events 0x%x on wake read pipe.", epollEvents);
+                ALOGW("Ignoring unexpected epoll events 0x%x on wake event fd.", epollEvents);
+            }
+        } else if (fd == mTimerFd) {
+            if (epollEvents & EPOLLIN) {
+                drainTimer();
+            } else {
+                ALOGW("Ignoring unexpected epoll events 0x%x on message timer.", epollEvents);
             }
         } else {
-            ssize_t requestIndex = mRequests.indexOfKey(fd);
-            if (requestIndex >= 0) {
+            Request* request = getRequestLocked(fd);
+            if (request) {
                 int events = 0;
                 if (epollEvents & EPOLLIN) events |= ALOOPER_EVENT_INPUT;
                 if (epollEvents & EPOLLOUT) events |= ALOOPER_EVENT_OUTPUT;
                 if (epollEvents & EPOLLERR) events |= ALOOPER_EVENT_ERROR;
                 if (epollEvents & EPOLLHUP) events |= ALOOPER_EVENT_HANGUP;
-                pushResponse(events, mRequests.valueAt(requestIndex));
+                request->eventCount += 1;
+                pushResponse(events, *request);
             } else {
                 ALOGW("Ignoring unexpected epoll events 0x%x on fd %d that is "
                         "no longer registered.", epollEvents, fd);
@@ -272,9 +304,10 @@ Done: ;
 
     // Invoke pending message callbacks.
     mNextMessageUptime = LLONG_MAX;
-    while (mMessageEnvelopes.size() != 0) {
+    while (mMessageHeap.size() != 0) {
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-        const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(0);
+        size_t slot = mMessageHeap.itemAt(0);
+        const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(slot);
         if (messageEnvelope.uptime <= now) {
             // Remove the envelope from the list.
             // We keep a strong reference to the handler until the call to handleMessage
@@ -283,7 +316,7 @@ Done: ;
             { // obtain handler
                 sp<MessageHandler> handler = messageEnvelope.handler;
                 Message message = messageEnvelope.message;
-                mMessageEnvelopes.removeAt(0);
+                removeMessageLocked(slot);
                 mSendingMessage = true;
                 mLock.unlock();
 
@@ -304,10 +337,17 @@ Done: ;
         }
     }
 
+    // Arm the message timer for whatever is now at the head of the queue.
+    updateTimerLocked();
+
     // Release lock.
     mLock.unlock();
 
     // Invoke all response callbacks.
+    // Callbacks that asked to be unregistered are collected and removed together
+    // afterwards so that the lock is only taken once for the whole batch.
+    size_t removals[EPOLL_MAX_EVENTS];
+    size_t removalCount = 0;
     for (size_t i = 0; i < mResponses.size(); i++) {
         Response& response = mResponses.editItemAt(i);
         if (response.request.ident == ALOOPER_POLL_CALLBACK) {
@@ -320,14 +360,35 @@ Done: ;
 #endif
             int callbackResult = response.request.callback->handleEvent(fd, events, data);
             if (callbackResult == 0) {
-                removeFd(fd);
+                removals[removalCount++] = i;
+            } else {
+                // Clear the callback reference in the response structure promptly because we
+                // will not clear the response vector itself until the next poll.
+                response.request.callback.clear();
             }
-            // Clear the callback reference in the response structure promptly because we
-            // will not clear the response vector itself until the next poll.
-            response.request.callback.clear();
             result = ALOOPER_POLL_CALLBACK;
         }
     }
+
+    if (removalCount != 0) {
+        { // acquire lock
+            AutoMutex _l(mLock);
+            for (size_t i = 0; i < removalCount; i++) {
+                const Request& request = mResponses.itemAt(removals[i]).request;
+                // Skip fds that a later callback already removed or registered anew.
+                const Request* current = getRequestLocked(request.fd);
+                if (current && current->callback == request.callback) {
+                    removeFdLocked(request.fd);
+                }
+            }
+        } // release lock
+
+        // Release the callbacks outside of the lock since their destructors may call
+        // back into the looper.
+        for (size_t i = 0; i < removalCount; i++) {
+            mResponses.editItemAt(removals[i]).request.callback.clear();
+        }
+    }
     return result;
 }
 
@@ -362,14 +423,26 @@ void Looper::wake() {
     ALOGD("%p ~ wake", this);
 #endif
 
+    // Coalesce wakes: if one is already signalled and the poll loop has not consumed
+    // it yet, the loop is guaranteed to wake up anyway so skip the system call.
+    // The barrier orders whatever the caller published before the check; it
+    // pairs with the one in awoken().
+    android_memory_barrier();
+    if (android_atomic_acquire_cas(0, 1, &mWakePending) != 0) {
+        return;
+    }
+
+    uint64_t inc = 1;
     ssize_t nWrite;
     do {
-        nWrite = write(mWakeWritePipeFd, "W", 1);
+        nWrite = write(mWakeEventFd, &inc, sizeof(uint64_t));
     } while (nWrite == -1 && errno == EINTR);
 
-    if (nWrite != 1) {
+    if (nWrite != sizeof(uint64_t)) {
         if (errno != EAGAIN) {
             ALOGW("Could not write wake signal, errno=%d", errno);
+            // nothing was signalled, so let the next wake try again
+            android_atomic_release_store(0, &mWakePending);
         }
     }
 }
@@ -379,11 +452,67 @@ void Looper::awoken() {
     ALOGD("%p ~ awoken", this);
 #endif
 
-    char buffer[16];
+    uint64_t counter;
     ssize_t nRead;
     do {
-        nRead = read(mWakeReadPipeFd, buffer, sizeof(buffer));
-    } while ((nRead == -1 && errno == EINTR) || nRead == sizeof(buffer));
+        nRead = read(mWakeEventFd, &counter, sizeof(uint64_t));
+    } while (nRead == -1 && errno == EINTR);
+
+    // Only allow new wakes through once the counter has been drained, otherwise
+    // a wake signalled in between could be consumed by the read above and lost.
+    // The barrier keeps the loop from reading state the wakers publish before
+    // the flag is clear: a waker that still saw it set has published by then.
+    android_atomic_release_store(0, &mWakePending);
+    android_memory_barrier();
+}
+
+void Looper::drainTimer() {
+#if DEBUG_POLL_AND_WAKE
+    ALOGD("%p ~ drainTimer", this);
+#endif
+
+    uint64_t expirations;
+    ssize_t nRead;
+    do {
+        nRead = read(mTimerFd, &expirations, sizeof(expirations));
+    } while (nRead == -1 && errno == EINTR);
+
+    // A one-shot timer is disarmed once it expires.
+    mTimerUptime = LLONG_MAX;
+}
+
+void Looper::updateTimerLocked() {
+    if (mTimerFd < 0) {
+        return;
+    }
+
+    nsecs_t uptime = LLONG_MAX;
+    if (mMessageHeap.size() != 0) {
+        uptime = mMessageEnvelopes.itemAt(mMessageHeap.itemAt(0)).uptime;
+    }
+    if (uptime == mTimerUptime) {
+        return;
+    }
+
+    // An all-zero it_value disarms the timer so clamp past deadlines to 1ns,
+    // which has already expired and therefore fires immediately.
+    struct itimerspec spec;
+    memset(& spec, 0, sizeof(spec));
+    if (uptime != LLONG_MAX) {
+        nsecs_t deadline = uptime > 0 ? uptime : 1;
+        spec.it_value.tv_sec = deadline / 1000000000LL;
+        spec.it_value.tv_nsec = deadline % 1000000000LL;
+    }
+
+#if DEBUG_POLL_AND_WAKE
+    ALOGD("%p ~ updateTimerLocked - uptime=%lld", this, uptime);
+#endif
+
+    if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, & spec, NULL) != 0) {
+        ALOGW("Could not arm message timer, errno=%d", errno);
+        return;
+    }
+    mTimerUptime = uptime;
 }
 
 void Looper::pushResponse(int events, const Request& request) {
@@ -427,6 +556,7 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
         Request request;
         request.fd = fd;
         request.ident = ident;
+        request.events = events;
         request.callback = callback;
         request.data = data;
 
@@ -435,22 +565,24 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
         eventItem.events = epollEvents;
         eventItem.data.fd = fd;
 
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
-        if (requestIndex < 0) {
+        if (!getRequestLocked(fd)) {
             int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, & eventItem);
             if (epollResult < 0) {
                 ALOGE("Error adding epoll events for fd %d, errno=%d", fd, errno);
                 return -1;
             }
-            mRequests.add(fd, request);
+            if (size_t(fd) >= mRequests.size()) {
+                mRequests.insertAt(Request(), mRequests.size(), fd + 1 - mRequests.size());
+            }
+            mRequestCount += 1;
         } else {
             int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, & eventItem);
             if (epollResult < 0) {
                 ALOGE("Error modifying epoll events for fd %d, errno=%d", fd, errno);
                 return -1;
             }
-            mRequests.replaceValueAt(requestIndex, request);
         }
+        mRequests.editItemAt(fd) = request;
     } // release lock
     return 1;
 }
@@ -460,24 +592,64 @@ int Looper::removeFd(int fd) {
     ALOGD("%p ~ removeFd - fd=%d", this, fd);
 #endif
 
-    { // acquire lock
-        AutoMutex _l(mLock);
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
-        if (requestIndex < 0) {
-            return 0;
-        }
+    AutoMutex _l(mLock);
+    if (!getRequestLocked(fd)) {
+        return 0;
+    }
+    return removeFdLocked(fd);
+}
 
-        int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
-        if (epollResult < 0) {
-            ALOGE("Error removing epoll events for fd %d, errno=%d", fd, errno);
-            return -1;
-        }
+int Looper::removeFdLocked(int fd) {
+    int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
+    if (epollResult < 0) {
+        ALOGE("Error removing epoll events for fd %d, errno=%d", fd, errno);
+        return -1;
+    }
 
-        mRequests.removeItemsAt(requestIndex);
-    } // release lock
+    mRequests.editItemAt(fd) = Request();
+    mRequestCount -= 1;
+
+    // Trim unused slots off the end of the table.
+    size_t size = mRequests.size();
+    while (size != 0 && mRequests.itemAt(size - 1).fd < 0) {
+        size -= 1;
+    }
+    if (size != mRequests.size()) {
+        mRequests.removeItemsAt(size, mRequests.size() - size);
+    }
     return 1;
 }
 
+Looper::Request* Looper::getRequestLocked(int fd) {
+    if (fd < 0 || size_t(fd) >= mRequests.size()) {
+        return NULL;
+    }
+    Request& request = mRequests.editItemAt(fd);
+    return request.fd == fd ? &request : NULL;
+}
+
+void Looper::dump(String8& result) {
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+
+    AutoMutex _l(mLock);
+
+    snprintf(buffer, SIZE, "Looper %p: %d fds registered, %d messages pending\n",
+            this, int(mRequestCount), int(mMessageHeap.size()));
+    result.append(buffer);
+    for (size_t i = 0; i < mRequests.size(); i++) {
+        const Request& request = mRequests.itemAt(i);
+        if (request.fd < 0) {
+            continue;
+        }
+        snprintf(buffer, SIZE, "  fd=%d: ident=%d, events=0x%x, callback=%p, data=%p, "
+                "eventCount=%u\n",
+                request.fd, request.ident, request.events, request.callback.get(),
+                request.data, request.eventCount);
+        result.append(buffer);
+    }
+}
+
 void Looper::sendMessage(const sp<MessageHandler>& handler, const Message& message) {
     nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
     sendMessageAtTime(now, handler, message);
@@ -496,17 +668,11 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
             this, uptime, handler.get(), message.what);
 #endif
 
-    size_t i = 0;
+    bool atHead;
     { // acquire lock
         AutoMutex _l(mLock);
 
-        size_t messageCount = mMessageEnvelopes.size();
-        while (i < messageCount && uptime >= mMessageEnvelopes.itemAt(i).uptime) {
-            i += 1;
-        }
-
-        MessageEnvelope messageEnvelope(uptime, handler, message);
-        mMessageEnvelopes.insertAt(messageEnvelope, i, 1);
+        size_t slot = enqueueMessageLocked(uptime, handler, message);
 
         // Optimization: If the Looper is currently sending a message, then we can skip
         // the call to wake() because the next thing the Looper will do after processing
@@ -515,10 +681,21 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
         if (mSendingMessage) {
             return;
         }
+
+        atHead = mMessageHeap.itemAt(0) == slot;
+
+        // With a message timer there is no need to wake the poll loop at all,
+        // rearming the timer is enough for epoll to notice the new deadline.
+        if (mTimerFd >= 0) {
+            if (atHead) {
+                updateTimerLocked();
+            }
+            return;
+        }
     } // release lock
 
     // Wake the poll loop only when we enqueue a new message at the head.
-    if (i == 0) {
+    if (atHead) {
         wake();
     }
 }
@@ -531,11 +708,20 @@ void Looper::removeMessages(const sp<MessageHandler>& handler) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler) {
-                mMessageEnvelopes.removeAt(i);
-            }
+        ssize_t handlerIndex = mMessageHandlers.indexOfKey(handler.get());
+        if (handlerIndex < 0) {
+            return;
+        }
+
+        ssize_t slot = mMessageHandlers.valueAt(handlerIndex);
+        while (slot >= 0) {
+            ssize_t next = mMessageEnvelopes.itemAt(slot).nextForHandler;
+            removeMessageLocked(slot);
+            slot = next;
+        }
+
+        if (!mSendingMessage) {
+            updateTimerLocked();
         }
     } // release lock
 }
@@ -548,14 +734,162 @@ void Looper::removeMessages(const sp<MessageHandler>& handler, int what) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler
-                    && messageEnvelope.message.what == what) {
-                mMessageEnvelopes.removeAt(i);
+        ssize_t handlerIndex = mMessageHandlers.indexOfKey(handler.get());
+        if (handlerIndex < 0) {
+            return;
+        }
+
+        ssize_t slot = mMessageHandlers.valueAt(handlerIndex);
+        while (slot >= 0) {
+            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(slot);
+            ssize_t next = messageEnvelope.nextForHandler;
+            if (messageEnvelope.message.what == what) {
+                removeMessageLocked(slot);
             }
+            slot = next;
+        }
+
+        if (!mSendingMessage) {
+            updateTimerLocked();
         }
     } // release lock
 }
 
+size_t Looper::enqueueMessageLocked(nsecs_t uptime, const sp<MessageHandler>& handler,
+        const Message& message) {
+    size_t slot;
+    if (mFreeEnvelope >= 0) {
+        slot = mFreeEnvelope;
+        mFreeEnvelope = mMessageEnvelopes.itemAt(slot).nextForHandler;
+    } else {
+        slot = mMessageEnvelopes.add();
+    }
+
+    MessageEnvelope& messageEnvelope = mMessageEnvelopes.editItemAt(slot);
+    messageEnvelope.uptime = uptime;
+    messageEnvelope.seq = mNextMessageSeq++;
+    messageEnvelope.handler = handler;
+    messageEnvelope.message = message;
+
+    // Link the envelope at the front of the handler's list.
+    messageEnvelope.prevForHandler = -1;
+    ssize_t handlerIndex = mMessageHandlers.indexOfKey(handler.get());
+    if (handlerIndex >= 0) {
+        ssize_t first = mMessageHandlers.valueAt(handlerIndex);
+        messageEnvelope.nextForHandler = first;
+        mMessageEnvelopes.editItemAt(first).prevForHandler = slot;
+        mMessageHandlers.replaceValueAt(handlerIndex, slot);
+    } else {
+        messageEnvelope.nextForHandler = -1;
+        mMessageHandlers.add(handler.get(), slot);
+    }
+
+    size_t heapIndex = mMessageHeap.add(slot);
+    messageEnvelope.heapIndex = heapIndex;
+    siftUpLocked(heapIndex);
+    return slot;
+}
+
+void Looper::removeMessageLocked(size_t slot) {
+    MessageEnvelope& messageEnvelope = mMessageEnvelopes.editItemAt(slot);
+
+    // Fill the hole in the heap with the last element and restore the heap order.
+    size_t heapIndex = messageEnvelope.heapIndex;
+    size_t lastIndex = mMessageHeap.size() - 1;
+    if (heapIndex != lastIndex) {
+        size_t lastSlot = mMessageHeap.itemAt(lastIndex);
+        setHeapSlotLocked(heapIndex, lastSlot);
+        mMessageHeap.removeAt(lastIndex);
+        if (heapIndex > 0
+                && messageBeforeLocked(lastSlot, mMessageHeap.itemAt((heapIndex - 1) / 2))) {
+            siftUpLocked(heapIndex);
+        } else {
+            siftDownLocked(heapIndex);
+        }
+    } else {
+        mMessageHeap.removeAt(lastIndex);
+    }
+
+    // Unlink the envelope from the handler's list.
+    ssize_t prev = messageEnvelope.prevForHandler;
+    ssize_t next = messageEnvelope.nextForHandler;
+    if (prev >= 0) {
+        mMessageEnvelopes.editItemAt(prev).nextForHandler = next;
+    } else {
+        ssize_t handlerIndex = mMessageHandlers.indexOfKey(messageEnvelope.handler.get());
+        if (next >= 0) {
+            mMessageHandlers.replaceValueAt(handlerIndex, next);
+        } else {
+            mMessageHandlers.removeItemsAt(handlerIndex);
+        }
+    }
+    if (next >= 0) {
+        mMessageEnvelopes.editItemAt(next).prevForHandler = prev;
+    }
+
+    if (mMessageHeap.size() == 0) {
+        // Nothing left, release the slot storage as well.
+        mMessageEnvelopes.clear();
+        mFreeEnvelope = -1;
+        return;
+    }
+
+    // Put the slot on the free list.
+    messageEnvelope.handler.clear();
+    messageEnvelope.heapIndex = -1;
+    messageEnvelope.prevForHandler = -1;
+    messageEnvelope.nextForHandler = mFreeEnvelope;
+    mFreeEnvelope = slot;
+}
+
+bool Looper::messageBeforeLocked(size_t slotA, size_t slotB) const {
+    const MessageEnvelope& a = mMessageEnvelopes.itemAt(slotA);
+    const MessageEnvelope& b = mMessageEnvelopes.itemAt(slotB);
+    return a.uptime < b.uptime || (a.uptime == b.uptime && a.seq < b.seq);
+}
+
+void Looper::setHeapSlotLocked(size_t heapIndex, size_t slot) {
+    mMessageHeap.editItemAt(heapIndex) = slot;
+    mMessageEnvelopes.editItemAt(slot).heapIndex = heapIndex;
+}
+
+void Looper::siftUpLocked(size_t heapIndex) {
+    size_t slot = mMessageHeap.itemAt(heapIndex);
+    while (heapIndex > 0) {
+        size_t parentIndex = (heapIndex - 1) / 2;
+        size_t parentSlot = mMessageHeap.itemAt(parentIndex);
+        if (!messageBeforeLocked(slot, parentSlot)) {
+            break;
+        }
+        setHeapSlotLocked(heapIndex, parentSlot);
+        heapIndex = parentIndex;
+    }
+    setHeapSlotLocked(heapIndex, slot);
+}
+
+void Looper::siftDownLocked(size_t heapIndex) {
+    size_t size = mMessageHeap.size();
+    size_t slot = mMessageHeap.itemAt(heapIndex);
+    for (;;) {
+        size_t childIndex = heapIndex * 2 + 1;
+        if (childIndex >= size) {
+            break;
+        }
+        size_t childSlot = mMessageHeap.itemAt(childIndex);
+        if (childIndex + 1 < size) {
+            size_t rightSlot = mMessageHeap.itemAt(childIndex + 1);
+            if (messageBeforeLocked(rightSlot, childSlot)) {
+                childIndex += 1;
+                childSlot = rightSlot;
+            }
+        }
+        if (!messageBeforeLocked(childSlot, slot)) {
+            break;
+        }
+        setHeapSlotLocked(heapIndex, childSlot);
+        heapIndex = childIndex;
+    }
+    setHeapSlotLocked(heapIndex, slot);
+}
+
 } // namespace android
@@ -40,18 +40,9 @@ namespace android {
 // to OS_PATH_SEPARATOR.
 #define RES_PATH_SEPARATOR '/'
 
-static SharedBuffer* gEmptyStringBuf = NULL;
-static char* gEmptyString = NULL;
-
 extern int gDarwinCantLoadAllObjects;
 int gDarwinIsReallyAnnoying;
 
-static inline char* getEmptyString()
-{
-    gEmptyStringBuf->acquire();
-    return gEmptyString;
-}
-
 void initialize_string8()
 {
     // HACK: This dummy dependency forces linking libutils Static.cpp,
@@ -59,140 +50,214 @@ void initialize_string8()
     // These variables are named for Darwin, but are needed elsewhere too,
     // including static linking on any platform.
     gDarwinIsReallyAnnoying = gDarwinCantLoadAllObjects;
-
-    SharedBuffer* buf = SharedBuffer::alloc(1);
-    char* str = (char*)buf->data();
-    *str = 0;
-    gEmptyStringBuf = buf;
-    gEmptyString = str;
 }
 
 void terminate_string8()
 {
-    SharedBuffer::bufferFromData(gEmptyString)->release();
-    gEmptyStringBuf = NULL;
-    gEmptyString = NULL;
 }
 
 // ---------------------------------------------------------------------------
 
-static char* allocFromUTF8(const char* in, size_t len)
+// Capacity for a string that grows from length to at least newLength, with
+// room for it to grow by half again before the next reallocation.
+static inline size_t grownCapacity(size_t length, size_t newLength)
 {
-    if (len > 0) {
-        SharedBuffer* buf = SharedBuffer::alloc(len+1);
-        ALOG_ASSERT(buf, "Unable to allocate shared buffer");
-        if (buf) {
-            char* str = (char*)buf->data();
-            memcpy(str, in, len);
-            str[len] = 0;
-            return str;
+    const size_t grown = length + length/2;
+    return grown > newLength ? grown : newLength;
+}
+
+void String8::release()
+{
+    if (isHeap()) {
+        SharedBuffer::bufferFromData(mHeap.data)->release();
+    }
+}
+
+void String8::setLength(size_t length)
+{
+    if (isHeap()) {
+        mHeap.length = length;
+        mHeap.data[length] = 0;
+    } else {
+        mInline[length] = 0;
+        mInline[INLINE_SIZE-1] = char(INLINE_CAPACITY - length);
+    }
+}
+
+/*
+ * Sets up an empty string to hold length bytes, and returns where to put
+ * them, already terminated, or NULL if out of memory.
+ */
+char* String8::initStorage(size_t length)
+{
+    if (length <= INLINE_CAPACITY) {
+        setLength(length);
+        return mInline;
+    }
+    SharedBuffer* buf = SharedBuffer::alloc(length+1);
+    ALOG_ASSERT(buf, "Unable to allocate shared buffer");
+    if (!buf) {
+        return NULL;
+    }
+    mHeap.data = (char*)buf->data();
+    mInline[INLINE_SIZE-1] = char(HEAP_TAG);
+    setLength(length);
+    return mHeap.data;
+}
+
+/*
+ * Makes sure this string can be modified in place and has room for at
+ * least capacity bytes, keeping its contents. If it has to be reallocated
+ * and grow is set, leaves room to grow some more. Returns the characters,
+ * or NULL if out of memory.
+ */
+char* String8::editStorage(size_t capacity, bool grow)
+{
+    if (!isHeap()) {
+        if (capacity <= INLINE_CAPACITY) {
+            return mInline;
+        }
+    } else {
+        SharedBuffer* buf = SharedBuffer::bufferFromData(mHeap.data);
+        if (buf->onlyOwner() && buf->size() > capacity) {
+            return mHeap.data;
         }
+    }
+
+    const size_t len = length();
+    if (grow) {
+        capacity = grownCapacity(len, capacity);
+    } else if (capacity < len) {
+        capacity = len;
+    }
+    SharedBuffer* buf = SharedBuffer::alloc(capacity+1);
+    ALOG_ASSERT(buf, "Unable to allocate shared buffer");
+    if (!buf) {
         return NULL;
     }
+    char* str = (char*)buf->data();
+    memcpy(str, string(), len+1);
+    release();
+    mHeap.data = str;
+    mHeap.length = len;
+    mInline[INLINE_SIZE-1] = char(HEAP_TAG);
+    return str;
+}
+
+void String8::swapStorage(String8& other)
+{
+    char tmp[INLINE_SIZE];
+    memcpy(tmp, mInline, INLINE_SIZE);
+    memcpy(mInline, other.mInline, INLINE_SIZE);
+    memcpy(other.mInline, tmp, INLINE_SIZE);
+}
 
-    return getEmptyString();
+bool String8::initFromUTF8(const char* in, size_t len)
+{
+    char* str = initStorage(len);
+    if (!str) {
+        return false;
+    }
+    memcpy(str, in, len);
+    return true;
 }
 
-static char* allocFromUTF16(const char16_t* in, size_t len)
+bool String8::initFromUTF16(const char16_t* in, size_t len)
 {
-    if (len == 0) return getEmptyString();
+    if (len == 0) return true;
 
     const ssize_t bytes = utf16_to_utf8_length(in, len);
     if (bytes < 0) {
-        return getEmptyString();
+        return true;
     }
 
-    SharedBuffer* buf = SharedBuffer::alloc(bytes+1);
-    ALOG_ASSERT(buf, "Unable to allocate shared buffer");
-    if (!buf) {
-        return getEmptyString();
+    char* str = initStorage(bytes);
+    if (!str) {
+        return false;
     }
-
-    char* str = (char*)buf->data();
     utf16_to_utf8(in, len, str);
-    return str;
+    return true;
 }
 
-static char* allocFromUTF32(const char32_t* in, size_t len)
+bool String8::initFromUTF32(const char32_t* in, size_t len)
 {
     if (len == 0) {
-        return getEmptyString();
+        return true;
     }
 
     const ssize_t bytes = utf32_to_utf8_length(in, len);
     if (bytes < 0) {
-        return getEmptyString();
+        return true;
     }
 
-    SharedBuffer* buf = SharedBuffer::alloc(bytes+1);
-    ALOG_ASSERT(buf, "Unable to allocate shared buffer");
-    if (!buf) {
-        return getEmptyString();
+    char* str = initStorage(bytes);
+    if (!str) {
+        return false;
     }
-
-    char* str = (char*) buf->data();
     utf32_to_utf8(in, len, str);
-
-    return str;
+    return true;
 }
 
 // ---------------------------------------------------------------------------
 
 String8::String8()
-    : mString(getEmptyString())
 {
+    initEmpty();
 }
 
 String8::String8(const String8& o)
-    : mString(o.mString)
 {
-    SharedBuffer::bufferFromData(mString)->acquire();
+    memcpy(mInline, o.mInline, INLINE_SIZE);
+    if (isHeap()) {
+        SharedBuffer::bufferFromData(mHeap.data)->acquire();
+    }
 }
 
 String8::String8(const char* o)
-    : mString(allocFromUTF8(o, strlen(o)))
 {
-    if (mString == NULL) {
-        mString = getEmptyString();
-    }
+    initEmpty();
+    initFromUTF8(o, strlen(o));
 }
 
 String8::String8(const char* o, size_t len)
-    : mString(allocFromUTF8(o, len))
 {
-    if (mString == NULL) {
-        mString = getEmptyString();
-    }
+    initEmpty();
+    initFromUTF8(o, len);
 }
 
 String8::String8(const String16& o)
-    : mString(allocFromUTF16(o.string(), o.size()))
 {
+    initEmpty();
+    initFromUTF16(o.string(), o.size());
 }
 
 String8::String8(const char16_t* o)
-    : mString(allocFromUTF16(o, strlen16(o)))
 {
+    initEmpty();
+    initFromUTF16(o, strlen16(o));
 }
 
 String8::String8(const char16_t* o, size_t len)
-    : mString(allocFromUTF16(o, len))
 {
+    initEmpty();
+    initFromUTF16(o, len);
 }
 
 String8::String8(const char32_t* o)
-    : mString(allocFromUTF32(o, strlen32(o)))
 {
+    initEmpty();
+    initFromUTF32(o, strlen32(o));
 }
 
 String8::String8(const char32_t* o, size_t len)
-    : mString(allocFromUTF32(o, len))
 {
+    initEmpty();
+    initFromUTF32(o, len);
 }
 
 String8::~String8()
 {
-    SharedBuffer::bufferFromData(mString)->release();
+    release();
 }
 
 String8 String8::format(const char* fmt, ...)
@@ -214,59 +279,51 @@ String8 String8::formatV(const char* fmt, va_list args)
 }
 
 void String8::clear() {
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = getEmptyString();
+    release();
+    initEmpty();
 }
 
 void String8::setTo(const String8& other)
 {
-    SharedBuffer::bufferFromData(other.mString)->acquire();
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = other.mString;
+    if (this != &other) {
+        if (other.isHeap()) {
+            SharedBuffer::bufferFromData(other.mHeap.data)->acquire();
+        }
+        release();
+        memcpy(mInline, other.mInline, INLINE_SIZE);
+    }
 }
 
+// The new string is built aside and swapped in, since other may point into
+// this one.
+
 status_t String8::setTo(const char* other)
 {
-    const char *newString = allocFromUTF8(other, strlen(other));
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = newString;
-    if (mString) return NO_ERROR;
-
-    mString = getEmptyString();
-    return NO_MEMORY;
+    return setTo(other, strlen(other));
 }
 
 status_t String8::setTo(const char* other, size_t len)
 {
-    const char *newString = allocFromUTF8(other, len);
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = newString;
-    if (mString) return NO_ERROR;
-
-    mString = getEmptyString();
-    return NO_MEMORY;
+    String8 tmp;
+    const bool ok = tmp.initFromUTF8(other, len);
+    swapStorage(tmp);
+    return ok ? NO_ERROR : NO_MEMORY;
 }
 
 status_t String8::setTo(const char16_t* other, size_t len)
 {
-    const char *newString = allocFromUTF16(other, len);
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = newString;
-    if (mString) return NO_ERROR;
-
-    mString = getEmptyString();
-    return NO_MEMORY;
+    String8 tmp;
+    const bool ok = tmp.initFromUTF16(other, len);
+    swapStorage(tmp);
+    return ok ? NO_ERROR : NO_MEMORY;
 }
 
 status_t String8::setTo(const char32_t* other, size_t len)
 {
-    const char *newString = allocFromUTF32(other, len);
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = newString;
-    if (mString) return NO_ERROR;
-
-    mString = getEmptyString();
-    return NO_MEMORY;
+    String8 tmp;
+    const bool ok = tmp.initFromUTF32(other, len);
+    swapStorage(tmp);
+    return ok ? NO_ERROR : NO_MEMORY;
 }
 
 status_t String8::append(const String8& other)
@@ -289,9 +346,7 @@ status_t String8::append(const char* other)
 
 status_t String8::append(const char* other, size_t otherLen)
 {
-    if (bytes() == 0) {
-        return setTo(other, otherLen);
-    } else if (otherLen == 0) {
+    if (otherLen == 0) {
         return NO_ERROR;
     }
 
@@ -311,66 +366,89 @@ status_t String8::appendFormat(const char* fmt, ...)
 
 status_t String8::appendFormatV(const char* fmt, va_list args)
 {
-    int result = NO_ERROR;
-    int n = vsnprintf(NULL, 0, fmt, args);
-    if (n != 0) {
-        size_t oldLength = length();
-        char* buf = lockBuffer(oldLength + n);
-        if (buf) {
-            vsnprintf(buf + oldLength, n + 1, fmt, args);
-        } else {
-            result = NO_MEMORY;
+    const size_t oldLength = length();
+
+    // Format straight into the room left at the end, if there is some
+    // that can be written to, which is most of the time for a string
+    // that is being built up.
+    char* room = NULL;
+    size_t roomSize = 0;
+    if (!isHeap()) {
+        room = mInline + oldLength;
+        roomSize = INLINE_SIZE - oldLength;
+    } else {
+        SharedBuffer* buf = SharedBuffer::bufferFromData(mHeap.data);
+        if (buf->onlyOwner()) {
+            room = mHeap.data + oldLength;
+            roomSize = buf->size() - oldLength;
         }
     }
-    return result;
+
+    va_list copy;
+    va_copy(copy, args);
+    const int n = vsnprintf(room, roomSize, fmt, copy);
+    va_end(copy);
+
+    if (n < 0) {
+        setLength(oldLength);
+        return BAD_VALUE;
+    }
+    if (size_t(n) < roomSize) {
+        setLength(oldLength + n);
+        return NO_ERROR;
+    }
+
+    // didn't fit: make room and format again
+    setLength(oldLength);
+    char* str = editStorage(oldLength + n, true);
+    if (!str) {
+        return NO_MEMORY;
+    }
+    vsnprintf(str + oldLength, n + 1, fmt, args);
+    setLength(oldLength + n);
+    return NO_ERROR;
 }
 
 status_t String8::real_append(const char* other, size_t otherLen)
 {
     const size_t myLen = bytes();
-    
-    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize(myLen+otherLen+1);
-    if (buf) {
-        char* str = (char*)buf->data();
-        mString = str;
-        str += myLen;
-        memcpy(str, other, otherLen);
-        str[otherLen] = '\0';
-        return NO_ERROR;
+    const size_t newLen = myLen + otherLen;
+
+    // other may be a part of this string, which may be about to move
+    const char* str = string();
+    const bool aliased = other >= str && other < str + myLen;
+    const size_t offset = other - str;
+
+    char* buf = editStorage(newLen, true);
+    if (!buf) {
+        return NO_MEMORY;
     }
-    return NO_MEMORY;
+    memcpy(buf + myLen, aliased ? buf + offset : other, otherLen);
+    setLength(newLen);
+    return NO_ERROR;
 }
 
 char* String8::lockBuffer(size_t size)
 {
-    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize(size+1);
+    char* buf = editStorage(size);
     if (buf) {
-        char* str = (char*)buf->data();
-        mString = str;
-        return str;
+        setLength(size);
     }
-    return NULL;
+    return buf;
 }
 
 void String8::unlockBuffer()
 {
-    unlockBuffer(strlen(mString));
+    unlockBuffer(strlen(string()));
 }
 
 status_t String8::unlockBuffer(size_t size)
 {
     if (size != this->size()) {
-        SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-            ->editResize(size+1);
-        if (! buf) {
+        if (!editStorage(size)) {
             return NO_MEMORY;
         }
-
-        char* str = (char*)buf->data();
-        str[size] = 0;
-        mString = str;
+        setLength(size);
     }
 
     return NO_ERROR;
@@ -382,9 +460,9 @@ ssize_t String8::find(const char* other, size_t start) const
     if (start >= len) {
         return -1;
     }
-    const char* s = mString+start;
-    const char* p = strstr(s, other);
-    return p ? p-mString : -1;
+    const char* str = string();
+    const char* p = strstr(str+start, other);
+    return p ? p-str : -1;
 }
 
 void String8::toLower()
@@ -437,17 +515,17 @@ void String8::toUpper(size_t start, size_t length)
 
 size_t String8::getUtf32Length() const
 {
-    return utf8_to_utf32_length(mString, length());
+    return utf8_to_utf32_length(string(), length());
 }
 
 int32_t String8::getUtf32At(size_t index, size_t *next_index) const
 {
-    return utf32_from_utf8_at(mString, length(), index, next_index);
+    return utf32_from_utf8_at(string(), length(), index, next_index);
 }
 
 void String8::getUtf32(char32_t* dst) const
 {
-    utf8_to_utf32(mString, length(), dst);
+    utf8_to_utf32(string(), length(), dst);
 }
 
 TextOutput& operator<<(TextOutput& to, const String8& val)
@@ -482,7 +560,7 @@ void String8::setPathName(const char* name, size_t len)
 String8 String8::getPathLeaf(void) const
 {
     const char* cp;
-    const char*const buf = mString;
+    const char*const buf = string();
 
     cp = strrchr(buf, OS_PATH_SEPARATOR);
     if (cp == NULL)
@@ -494,7 +572,7 @@ String8 String8::getPathLeaf(void) const
 String8 String8::getPathDir(void) const
 {
     const char* cp;
-    const char*const str = mString;
+    const char*const str = string();
 
     cp = strrchr(str, OS_PATH_SEPARATOR);
     if (cp == NULL)
@@ -506,7 +584,7 @@ String8 String8::getPathDir(void) const
 String8 String8::walkPath(String8* outRemains) const
 {
     const char* cp;
-    const char*const str = mString;
+    const char*const str = string();
     const char* buf = str;
 
     cp = strchr(buf, OS_PATH_SEPARATOR);
@@ -530,14 +608,14 @@ String8 String8::walkPath(String8* outRemains) const
 /*
  * Helper function for finding the start of an extension in a pathname.
  *
- * Returns a pointer inside mString, or NULL if no extension was found.
+ * Returns a pointer inside the string, or NULL if no extension was found.
  */
 char* String8::find_extension(void) const
 {
     const char* lastSlash;
     const char* lastDot;
     int extLen;
-    const char* const str = mString;
+    const char* const str = string();
 
     // only look at the filename
     lastSlash = strrchr(str, OS_PATH_SEPARATOR);
@@ -569,7 +647,7 @@ String8 String8::getPathExtension(void) const
 String8 String8::getBasePath(void) const
 {
     char* ext;
-    const char* const str = mString;
+    const char* const str = string();
 
     ext = find_extension();
     if (ext == NULL)
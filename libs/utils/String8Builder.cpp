@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "String8Builder"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utils/Log.h>
+#include <utils/String8Builder.h>
+
+namespace android {
+
+String8Builder::String8Builder()
+    : mFirst(NULL), mLast(NULL), mLength(0)
+{
+}
+
+String8Builder::~String8Builder()
+{
+    clear();
+}
+
+void String8Builder::clear()
+{
+    Chunk* chunk = mFirst;
+    while (chunk) {
+        Chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    mFirst = mLast = NULL;
+    mLength = 0;
+}
+
+String8Builder::Chunk* String8Builder::addChunk(size_t minimumSize)
+{
+    size_t size = mLength;
+    if (size < MIN_CHUNK_SIZE) {
+        size = MIN_CHUNK_SIZE;
+    } else if (size > MAX_CHUNK_SIZE) {
+        size = MAX_CHUNK_SIZE;
+    }
+    if (size < minimumSize) {
+        size = minimumSize;
+    }
+
+    Chunk* chunk = static_cast<Chunk*>(malloc(sizeof(Chunk) + size));
+    ALOG_ASSERT(chunk, "Unable to allocate chunk");
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    if (mLast) {
+        mLast->next = chunk;
+    } else {
+        mFirst = chunk;
+    }
+    mLast = chunk;
+    return chunk;
+}
+
+status_t String8Builder::append(const String8& other)
+{
+    return append(other.string(), other.length());
+}
+
+status_t String8Builder::append(const char* other)
+{
+    return append(other, strlen(other));
+}
+
+status_t String8Builder::append(const char* other, size_t numChars)
+{
+    while (numChars > 0) {
+        Chunk* chunk = mLast;
+        if (!chunk || chunk->used == chunk->size) {
+            chunk = addChunk(numChars);
+            if (!chunk) {
+                return NO_MEMORY;
+            }
+        }
+        size_t n = chunk->size - chunk->used;
+        if (n > numChars) {
+            n = numChars;
+        }
+        memcpy(chunk->data() + chunk->used, other, n);
+        chunk->used += n;
+        mLength += n;
+        other += n;
+        numChars -= n;
+    }
+    return NO_ERROR;
+}
+
+status_t String8Builder::appendFormat(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+
+    status_t result = appendFormatV(fmt, args);
+
+    va_end(args);
+    return result;
+}
+
+status_t String8Builder::appendFormatV(const char* fmt, va_list args)
+{
+    // Formatted pieces are never split across chunks: try what is left of
+    // the last one, and format again into a new one if that was too small.
+    Chunk* chunk = mLast;
+    char* room = chunk ? chunk->data() + chunk->used : NULL;
+    size_t roomSize = chunk ? chunk->size - chunk->used : 0;
+
+    va_list copy;
+    va_copy(copy, args);
+    const int n = vsnprintf(room, roomSize, fmt, copy);
+    va_end(copy);
+
+    if (n < 0) {
+        return BAD_VALUE;
+    }
+    if (size_t(n) >= roomSize) {
+        chunk = addChunk(n + 1);
+        if (!chunk) {
+            return NO_MEMORY;
+        }
+        vsnprintf(chunk->data(), n + 1, fmt, args);
+    }
+    chunk->used += n;
+    mLength += n;
+    return NO_ERROR;
+}
+
+String8 String8Builder::toString() const
+{
+    String8 result;
+    char* buf = result.lockBuffer(mLength);
+    if (!buf) {
+        return result;
+    }
+    for (const Chunk* chunk = mFirst; chunk; chunk = chunk->next) {
+        memcpy(buf, chunk->data(), chunk->used);
+        buf += chunk->used;
+    }
+    result.unlockBuffer(mLength);
+    return result;
+}
+
+}; // namespace android
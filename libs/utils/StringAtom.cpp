@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <cutils/atomic.h>
+#include <utils/StringAtom.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+// The table is a fixed array of chains that atoms are only ever pushed onto,
+// with compare-and-swap, and never taken off again. Readers see either the
+// old head of a chain or a complete new atom in front of it, so they need
+// no lock. Descriptors number in the hundreds, which keeps chains short.
+//
+// The array is plain zero-initialized data, so atoms can be made from
+// static constructors in any order.
+
+struct InternedString {
+    InternedString* next;
+    hash_t hash;
+    String16 string;
+
+    InternedString(hash_t hash, const char16_t* str, size_t len) :
+            next(NULL), hash(hash), string(str, len) { }
+};
+
+enum {
+    BUCKET_COUNT = 256
+};
+
+static InternedString* volatile gBuckets[BUCKET_COUNT];
+
+static inline hash_t hashOf(const char16_t* str, size_t len)
+{
+    return hash_string(reinterpret_cast<const char*>(str), len * sizeof(char16_t));
+}
+
+static inline InternedString* volatile* bucketFor(hash_t hash)
+{
+    // the low bits of FNV-1a mix well enough
+    return &gBuckets[hash & (BUCKET_COUNT - 1)];
+}
+
+static inline InternedString* head(InternedString* volatile* bucket)
+{
+    InternedString* atom = *bucket;
+    android_memory_barrier();
+    return atom;
+}
+
+// Searches a chain from atom up to, not including, end.
+static InternedString* findIn(InternedString* atom, const InternedString* end, hash_t hash,
+        const char16_t* str, size_t len)
+{
+    for (; atom != end; atom = atom->next) {
+        if (atom->hash == hash && atom->string.size() == len
+                && !memcmp(atom->string.string(), str, len * sizeof(char16_t))) {
+            return atom;
+        }
+    }
+    return NULL;
+}
+
+static String16 intern(const char16_t* str, size_t len)
+{
+    if (len == 0) {
+        return String16();
+    }
+
+    const hash_t hash = hashOf(str, len);
+    InternedString* volatile* bucket = bucketFor(hash);
+    InternedString* first = head(bucket);
+    InternedString* found = findIn(first, NULL, hash, str, len);
+    if (found) {
+        return found->string;
+    }
+
+    InternedString* atom = new InternedString(hash, str, len);
+    for (;;) {
+        atom->next = first;
+        // a full barrier, which publishes the atom along with the pointer
+        if (__sync_bool_compare_and_swap(bucket, first, atom)) {
+            return atom->string;
+        }
+        // someone else got there first; they may have added this string
+        InternedString* newFirst = head(bucket);
+        found = findIn(newFirst, first, hash, str, len);
+        if (found) {
+            delete atom;
+            return found->string;
+        }
+        first = newFirst;
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+StringAtom::StringAtom(const String16& str)
+    : mString(intern(str.string(), str.size()))
+{
+}
+
+StringAtom::StringAtom(const char16_t* str, size_t len)
+    : mString(intern(str, len))
+{
+}
+
+StringAtom::StringAtom(const char* str)
+{
+    const String16 str16(str);
+    mString = intern(str16.string(), str16.size());
+}
+
+bool StringAtom::find(const String16& str, StringAtom* outAtom)
+{
+    return find(str.string(), str.size(), outAtom);
+}
+
+bool StringAtom::find(const char16_t* str, size_t len, StringAtom* outAtom)
+{
+    if (len == 0) {
+        outAtom->mString = String16();
+        return true;
+    }
+
+    const hash_t hash = hashOf(str, len);
+    InternedString* found = findIn(head(bucketFor(hash)), NULL, hash, str, len);
+    if (!found) {
+        return false;
+    }
+    outAtom->mString = found->string;
+    return true;
+}
+
+}; // namespace android
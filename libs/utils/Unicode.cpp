@@ -17,6 +17,13 @@
 #include <utils/Unicode.h>
 
 #include <stddef.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #ifdef HAVE_WINSOCK
 # undef  nhtol
@@ -68,6 +75,152 @@ static const char32_t kFirstByteMark[] = {
     0x00000000, 0x00000000, 0x000000C0, 0x000000E0, 0x000000F0
 };
 
+// --------------------------------------------------------------------------
+// ASCII runs
+// --------------------------------------------------------------------------
+
+// Most strings converted here (interface descriptors, service and package
+// names, paths) are mostly or entirely ASCII. The conversions below hand
+// every run of ASCII to these helpers, which go sixteen code units at a
+// time with NEON or SSE2, or two 64-bit words at a time without either,
+// and only handle the other characters one at a time.
+//
+// u8x16 holds sixteen bytes; u8x16_load_utf16() narrows sixteen UTF-16
+// code units with saturation, so that anything past U+007F still has its
+// top bit set (without SIMD, all of them do).
+
+#if defined(__ARM_NEON__)
+typedef uint8x16_t u8x16;
+static inline u8x16 u8x16_load(const uint8_t* p) { return vld1q_u8(p); }
+static inline void u8x16_store(uint8_t* p, u8x16 v) { vst1q_u8(p, v); }
+static inline bool u8x16_is_ascii(u8x16 v) {
+    uint64x2_t w = vreinterpretq_u64_u8(v);
+    return ((vgetq_lane_u64(w, 0) | vgetq_lane_u64(w, 1)) & 0x8080808080808080ULL) == 0;
+}
+static inline u8x16 u8x16_load_utf16(const char16_t* p) {
+    return vcombine_u8(vqmovn_u16(vld1q_u16(p)), vqmovn_u16(vld1q_u16(p + 8)));
+}
+static inline void u8x16_store_utf16(char16_t* p, u8x16 v) {
+    vst1q_u16(p, vmovl_u8(vget_low_u8(v)));
+    vst1q_u16(p + 8, vmovl_u8(vget_high_u8(v)));
+}
+#elif defined(__SSE2__)
+typedef __m128i u8x16;
+static inline u8x16 u8x16_load(const uint8_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+static inline void u8x16_store(uint8_t* p, u8x16 v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+static inline bool u8x16_is_ascii(u8x16 v) { return _mm_movemask_epi8(v) == 0; }
+static inline __m128i u16x8_clamp_to_u8(__m128i v) {
+    // _mm_packus_epi16() saturates signed values, so clamp to 0xFF first
+    return _mm_sub_epi16(v, _mm_subs_epu16(v, _mm_set1_epi16(0xFF)));
+}
+static inline u8x16 u8x16_load_utf16(const char16_t* p) {
+    return _mm_packus_epi16(
+            u16x8_clamp_to_u8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+            u16x8_clamp_to_u8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 8))));
+}
+static inline void u8x16_store_utf16(char16_t* p, u8x16 v) {
+    const __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_unpacklo_epi8(v, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 8), _mm_unpackhi_epi8(v, zero));
+}
+#else
+typedef struct { uint64_t w[2]; } u8x16;
+static inline u8x16 u8x16_load(const uint8_t* p) {
+    u8x16 v;
+    memcpy(v.w, p, 16);
+    return v;
+}
+static inline void u8x16_store(uint8_t* p, u8x16 v) { memcpy(p, v.w, 16); }
+static inline bool u8x16_is_ascii(u8x16 v) {
+    return ((v.w[0] | v.w[1]) & 0x8080808080808080ULL) == 0;
+}
+static inline u8x16 u8x16_load_utf16(const char16_t* p) {
+    // check four code units to a word before narrowing any of them
+    uint64_t w[4];
+    memcpy(w, p, sizeof(w));
+    u8x16 v;
+    if ((w[0] | w[1] | w[2] | w[3]) & 0xFF80FF80FF80FF80ULL) {
+        v.w[0] = v.w[1] = 0x8080808080808080ULL;
+        return v;
+    }
+    uint8_t b[16];
+    for (int i = 0; i < 16; i++) {
+        b[i] = (uint8_t) p[i];
+    }
+    return u8x16_load(b);
+}
+static inline void u8x16_store_utf16(char16_t* p, u8x16 v) {
+    uint8_t b[16];
+    u8x16_store(b, v);
+    for (int i = 0; i < 16; i++) {
+        p[i] = b[i];
+    }
+}
+#endif
+
+// Each returns the length of the run of ASCII at the start of src, having
+// copied it to dst if there is one.
+
+static inline size_t ascii_run_utf8(const uint8_t* src, size_t len)
+{
+    size_t i = 0;
+    while (i + 16 <= len && u8x16_is_ascii(u8x16_load(src + i))) {
+        i += 16;
+    }
+    while (i < len && src[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+static inline size_t ascii_run_utf16(const char16_t* src, size_t len)
+{
+    size_t i = 0;
+    while (i + 16 <= len && u8x16_is_ascii(u8x16_load_utf16(src + i))) {
+        i += 16;
+    }
+    while (i < len && src[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+static inline size_t ascii_utf8_to_utf16(const uint8_t* src, size_t len, char16_t* dst)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        u8x16 v = u8x16_load(src + i);
+        if (!u8x16_is_ascii(v)) {
+            break;
+        }
+        u8x16_store_utf16(dst + i, v);
+    }
+    for (; i < len && src[i] < 0x80; i++) {
+        dst[i] = src[i];
+    }
+    return i;
+}
+
+static inline size_t ascii_utf16_to_utf8(const char16_t* src, size_t len, uint8_t* dst)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        u8x16 v = u8x16_load_utf16(src + i);
+        if (!u8x16_is_ascii(v)) {
+            break;
+        }
+        u8x16_store(dst + i, v);
+    }
+    for (; i < len && src[i] < 0x80; i++) {
+        dst[i] = (uint8_t) src[i];
+    }
+    return i;
+}
+
 // --------------------------------------------------------------------------
 // UTF-32
 // --------------------------------------------------------------------------
@@ -340,6 +493,13 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst)
     const char16_t* const end_utf16 = src + src_len;
     char *cur = dst;
     while (cur_utf16 < end_utf16) {
+        if (*cur_utf16 < 0x80) {
+            const size_t n = ascii_utf16_to_utf8(cur_utf16, end_utf16 - cur_utf16,
+                    (uint8_t*) cur);
+            cur_utf16 += n;
+            cur += n;
+            continue;
+        }
         char32_t utf32;
         // surrogate pairs
         if ((*cur_utf16 & 0xFC00) == 0xD800) {
@@ -362,12 +522,21 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst)
 
 ssize_t utf8_length(const char *src)
 {
-    const char *cur = src;
-    size_t ret = 0;
+    // strlen() is fast, and is all it takes for ASCII
+    const size_t len = strlen(src);
+    size_t ret = ascii_run_utf8((const uint8_t*) src, len);
+    if (ret == len) {
+        return ret;
+    }
+
+    const char *cur = src + ret;
+    const char* const end = src + len;
     while (*cur != '\0') {
-        const char first_char = *cur++;
+        const uint8_t first_char = *cur++;
         if ((first_char & 0x80) == 0) { // ASCII
-            ret += 1;
+            const size_t n = 1 + ascii_run_utf8((const uint8_t*) cur, end - cur);
+            ret += n;
+            cur += n - 1;
             continue;
         }
         // (UTF-8's character must not be like 10xxxxxx,
@@ -412,6 +581,12 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
     size_t ret = 0;
     const char16_t* const end = src + src_len;
     while (src < end) {
+        if (*src < 0x80) {
+            const size_t n = ascii_run_utf16(src, end - src);
+            ret += n;
+            src += n;
+            continue;
+        }
         if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
                 && (*++src & 0xFC00) == 0xDC00) {
             // surrogate pairs are always 4 bytes.
@@ -459,6 +634,8 @@ size_t utf8_to_utf32_length(const char *src, size_t src_len)
         const char first_char = *cur;
         num_to_skip = 1;
         if ((first_char & 0x80) == 0) {  // ASCII
+            num_to_skip = ascii_run_utf8((const uint8_t*) cur, end - cur);
+            ret += num_to_skip - 1;
             continue;
         }
         int32_t mask;
@@ -479,6 +656,16 @@ void utf8_to_utf32(const char* src, size_t src_len, char32_t* dst)
     const char* const end = src + src_len;
     char32_t* cur_utf32 = dst;
     while (cur < end) {
+        if ((*cur & 0x80) == 0) {
+            const uint8_t* ascii = (const uint8_t*) cur;
+            const size_t n = ascii_run_utf8(ascii, end - cur);
+            for (size_t i = 0; i < n; i++) {
+                cur_utf32[i] = ascii[i];
+            }
+            cur += n;
+            cur_utf32 += n;
+            continue;
+        }
         size_t num_read;
         *cur_utf32++ = static_cast<char32_t>(utf32_at_internal(cur, &num_read));
         cur += num_read;
@@ -524,8 +711,18 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len)
     /* Validate that the UTF-8 is the correct len */
     size_t u16measuredLen = 0;
     while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            const size_t n = ascii_run_utf8(u8cur, u8end - u8cur);
+            u16measuredLen += n;
+            u8cur += n;
+            continue;
+        }
         u16measuredLen++;
         int u8charLen = utf8_codepoint_len(*u8cur);
+        if (u8charLen > u8end - u8cur) {
+            // truncated
+            return -1;
+        }
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8charLen);
         if (codepoint > 0xFFFF) u16measuredLen++; // this will be a surrogate pair in utf16
         u8cur += u8charLen;
@@ -549,6 +746,12 @@ char16_t* utf8_to_utf16_no_null_terminator(const uint8_t* u8str, size_t u8len, c
     char16_t* u16cur = u16str;
 
     while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            const size_t n = ascii_utf8_to_utf16(u8cur, u8end - u8cur, u16cur);
+            u8cur += n;
+            u16cur += n;
+            continue;
+        }
         size_t u8len = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
 
@@ -573,4 +776,113 @@ void utf8_to_utf16(const uint8_t* u8str, size_t u8len, char16_t* u16str) {
     *end = 0;
 }
 
+// --------------------------------------------------------------------------
+// Validation
+// --------------------------------------------------------------------------
+
+/**
+ * Returns the length of the well-formed UTF-8 sequence starting at "src",
+ * which has "avail" bytes, or 0 if it isn't one. Follows table 3-7 of the
+ * Unicode standard: no overlong forms, surrogates or code points past
+ * U+10FFFF.
+ */
+static inline size_t utf8_checked_sequence_length(const uint8_t* src, size_t avail)
+{
+    const uint8_t first = src[0];
+    size_t len;
+    uint8_t lo = 0x80, hi = 0xBF;   // range of the second byte
+    if (first < 0x80) {
+        return 1;
+    } else if (first < 0xC2) {
+        return 0;
+    } else if (first < 0xE0) {
+        len = 2;
+    } else if (first < 0xF0) {
+        len = 3;
+        if (first == 0xE0) {
+            lo = 0xA0;
+        } else if (first == 0xED) {
+            hi = 0x9F;
+        }
+    } else if (first < 0xF5) {
+        len = 4;
+        if (first == 0xF0) {
+            lo = 0x90;
+        } else if (first == 0xF4) {
+            hi = 0x8F;
+        }
+    } else {
+        return 0;
+    }
+
+    if (avail < len || src[1] < lo || src[1] > hi) {
+        return 0;
+    }
+    for (size_t i = 2; i < len; i++) {
+        if ((src[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+ssize_t utf8_to_utf16_length_checked(const uint8_t* src, size_t src_len, size_t* bad_offset)
+{
+    const uint8_t* cur = src;
+    const uint8_t* const end = src + src_len;
+    size_t ret = 0;
+    while (cur < end) {
+        if (*cur < 0x80) {
+            const size_t n = ascii_run_utf8(cur, end - cur);
+            ret += n;
+            cur += n;
+            continue;
+        }
+        const size_t len = utf8_checked_sequence_length(cur, end - cur);
+        if (len == 0) {
+            if (bad_offset) {
+                *bad_offset = cur - src;
+            }
+            return -1;
+        }
+        // four bytes become a surrogate pair
+        ret += len == 4 ? 2 : 1;
+        cur += len;
+    }
+    return ret;
+}
+
+ssize_t utf16_to_utf8_length_checked(const char16_t* src, size_t src_len, size_t* bad_index)
+{
+    const char16_t* cur = src;
+    const char16_t* const end = src + src_len;
+    size_t ret = 0;
+    while (cur < end) {
+        const char16_t ch = *cur;
+        if (ch < 0x80) {
+            const size_t n = ascii_run_utf16(cur, end - cur);
+            ret += n;
+            cur += n;
+            continue;
+        }
+        if (ch < 0x800) {
+            ret += 2;
+        } else if ((ch & 0xF800) != 0xD800) {
+            ret += 3;
+        } else if ((ch & 0xFC00) == 0xD800 && cur + 1 < end
+                && (cur[1] & 0xFC00) == 0xDC00) {
+            ret += 4;
+            cur++;
+        } else {
+            // unpaired surrogate
+            if (bad_index) {
+                *bad_index = cur - src;
+            }
+            return -1;
+        }
+        cur++;
+    }
+    return ret;
+}
+
 }
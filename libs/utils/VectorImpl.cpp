@@ -323,10 +323,7 @@ ssize_t VectorImpl::setCapacity(size_t new_capacity)
     } 
     SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
     if (sb) {
-        void* array = sb->data();
-        _do_copy(array, mStorage, size());
-        release_storage();
-        mStorage = const_cast<void*>(array);
+        _replace_storage(sb->data(), mCount, 0, 0);
     } else {
         return NO_MEMORY;
     }
@@ -357,28 +354,18 @@ void* VectorImpl::_grow(size_t where, size_t amount)
     if (capacity() < new_size) {
         const size_t new_capacity = max(kMinVectorCapacity, ((new_size*3)+1)/2);
 //        ALOGV("grow vector %p, new_capacity=%d", this, (int)new_capacity);
-        if ((mStorage) &&
+        const SharedBuffer* cur_sb = mStorage ? SharedBuffer::sharedBuffer(mStorage) : 0;
+        if ((cur_sb) &&
             (mCount==where) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
+            (((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR)) ||
+             ((mFlags & HAS_TRIVIAL_MOVE) && cur_sb->onlyOwner())))
         {
-            const SharedBuffer* cur_sb = SharedBuffer::sharedBuffer(mStorage);
             SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
             mStorage = sb->data();
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
             if (sb) {
-                void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != mCount) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
-                    _do_copy(dest, from, mCount-where);
-                }
-                release_storage();
-                mStorage = const_cast<void*>(array);
+                _replace_storage(sb->data(), where, amount, 0);
             }
         }
     } else {
@@ -410,27 +397,21 @@ void VectorImpl::_shrink(size_t where, size_t amount)
     if (new_size*3 < capacity()) {
         const size_t new_capacity = max(kMinVectorCapacity, new_size*2);
 //        ALOGV("shrink vector %p, new_capacity=%d", this, (int)new_capacity);
+        const SharedBuffer* cur_sb = SharedBuffer::sharedBuffer(mStorage);
         if ((where == new_size) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
+            (((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR)) ||
+             ((mFlags & HAS_TRIVIAL_MOVE) && cur_sb->onlyOwner())))
         {
-            const SharedBuffer* cur_sb = SharedBuffer::sharedBuffer(mStorage);
+            if (cur_sb->onlyOwner()) {
+                void* to = reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize;
+                _do_destroy(to, amount);
+            }
             SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
             mStorage = sb->data();
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
             if (sb) {
-                void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != new_size) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
-                    _do_copy(dest, from, new_size - where);
-                }
-                release_storage();
-                mStorage = const_cast<void*>(array);
+                _replace_storage(sb->data(), where, 0, amount);
             }
         }
     } else {
@@ -445,6 +426,39 @@ void VectorImpl::_shrink(size_t where, size_t amount)
     mCount = new_size;
 }
 
+// Makes 'array', a new buffer, the storage of this vector. The items before
+// 'where' go to the start of it, 'removed' items at 'where' are dropped, and
+// the items after them go to 'where + inserted'. If nobody else shares the
+// old buffer the items are moved and the buffer freed, otherwise they are
+// copied and the buffer released.
+void VectorImpl::_replace_storage(void* array, size_t where,
+        size_t inserted, size_t removed)
+{
+    const size_t tail = mCount - where - removed;
+    const uint8_t* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+removed)*mItemSize;
+    uint8_t* dest = reinterpret_cast<uint8_t *>(array) + (where+inserted)*mItemSize;
+    const SharedBuffer* cur_sb = mStorage ? SharedBuffer::sharedBuffer(mStorage) : 0;
+    if (cur_sb && cur_sb->onlyOwner()) {
+        _do_relocate(array, mStorage, where);
+        if (removed) {
+            void* gone = reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize;
+            _do_destroy(gone, removed);
+        }
+        _do_relocate(dest, from, tail);
+        cur_sb->release(SharedBuffer::eKeepStorage);
+        SharedBuffer::dealloc(cur_sb);
+    } else {
+        if (where != 0) {
+            _do_copy(array, mStorage, where);
+        }
+        if (tail != 0) {
+            _do_copy(dest, from, tail);
+        }
+        release_storage();
+    }
+    mStorage = array;
+}
+
 size_t VectorImpl::itemSize() const {
     return mItemSize;
 }
@@ -484,6 +498,20 @@ void VectorImpl::_do_move_backward(void* dest, const void* from, size_t num) con
     do_move_backward(dest, from, num);
 }
 
+// Moves items to memory that doesn't overlap them, leaving 'from'
+// uninitialized.
+void VectorImpl::_do_relocate(void* dest, const void* from, size_t num) const {
+    if (num == 0) {
+        return;
+    }
+    if ((mFlags & HAS_TRIVIAL_MOVE) ||
+            ((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR))) {
+        memcpy(dest, from, num*itemSize());
+    } else {
+        do_move_backward(dest, from, num);
+    }
+}
+
 void VectorImpl::reservedVectorImpl1() { }
 void VectorImpl::reservedVectorImpl2() { }
 void VectorImpl::reservedVectorImpl3() { }
@@ -6,10 +6,20 @@ include $(CLEAR_VARS)
 test_src_files := \
 	BasicHashtable_test.cpp \
 	BlobCache_test.cpp \
+	BlobCache_benchmark.cpp \
+	FlatHashMap_test.cpp \
+	FlatHashMap_benchmark.cpp \
 	Looper_test.cpp \
+	Looper_benchmark.cpp \
+	LruCache_test.cpp \
+	LruCache_benchmark.cpp \
 	String8_test.cpp \
+	String8_benchmark.cpp \
+	StringAtom_test.cpp \
 	Unicode_test.cpp \
+	Unicode_benchmark.cpp \
 	Vector_test.cpp \
+	Vector_benchmark.cpp \
 	ZipFileRO_test.cpp
 
 shared_libraries := \
@@ -0,0 +1,164 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Startup benchmark for BlobCache: loads a 2 MB cache of shader-sized
+// entries the way egl_cache does and then looks every entry up.
+//
+
+#include <utils/BlobCache.h>
+#include <utils/Errors.h>
+#include <utils/FileMap.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace android {
+
+enum {
+    MAX_KEY_SIZE = 4096,
+    MAX_VALUE_SIZE = 16 * 1024,
+    MAX_TOTAL_SIZE = 2 * 1024 * 1024,
+    // Shader binaries are keyed by a digest of the source and tend to be a
+    // few kilobytes each.
+    KEY_SIZE = 40,
+    MIN_VALUE_SIZE = 512,
+    VALUE_SIZE_RANGE = 8 * 1024,
+};
+
+class BlobCacheBenchmark : public testing::Test {
+protected:
+    sp<BlobCache> mCache;
+    uint8_t* mFlat;
+    size_t mFlatSize;
+    size_t mNumEntries;
+    int mFd;
+    uint32_t mSeed;
+
+    virtual void SetUp() {
+        mSeed = 1;
+        mCache = new BlobCache(MAX_KEY_SIZE, MAX_VALUE_SIZE, MAX_TOTAL_SIZE);
+
+        // Fill the cache to just under its limit so that nothing is evicted.
+        uint8_t key[KEY_SIZE];
+        uint8_t value[MIN_VALUE_SIZE + VALUE_SIZE_RANGE];
+        size_t total = 0;
+        mNumEntries = 0;
+        while (true) {
+            size_t valueSize = MIN_VALUE_SIZE + nextRandom() % VALUE_SIZE_RANGE;
+            if (total + KEY_SIZE + valueSize > MAX_TOTAL_SIZE) {
+                break;
+            }
+            makeKey(key, mNumEntries);
+            memset(value, mNumEntries & 0xff, valueSize);
+            mCache->set(key, KEY_SIZE, value, valueSize);
+            total += KEY_SIZE + valueSize;
+            mNumEntries++;
+        }
+
+        mFlatSize = mCache->getFlattenedSize();
+        mFlat = new uint8_t[mFlatSize];
+        ASSERT_EQ(OK, mCache->flatten(mFlat, mFlatSize, NULL, 0));
+
+        char path[] = "/data/local/tmp/BlobCache_benchmark.XXXXXX";
+        mFd = mkstemp(path);
+        if (mFd == -1) {
+            strcpy(path, "/tmp/BlobCache_benchmark.XXXXXX");
+            mFd = mkstemp(path);
+        }
+        ASSERT_NE(-1, mFd);
+        unlink(path);
+        ASSERT_EQ(ssize_t(mFlatSize), write(mFd, mFlat, mFlatSize));
+    }
+
+    virtual void TearDown() {
+        close(mFd);
+        delete[] mFlat;
+        mCache.clear();
+    }
+
+    // Deterministic pseudo-random sequence so that runs are comparable.
+    uint32_t nextRandom() {
+        mSeed = mSeed * 1103515245 + 12345;
+        return mSeed >> 8;
+    }
+
+    static void makeKey(uint8_t* key, size_t i) {
+        memset(key, 0, KEY_SIZE);
+        snprintf(reinterpret_cast<char*>(key), KEY_SIZE, "shader-%08x", unsigned(i));
+    }
+
+    // Looks up every entry once, as the first frames of an app would.
+    nsecs_t lookupAll(BlobCache* cache) {
+        uint8_t key[KEY_SIZE];
+        uint8_t value[MIN_VALUE_SIZE + VALUE_SIZE_RANGE];
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < mNumEntries; i++) {
+            makeKey(key, i);
+            size_t size = cache->get(key, KEY_SIZE, value, sizeof(value));
+            EXPECT_LT(size_t(0), size);
+            EXPECT_EQ(uint8_t(i & 0xff), value[0]);
+        }
+        return systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    }
+
+    void report(const char* what, nsecs_t load, nsecs_t lookups) {
+        printf("%-32s load %6lld us, %d lookups %6lld us (%6.1f ns/op)\n", what,
+                (long long) ns2us(load), int(mNumEntries),
+                (long long) ns2us(lookups), double(lookups) / mNumEntries);
+    }
+};
+
+TEST_F(BlobCacheBenchmark, LoadByCopying) {
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    uint8_t* buf = new uint8_t[mFlatSize];
+    ASSERT_EQ(ssize_t(mFlatSize), pread(mFd, buf, mFlatSize, 0));
+    sp<BlobCache> cache(new BlobCache(MAX_KEY_SIZE, MAX_VALUE_SIZE, MAX_TOTAL_SIZE));
+    ASSERT_EQ(OK, cache->unflatten(buf, mFlatSize, NULL, 0));
+    delete[] buf;
+    nsecs_t load = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    report("read + unflatten", load, lookupAll(cache.get()));
+}
+
+TEST_F(BlobCacheBenchmark, LoadMapped) {
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    FileMap* map = new FileMap();
+    ASSERT_TRUE(map->create(NULL, mFd, 0, mFlatSize, true));
+    sp<BlobCache> cache(new BlobCache(MAX_KEY_SIZE, MAX_VALUE_SIZE, MAX_TOTAL_SIZE));
+    ASSERT_EQ(OK, cache->unflattenMapped(map, 0));
+    map->release();
+    nsecs_t load = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    report("mmap + unflattenMapped", load, lookupAll(cache.get()));
+
+    BlobCache::Stats stats;
+    cache->getStats(&stats);
+    printf("%d entries, %d bytes, %d bytes mapped, %u hits, %u misses\n",
+            int(stats.entries), int(stats.totalSize), int(stats.mappedSize),
+            stats.hits, stats.misses);
+    EXPECT_EQ(stats.totalSize, stats.mappedSize);
+}
+
+TEST_F(BlobCacheBenchmark, SetUnderEvictionPressure) {
+    // Keep inserting past the limit so that every few sets trigger a clean.
+    uint8_t key[KEY_SIZE];
+    uint8_t value[MIN_VALUE_SIZE + VALUE_SIZE_RANGE];
+    memset(value, 0x5a, sizeof(value));
+    const size_t count = mNumEntries * 4;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < count; i++) {
+        makeKey(key, mNumEntries + i);
+        mCache->set(key, KEY_SIZE, value, MIN_VALUE_SIZE + nextRandom() % VALUE_SIZE_RANGE);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    BlobCache::Stats stats;
+    mCache->getStats(&stats);
+    printf("%d sets %6lld us (%6.1f ns/op), %u evictions\n", int(count),
+            (long long) ns2us(elapsed), double(elapsed) / count, stats.evictions);
+}
+
+} // namespace android
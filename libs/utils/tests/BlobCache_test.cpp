@@ -16,11 +16,15 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
 
 #include <utils/BlobCache.h>
 #include <utils/Errors.h>
+#include <utils/FileMap.h>
 
 namespace android {
 
@@ -258,6 +262,57 @@ TEST_F(BlobCacheTest, ExceedingTotalLimitHalvesCacheSize) {
     ASSERT_EQ(maxEntries/2 + 1, numCached);
 }
 
+TEST_F(BlobCacheTest, ExceedingTotalLimitEvictsLeastRecentlyUsed) {
+    // Fill up the entire cache with 1 char key/value pairs.
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, "x", 1);
+    }
+    // Use the oldest entry so that it becomes the newest.
+    {
+        uint8_t k = 0;
+        ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+    }
+    // Insert one more entry, causing a cache overflow.
+    {
+        uint8_t k = maxEntries;
+        mBC->set(&k, 1, "x", 1);
+    }
+    uint8_t k = 0;
+    ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+    k = 1;
+    ASSERT_EQ(size_t(0), mBC->get(&k, 1, NULL, 0));
+    k = maxEntries;
+    ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+}
+
+TEST_F(BlobCacheTest, StatsCountHitsMissesAndEvictions) {
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries + 1; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, "x", 1);
+    }
+    char key[MAX_KEY_SIZE+1] = { 0 };
+    mBC->set(key, MAX_KEY_SIZE+1, "x", 1);
+    uint8_t k = maxEntries;
+    mBC->get(&k, 1, NULL, 0);
+    k = 0;
+    mBC->get(&k, 1, NULL, 0);
+
+    BlobCache::Stats stats;
+    mBC->getStats(&stats);
+    ASSERT_EQ(uint32_t(1), stats.hits);
+    ASSERT_EQ(uint32_t(1), stats.misses);
+    ASSERT_EQ(uint32_t(maxEntries + 1), stats.insertions);
+    ASSERT_EQ(uint32_t(1), stats.rejections);
+    ASSERT_EQ(uint32_t(maxEntries / 2), stats.evictions);
+    ASSERT_EQ(size_t(2 * (maxEntries / 2)), stats.evictedBytes);
+    ASSERT_EQ(size_t(maxEntries / 2 + 1), stats.entries);
+    ASSERT_EQ(size_t(2 * (maxEntries / 2 + 1)), stats.totalSize);
+    ASSERT_EQ(size_t(0), stats.mappedSize);
+}
+
 class BlobCacheFlattenTest : public BlobCacheTest {
 protected:
     virtual void SetUp() {
@@ -418,4 +473,72 @@ TEST_F(BlobCacheFlattenTest, UnflattenCatchesBufferTooSmall) {
     ASSERT_EQ(size_t(0), mBC2->get("abcd", 4, buf, 4));
 }
 
+TEST_F(BlobCacheFlattenTest, FlattenKeepsLeastRecentlyUsedOrder) {
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, &k, 1);
+    }
+    uint8_t k = 0;
+    ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+
+    roundTrip();
+
+    // Overflowing the restored cache should evict the same entries as it
+    // would have in the original.
+    k = maxEntries;
+    mBC2->set(&k, 1, &k, 1);
+    k = 0;
+    ASSERT_EQ(size_t(1), mBC2->get(&k, 1, NULL, 0));
+    k = 1;
+    ASSERT_EQ(size_t(0), mBC2->get(&k, 1, NULL, 0));
+}
+
+TEST_F(BlobCacheFlattenTest, UnflattenMappedServesValuesFromMap) {
+    char buf[2] = { 0xee, 0xee };
+    mBC->set("ab", 2, "cd", 2);
+    mBC->set("ef", 2, "gh", 2);
+
+    char path[] = "/data/local/tmp/BlobCache_test.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        strcpy(path, "/tmp/BlobCache_test.XXXXXX");
+        fd = mkstemp(path);
+    }
+    ASSERT_NE(-1, fd);
+    unlink(path);
+
+    // Put the cache after a small file header, as egl_cache does.
+    const size_t offset = 8;
+    size_t size = mBC->getFlattenedSize();
+    uint8_t* flat = new uint8_t[offset + size];
+    memset(flat, 0, offset);
+    ASSERT_EQ(OK, mBC->flatten(flat + offset, size, NULL, 0));
+    ASSERT_EQ(ssize_t(offset + size), write(fd, flat, offset + size));
+    delete[] flat;
+
+    FileMap* map = new FileMap();
+    ASSERT_TRUE(map->create(NULL, fd, 0, offset + size, true));
+    close(fd);
+    ASSERT_EQ(OK, mBC2->unflattenMapped(map, offset));
+    map->release();
+
+    BlobCache::Stats stats;
+    mBC2->getStats(&stats);
+    ASSERT_EQ(size_t(8), stats.mappedSize);
+
+    ASSERT_EQ(size_t(2), mBC2->get("ab", 2, buf, 2));
+    ASSERT_EQ('c', buf[0]);
+    ASSERT_EQ('d', buf[1]);
+
+    // Replacing a mapped value copies the new one.
+    mBC2->set("ab", 2, "ij", 2);
+    ASSERT_EQ(size_t(2), mBC2->get("ab", 2, buf, 2));
+    ASSERT_EQ('i', buf[0]);
+    ASSERT_EQ(size_t(2), mBC2->get("ef", 2, buf, 2));
+    ASSERT_EQ('g', buf[0]);
+    mBC2->getStats(&stats);
+    ASSERT_EQ(size_t(4), stats.mappedSize);
+}
+
 } // namespace android
@@ -0,0 +1,151 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Compares FlatHashMap with BasicHashtable and KeyedVector at 1k, 10k and
+// 100k int keys: inserting every key in random order, looking each of them
+// up, and erasing them all again. KeyedVector sits out the 100k run, where
+// inserting into the middle of its sorted array takes seconds.
+//
+// Also compares looking up String8 keys by C string, which KeyedVector can
+// only do by making a String8 from it first.
+//
+
+#include <utils/BasicHashtable.h>
+#include <utils/FlatHashMap.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+namespace android {
+
+enum {
+    STRING_KEYS = 1000,
+    STRING_LOOKUPS = 1000000,
+};
+
+// Spreads consecutive numbers over the key space, so that sorted
+// containers see the keys out of order.
+static inline int keyFor(uint32_t i) {
+    return int((i * 2654435761u) >> 1);
+}
+
+class FlatMapAdapter {
+public:
+    void add(int key, int value) { mMap.add(key, value); }
+    int get(int key) const { return mMap.valueAt(mMap.indexOfKey(key)); }
+    void remove(int key) { mMap.removeItem(key); }
+    size_t size() const { return mMap.size(); }
+
+private:
+    FlatHashMap<int, int> mMap;
+};
+
+class BasicHashtableAdapter {
+public:
+    void add(int key, int value) {
+        mTable.add(hash_type(key), Entry(key, value));
+    }
+    int get(int key) const {
+        return mTable.entryAt(mTable.find(-1, hash_type(key), key)).value;
+    }
+    void remove(int key) {
+        mTable.removeAt(mTable.find(-1, hash_type(key), key));
+    }
+    size_t size() const { return mTable.size(); }
+
+private:
+    typedef key_value_pair_t<int, int> Entry;
+    BasicHashtable<int, Entry> mTable;
+};
+
+class KeyedVectorAdapter {
+public:
+    void add(int key, int value) { mVector.add(key, value); }
+    int get(int key) const { return mVector.valueFor(key); }
+    void remove(int key) { mVector.removeItem(key); }
+    size_t size() const { return mVector.size(); }
+
+private:
+    KeyedVector<int, int> mVector;
+};
+
+template <typename TAdapter>
+static void run(const char* name, uint32_t count) {
+    TAdapter map;
+
+    nsecs_t start = systemTime();
+    for (uint32_t i = 0; i < count; i++) {
+        map.add(keyFor(i), int(i));
+    }
+    const nsecs_t insertTime = systemTime() - start;
+    EXPECT_EQ(count, uint32_t(map.size()));
+
+    start = systemTime();
+    int sum = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        sum += map.get(keyFor(i));
+    }
+    const nsecs_t lookupTime = systemTime() - start;
+
+    start = systemTime();
+    for (uint32_t i = 0; i < count; i++) {
+        map.remove(keyFor(i));
+    }
+    const nsecs_t eraseTime = systemTime() - start;
+    EXPECT_EQ(0u, map.size());
+
+    printf("%-16s %6u keys: insert %7.1f ns, lookup %6.1f ns, erase %7.1f ns (%d)\n",
+            name, count, double(insertTime) / count, double(lookupTime) / count,
+            double(eraseTime) / count, sum & 1);
+}
+
+TEST(FlatHashMapBenchmark, Keys1k) {
+    run<FlatMapAdapter>("FlatHashMap", 1000);
+    run<BasicHashtableAdapter>("BasicHashtable", 1000);
+    run<KeyedVectorAdapter>("KeyedVector", 1000);
+}
+
+TEST(FlatHashMapBenchmark, Keys10k) {
+    run<FlatMapAdapter>("FlatHashMap", 10000);
+    run<BasicHashtableAdapter>("BasicHashtable", 10000);
+    run<KeyedVectorAdapter>("KeyedVector", 10000);
+}
+
+TEST(FlatHashMapBenchmark, Keys100k) {
+    run<FlatMapAdapter>("FlatHashMap", 100000);
+    run<BasicHashtableAdapter>("BasicHashtable", 100000);
+}
+
+TEST(FlatHashMapBenchmark, String8LookupByCString) {
+    Vector<String8> names;
+    FlatHashMap<String8, int> map;
+    KeyedVector<String8, int> vector;
+    for (int i = 0; i < STRING_KEYS; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "android.hardware.key.%d", keyFor(i));
+        names.add(String8(buf));
+        map.add(names[i], i);
+        vector.add(names[i], i);
+    }
+
+    nsecs_t start = systemTime();
+    int sum = 0;
+    for (uint32_t i = 0; i < STRING_LOOKUPS; i++) {
+        sum += map.valueFor(names[i % STRING_KEYS].string());
+    }
+    const nsecs_t flatTime = systemTime() - start;
+
+    start = systemTime();
+    for (uint32_t i = 0; i < STRING_LOOKUPS; i++) {
+        sum += vector.valueFor(String8(names[i % STRING_KEYS].string()));
+    }
+    const nsecs_t vectorTime = systemTime() - start;
+
+    printf("String8 keys by const char*: FlatHashMap %6.1f ns, KeyedVector %6.1f ns (%d)\n",
+            double(flatTime) / STRING_LOOKUPS, double(vectorTime) / STRING_LOOKUPS, sum & 1);
+}
+
+} // namespace android
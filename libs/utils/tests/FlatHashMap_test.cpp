@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FlatHashMap_test"
+
+#include <utils/FlatHashMap.h>
+#include <utils/String8.h>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+namespace android {
+
+typedef FlatHashMap<int, int> SimpleMap;
+
+struct ComplexKey {
+    int k;
+
+    explicit ComplexKey(int k) : k(k) {
+        instanceCount += 1;
+    }
+
+    ComplexKey(const ComplexKey& other) : k(other.k) {
+        instanceCount += 1;
+    }
+
+    ~ComplexKey() {
+        instanceCount -= 1;
+    }
+
+    bool operator ==(const ComplexKey& other) const {
+        return k == other.k;
+    }
+
+    static ssize_t instanceCount;
+};
+
+ssize_t ComplexKey::instanceCount = 0;
+
+// all keys in one of four buckets, to exercise long probe sequences
+template<> inline hash_t hash_type(const ComplexKey& value) {
+    return hash_type(value.k & 3);
+}
+
+struct ComplexValue {
+    int v;
+
+    explicit ComplexValue(int v) : v(v) {
+        instanceCount += 1;
+    }
+
+    ComplexValue(const ComplexValue& other) : v(other.v) {
+        instanceCount += 1;
+    }
+
+    ~ComplexValue() {
+        instanceCount -= 1;
+    }
+
+    ComplexValue& operator =(const ComplexValue& other) {
+        v = other.v;
+        return *this;
+    }
+
+    static ssize_t instanceCount;
+};
+
+ssize_t ComplexValue::instanceCount = 0;
+
+typedef FlatHashMap<ComplexKey, ComplexValue> ComplexMap;
+
+class FlatHashMapTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        ComplexKey::instanceCount = 0;
+        ComplexValue::instanceCount = 0;
+    }
+
+    virtual void TearDown() {
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(0, 0));
+    }
+
+    void assertInstanceCount(ssize_t keys, ssize_t values) {
+        if (keys != ComplexKey::instanceCount || values != ComplexValue::instanceCount) {
+            FAIL() << "Expected " << keys << " keys and " << values << " values "
+                    "but there were actually " << ComplexKey::instanceCount << " keys and "
+                    << ComplexValue::instanceCount << " values";
+        }
+    }
+
+    static String8 keyFor(int i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "key%d", i);
+        return String8(buf);
+    }
+};
+
+TEST_F(FlatHashMapTest, Empty) {
+    SimpleMap map;
+
+    EXPECT_EQ(0u, map.size());
+    EXPECT_TRUE(map.isEmpty());
+    EXPECT_EQ(0u, map.capacity());
+    EXPECT_EQ(-1, map.indexOfKey(0));
+    EXPECT_EQ(NAME_NOT_FOUND, map.removeItem(0));
+    EXPECT_EQ(-1, map.next(-1));
+}
+
+TEST_F(FlatHashMapTest, AddAndFind) {
+    SimpleMap map;
+
+    map.add(1, 10);
+    map.add(2, 20);
+    map.add(3, 30);
+    EXPECT_EQ(3u, map.size());
+    EXPECT_EQ(10, map.valueFor(1));
+    EXPECT_EQ(20, map.valueFor(2));
+    EXPECT_EQ(30, map.valueFor(3));
+    EXPECT_EQ(-1, map.indexOfKey(4));
+
+    ssize_t index = map.indexOfKey(2);
+    ASSERT_GE(index, 0);
+    EXPECT_EQ(2, map.keyAt(index));
+    EXPECT_EQ(20, map.valueAt(index));
+}
+
+TEST_F(FlatHashMapTest, AddReplacesValue) {
+    SimpleMap map;
+
+    ssize_t index = map.add(1, 10);
+    EXPECT_EQ(index, map.add(1, 11));
+    EXPECT_EQ(1u, map.size());
+    EXPECT_EQ(11, map.valueFor(1));
+
+    map.editValueFor(1) = 12;
+    EXPECT_EQ(12, map.valueFor(1));
+}
+
+TEST_F(FlatHashMapTest, AddReturnsIndexOfNewEntry) {
+    SimpleMap map;
+
+    for (int i = 0; i < 1000; i++) {
+        ssize_t index = map.add(i, -i);
+        ASSERT_GE(index, 0);
+        ASSERT_EQ(i, map.keyAt(index));
+        ASSERT_EQ(-i, map.valueAt(index));
+    }
+}
+
+TEST_F(FlatHashMapTest, Remove) {
+    SimpleMap map;
+
+    for (int i = 0; i < 100; i++) {
+        map.add(i, i * 2);
+    }
+    for (int i = 0; i < 100; i += 2) {
+        ASSERT_LE(0, map.removeItem(i));
+    }
+    EXPECT_EQ(50u, map.size());
+    EXPECT_EQ(NAME_NOT_FOUND, map.removeItem(0));
+    for (int i = 0; i < 100; i++) {
+        if (i & 1) {
+            ASSERT_EQ(i * 2, map.valueFor(i)) << i;
+        } else {
+            ASSERT_EQ(-1, map.indexOfKey(i)) << i;
+        }
+    }
+}
+
+TEST_F(FlatHashMapTest, Iterate) {
+    SimpleMap map;
+
+    int expectedSum = 0;
+    for (int i = 0; i < 100; i++) {
+        map.add(i, i);
+        expectedSum += i;
+    }
+    int sum = 0;
+    size_t count = 0;
+    for (ssize_t i = map.next(-1); i >= 0; i = map.next(i)) {
+        EXPECT_EQ(map.keyAt(i), map.valueAt(i));
+        sum += map.valueAt(i);
+        count += 1;
+    }
+    EXPECT_EQ(100u, count);
+    EXPECT_EQ(expectedSum, sum);
+}
+
+TEST_F(FlatHashMapTest, CollidingKeysAreDestroyed) {
+    {
+        ComplexMap map;
+        for (int i = 0; i < 200; i++) {
+            map.add(ComplexKey(i), ComplexValue(i * 10));
+        }
+        EXPECT_EQ(200u, map.size());
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(200, 200));
+
+        for (int i = 0; i < 200; i += 3) {
+            ASSERT_LE(0, map.removeItem(ComplexKey(i)));
+        }
+        EXPECT_EQ(133u, map.size());
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(133, 133));
+        for (int i = 0; i < 200; i++) {
+            ssize_t index = map.indexOfKey(ComplexKey(i));
+            if (i % 3) {
+                ASSERT_LE(0, index) << i;
+                ASSERT_EQ(i * 10, map.valueAt(index).v);
+            } else {
+                ASSERT_EQ(-1, index) << i;
+            }
+        }
+
+        ComplexMap copy(map);
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(266, 266));
+        map.clear();
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(133, 133));
+        EXPECT_EQ(1990, copy.valueFor(ComplexKey(199)).v);
+    }
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(0, 0));
+}
+
+TEST_F(FlatHashMapTest, ReserveAndShrink) {
+    SimpleMap map;
+
+    map.reserve(1000);
+    size_t capacity = map.capacity();
+    EXPECT_LE(1000u, capacity);
+    for (int i = 0; i < 1000; i++) {
+        map.add(i, i);
+    }
+    EXPECT_EQ(capacity, map.capacity());
+
+    for (int i = 10; i < 1000; i++) {
+        map.removeItem(i);
+    }
+    map.shrink();
+    EXPECT_LE(10u, map.capacity());
+    EXPECT_GT(100u, map.capacity());
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(i, map.valueFor(i));
+    }
+
+    map.clear();
+    map.shrink();
+    EXPECT_EQ(0u, map.capacity());
+    EXPECT_EQ(-1, map.indexOfKey(0));
+}
+
+TEST_F(FlatHashMapTest, ManyEntriesSurviveRehash) {
+    SimpleMap map;
+
+    for (int i = 0; i < 100000; i++) {
+        map.add(i * 16, i);
+    }
+    EXPECT_EQ(100000u, map.size());
+    for (int i = 0; i < 100000; i++) {
+        ASSERT_EQ(i, map.valueFor(i * 16)) << i;
+        ASSERT_EQ(-1, map.indexOfKey(i * 16 + 1)) << i;
+    }
+}
+
+TEST_F(FlatHashMapTest, String8KeysFoundByCString) {
+    FlatHashMap<String8, int> map;
+
+    for (int i = 0; i < 100; i++) {
+        map.add(keyFor(i), i);
+    }
+    EXPECT_EQ(42, map.valueFor("key42"));
+    EXPECT_EQ(42, map.valueFor(String8("key42")));
+    EXPECT_EQ(map.indexOfKey(String8("key7")), map.indexOfKey("key7"));
+    EXPECT_EQ(-1, map.indexOfKey("key100"));
+    EXPECT_EQ(-1, map.indexOfKey(""));
+
+    EXPECT_LE(0, map.removeItem("key42"));
+    EXPECT_EQ(-1, map.indexOfKey(String8("key42")));
+    EXPECT_EQ(99u, map.size());
+}
+
+TEST_F(FlatHashMapTest, Set) {
+    FlatHashSet<String8> set;
+
+    EXPECT_FALSE(set.contains("a"));
+    ssize_t index = set.add(String8("a"));
+    EXPECT_EQ(index, set.add(String8("a")));
+    set.add(String8("b"));
+    EXPECT_EQ(2u, set.size());
+    EXPECT_TRUE(set.contains("a"));
+    EXPECT_TRUE(set.contains(String8("b")));
+    EXPECT_EQ(String8("a"), set.itemAt(set.indexOf("a")));
+
+    EXPECT_LE(0, set.remove("a"));
+    EXPECT_EQ(NAME_NOT_FOUND, set.remove(String8("a")));
+    EXPECT_FALSE(set.contains("a"));
+    EXPECT_EQ(1u, set.size());
+}
+
+} // namespace android
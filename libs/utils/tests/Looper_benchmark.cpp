@@ -0,0 +1,147 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Microbenchmark for the Looper message queue.
+//
+
+#include <utils/Looper.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+namespace android {
+
+enum {
+    MESSAGE_COUNT = 10000,
+    HANDLER_COUNT = 16,
+    WHAT_COUNT = 64,
+};
+
+class CountingMessageHandler : public MessageHandler {
+public:
+    size_t count;
+
+    CountingMessageHandler() : count(0) { }
+
+    virtual void handleMessage(const Message& message) {
+        count += 1;
+    }
+};
+
+class LooperBenchmark : public testing::Test {
+protected:
+    sp<Looper> mLooper;
+    sp<CountingMessageHandler> mHandlers[HANDLER_COUNT];
+    uint32_t mSeed;
+
+    virtual void SetUp() {
+        mLooper = new Looper(true);
+        for (size_t i = 0; i < HANDLER_COUNT; i++) {
+            mHandlers[i] = new CountingMessageHandler();
+        }
+        mSeed = 1;
+    }
+
+    virtual void TearDown() {
+        for (size_t i = 0; i < HANDLER_COUNT; i++) {
+            mHandlers[i].clear();
+        }
+        mLooper.clear();
+    }
+
+    // Deterministic pseudo-random sequence so that runs are comparable.
+    uint32_t nextRandom() {
+        mSeed = mSeed * 1103515245 + 12345;
+        return mSeed >> 8;
+    }
+
+    // Posts MESSAGE_COUNT messages spread over [base, base + range) in random order.
+    nsecs_t postMessages(nsecs_t base, nsecs_t range) {
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < MESSAGE_COUNT; i++) {
+            uint32_t r = nextRandom();
+            mLooper->sendMessageAtTime(base + nsecs_t(r % uint32_t(range / 1000)) * 1000,
+                    mHandlers[r % HANDLER_COUNT], Message((r >> 4) % WHAT_COUNT));
+        }
+        return systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    }
+
+    size_t handledCount() const {
+        size_t count = 0;
+        for (size_t i = 0; i < HANDLER_COUNT; i++) {
+            count += mHandlers[i]->count;
+        }
+        return count;
+    }
+
+    static void report(const char* what, nsecs_t elapsed, size_t ops) {
+        printf("%-48s %8lld us total %8.1f ns/op\n", what,
+                (long long) ns2us(elapsed), double(elapsed) / ops);
+    }
+
+    void runPostAndRemove(const char* mode) {
+        char label[64];
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        nsecs_t elapsed = postMessages(now + s2ns(1000), s2ns(10));
+        snprintf(label, sizeof(label), "%s: post %d delayed", mode, MESSAGE_COUNT);
+        report(label, elapsed, MESSAGE_COUNT);
+
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < HANDLER_COUNT; i++) {
+            for (int what = 0; what < WHAT_COUNT; what++) {
+                mLooper->removeMessages(mHandlers[i], what);
+            }
+        }
+        elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        snprintf(label, sizeof(label), "%s: removeMessages(handler, what)", mode);
+        report(label, elapsed, HANDLER_COUNT * WHAT_COUNT);
+
+        postMessages(now + s2ns(1000), s2ns(10));
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < HANDLER_COUNT; i++) {
+            mLooper->removeMessages(mHandlers[i]);
+        }
+        elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        snprintf(label, sizeof(label), "%s: removeMessages(handler)", mode);
+        report(label, elapsed, HANDLER_COUNT);
+
+        mLooper->pollAll(0);
+        EXPECT_EQ(size_t(0), handledCount())
+                << "all messages should have been removed";
+    }
+
+    void runDispatch(const char* mode) {
+        char label[64];
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        postMessages(now - s2ns(10), s2ns(10));
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        mLooper->pollOnce(0);
+        nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        snprintf(label, sizeof(label), "%s: dispatch %d due", mode, MESSAGE_COUNT);
+        report(label, elapsed, MESSAGE_COUNT);
+
+        EXPECT_EQ(size_t(MESSAGE_COUNT), handledCount());
+    }
+};
+
+TEST_F(LooperBenchmark, PostAndRemoveDelayedMessages) {
+    runPostAndRemove("wake");
+}
+
+TEST_F(LooperBenchmark, PostAndRemoveDelayedMessagesWithMessageTimer) {
+    ASSERT_TRUE(mLooper->enableMessageTimer());
+    runPostAndRemove("timer");
+}
+
+TEST_F(LooperBenchmark, DispatchDueMessages) {
+    runDispatch("wake");
+}
+
+TEST_F(LooperBenchmark, DispatchDueMessagesWithMessageTimer) {
+    ASSERT_TRUE(mLooper->enableMessageTimer());
+    runDispatch("timer");
+}
+
+} // namespace android
@@ -150,6 +150,28 @@ TEST_F(LooperTest, PollOnce_WhenNonZeroTimeoutAndAwokenWhileWaiting_PromptlyRetu
             << "pollOnce result should be ALOOPER_POLL_CALLBACK because loop was awoken";
 }
 
+TEST_F(LooperTest, PollOnce_WhenAwokenRepeatedlyBeforeWaiting_ReturnsWakeOnlyOnce) {
+    mLooper->wake();
+    mLooper->wake();
+    mLooper->wake();
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_WAKE, result)
+            << "pollOnce result should be ALOOPER_POLL_WAKE because loop was awoken";
+
+    result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_TIMEOUT, result)
+            << "pollOnce result should be ALOOPER_POLL_TIMEOUT because the wakes were coalesced";
+
+    mLooper->wake();
+    result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_WAKE, result)
+            << "pollOnce result should be ALOOPER_POLL_WAKE because loop was awoken again";
+}
+
 TEST_F(LooperTest, PollOnce_WhenZeroTimeoutAndNoRegisteredFDs_ImmediatelyReturns) {
     StopWatch stopWatch("pollOnce");
     int result = mLooper->pollOnce(0);
@@ -437,6 +459,36 @@ TEST_F(LooperTest, PollOnce_WhenCallbackAddedTwice_OnlySecondCallbackShouldBeInv
             << "replacement handler callback should be invoked";
 }
 
+TEST_F(LooperTest, Dump_WhenFdWasSignalled_ReportsEventCount) {
+    Pipe pipe;
+    StubCallbackHandler handler(true);
+
+    handler.setCallback(mLooper, pipe.receiveFd, ALOOPER_EVENT_INPUT);
+    pipe.writeSignal();
+    mLooper->pollOnce(0);
+    mLooper->pollOnce(0);
+
+    String8 dump;
+    mLooper->dump(dump);
+
+    char expected[64];
+    snprintf(expected, sizeof(expected), "fd=%d: ident=%d, events=0x%x, callback=",
+            pipe.receiveFd, ALOOPER_POLL_CALLBACK, ALOOPER_EVENT_INPUT);
+    EXPECT_TRUE(strstr(dump.string(), "1 fds registered") != NULL)
+            << "dump should report the registered fd";
+    EXPECT_TRUE(strstr(dump.string(), expected) != NULL)
+            << "dump should describe the registered fd";
+    EXPECT_TRUE(strstr(dump.string(), "eventCount=2") != NULL)
+            << "dump should count both events since the signal was never consumed";
+
+    mLooper->removeFd(pipe.receiveFd);
+    dump.clear();
+    mLooper->dump(dump);
+
+    EXPECT_TRUE(strstr(dump.string(), "0 fds registered") != NULL)
+            << "dump should not report the removed fd";
+}
+
 TEST_F(LooperTest, SendMessage_WhenOneMessageIsEnqueue_ShouldInvokeHandlerDuringNextPoll) {
     sp<StubMessageHandler> handler = new StubMessageHandler();
     mLooper->sendMessage(handler, Message(MSG_TEST1));
@@ -690,4 +742,79 @@ TEST_F(LooperTest, RemoveMessage_WhenRemovingSomeMessagesForHandler_ShouldRemove
             << "no more messages to handle";
 }
 
+TEST_F(LooperTest, SendMessageAtTime_WhenSentOutOfOrder_ShouldInvokeHandlersInUptimeOrder) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    mLooper->sendMessageAtTime(now - ms2ns(10), handler, Message(MSG_TEST3));
+    mLooper->sendMessageAtTime(now - ms2ns(30), handler, Message(MSG_TEST1));
+    mLooper->sendMessageAtTime(now - ms2ns(10), handler, Message(MSG_TEST4));
+    mLooper->sendMessageAtTime(now - ms2ns(20), handler, Message(MSG_TEST2));
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_CALLBACK, result)
+            << "pollOnce result should be ALOOPER_POLL_CALLBACK because messages were sent";
+    EXPECT_EQ(size_t(4), handler->messages.size())
+            << "handled messages";
+    EXPECT_EQ(MSG_TEST1, handler->messages[0].what)
+            << "earliest message handled first";
+    EXPECT_EQ(MSG_TEST2, handler->messages[1].what)
+            << "handled message";
+    EXPECT_EQ(MSG_TEST3, handler->messages[2].what)
+            << "messages with the same uptime are handled in the order they were sent";
+    EXPECT_EQ(MSG_TEST4, handler->messages[3].what)
+            << "messages with the same uptime are handled in the order they were sent";
+}
+
+TEST_F(LooperTest, SendMessageDelayed_WhenMessageTimerEnabled_ShouldInvokeHandlerAfterDelayTimeWithoutWaking) {
+    ASSERT_TRUE(mLooper->enableMessageTimer());
+
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    mLooper->sendMessageDelayed(ms2ns(100), handler, Message(MSG_TEST1));
+
+    StopWatch stopWatch("pollOnce");
+    int result = mLooper->pollOnce(1000);
+    int32_t elapsedMillis = ns2ms(stopWatch.elapsedTime());
+
+    EXPECT_NEAR(100, elapsedMillis, TIMING_TOLERANCE_MS)
+            << "first poll should end around the time of the delayed message dispatch";
+    EXPECT_EQ(ALOOPER_POLL_CALLBACK, result)
+            << "pollOnce result should be ALOOPER_POLL_CALLBACK because message was sent";
+    EXPECT_EQ(size_t(1), handler->messages.size())
+            << "handled message";
+    EXPECT_EQ(MSG_TEST1, handler->messages[0].what)
+            << "handled message";
+
+    result = mLooper->pollOnce(100);
+    elapsedMillis = ns2ms(stopWatch.elapsedTime());
+
+    EXPECT_NEAR(100 + 100, elapsedMillis, TIMING_TOLERANCE_MS)
+            << "second poll should timeout";
+    EXPECT_EQ(ALOOPER_POLL_TIMEOUT, result)
+            << "pollOnce result should be ALOOPER_POLL_TIMEOUT because there were no messages left";
+}
+
+TEST_F(LooperTest, RemoveMessage_WhenMessageTimerEnabledAndHeadRemoved_ShouldWaitForNextMessage) {
+    ASSERT_TRUE(mLooper->enableMessageTimer());
+
+    sp<StubMessageHandler> handler1 = new StubMessageHandler();
+    sp<StubMessageHandler> handler2 = new StubMessageHandler();
+    mLooper->sendMessageDelayed(ms2ns(50), handler1, Message(MSG_TEST1));
+    mLooper->sendMessageDelayed(ms2ns(100), handler2, Message(MSG_TEST2));
+    mLooper->removeMessages(handler1);
+
+    StopWatch stopWatch("pollOnce");
+    int result = mLooper->pollOnce(1000);
+    int32_t elapsedMillis = ns2ms(stopWatch.elapsedTime());
+
+    EXPECT_NEAR(100, elapsedMillis, TIMING_TOLERANCE_MS)
+            << "poll should end around the time of the remaining message dispatch";
+    EXPECT_EQ(ALOOPER_POLL_CALLBACK, result)
+            << "pollOnce result should be ALOOPER_POLL_CALLBACK because message was sent";
+    EXPECT_EQ(size_t(0), handler1->messages.size())
+            << "removed message not handled";
+    EXPECT_EQ(size_t(1), handler2->messages.size())
+            << "handled message";
+}
+
 } // namespace android
@@ -0,0 +1,82 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Compares GenerationCache and LruCache at 1k, 10k and 100k entries:
+// lookups of cached keys, and inserts of new keys into a full cache, each of
+// which evicts the oldest entry.
+//
+
+#include <utils/GenerationCache.h>
+#include <utils/LruCache.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+namespace android {
+
+enum {
+    OPS_PER_RUN = 10000,
+};
+
+// Spreads consecutive numbers over the key space, so that new keys land
+// anywhere in GenerationCache's sorted vector.
+static inline int keyFor(uint32_t i) {
+    return int((i * 2654435761u) >> 1);
+}
+
+template <typename TCache>
+class CacheRunner {
+public:
+    explicit CacheRunner(uint32_t entries) : mCache(entries), mEntries(entries) {
+    }
+
+    void run(const char* name) {
+        // fill the cache in key order, which is cheap for either of them
+        for (uint32_t i = 0; i < mEntries; i++) {
+            mCache.put(int(i), int(i));
+        }
+
+        nsecs_t start = systemTime();
+        uint32_t seed = 1;
+        int sum = 0;
+        for (uint32_t i = 0; i < OPS_PER_RUN; i++) {
+            seed = seed * 1103515245 + 12345;
+            sum += mCache.get(int((seed >> 8) % mEntries));
+        }
+        const nsecs_t getTime = systemTime() - start;
+
+        start = systemTime();
+        for (uint32_t i = 0; i < OPS_PER_RUN; i++) {
+            mCache.put(keyFor(mEntries + i) | 0x40000000, int(i));
+        }
+        const nsecs_t putTime = systemTime() - start;
+
+        printf("%-16s %6u entries: get %7.1f ns, put+evict %9.1f ns (%d)\n",
+                name, mEntries, double(getTime) / OPS_PER_RUN,
+                double(putTime) / OPS_PER_RUN, sum & 1);
+        EXPECT_EQ(mEntries, uint32_t(mCache.size()));
+    }
+
+private:
+    TCache mCache;
+    uint32_t mEntries;
+};
+
+static void runBoth(uint32_t entries) {
+    CacheRunner<GenerationCache<int, int> >(entries).run("GenerationCache");
+    CacheRunner<LruCache<int, int> >(entries).run("LruCache");
+}
+
+TEST(LruCacheBenchmark, Entries1k) {
+    runBoth(1000);
+}
+
+TEST(LruCacheBenchmark, Entries10k) {
+    runBoth(10000);
+}
+
+TEST(LruCacheBenchmark, Entries100k) {
+    runBoth(100000);
+}
+
+} // namespace android
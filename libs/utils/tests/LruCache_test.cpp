@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LruCache_test"
+
+#include <utils/LruCache.h>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+typedef LruCache<int, int> SimpleCache;
+
+struct ComplexKey {
+    int k;
+
+    explicit ComplexKey(int k) : k(k) {
+        instanceCount += 1;
+    }
+
+    ComplexKey(const ComplexKey& other) : k(other.k) {
+        instanceCount += 1;
+    }
+
+    ~ComplexKey() {
+        instanceCount -= 1;
+    }
+
+    bool operator ==(const ComplexKey& other) const {
+        return k == other.k;
+    }
+
+    bool operator !=(const ComplexKey& other) const {
+        return k != other.k;
+    }
+
+    static ssize_t instanceCount;
+};
+
+ssize_t ComplexKey::instanceCount = 0;
+
+template<> inline hash_t hash_type(const ComplexKey& value) {
+    return hash_type(value.k);
+}
+
+struct ComplexValue {
+    int v;
+
+    ComplexValue() : v(0) {
+        instanceCount += 1;
+    }
+
+    explicit ComplexValue(int v) : v(v) {
+        instanceCount += 1;
+    }
+
+    ComplexValue(const ComplexValue& other) : v(other.v) {
+        instanceCount += 1;
+    }
+
+    ~ComplexValue() {
+        instanceCount -= 1;
+    }
+
+    static ssize_t instanceCount;
+};
+
+ssize_t ComplexValue::instanceCount = 0;
+
+typedef LruCache<ComplexKey, ComplexValue> ComplexCache;
+
+class EntryRemovedCallback : public OnEntryRemoved<int, int> {
+public:
+    EntryRemovedCallback() : callbackCount(0), lastKey(-1), lastValue(-1) { }
+    ~EntryRemovedCallback() { }
+    void operator()(int& key, int& value) {
+        callbackCount += 1;
+        lastKey = key;
+        lastValue = value;
+    }
+    ssize_t callbackCount;
+    int lastKey;
+    int lastValue;
+};
+
+class LruCacheTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        ComplexKey::instanceCount = 0;
+        ComplexValue::instanceCount = 0;
+    }
+
+    virtual void TearDown() {
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(0, 0));
+    }
+
+    void assertInstanceCount(ssize_t keys, ssize_t values) {
+        if (keys != ComplexKey::instanceCount || values != ComplexValue::instanceCount) {
+            FAIL() << "Expected " << keys << " keys and " << values << " values "
+                    "but there were actually " << ComplexKey::instanceCount << " keys and "
+                    << ComplexValue::instanceCount << " values";
+        }
+    }
+};
+
+TEST_F(LruCacheTest, Empty) {
+    SimpleCache cache(100);
+
+    EXPECT_EQ(0, cache.get(0));
+    EXPECT_FALSE(cache.contains(0));
+    EXPECT_FALSE(cache.remove(0));
+    EXPECT_FALSE(cache.removeOldest());
+    EXPECT_EQ(0u, cache.size());
+    EXPECT_EQ(0u, cache.cost());
+}
+
+TEST_F(LruCacheTest, Simple) {
+    SimpleCache cache(100);
+
+    EXPECT_TRUE(cache.put(1, 4));
+    EXPECT_TRUE(cache.put(2, 5));
+    EXPECT_TRUE(cache.put(3, 6));
+    EXPECT_EQ(3u, cache.size());
+    EXPECT_EQ(4, cache.get(1));
+    EXPECT_EQ(5, cache.get(2));
+    EXPECT_EQ(6, cache.get(3));
+    EXPECT_EQ(0, cache.get(4));
+    EXPECT_TRUE(cache.contains(2));
+}
+
+TEST_F(LruCacheTest, PutExistingKeyFails) {
+    SimpleCache cache(100);
+
+    EXPECT_TRUE(cache.put(1, 4));
+    EXPECT_FALSE(cache.put(1, 5));
+    EXPECT_EQ(1u, cache.size());
+    EXPECT_EQ(4, cache.get(1));
+}
+
+TEST_F(LruCacheTest, MaxCapacity) {
+    SimpleCache cache(2);
+
+    EXPECT_TRUE(cache.put(1, 4));
+    EXPECT_TRUE(cache.put(2, 5));
+    EXPECT_TRUE(cache.put(3, 6));
+    EXPECT_EQ(2u, cache.size());
+    EXPECT_FALSE(cache.contains(1));
+    EXPECT_EQ(5, cache.get(2));
+    EXPECT_EQ(6, cache.get(3));
+}
+
+TEST_F(LruCacheTest, GetMakesYoungest) {
+    SimpleCache cache(2);
+
+    cache.put(1, 4);
+    cache.put(2, 5);
+    EXPECT_EQ(1, cache.getOldestKey());
+    EXPECT_EQ(4, cache.get(1));
+    EXPECT_EQ(2, cache.getOldestKey());
+    cache.put(3, 6);
+    EXPECT_TRUE(cache.contains(1));
+    EXPECT_FALSE(cache.contains(2));
+    EXPECT_TRUE(cache.contains(3));
+}
+
+TEST_F(LruCacheTest, RemoveOldest) {
+    SimpleCache cache(100);
+
+    cache.put(1, 4);
+    cache.put(2, 5);
+    cache.put(3, 6);
+    cache.get(1);
+    EXPECT_TRUE(cache.removeOldest());
+    EXPECT_FALSE(cache.contains(2));
+    EXPECT_TRUE(cache.removeOldest());
+    EXPECT_FALSE(cache.contains(3));
+    EXPECT_TRUE(cache.removeOldest());
+    EXPECT_EQ(0u, cache.size());
+    EXPECT_FALSE(cache.removeOldest());
+}
+
+TEST_F(LruCacheTest, MaxCost) {
+    SimpleCache cache(SimpleCache::kUnlimitedCapacity, 100);
+
+    EXPECT_TRUE(cache.put(1, 4, 40));
+    EXPECT_TRUE(cache.put(2, 5, 40));
+    EXPECT_EQ(80u, cache.cost());
+
+    // evicts 1 to make room
+    EXPECT_TRUE(cache.put(3, 6, 30));
+    EXPECT_FALSE(cache.contains(1));
+    EXPECT_EQ(70u, cache.cost());
+
+    // evicts everything
+    EXPECT_TRUE(cache.put(4, 7, 100));
+    EXPECT_EQ(1u, cache.size());
+    EXPECT_EQ(100u, cache.cost());
+
+    // too large on its own
+    EXPECT_FALSE(cache.put(5, 8, 101));
+    EXPECT_TRUE(cache.contains(4));
+
+    EXPECT_TRUE(cache.remove(4));
+    EXPECT_EQ(0u, cache.cost());
+}
+
+TEST_F(LruCacheTest, Callback) {
+    SimpleCache cache(2);
+    EntryRemovedCallback callback;
+    cache.setOnEntryRemovedListener(&callback);
+
+    cache.put(1, 4);
+    cache.put(2, 5);
+    cache.put(3, 6);
+    EXPECT_EQ(1, callback.callbackCount);
+    EXPECT_EQ(1, callback.lastKey);
+    EXPECT_EQ(4, callback.lastValue);
+
+    cache.remove(3);
+    EXPECT_EQ(2, callback.callbackCount);
+    EXPECT_EQ(3, callback.lastKey);
+    EXPECT_EQ(6, callback.lastValue);
+
+    cache.clear();
+    EXPECT_EQ(3, callback.callbackCount);
+    EXPECT_EQ(2, callback.lastKey);
+}
+
+TEST_F(LruCacheTest, ComplexEntriesAreDestroyed) {
+    {
+        ComplexCache cache(10);
+        for (int i = 0; i < 100; i++) {
+            cache.put(ComplexKey(i), ComplexValue(i * 10));
+        }
+        EXPECT_EQ(10u, cache.size());
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(10, 11));  // +1 for the null value
+
+        EXPECT_EQ(990, cache.get(ComplexKey(99)).v);
+        EXPECT_EQ(0, cache.get(ComplexKey(0)).v);
+        EXPECT_TRUE(cache.remove(ComplexKey(95)));
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(9, 10));
+    }
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(0, 0));
+}
+
+TEST_F(LruCacheTest, ManyEntriesSurviveRehash) {
+    SimpleCache cache(5000);
+
+    for (int i = 0; i < 10000; i++) {
+        ASSERT_TRUE(cache.put(i, i * 2));
+    }
+    EXPECT_EQ(5000u, cache.size());
+    for (int i = 0; i < 5000; i++) {
+        ASSERT_FALSE(cache.contains(i)) << i;
+    }
+    for (int i = 5000; i < 10000; i++) {
+        ASSERT_EQ(i * 2, cache.get(i)) << i;
+    }
+    // the entries come out from oldest to youngest
+    for (int i = 5000; i < 10000; i++) {
+        ASSERT_EQ(i, cache.getOldestKey());
+        ASSERT_TRUE(cache.removeOldest());
+    }
+    EXPECT_EQ(0u, cache.size());
+}
+
+} // namespace android
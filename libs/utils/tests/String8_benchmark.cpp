@@ -0,0 +1,97 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Builds a dumpsys-sized report the way SurfaceFlinger::dumpAllLocked() and
+// BufferQueue::dump() do, a few hundred formatted lines at a time: with
+// snprintf() into a scratch buffer and String8::append(), with
+// String8::appendFormat(), and with String8Builder. Also times making,
+// copying and destroying the short strings (names, tags) that most
+// String8s hold.
+//
+
+#include <utils/String8.h>
+#include <utils/String8Builder.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+namespace android {
+
+enum {
+    DUMPS_PER_RUN = 1000,
+    LINES_PER_DUMP = 400,
+    SHORT_STRINGS_PER_RUN = 1000000,
+};
+
+static void report(const char* name, nsecs_t duration, size_t length) {
+    printf("%-28s %8.1f us per dump (%u bytes)\n",
+            name, duration / 1000.0 / DUMPS_PER_RUN, unsigned(length));
+}
+
+TEST(String8Benchmark, DumpWithSnprintfAndAppend) {
+    const size_t SIZE = 4096;
+    char buffer[SIZE];
+    size_t length = 0;
+    const nsecs_t start = systemTime();
+    for (int d = 0; d < DUMPS_PER_RUN; d++) {
+        String8 result;
+        for (int i = 0; i < LINES_PER_DUMP; i++) {
+            snprintf(buffer, SIZE, "    [%02d] state=%d, crop=[%d,%d,%d,%d], "
+                    "transform=0x%02x, timestamp=%d\n",
+                    i, i & 3, 0, 0, 720 + i, 1280, i & 7, i * 16667);
+            result.append(buffer);
+        }
+        length = result.length();
+    }
+    report("snprintf + append", systemTime() - start, length);
+}
+
+TEST(String8Benchmark, DumpWithAppendFormat) {
+    size_t length = 0;
+    const nsecs_t start = systemTime();
+    for (int d = 0; d < DUMPS_PER_RUN; d++) {
+        String8 result;
+        for (int i = 0; i < LINES_PER_DUMP; i++) {
+            result.appendFormat("    [%02d] state=%d, crop=[%d,%d,%d,%d], "
+                    "transform=0x%02x, timestamp=%d\n",
+                    i, i & 3, 0, 0, 720 + i, 1280, i & 7, i * 16667);
+        }
+        length = result.length();
+    }
+    report("appendFormat", systemTime() - start, length);
+}
+
+TEST(String8Benchmark, DumpWithBuilder) {
+    size_t length = 0;
+    const nsecs_t start = systemTime();
+    for (int d = 0; d < DUMPS_PER_RUN; d++) {
+        String8Builder builder;
+        for (int i = 0; i < LINES_PER_DUMP; i++) {
+            builder.appendFormat("    [%02d] state=%d, crop=[%d,%d,%d,%d], "
+                    "transform=0x%02x, timestamp=%d\n",
+                    i, i & 3, 0, 0, 720 + i, 1280, i & 7, i * 16667);
+        }
+        String8 result(builder.toString());
+        length = result.length();
+    }
+    report("String8Builder", systemTime() - start, length);
+}
+
+TEST(String8Benchmark, ShortStrings) {
+    static const char* const names[] = {
+        "", "GLES", "SurfaceView", "StatusBar", "0x7f0a0012", "com.android",
+    };
+    const size_t count = sizeof(names) / sizeof(names[0]);
+    size_t total = 0;
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < SHORT_STRINGS_PER_RUN; i++) {
+        String8 name(names[i % count]);
+        String8 copy(name);
+        total += copy.length();
+    }
+    const nsecs_t duration = systemTime() - start;
+    printf("%-28s %8.1f ns per string (%u bytes)\n", "short strings",
+            double(duration) / SHORT_STRINGS_PER_RUN, unsigned(total));
+}
+
+} // namespace android
@@ -17,6 +17,7 @@
 #define LOG_TAG "String8_test"
 #include <utils/Log.h>
 #include <utils/String8.h>
+#include <utils/String8Builder.h>
 
 #include <gtest/gtest.h>
 
@@ -72,4 +73,149 @@ TEST_F(String8Test, OperatorPlusEquals) {
     EXPECT_STREQ(src3, " Verify me.");
 }
 
+TEST_F(String8Test, ShortStringsAreInline) {
+    String8 empty;
+    EXPECT_EQ(0u, empty.length());
+    EXPECT_STREQ("", empty.string());
+    EXPECT_TRUE(empty.sharedBuffer() == NULL);
+
+    String8 tag("SurfaceView");
+    EXPECT_TRUE(tag.sharedBuffer() == NULL);
+    EXPECT_EQ(11u, tag.length());
+
+    // the longest string that is always inline
+    String8 full("0123456789abcde");
+    EXPECT_TRUE(full.sharedBuffer() == NULL);
+    EXPECT_EQ(15u, full.length());
+    EXPECT_STREQ("0123456789abcde", full.string());
+
+    String8 copy(full);
+    EXPECT_STREQ("0123456789abcde", copy.string());
+    EXPECT_NE(full.string(), copy.string());
+}
+
+TEST_F(String8Test, LongStringsShareBuffer) {
+    String8 a("This is much too long to fit inline");
+    String8 b(a);
+    ASSERT_TRUE(a.sharedBuffer() != NULL);
+    EXPECT_EQ(a.sharedBuffer(), b.sharedBuffer());
+
+    b.append("!");
+    EXPECT_NE(a.sharedBuffer(), b.sharedBuffer());
+    EXPECT_STREQ("This is much too long to fit inline", a.string());
+    EXPECT_STREQ("This is much too long to fit inline!", b.string());
+}
+
+TEST_F(String8Test, AppendGrowsGeometrically) {
+    String8 s;
+    const SharedBuffer* buf = NULL;
+    int reallocations = 0;
+    for (int i = 0; i < 10000; i++) {
+        s.append("x");
+        if (s.sharedBuffer() != buf) {
+            buf = s.sharedBuffer();
+            reallocations++;
+        }
+    }
+    EXPECT_EQ(10000u, s.length());
+    EXPECT_GT(30, reallocations);
+    EXPECT_EQ(10000u, strlen(s.string()));
+}
+
+TEST_F(String8Test, AppendToItself) {
+    String8 s("abc");
+    s.append(s.string(), s.length());
+    EXPECT_STREQ("abcabc", s.string());
+    s.append(s);
+    EXPECT_STREQ("abcabcabcabc", s.string());
+    s.append(s.string() + 6);
+    EXPECT_STREQ("abcabcabcabcabcabc", s.string());
+    EXPECT_EQ(18u, s.length());
+}
+
+TEST_F(String8Test, SetToItself) {
+    String8 s("a string long enough to be on the heap");
+    s.setTo(s.string() + 2);
+    EXPECT_STREQ("string long enough to be on the heap", s.string());
+    s.setTo(s.string() + 7, 4);
+    EXPECT_STREQ("long", s.string());
+    s = s;
+    EXPECT_STREQ("long", s.string());
+}
+
+TEST_F(String8Test, AppendFormat) {
+    String8 s("x=");
+    EXPECT_EQ(NO_ERROR, s.appendFormat("%d", 42));
+    EXPECT_STREQ("x=42", s.string());
+    EXPECT_EQ(4u, s.length());
+
+    // does not fit inline
+    EXPECT_EQ(NO_ERROR, s.appendFormat(", %s=%d", "a rather long name", 7));
+    EXPECT_STREQ("x=42, a rather long name=7", s.string());
+    EXPECT_EQ(26u, s.length());
+
+    String8 shared(s);
+    EXPECT_EQ(NO_ERROR, s.appendFormat("%c", '.'));
+    EXPECT_STREQ("x=42, a rather long name=7.", s.string());
+    EXPECT_STREQ("x=42, a rather long name=7", shared.string());
+}
+
+TEST_F(String8Test, LockBuffer) {
+    String8 s("abc");
+    char* buf = s.lockBuffer(20);
+    ASSERT_TRUE(buf != NULL);
+    EXPECT_EQ('a', buf[0]);
+    strcpy(buf + 3, "defghijklmnopqrst");
+    s.unlockBuffer();
+    EXPECT_EQ(20u, s.length());
+    EXPECT_STREQ("abcdefghijklmnopqrst", s.string());
+
+    buf = s.lockBuffer(20);
+    s.unlockBuffer(2);
+    EXPECT_STREQ("ab", s.string());
+    EXPECT_EQ(2u, s.length());
+}
+
+TEST_F(String8Test, ToLowerKeepsLength) {
+    String8 s("MIXED Case String Past The Inline Limit");
+    s.toLower();
+    EXPECT_STREQ("mixed case string past the inline limit", s.string());
+    String8 t("ABC");
+    t.toLower(1, 1);
+    EXPECT_STREQ("AbC", t.string());
+}
+
+TEST_F(String8Test, Builder) {
+    String8Builder builder;
+    EXPECT_TRUE(builder.isEmpty());
+    EXPECT_STREQ("", builder.toString().string());
+
+    String8 expected;
+    for (int i = 0; i < 1000; i++) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "line %d of the dump\n", i);
+        expected.append(buf);
+        if (i & 1) {
+            ASSERT_EQ(NO_ERROR, builder.appendFormat("line %d of the dump\n", i));
+        } else {
+            ASSERT_EQ(NO_ERROR, builder.append(buf));
+        }
+    }
+    EXPECT_EQ(expected.length(), builder.length());
+    String8 result(builder.toString());
+    EXPECT_EQ(expected.length(), result.length());
+    EXPECT_STREQ(expected.string(), result.string());
+
+    // pieces larger than a chunk
+    String8 big(expected);
+    builder.clear();
+    builder.append("[");
+    builder.append(big);
+    builder.appendFormat("%s]", big.string());
+    result = builder.toString();
+    EXPECT_EQ(big.length() * 2 + 2, result.length());
+    EXPECT_EQ('[', result.string()[0]);
+    EXPECT_EQ(']', result.string()[result.length() - 1]);
+}
+
 }
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StringAtom_test"
+
+#include <utils/StringAtom.h>
+#include <utils/Vector.h>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <stdio.h>
+
+namespace android {
+
+class StringAtomTest : public testing::Test {
+protected:
+    enum {
+        THREADS = 8,
+        STRINGS_PER_THREAD = 500,
+    };
+
+    // a different prefix for every test, since atoms live forever
+    static String16 nameFor(const char* prefix, int i) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "android.test.%s.IInterface%d", prefix, i);
+        return String16(buf);
+    }
+
+    struct ThreadArgs {
+        const String16* names;
+        const char16_t* seen[STRINGS_PER_THREAD];
+    };
+
+    static void* internAll(void* arg) {
+        ThreadArgs* args = static_cast<ThreadArgs*>(arg);
+        for (int i = 0; i < STRINGS_PER_THREAD; i++) {
+            args->seen[i] = StringAtom(args->names[i]).string().string();
+        }
+        return NULL;
+    }
+};
+
+TEST_F(StringAtomTest, EqualStringsShareABuffer) {
+    StringAtom a(String16("android.test.equal.IFoo"));
+    StringAtom b("android.test.equal.IFoo");
+    const String16 c(String16("android.test.equal.IFoo"));
+    StringAtom d(c.string(), c.size());
+
+    EXPECT_TRUE(a == b);
+    EXPECT_TRUE(a == d);
+    EXPECT_EQ(a.string().string(), b.string().string());
+    EXPECT_EQ(a.string().string(), d.string().string());
+    EXPECT_NE(c.string(), a.string().string());
+    EXPECT_EQ(c, a.string());
+    EXPECT_EQ(23u, a.size());
+}
+
+TEST_F(StringAtomTest, DifferentStringsAreDifferentAtoms) {
+    StringAtom a("android.test.different.IFoo");
+    StringAtom b("android.test.different.IBar");
+    StringAtom c("android.test.different.IFo");
+
+    EXPECT_TRUE(a != b);
+    EXPECT_TRUE(a != c);
+    EXPECT_FALSE(a == c);
+    EXPECT_EQ(String16("android.test.different.IBar"), b.string());
+}
+
+TEST_F(StringAtomTest, EmptyString) {
+    StringAtom empty;
+    StringAtom fromString(String16(""));
+    StringAtom fromChars("");
+
+    EXPECT_EQ(0u, empty.size());
+    EXPECT_TRUE(empty == fromString);
+    EXPECT_TRUE(empty == fromChars);
+    EXPECT_TRUE(empty != StringAtom("android.test.empty.IFoo"));
+}
+
+TEST_F(StringAtomTest, FindDoesNotAdd) {
+    const String16 name("android.test.find.IFoo");
+    StringAtom atom;
+
+    EXPECT_FALSE(StringAtom::find(name, &atom));
+    EXPECT_FALSE(StringAtom::find(name, &atom));
+
+    StringAtom added(name);
+    ASSERT_TRUE(StringAtom::find(name, &atom));
+    EXPECT_TRUE(atom == added);
+    ASSERT_TRUE(StringAtom::find(name.string(), name.size(), &atom));
+    EXPECT_TRUE(atom == added);
+}
+
+TEST_F(StringAtomTest, ManyAtomsStayDistinct) {
+    const int count = 5000;
+    Vector<StringAtom> atoms;
+    for (int i = 0; i < count; i++) {
+        atoms.add(StringAtom(nameFor("many", i)));
+    }
+    for (int i = 0; i < count; i++) {
+        StringAtom again(nameFor("many", i));
+        ASSERT_TRUE(again == atoms[i]) << i;
+        ASSERT_EQ(nameFor("many", i), again.string()) << i;
+        if (i > 0) {
+            ASSERT_TRUE(again != atoms[i - 1]) << i;
+        }
+    }
+}
+
+TEST_F(StringAtomTest, ConcurrentInternsAgree) {
+    String16 names[STRINGS_PER_THREAD];
+    for (int i = 0; i < STRINGS_PER_THREAD; i++) {
+        names[i] = nameFor("concurrent", i);
+    }
+
+    pthread_t threads[THREADS];
+    ThreadArgs args[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        args[t].names = names;
+        ASSERT_EQ(0, pthread_create(&threads[t], NULL, internAll, &args[t]));
+    }
+    for (int t = 0; t < THREADS; t++) {
+        ASSERT_EQ(0, pthread_join(threads[t], NULL));
+    }
+
+    for (int i = 0; i < STRINGS_PER_THREAD; i++) {
+        const char16_t* expected = StringAtom(names[i]).string().string();
+        for (int t = 0; t < THREADS; t++) {
+            ASSERT_EQ(expected, args[t].seen[i]) << "thread " << t << ", string " << i;
+        }
+    }
+}
+
+TEST_F(StringAtomTest, String16CopiesCompareByBuffer) {
+    StringAtom atom("android.test.copies.IFoo");
+    const String16 a(atom.string());
+    const String16 b(atom.string());
+
+    EXPECT_TRUE(a == b);
+    EXPECT_FALSE(a != b);
+    EXPECT_EQ(0, a.compare(b));
+    EXPECT_TRUE(a != String16("android.test.copies.IBar"));
+}
+
+} // namespace android
@@ -0,0 +1,82 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Converts 64KB of mostly ASCII, Latin-1 and CJK text from UTF-8 to UTF-16
+// and back the way String16(const char*) and String8(const String16&) do,
+// measuring first and then converting, and validates it with
+// utf8_to_utf16_length_checked().
+//
+
+#include <utils/Timers.h>
+#include <utils/Unicode.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace android {
+
+enum {
+    CORPUS_SIZE = 64 * 1024,
+    PASSES = 200,
+};
+
+static void run(const char* name, const char* sample) {
+    // repeat the sample, so that the corpus ends on a character boundary
+    const size_t sampleLen = strlen(sample);
+    uint8_t* utf8 = new uint8_t[CORPUS_SIZE];
+    size_t len = 0;
+    while (len + sampleLen <= CORPUS_SIZE) {
+        memcpy(utf8 + len, sample, sampleLen);
+        len += sampleLen;
+    }
+    const ssize_t len16 = utf8_to_utf16_length(utf8, len);
+    ASSERT_LT(0, len16);
+    char16_t* utf16 = new char16_t[len16 + 1];
+    char* back = new char[len + 1];
+
+    nsecs_t start = systemTime();
+    for (int i = 0; i < PASSES; i++) {
+        utf8_to_utf16_length(utf8, len);
+        utf8_to_utf16(utf8, len, utf16);
+    }
+    const nsecs_t toUtf16 = systemTime() - start;
+
+    start = systemTime();
+    for (int i = 0; i < PASSES; i++) {
+        utf16_to_utf8_length(utf16, len16);
+        utf16_to_utf8(utf16, len16, back);
+    }
+    const nsecs_t toUtf8 = systemTime() - start;
+
+    start = systemTime();
+    for (int i = 0; i < PASSES; i++) {
+        utf8_to_utf16_length_checked(utf8, len, NULL);
+    }
+    const nsecs_t checked = systemTime() - start;
+
+    EXPECT_EQ(0, memcmp(utf8, back, len));
+    const double mb = double(len) * PASSES / (1024 * 1024);
+    printf("%-8s UTF-8 to UTF-16 %6.0f MB/s, UTF-16 to UTF-8 %6.0f MB/s, "
+            "checked %6.0f MB/s\n", name,
+            mb * 1e9 / toUtf16, mb * 1e9 / toUtf8, mb * 1e9 / checked);
+
+    delete[] utf8;
+    delete[] utf16;
+    delete[] back;
+}
+
+TEST(UnicodeBenchmark, ASCII) {
+    run("ASCII", "android.hardware.ICameraService/media.camera ");
+}
+
+TEST(UnicodeBenchmark, Latin1) {
+    run("Latin-1", "Cr\xC3\xA8me br\xC3\xBBl\xC3\xA9" "e \xC3\xA0 la fran\xC3\xA7"
+            "aise, d\xC3\xA9j\xC3\xA0 vu. ");
+}
+
+TEST(UnicodeBenchmark, CJK) {
+    run("CJK", "\xE4\xB8\xAD\xE6\x96\x87\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E"
+            "\xED\x95\x9C\xEA\xB5\xAD\xEC\x96\xB4");
+}
+
+} // namespace android
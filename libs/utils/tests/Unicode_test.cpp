@@ -19,6 +19,7 @@
 #include <utils/Unicode.h>
 
 #include <gtest/gtest.h>
+#include <string.h>
 
 namespace android {
 
@@ -112,4 +113,133 @@ TEST_F(UnicodeTest, UTF8toUTF16Normal) {
             << "should be NULL terminated";
 }
 
+// Every length and alignment around the 16 code units the ASCII runs are
+// converted in, with a non-ASCII character at every position.
+TEST_F(UnicodeTest, UTF8toUTF16AroundASCIIRuns) {
+    uint8_t str[80];
+    char16_t output[80];
+    for (size_t len = 0; len < 40; len++) {
+        for (size_t pos = 0; pos <= len; pos++) {
+            size_t n = 0;
+            for (size_t i = 0; i < len; i++) {
+                if (i == pos) {
+                    str[n++] = 0xC4; // U+0100
+                    str[n++] = 0x80;
+                } else {
+                    str[n++] = 'a' + i % 26;
+                }
+            }
+            const size_t expected = len;
+            ASSERT_EQ(ssize_t(expected), utf8_to_utf16_length(str + 0, n))
+                    << "len " << len << ", pos " << pos;
+            utf8_to_utf16(str, n, output);
+            for (size_t i = 0; i < len; i++) {
+                ASSERT_EQ(i == pos ? 0x0100 : 'a' + i % 26, output[i])
+                        << "len " << len << ", pos " << pos << ", i " << i;
+            }
+            ASSERT_EQ(0, output[len]);
+        }
+    }
+}
+
+TEST_F(UnicodeTest, UTF16toUTF8AroundASCIIRuns) {
+    // U+0080 and U+0100 must not pass for ASCII after narrowing
+    const char16_t others[] = { 0x0080, 0x0100, 0x8080, 0xFF00 };
+    char16_t str[40];
+    char output[40 * 3 + 1];
+    for (size_t o = 0; o < sizeof(others) / sizeof(others[0]); o++) {
+        for (size_t len = 1; len < 40; len++) {
+            for (size_t pos = 0; pos < len; pos++) {
+                for (size_t i = 0; i < len; i++) {
+                    str[i] = i == pos ? others[o] : 'A' + i % 26;
+                }
+                const ssize_t bytes = utf16_to_utf8_length(str, len);
+                ASSERT_LT(ssize_t(len), bytes);
+                utf16_to_utf8(str, len, output);
+                ASSERT_EQ(size_t(bytes), strlen(output));
+
+                // and back
+                char16_t back[40];
+                ASSERT_EQ(ssize_t(len), utf8_to_utf16_length((const uint8_t*) output, bytes));
+                utf8_to_utf16((const uint8_t*) output, bytes, back);
+                ASSERT_EQ(0, memcmp(str, back, len * sizeof(char16_t)))
+                        << "char " << o << ", len " << len << ", pos " << pos;
+            }
+        }
+    }
+}
+
+TEST_F(UnicodeTest, UTF8toUTF32Mixed) {
+    // 20 ASCII, U+00E9, 20 ASCII, U+4E2D
+    const char* str = "abcdefghijklmnopqrst\xC3\xA9" "abcdefghijklmnopqrst\xE4\xB8\xAD";
+    const size_t len = strlen(str);
+    ASSERT_EQ(42u, utf8_to_utf32_length(str, len));
+    ASSERT_EQ(ssize_t(len), utf8_length(str));
+
+    char32_t output[43];
+    utf8_to_utf32(str, len, output);
+    EXPECT_EQ(char32_t('a'), output[0]);
+    EXPECT_EQ(char32_t('t'), output[19]);
+    EXPECT_EQ(0x00E9u, output[20]);
+    EXPECT_EQ(char32_t('a'), output[21]);
+    EXPECT_EQ(0x4E2Du, output[41]);
+    EXPECT_EQ(0u, output[42]);
+}
+
+TEST_F(UnicodeTest, UTF8LengthInvalidAfterASCII) {
+    EXPECT_EQ(40, utf8_length("0123456789012345678901234567890123456789"));
+    EXPECT_EQ(-1, utf8_length("01234567890123456789012345678901234567\x80"));
+    EXPECT_EQ(0, utf8_length(""));
+}
+
+TEST_F(UnicodeTest, UTF8toUTF16Checked) {
+    size_t bad = 1000;
+    const uint8_t valid[] = {
+        'a', 0xC4, 0x80, 0xE2, 0x8C, 0xA3, 0xF0, 0x90, 0x80, 0x80, 0xF4, 0x8F, 0xBF, 0xBF,
+    };
+    EXPECT_EQ(7, utf8_to_utf16_length_checked(valid, sizeof(valid), &bad));
+    EXPECT_EQ(1000u, bad);
+    EXPECT_EQ(0, utf8_to_utf16_length_checked(valid, 0, &bad));
+
+    struct {
+        uint8_t str[5];
+        size_t len;
+    } const invalid[] = {
+        { { 'a', 0x80 }, 2 },               // stray continuation byte
+        { { 'a', 0xC0, 0x80 }, 3 },         // overlong U+0000
+        { { 'a', 0xC1, 0xBF }, 3 },         // overlong U+007F
+        { { 'a', 0xE0, 0x80, 0x80 }, 4 },   // overlong U+0000
+        { { 'a', 0xED, 0xA0, 0x80 }, 4 },   // surrogate U+D800
+        { { 'a', 0xF4, 0x90, 0x80, 0x80 }, 5 }, // U+110000
+        { { 'a', 0xF5, 0x80, 0x80, 0x80 }, 5 },
+        { { 'a', 0xE2, 0x8C }, 3 },         // truncated
+        { { 'a', 0xE2, 0x41, 0xA3 }, 4 },   // missing continuation byte
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        bad = 1000;
+        EXPECT_EQ(-1, utf8_to_utf16_length_checked(invalid[i].str, invalid[i].len, &bad))
+                << "case " << i;
+        EXPECT_EQ(1u, bad) << "case " << i;
+    }
+    EXPECT_EQ(-1, utf8_to_utf16_length_checked(invalid[0].str, invalid[0].len, NULL));
+}
+
+TEST_F(UnicodeTest, UTF16toUTF8Checked) {
+    size_t bad = 1000;
+    const char16_t valid[] = { 'a', 0x00E9, 0x4E2D, 0xD800, 0xDC00 };
+    EXPECT_EQ(1 + 2 + 3 + 4, utf16_to_utf8_length_checked(valid, 5, &bad));
+    EXPECT_EQ(1000u, bad);
+    EXPECT_EQ(0, utf16_to_utf8_length_checked(valid, 0, &bad));
+
+    const char16_t loneHigh[] = { 'a', 'b', 0xD800, 'c' };
+    EXPECT_EQ(-1, utf16_to_utf8_length_checked(loneHigh, 4, &bad));
+    EXPECT_EQ(2u, bad);
+    EXPECT_EQ(-1, utf16_to_utf8_length_checked(loneHigh, 3, &bad));
+    EXPECT_EQ(2u, bad);
+
+    const char16_t loneLow[] = { 'a', 0xDC00 };
+    EXPECT_EQ(-1, utf16_to_utf8_length_checked(loneLow, 2, &bad));
+    EXPECT_EQ(1u, bad);
+}
+
 }
@@ -0,0 +1,85 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Grows a Vector<sp<T>> to 1M items one push() at a time, and reports the
+// time taken and the reference count changes that growing caused. The
+// same vector of a plain struct holding an sp<T> shows the cost of
+// copying every item into each new buffer, which is what the vector did
+// for sp<T> before it learned to move them.
+//
+
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+namespace android {
+
+enum {
+    ITEMS_PER_RUN = 1000000,
+};
+
+// Counts reference count changes. Atomic like RefBase, since the cost of
+// the atomics is the point.
+class Counted {
+public:
+    Counted() : mCount(0) { }
+
+    void incStrong(const void* id) const {
+        android_atomic_inc(&mCount);
+        android_atomic_inc(&sChanges);
+    }
+    void decStrong(const void* id) const {
+        android_atomic_inc(&sChanges);
+        if (android_atomic_dec(&mCount) == 1) {
+            delete this;
+        }
+    }
+
+    typedef Counted basetype;
+
+    static volatile int32_t sChanges;
+
+private:
+    friend class ReferenceMover;
+    static void moveReferences(void* d, void const* s, size_t n,
+            const ReferenceConverterBase& caster) { }
+
+    mutable volatile int32_t mCount;
+};
+
+volatile int32_t Counted::sChanges = 0;
+
+// Has none of sp<>'s move support, so the vector copies it.
+struct CopiedSp {
+    sp<Counted> ptr;
+};
+
+template <typename T>
+static void run(const char* name, const T& item) {
+    Vector<T> vector;
+    Counted::sChanges = 0;
+    const nsecs_t start = systemTime();
+    for (size_t i = 0; i < ITEMS_PER_RUN; i++) {
+        vector.push(item);
+    }
+    const nsecs_t duration = systemTime() - start;
+
+    // each push() takes one reference, everything else is growing
+    const int32_t growing = Counted::sChanges - ITEMS_PER_RUN;
+    printf("%-16s %8.2f ms, %8d reference changes while growing\n",
+            name, duration / 1000000.0, growing);
+    EXPECT_EQ(size_t(ITEMS_PER_RUN), vector.size());
+}
+
+TEST(VectorBenchmark, GrowVectorOfSp) {
+    sp<Counted> item(new Counted());
+    CopiedSp copied;
+    copied.ptr = item;
+
+    run("sp<T>", item);
+    run("copied sp<T>", copied);
+}
+
+} // namespace android
@@ -16,16 +16,58 @@
 
 #define LOG_TAG "Vector_test"
 
+#include <utils/KeyedVector.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
 #include <cutils/log.h>
 #include <gtest/gtest.h>
+#include <stdio.h>
 #include <unistd.h>
 
 namespace android {
 
+// Counts every reference count change, so tests can check that moving items
+// around inside a vector doesn't copy the sp<>s.
+class Counted {
+public:
+    Counted() : mCount(0) { sLive++; }
+    ~Counted() { sLive--; }
+
+    void incStrong(const void* id) const { mCount++; sIncs++; }
+    void decStrong(const void* id) const {
+        sDecs++;
+        if (--mCount == 0) {
+            delete this;
+        }
+    }
+    int32_t getStrongCount() const { return mCount; }
+
+    typedef Counted basetype;
+
+    static void resetCounts() { sIncs = sDecs = 0; }
+
+    static int sIncs;
+    static int sDecs;
+    static int sLive;
+
+private:
+    friend class ReferenceMover;
+    static void moveReferences(void* d, void const* s, size_t n,
+            const ReferenceConverterBase& caster) { }
+
+    mutable int32_t mCount;
+};
+
+int Counted::sIncs = 0;
+int Counted::sDecs = 0;
+int Counted::sLive = 0;
+
 class VectorTest : public testing::Test {
 protected:
     virtual void SetUp() {
+        Counted::sLive = 0;
+        Counted::resetCounts();
     }
 
     virtual void TearDown() {
@@ -71,5 +113,155 @@ TEST_F(VectorTest, CopyOnWrite_CopyAndAddElements) {
     EXPECT_EQ(other[3], 5);
 }
 
+TEST_F(VectorTest, Growing_MovesSpWithoutRefCounting) {
+    const size_t N = 1000;
+    Vector< sp<Counted> > items;
+    for (size_t i = 0; i < N; i++) {
+        items.add(new Counted());
+    }
+
+    Counted::resetCounts();
+    Vector< sp<Counted> > vector;
+    for (size_t i = 0; i < N; i++) {
+        vector.push(items[i]);
+    }
+    // one reference for each push, and none for growing
+    EXPECT_EQ(int(N), Counted::sIncs);
+    EXPECT_EQ(0, Counted::sDecs);
+
+    // inserting at the front moves everything, in place or to a new buffer
+    vector.insertAt(items[0], 0, N);
+    EXPECT_EQ(int(2 * N), Counted::sIncs);
+    EXPECT_EQ(0, Counted::sDecs);
+
+    for (size_t i = 0; i < N; i++) {
+        ASSERT_EQ(items[0].get(), vector[i].get());
+        ASSERT_EQ(items[i].get(), vector[N + i].get());
+    }
+    EXPECT_EQ(int32_t(N + 2), items[0]->getStrongCount());
+    EXPECT_EQ(2, items[1]->getStrongCount());
+}
+
+TEST_F(VectorTest, Shrinking_MovesSpWithoutRefCounting) {
+    const size_t N = 1000;
+    Vector< sp<Counted> > vector;
+    for (size_t i = 0; i < N; i++) {
+        vector.add(new Counted());
+    }
+
+    Counted::resetCounts();
+    // removing from the middle shrinks the buffer and moves the rest
+    vector.removeItemsAt(10, N - 20);
+    EXPECT_EQ(20, Counted::sLive);
+    EXPECT_EQ(0, Counted::sIncs);
+    EXPECT_EQ(int(N - 20), Counted::sDecs);
+    for (size_t i = 0; i < vector.size(); i++) {
+        ASSERT_EQ(1, vector[i]->getStrongCount());
+    }
+
+    vector.clear();
+    EXPECT_EQ(0, Counted::sLive);
+}
+
+TEST_F(VectorTest, Growing_SharedStorageIsCopied) {
+    Vector< sp<Counted> > vector;
+    for (size_t i = 0; i < 4; i++) {
+        vector.add(new Counted());
+    }
+    Vector< sp<Counted> > other(vector);
+
+    Counted::resetCounts();
+    vector.add(new Counted());
+    // the four items are now in both vectors
+    EXPECT_EQ(5, Counted::sIncs);
+    EXPECT_EQ(0, Counted::sDecs);
+    EXPECT_EQ(5u, vector.size());
+    EXPECT_EQ(4u, other.size());
+    EXPECT_EQ(2, other[0]->getStrongCount());
+
+    other.clear();
+    EXPECT_EQ(1, vector[0]->getStrongCount());
+}
+
+TEST_F(VectorTest, SetCapacity_MovesSpWithoutRefCounting) {
+    Vector< sp<Counted> > vector;
+    for (size_t i = 0; i < 10; i++) {
+        vector.add(new Counted());
+    }
+
+    Counted::resetCounts();
+    vector.setCapacity(1000);
+    EXPECT_EQ(0, Counted::sIncs);
+    EXPECT_EQ(0, Counted::sDecs);
+    EXPECT_EQ(1000u, vector.capacity());
+    EXPECT_EQ(1, vector[9]->getStrongCount());
+}
+
+TEST_F(VectorTest, KeyedVector_MovesSpValuesWithoutRefCounting) {
+    const int N = 1000;
+    Vector< sp<Counted> > items;
+    for (int i = 0; i < N; i++) {
+        items.add(new Counted());
+    }
+
+    Counted::resetCounts();
+    KeyedVector<int, sp<Counted> > map;
+    // adding in reverse inserts every item at the front
+    for (int i = N - 1; i >= 0; i--) {
+        map.add(i, items[i]);
+    }
+    // add() copies the value into a temporary pair and then into the vector
+    EXPECT_EQ(2 * N, Counted::sIncs);
+    EXPECT_EQ(N, Counted::sDecs);
+    for (int i = 0; i < N; i++) {
+        ASSERT_EQ(i, map.keyAt(i));
+        ASSERT_EQ(items[i].get(), map.valueAt(i).get());
+    }
+}
+
+TEST_F(VectorTest, Growing_KeepsStrings) {
+    Vector<String8> vector;
+    for (int i = 0; i < 1000; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "%d", i);
+        vector.add(String8(name));
+    }
+    vector.insertAt(String8("first"), 0);
+    vector.removeItemsAt(1, 900);
+
+    ASSERT_EQ(101u, vector.size());
+    EXPECT_STREQ("first", vector[0].string());
+    EXPECT_STREQ("900", vector[1].string());
+    EXPECT_STREQ("999", vector[100].string());
+}
+
+#if __cplusplus >= 201103L
+TEST_F(VectorTest, PushMovesItem) {
+    Vector< sp<Counted> > vector;
+    sp<Counted> item(new Counted());
+
+    Counted::resetCounts();
+    vector.push(std::move(item));
+    EXPECT_EQ(0, Counted::sIncs);
+    EXPECT_EQ(0, Counted::sDecs);
+    EXPECT_TRUE(item == NULL);
+    EXPECT_EQ(1, vector[0]->getStrongCount());
+}
+
+TEST_F(VectorTest, EmplaceConstructsInPlace) {
+    Vector<String8> vector;
+    EXPECT_EQ(0, vector.emplace("abc", 2));
+    EXPECT_EQ(1, vector.emplace());
+    EXPECT_STREQ("ab", vector[0].string());
+    EXPECT_STREQ("", vector[1].string());
+
+    Vector< sp<Counted> > sps;
+    Counted* counted = new Counted();
+    Counted::resetCounts();
+    sps.emplace(counted);
+    EXPECT_EQ(1, Counted::sIncs);
+    EXPECT_EQ(0, Counted::sDecs);
+}
+#endif
 
 } // namespace android
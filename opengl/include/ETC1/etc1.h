@@ -43,6 +43,23 @@ extern "C" {
 
 void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 validPixelMask, etc1_byte* pOut);
 
+// Encoder quality presets.
+//
+// ETC1_QUALITY_FAST only tries the modifier tables closest to the spread of each sub-block.
+// ETC1_QUALITY_MEDIUM is what etc1_encode_block does.
+// ETC1_QUALITY_EXHAUSTIVE also tries base colors around the sub-block averages, in both
+// the differential and the individual mode. Its (luminance weighted) error is never
+// larger than that of ETC1_QUALITY_MEDIUM.
+
+#define ETC1_QUALITY_FAST 0
+#define ETC1_QUALITY_MEDIUM 1
+#define ETC1_QUALITY_EXHAUSTIVE 2
+
+// Encode a block of pixels with the given quality preset. See etc1_encode_block.
+
+void etc1_encode_block_quality(const etc1_byte* pIn, etc1_uint32 validPixelMask,
+        etc1_byte* pOut, int quality);
+
 // Decode a block of pixels.
 //
 // pIn is an ETC1 compressed version of the data.
@@ -67,6 +84,14 @@ etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height);
 int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut);
 
+// Encode an entire image with the given quality preset, splitting the rows of blocks
+// between up to threadCount threads (including the calling one). The output is the same
+// for any threadCount. See etc1_encode_image.
+
+int etc1_encode_image_quality(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut,
+        int quality, etc1_uint32 threadCount);
+
 // Decode an entire image.
 // pIn - pointer to encoded data.
 // pOut - pointer to the image data. Will be written such that
@@ -19,8 +19,10 @@
 #include "egl_impl.h"
 #include "egldefs.h"
 
+#include <utils/FileMap.h>
+
 #include <fcntl.h>
-#include <sys/mman.h>
+#include <stddef.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -42,6 +44,16 @@ static const size_t maxTotalSize = MAX_EGL_CACHE_SIZE;
 static const char* cacheFileMagic = "EGL$";
 static const size_t cacheFileHeaderSize = 8;
 
+// Journal file.  New entries are appended to "<cache file>.journal" as
+// checksummed records instead of rewriting the whole cache file; see
+// egl_cache.h for the layout.
+static const char* journalFileMagic = "EGJ$";
+static const uint32_t journalFileVersion = 1;
+
+// The cache file is rewritten, and the journal emptied, once the bytes on
+// disk that no longer correspond to live cache entries exceed this.
+static const size_t journalCompactionThreshold = maxTotalSize / 4;
+
 // The time in seconds to wait before saving newly inserted cache entries.
 static const unsigned int deferredSaveDelay = 4;
 
@@ -69,7 +81,11 @@ static EGLsizeiANDROID getBlob(const void* key, EGLsizeiANDROID keySize,
 //
 egl_cache_t::egl_cache_t() :
         mInitialized(false),
-        mBlobCache(NULL) {
+        mBlobCache(NULL),
+        mSnapshotSize(0),
+        mSnapshotCrc(0),
+        mJournalSize(0),
+        mCompactPending(false) {
 }
 
 egl_cache_t::~egl_cache_t() {
@@ -125,6 +141,9 @@ void egl_cache_t::terminate() {
         saveBlobCacheLocked();
         mBlobCache = NULL;
     }
+    mJournalPending.clear();
+    mSnapshotSize = 0;
+    mJournalSize = 0;
     mInitialized = false;
 }
 
@@ -140,6 +159,7 @@ void egl_cache_t::setBlob(const void* key, EGLsizeiANDROID keySize,
     if (mInitialized) {
         sp<BlobCache> bc = getBlobCacheLocked();
         bc->set(key, keySize, value, valueSize);
+        queueJournalRecordLocked(key, keySize, value, valueSize);
 
         if (!mSavePending) {
             class DeferredSaveThread : public Thread {
@@ -186,6 +206,8 @@ EGLsizeiANDROID egl_cache_t::getBlob(const void* key, EGLsizeiANDROID keySize,
 void egl_cache_t::setCacheFilename(const char* filename) {
     Mutex::Autolock lock(mMutex);
     mFilename = filename;
+    mJournalFilename = filename;
+    mJournalFilename.append(".journal");
 }
 
 sp<BlobCache> egl_cache_t::getBlobCacheLocked() {
@@ -196,90 +218,311 @@ sp<BlobCache> egl_cache_t::getBlobCacheLocked() {
     return mBlobCache;
 }
 
+static inline size_t align4(size_t size) {
+    return (size + 3) & ~3;
+}
+
 static uint32_t crc32c(const uint8_t* buf, size_t len) {
-    const uint32_t polyBits = 0x82F63B78;
-    uint32_t r = 0;
-    for (size_t i = 0; i < len; i++) {
-        r ^= buf[i];
-        for (int j = 0; j < 8; j++) {
-            if (r & 1) {
-                r = (r >> 1) ^ polyBits;
-            } else {
-                r >>= 1;
+    // Table-driven form of the bitwise CRC-32C; the file stays compatible.
+    // The table is only touched with the cache mutex held.
+    static uint32_t table[256];
+    static bool tableInitialized = false;
+    if (!tableInitialized) {
+        const uint32_t polyBits = 0x82F63B78;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t r = i;
+            for (int j = 0; j < 8; j++) {
+                if (r & 1) {
+                    r = (r >> 1) ^ polyBits;
+                } else {
+                    r >>= 1;
+                }
             }
+            table[i] = r;
         }
+        tableInitialized = true;
+    }
+
+    uint32_t r = 0;
+    for (size_t i = 0; i < len; i++) {
+        r = table[(r ^ buf[i]) & 0xff] ^ (r >> 8);
     }
     return r;
 }
 
+void egl_cache_t::queueJournalRecordLocked(const void* key, size_t keySize,
+        const void* value, size_t valueSize) {
+    if (mFilename.length() == 0 || mCompactPending || keySize == 0 ||
+            valueSize == 0 || keySize > maxKeySize || valueSize > maxValueSize) {
+        return;
+    }
+    const size_t recordSize = align4(sizeof(JournalRecord) + keySize + valueSize);
+    if (mJournalPending.size() + recordSize > maxTotalSize) {
+        // Rewriting the cache is cheaper than journaling this much.
+        mJournalPending.clear();
+        mCompactPending = true;
+        return;
+    }
+
+    const size_t pos = mJournalPending.size();
+    mJournalPending.insertAt(0, pos, recordSize);
+    uint8_t* record = mJournalPending.editArray() + pos;
+    JournalRecord* header = reinterpret_cast<JournalRecord*>(record);
+    header->mKeySize = keySize;
+    header->mValueSize = valueSize;
+    memcpy(header->mData, key, keySize);
+    memcpy(header->mData + keySize, value, valueSize);
+    header->mCrc = crc32c(record + sizeof(uint32_t),
+            sizeof(JournalRecord) - sizeof(uint32_t) + keySize + valueSize);
+}
+
 void egl_cache_t::saveBlobCacheLocked() {
     if (mFilename.length() > 0) {
-        size_t cacheSize = mBlobCache->getFlattenedSize();
-        size_t headerSize = cacheFileHeaderSize;
-        const char* fname = mFilename.string();
+        BlobCache::Stats stats;
+        mBlobCache->getStats(&stats);
+        ALOGV("saving cache: %d entries, %d bytes, %u hits, %u misses, "
+                "%u evictions", stats.entries, stats.totalSize, stats.hits,
+                stats.misses, stats.evictions);
+
+        // Everything on disk beyond what a fresh cache file would hold is
+        // garbage: evicted entries and values that were replaced since.
+        const size_t onDisk = mSnapshotSize + mJournalSize +
+                mJournalPending.size();
+        const size_t live = cacheFileHeaderSize + mBlobCache->getFlattenedSize();
+        const size_t garbage = onDisk > live ? onDisk - live : 0;
+
+        bool compact = mCompactPending || mSnapshotSize == 0 ||
+                garbage > journalCompactionThreshold;
+        if (!compact && !mJournalPending.isEmpty()) {
+            compact = !appendJournalLocked();
+        }
+        if (compact) {
+            writeSnapshotLocked();
+        }
+        mJournalPending.clear();
+        mCompactPending = false;
+    }
+}
 
-        // Try to create the file with no permissions so we can write it
-        // without anyone trying to read it.
-        int fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
-        if (fd == -1) {
-            if (errno == EEXIST) {
-                // The file exists, delete it and try again.
-                if (unlink(fname) == -1) {
-                    // No point in retrying if the unlink failed.
-                    ALOGE("error unlinking cache file %s: %s (%d)", fname,
-                            strerror(errno), errno);
-                    return;
-                }
-                // Retry now that we've unlinked the file.
-                fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
-            }
-            if (fd == -1) {
-                ALOGE("error creating cache file %s: %s (%d)", fname,
-                        strerror(errno), errno);
+bool egl_cache_t::appendJournalLocked() {
+    if (mJournalSize == 0) {
+        // There is no valid journal to append to.
+        return false;
+    }
+    const char* fname = mJournalFilename.string();
+    int fd = open(fname, O_WRONLY, 0);
+    if (fd == -1) {
+        ALOGE("error opening cache journal %s: %s (%d)", fname,
+                strerror(errno), errno);
+        return false;
+    }
+
+    // Drop anything after the last good record, such as a record that was
+    // only partly written when the process died, before appending.
+    const size_t size = mJournalPending.size();
+    if (ftruncate(fd, mJournalSize) == -1 ||
+            pwrite(fd, mJournalPending.array(), size, mJournalSize) != ssize_t(size) ||
+            fdatasync(fd) == -1) {
+        ALOGE("error appending to cache journal: %s (%d)", strerror(errno),
+                errno);
+        close(fd);
+        return false;
+    }
+    close(fd);
+
+    mJournalSize += size;
+    ALOGV("appended %d bytes to the cache journal (now %d bytes)", size,
+            mJournalSize);
+    return true;
+}
+
+void egl_cache_t::writeSnapshotLocked() {
+    size_t cacheSize = mBlobCache->getFlattenedSize();
+    size_t headerSize = cacheFileHeaderSize;
+    const char* fname = mFilename.string();
+    String8 tmpName(mFilename);
+    tmpName.append(".tmp");
+
+    // Write the new contents to a temporary file with no permissions so we
+    // can write it without anyone trying to read it, then rename it over
+    // the cache file.  A crash at any point leaves either the old or the
+    // new cache file in place.
+    int fd = open(tmpName.string(), O_CREAT | O_EXCL | O_RDWR, 0);
+    if (fd == -1) {
+        if (errno == EEXIST) {
+            // A previous save was interrupted; delete it and try again.
+            if (unlink(tmpName.string()) == -1) {
+                // No point in retrying if the unlink failed.
+                ALOGE("error unlinking cache file %s: %s (%d)",
+                        tmpName.string(), strerror(errno), errno);
                 return;
             }
+            // Retry now that we've unlinked the file.
+            fd = open(tmpName.string(), O_CREAT | O_EXCL | O_RDWR, 0);
         }
-
-        size_t fileSize = headerSize + cacheSize;
-
-        uint8_t* buf = new uint8_t [fileSize];
-        if (!buf) {
-            ALOGE("error allocating buffer for cache contents: %s (%d)",
+        if (fd == -1) {
+            ALOGE("error creating cache file %s: %s (%d)", tmpName.string(),
                     strerror(errno), errno);
-            close(fd);
-            unlink(fname);
             return;
         }
+    }
 
-        status_t err = mBlobCache->flatten(buf + headerSize, cacheSize, NULL,
-                0);
-        if (err != OK) {
-            ALOGE("error writing cache contents: %s (%d)", strerror(-err),
-                    -err);
-            delete [] buf;
-            close(fd);
-            unlink(fname);
-            return;
-        }
+    size_t fileSize = headerSize + cacheSize;
 
-        // Write the file magic and CRC
-        memcpy(buf, cacheFileMagic, 4);
-        uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
-        *crc = crc32c(buf + headerSize, cacheSize);
+    uint8_t* buf = new uint8_t [fileSize];
+    if (!buf) {
+        ALOGE("error allocating buffer for cache contents: %s (%d)",
+                strerror(errno), errno);
+        close(fd);
+        unlink(tmpName.string());
+        return;
+    }
 
-        if (write(fd, buf, fileSize) == -1) {
-            ALOGE("error writing cache file: %s (%d)", strerror(errno),
-                    errno);
-            delete [] buf;
-            close(fd);
-            unlink(fname);
-            return;
-        }
+    status_t err = mBlobCache->flatten(buf + headerSize, cacheSize, NULL,
+            0);
+    if (err != OK) {
+        ALOGE("error writing cache contents: %s (%d)", strerror(-err),
+                -err);
+        delete [] buf;
+        close(fd);
+        unlink(tmpName.string());
+        return;
+    }
+
+    // Write the file magic and CRC
+    memcpy(buf, cacheFileMagic, 4);
+    uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
+    *crc = crc32c(buf + headerSize, cacheSize);
+    const uint32_t snapshotCrc = *crc;
 
+    if (write(fd, buf, fileSize) == -1 || fsync(fd) == -1) {
+        ALOGE("error writing cache file: %s (%d)", strerror(errno),
+                errno);
         delete [] buf;
-        fchmod(fd, S_IRUSR);
         close(fd);
+        unlink(tmpName.string());
+        return;
+    }
+
+    delete [] buf;
+    fchmod(fd, S_IRUSR);
+    close(fd);
+
+    if (rename(tmpName.string(), fname) == -1) {
+        ALOGE("error renaming cache file to %s: %s (%d)", fname,
+                strerror(errno), errno);
+        unlink(tmpName.string());
+        return;
+    }
+
+    mSnapshotSize = fileSize;
+    mSnapshotCrc = snapshotCrc;
+    resetJournalLocked();
+}
+
+void egl_cache_t::resetJournalLocked() {
+    // The header names the cache file the journal applies to, so if we die
+    // between renaming a new cache file into place and getting here, the
+    // old journal is ignored rather than replayed on top of it.
+    JournalHeader header;
+    memcpy(header.mMagic, journalFileMagic, 4);
+    header.mVersion = journalFileVersion;
+    header.mSnapshotCrc = mSnapshotCrc;
+    header.mHeaderCrc = crc32c(reinterpret_cast<const uint8_t*>(&header),
+            offsetof(JournalHeader, mHeaderCrc));
+
+    mJournalSize = 0;
+    const char* fname = mJournalFilename.string();
+    int fd = open(fname, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        ALOGE("error creating cache journal %s: %s (%d)", fname,
+                strerror(errno), errno);
+        return;
+    }
+    if (write(fd, &header, sizeof(header)) != ssize_t(sizeof(header)) ||
+            fdatasync(fd) == -1) {
+        ALOGE("error writing cache journal header: %s (%d)", strerror(errno),
+                errno);
+        close(fd);
+        unlink(fname);
+        return;
     }
+    close(fd);
+    mJournalSize = sizeof(header);
+}
+
+void egl_cache_t::replayJournalLocked() {
+    const char* fname = mJournalFilename.string();
+    int fd = open(fname, O_RDONLY, 0);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            ALOGE("error opening cache journal %s: %s (%d)", fname,
+                    strerror(errno), errno);
+        }
+        return;
+    }
+
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) == -1 || size_t(statBuf.st_size) < sizeof(JournalHeader)) {
+        close(fd);
+        return;
+    }
+    const size_t fileSize = statBuf.st_size;
+
+    FileMap* map = new FileMap();
+    if (!map->create(fname, fd, 0, fileSize, true)) {
+        ALOGE("error mmaping cache journal: %s (%d)", strerror(errno), errno);
+        map->release();
+        close(fd);
+        return;
+    }
+    close(fd);
+    const uint8_t* buf = reinterpret_cast<const uint8_t*>(map->getDataPtr());
+
+    const JournalHeader* header = reinterpret_cast<const JournalHeader*>(buf);
+    if (memcmp(header->mMagic, journalFileMagic, 4) != 0 ||
+            header->mVersion != journalFileVersion ||
+            header->mHeaderCrc != crc32c(buf, offsetof(JournalHeader, mHeaderCrc)) ||
+            header->mSnapshotCrc != mSnapshotCrc) {
+        // Stale or damaged; the next save starts a new journal.
+        ALOGV("ignoring cache journal that does not match the cache file");
+        map->release();
+        return;
+    }
+
+    // Replay records until the end of the file or the first record that
+    // is truncated or fails its checksum; everything after that point was
+    // never completely written.
+    size_t pos = sizeof(JournalHeader);
+    size_t replayed = 0;
+    while (pos + sizeof(JournalRecord) <= fileSize) {
+        const JournalRecord* record =
+                reinterpret_cast<const JournalRecord*>(buf + pos);
+        const size_t keySize = record->mKeySize;
+        const size_t valueSize = record->mValueSize;
+        if (keySize > maxKeySize || valueSize > maxValueSize ||
+                pos + sizeof(JournalRecord) + keySize + valueSize > fileSize) {
+            break;
+        }
+        if (record->mCrc != crc32c(buf + pos + sizeof(uint32_t),
+                sizeof(JournalRecord) - sizeof(uint32_t) + keySize + valueSize)) {
+            break;
+        }
+        mBlobCache->set(record->mData, keySize, record->mData + keySize,
+                valueSize);
+        pos += align4(sizeof(JournalRecord) + keySize + valueSize);
+        replayed++;
+    }
+    if (pos > fileSize) {
+        pos = fileSize;
+    }
+    if (pos < fileSize) {
+        ALOGW("cache journal has %d bytes of incomplete records",
+                fileSize - pos);
+    }
+    ALOGV("replayed %d cache journal records", replayed);
+    mJournalSize = pos;
+    map->release();
 }
 
 void egl_cache_t::loadBlobCacheLocked() {
@@ -310,41 +553,55 @@ void egl_cache_t::loadBlobCacheLocked() {
             return;
         }
 
-        uint8_t* buf = reinterpret_cast<uint8_t*>(mmap(NULL, fileSize,
-                PROT_READ, MAP_PRIVATE, fd, 0));
-        if (buf == MAP_FAILED) {
+        if (fileSize < headerSize) {
+            ALOGE("cache file is too small: %#llx", statBuf.st_size);
+            close(fd);
+            return;
+        }
+
+        // The cache keeps serving entries straight out of this mapping
+        // until they are evicted or replaced, so they are never copied to
+        // the heap.  The mapping stays valid after the file is replaced by
+        // the next save.
+        FileMap* map = new FileMap();
+        if (!map->create(mFilename.string(), fd, 0, fileSize, true)) {
             ALOGE("error mmaping cache file: %s (%d)", strerror(errno),
                     errno);
+            map->release();
             close(fd);
             return;
         }
+        close(fd);
+        const uint8_t* buf = reinterpret_cast<const uint8_t*>(map->getDataPtr());
 
         // Check the file magic and CRC
         size_t cacheSize = fileSize - headerSize;
         if (memcmp(buf, cacheFileMagic, 4) != 0) {
             ALOGE("cache file has bad mojo");
-            close(fd);
+            map->release();
             return;
         }
-        uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
-        if (crc32c(buf + headerSize, cacheSize) != *crc) {
+        // copied out: the mapping goes away with the last reference to it,
+        // which unflattenMapped() only keeps if it retained any entries
+        const uint32_t crc = *reinterpret_cast<const uint32_t*>(buf + 4);
+        if (crc32c(buf + headerSize, cacheSize) != crc) {
             ALOGE("cache file failed CRC check");
-            close(fd);
+            map->release();
             return;
         }
 
-        status_t err = mBlobCache->unflatten(buf + headerSize, cacheSize, NULL,
-                0);
+        status_t err = mBlobCache->unflattenMapped(map, headerSize);
         if (err != OK) {
             ALOGE("error reading cache contents: %s (%d)", strerror(-err),
                     -err);
-            munmap(buf, fileSize);
-            close(fd);
+            map->release();
             return;
         }
+        map->release();
 
-        munmap(buf, fileSize);
-        close(fd);
+        mSnapshotSize = fileSize;
+        mSnapshotCrc = crc;
+        replayJournalLocked();
     }
 }
 
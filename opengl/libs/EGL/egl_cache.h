@@ -23,6 +23,7 @@
 #include <utils/BlobCache.h>
 #include <utils/String8.h>
 #include <utils/StrongPointer.h>
+#include <utils/Vector.h>
 
 // ----------------------------------------------------------------------------
 namespace android {
@@ -81,13 +82,66 @@ private:
     sp<BlobCache> getBlobCacheLocked();
 
     // saveBlobCache attempts to save the current contents of mBlobCache to
-    // disk.
+    // disk.  Entries set since the last save are appended to the journal,
+    // unless the files on disk hold enough stale data that rewriting the
+    // cache file is worthwhile.
     void saveBlobCacheLocked();
 
     // loadBlobCache attempts to load the saved cache contents from disk into
-    // mBlobCache.
+    // mBlobCache, replaying the journal on top of them.
     void loadBlobCacheLocked();
 
+    // queueJournalRecordLocked adds a record for a key/value pair passed to
+    // setBlob to mJournalPending.
+    void queueJournalRecordLocked(const void* key, size_t keySize,
+            const void* value, size_t valueSize);
+
+    // appendJournalLocked writes mJournalPending to the end of the journal.
+    // It returns false if the journal could not be written.
+    bool appendJournalLocked();
+
+    // writeSnapshotLocked replaces the cache file with the full contents of
+    // mBlobCache and starts a new, empty journal.
+    void writeSnapshotLocked();
+
+    // resetJournalLocked truncates the journal to a header that refers to
+    // the current cache file.
+    void resetJournalLocked();
+
+    // replayJournalLocked applies the valid records of the journal to
+    // mBlobCache, if the journal belongs to the cache file just loaded.
+    void replayJournalLocked();
+
+    // The journal starts with a JournalHeader and is followed by
+    // JournalRecords, each 4-byte aligned.  Neither needs to be portable;
+    // like the cache file, the journal is only read by the device that
+    // wrote it.
+    struct JournalHeader {
+        // mMagic is 'EGJ$'.
+        char mMagic[4];
+
+        // mVersion is the journal format version.
+        uint32_t mVersion;
+
+        // mSnapshotCrc is the CRC of the cache file the records apply to.
+        uint32_t mSnapshotCrc;
+
+        // mHeaderCrc is the CRC of the preceding header fields.
+        uint32_t mHeaderCrc;
+    };
+
+    struct JournalRecord {
+        // mCrc is the CRC of the rest of the record, including the key and
+        // value data.  It must be the first field.
+        uint32_t mCrc;
+
+        uint32_t mKeySize;
+        uint32_t mValueSize;
+
+        // mData contains the key followed immediately by the value.
+        uint8_t mData[];
+    };
+
     // mInitialized indicates whether the egl_cache_t is in the initialized
     // state.  It is initialized to false at construction time, and gets set to
     // true when initialize is called.  It is set back to false when terminate
@@ -108,6 +162,25 @@ private:
     // from disk.
     String8 mFilename;
 
+    // mJournalFilename is mFilename with ".journal" appended; the journal
+    // holds the entries inserted since the cache file was last written.
+    String8 mJournalFilename;
+
+    // mSnapshotSize and mSnapshotCrc describe the cache file as last loaded
+    // or written.  mSnapshotSize is 0 if there is none.
+    size_t mSnapshotSize;
+    uint32_t mSnapshotCrc;
+
+    // mJournalSize is the size of the valid part of the journal, or 0 if
+    // there is no usable journal.
+    size_t mJournalSize;
+
+    // mJournalPending holds the records queued by setBlob since the last
+    // save.  If it grows too large it is dropped and mCompactPending is set
+    // so that the next save rewrites the cache file instead.
+    Vector<uint8_t> mJournalPending;
+    bool mCompactPending;
+
     // mSavePending indicates whether or not a deferred save operation is
     // pending.  Each time a key/value pair is inserted into the cache via
     // setBlob, a deferred save is initiated if one is not already pending.
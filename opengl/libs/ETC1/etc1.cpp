@@ -16,6 +16,10 @@
 
 #include <string.h>
 
+#if defined(HAVE_PTHREADS)
+#include <pthread.h>
+#endif
+
 /* From http://www.khronos.org/registry/gles/extensions/OES/OES_compressed_ETC1_RGB8_texture.txt
 
  The number of bits that represent a 4x4 texel block is 64 bits if
@@ -163,35 +167,95 @@ inline int convertDiff(int base, int diff) {
     return convert5To8((0x1f & base) + kLookup[0x7 & diff]);
 }
 
-static
-void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
-        etc1_uint32 low, bool second, bool flipped) {
-    int baseX = 0;
-    int baseY = 0;
-    if (second) {
-        if (flipped) {
-            baseY = 2;
-        } else {
-            baseX = 2;
-        }
+// The decoder works on a palette of the four colors each sub-block can
+// produce, computed with saturating byte arithmetic.  etc1_u8x16 wraps the
+// NEON or SSE2 registers that do this sixteen bytes (four RGBX colors) at a
+// time, with a plain C fallback.
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+typedef uint8x16_t etc1_u8x16;
+static inline etc1_u8x16 u8x16_load(const etc1_byte* p) { return vld1q_u8(p); }
+static inline void u8x16_store(etc1_byte* p, etc1_u8x16 v) { vst1q_u8(p, v); }
+static inline etc1_u8x16 u8x16_adds(etc1_u8x16 a, etc1_u8x16 b) { return vqaddq_u8(a, b); }
+static inline etc1_u8x16 u8x16_subs(etc1_u8x16 a, etc1_u8x16 b) { return vqsubq_u8(a, b); }
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128i etc1_u8x16;
+static inline etc1_u8x16 u8x16_load(const etc1_byte* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+static inline void u8x16_store(etc1_byte* p, etc1_u8x16 v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+static inline etc1_u8x16 u8x16_adds(etc1_u8x16 a, etc1_u8x16 b) { return _mm_adds_epu8(a, b); }
+static inline etc1_u8x16 u8x16_subs(etc1_u8x16 a, etc1_u8x16 b) { return _mm_subs_epu8(a, b); }
+#else
+typedef struct { etc1_byte v[16]; } etc1_u8x16;
+static inline etc1_u8x16 u8x16_load(const etc1_byte* p) {
+    etc1_u8x16 r;
+    memcpy(r.v, p, 16);
+    return r;
+}
+static inline void u8x16_store(etc1_byte* p, etc1_u8x16 v) { memcpy(p, v.v, 16); }
+static inline etc1_u8x16 u8x16_adds(etc1_u8x16 a, etc1_u8x16 b) {
+    for (int i = 0; i < 16; i++) {
+        int x = a.v[i] + b.v[i];
+        a.v[i] = (etc1_byte) (x < 255 ? x : 255);
     }
-    for (int i = 0; i < 8; i++) {
-        int x, y;
-        if (flipped) {
-            x = baseX + (i >> 1);
-            y = baseY + (i & 1);
-        } else {
-            x = baseX + (i >> 2);
-            y = baseY + (i & 3);
-        }
-        int k = y + (x * 4);
-        int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
-        int delta = table[offset];
-        etc1_byte* q = pOut + 3 * (x + 4 * y);
-        *q++ = clamp(r + delta);
-        *q++ = clamp(g + delta);
-        *q++ = clamp(b + delta);
+    return a;
+}
+static inline etc1_u8x16 u8x16_subs(etc1_u8x16 a, etc1_u8x16 b) {
+    for (int i = 0; i < 16; i++) {
+        int x = a.v[i] - b.v[i];
+        a.v[i] = (etc1_byte) (x > 0 ? x : 0);
     }
+    return a;
+}
+#endif
+
+// Positive and negative parts of each row of kModifierTable, laid out to
+// match a palette of four RGBX colors.
+typedef struct {
+    etc1_byte add[16];
+    etc1_byte sub[16];
+} etc1_palette_delta;
+
+static const etc1_palette_delta kPaletteDelta[8] = {
+    { { 2, 2, 2, 0, 8, 8, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 0, 8, 8, 8, 0 } },
+    { { 5, 5, 5, 0, 17, 17, 17, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 5, 5, 5, 0, 17, 17, 17, 0 } },
+    { { 9, 9, 9, 0, 29, 29, 29, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 9, 9, 9, 0, 29, 29, 29, 0 } },
+    { { 13, 13, 13, 0, 42, 42, 42, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 13, 13, 13, 0, 42, 42, 42, 0 } },
+    { { 18, 18, 18, 0, 60, 60, 60, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 18, 18, 18, 0, 60, 60, 60, 0 } },
+    { { 24, 24, 24, 0, 80, 80, 80, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 24, 24, 24, 0, 80, 80, 80, 0 } },
+    { { 33, 33, 33, 0, 106, 106, 106, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 33, 33, 33, 0, 106, 106, 106, 0 } },
+    { { 47, 47, 47, 0, 183, 183, 183, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 47, 47, 47, 0, 183, 183, 183, 0 } },
+};
+
+// Fills pPalette with the four colors, as RGBX, that a sub-block with base
+// color (r, g, b) and the given modifier table decodes to.
+static inline
+void decode_palette(etc1_byte* pPalette, int r, int g, int b, int table) {
+    etc1_byte base[16];
+    for (int i = 0; i < 4; i++) {
+        base[i * 4 + 0] = (etc1_byte) r;
+        base[i * 4 + 1] = (etc1_byte) g;
+        base[i * 4 + 2] = (etc1_byte) b;
+        base[i * 4 + 3] = 0;
+    }
+    const etc1_palette_delta& delta = kPaletteDelta[table];
+    etc1_u8x16 v = u8x16_load(base);
+    v = u8x16_adds(v, u8x16_load(delta.add));
+    v = u8x16_subs(v, u8x16_load(delta.sub));
+    u8x16_store(pPalette, v);
 }
 
 // Input is an ETC1 compressed version of the data.
@@ -223,11 +287,24 @@ void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
     }
     int tableIndexA = 7 & (high >> 5);
     int tableIndexB = 7 & (high >> 2);
-    const int* tableA = kModifierTable + tableIndexA * 4;
-    const int* tableB = kModifierTable + tableIndexB * 4;
+    // Colors 0-3 belong to the first sub-block, 4-7 to the second.
+    etc1_byte palette[32];
+    decode_palette(palette, r1, g1, b1, tableIndexA);
+    decode_palette(palette + 16, r2, g2, b2, tableIndexB);
+
     bool flipped = (high & 1) != 0;
-    decode_subblock(pOut, r1, g1, b1, tableA, low, false, flipped);
-    decode_subblock(pOut, r2, g2, b2, tableB, low, true, flipped);
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            int k = y + (x * 4);
+            int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
+            int second = flipped ? (y >> 1) : (x >> 1);
+            const etc1_byte* c = palette + (second * 4 + offset) * 4;
+            etc1_byte* q = pOut + 3 * (x + 4 * y);
+            q[0] = c[0];
+            q[1] = c[1];
+            q[2] = c[2];
+        }
+    }
 }
 
 typedef struct {
@@ -331,11 +408,23 @@ static etc1_uint32 chooseModifier(const etc1_byte* pBaseColors,
     return bestScore;
 }
 
+// The valid pixels of one sub-block, and for each the terms of its error
+// against the current base color that don't depend on the modifier.
+typedef struct {
+    int count;
+    const etc1_byte* pixels[8];
+    int bitIndex[8];
+    // With e = base - pixel per channel, d = 3 eR + 6 eG + eB and
+    // c = 3 eR^2 + 6 eG^2 + eB^2, so that as long as nothing clamps the
+    // error for modifier m is 10 m^2 + 2 m d + c.
+    int d[8];
+    int c[8];
+} etc_subblock;
+
 static
-void etc_encode_subblock_helper(const etc1_byte* pIn, etc1_uint32 inMask,
-        etc_compressed* pCompressed, bool flipped, bool second,
-        const etc1_byte* pBaseColors, const int* pModifierTable) {
-    int score = pCompressed->score;
+void etc_gather_subblock(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc_subblock* pSub, bool flipped, bool second) {
+    int count = 0;
     if (flipped) {
         int by = 0;
         if (second) {
@@ -346,8 +435,9 @@ void etc_encode_subblock_helper(const etc1_byte* pIn, etc1_uint32 inMask,
             for (int x = 0; x < 4; x++) {
                 int i = x + 4 * yy;
                 if (inMask & (1 << i)) {
-                    score += chooseModifier(pBaseColors, pIn + i * 3,
-                            &pCompressed->low, yy + x * 4, pModifierTable);
+                    pSub->pixels[count] = pIn + i * 3;
+                    pSub->bitIndex[count] = yy + x * 4;
+                    count++;
                 }
             }
         }
@@ -361,21 +451,109 @@ void etc_encode_subblock_helper(const etc1_byte* pIn, etc1_uint32 inMask,
                 int xx = bx + x;
                 int i = xx + 4 * y;
                 if (inMask & (1 << i)) {
-                    score += chooseModifier(pBaseColors, pIn + i * 3,
-                            &pCompressed->low, y + xx * 4, pModifierTable);
+                    pSub->pixels[count] = pIn + i * 3;
+                    pSub->bitIndex[count] = y + xx * 4;
+                    count++;
                 }
             }
         }
     }
+    pSub->count = count;
+}
+
+static
+void etc_prepare_subblock(etc_subblock* pSub, const etc1_byte* pBaseColors) {
+    for (int i = 0; i < pSub->count; i++) {
+        const etc1_byte* p = pSub->pixels[i];
+        int er = pBaseColors[0] - p[0];
+        int eg = pBaseColors[1] - p[1];
+        int eb = pBaseColors[2] - p[2];
+        pSub->d[i] = 3 * er + 6 * eg + eb;
+        pSub->c[i] = 3 * square(er) + 6 * square(eg) + square(eb);
+    }
+}
+
+// Returns true if some modifier of the table can take a channel of the base
+// color out of [0, 255].
+static inline
+bool modifierMayClamp(const etc1_byte* pBaseColors, const int* pModifierTable) {
+    int big = pModifierTable[1];
+    for (int i = 0; i < 3; i++) {
+        if (pBaseColors[i] < big || pBaseColors[i] + big > 255) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Same result as chooseModifier, for a base color and table that don't
+// clamp; ties go to the lowest index in both.
+static inline
+etc1_uint32 chooseModifierUnclamped(int d, int c, etc1_uint32* pLow,
+        int bitIndex, const int* pModifierTable) {
+    etc1_uint32 bestScore = ~0;
+    int bestIndex = 0;
+    for (int i = 0; i < 4; i++) {
+        int modifier = pModifierTable[i];
+        etc1_uint32 score = (etc1_uint32) (c + modifier * (10 * modifier + 2 * d));
+        if (score < bestScore) {
+            bestScore = score;
+            bestIndex = i;
+        }
+    }
+    etc1_uint32 lowMask = (((bestIndex >> 1) << 16) | (bestIndex & 1))
+            << bitIndex;
+    *pLow |= lowMask;
+    return bestScore;
+}
+
+static
+void etc_encode_subblock_helper(const etc_subblock* pSub,
+        etc_compressed* pCompressed, const etc1_byte* pBaseColors,
+        const int* pModifierTable) {
+    int score = pCompressed->score;
+    if (!modifierMayClamp(pBaseColors, pModifierTable)) {
+        for (int i = 0; i < pSub->count; i++) {
+            score += chooseModifierUnclamped(pSub->d[i], pSub->c[i],
+                    &pCompressed->low, pSub->bitIndex[i], pModifierTable);
+        }
+    } else {
+        for (int i = 0; i < pSub->count; i++) {
+            score += chooseModifier(pBaseColors, pSub->pixels[i],
+                    &pCompressed->low, pSub->bitIndex[i], pModifierTable);
+        }
+    }
     pCompressed->score = score;
 }
 
+// Picks the range of modifier tables worth trying for a sub-block at
+// ETC1_QUALITY_FAST: the smallest table whose large modifier covers the
+// pixel furthest from the base color, and the one below it.
+static
+void etc_guess_tables(const etc_subblock* pSub, int* pFirst, int* pLast) {
+    int maxDeviation = 0;
+    for (int i = 0; i < pSub->count; i++) {
+        int deviation = pSub->d[i] >= 0 ? pSub->d[i] : -pSub->d[i];
+        if (deviation > maxDeviation) {
+            maxDeviation = deviation;
+        }
+    }
+    maxDeviation = (maxDeviation + 5) / 10;
+    int table = 0;
+    while (table < 7 && kModifierTable[table * 4 + 1] < maxDeviation) {
+        table++;
+    }
+    *pFirst = table > 0 ? table - 1 : 0;
+    *pLast = table;
+}
+
 static bool inRange4bitSigned(int color) {
     return color >= -4 && color <= 3;
 }
 
 static void etc_encodeBaseColors(etc1_byte* pBaseColors,
-        const etc1_byte* pColors, etc_compressed* pCompressed) {
+        const etc1_byte* pColors, etc_compressed* pCompressed,
+        bool allowDifferential) {
     int r1, g1, b1, r2, g2, b2; // 8 bit base colors for sub-blocks
     bool differential;
     {
@@ -394,8 +572,8 @@ static void etc_encodeBaseColors(etc1_byte* pBaseColors,
         int dg = g52 - g51;
         int db = b52 - b51;
 
-        differential = inRange4bitSigned(dr) && inRange4bitSigned(dg)
-                && inRange4bitSigned(db);
+        differential = allowDifferential && inRange4bitSigned(dr)
+                && inRange4bitSigned(dg) && inRange4bitSigned(db);
         if (differential) {
             r2 = convert5To8(r51 + dr);
             g2 = convert5To8(g51 + dg);
@@ -431,37 +609,49 @@ static void etc_encodeBaseColors(etc1_byte* pBaseColors,
 
 static
 void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
-        const etc1_byte* pColors, etc_compressed* pCompressed, bool flipped) {
+        const etc1_byte* pColors, etc_compressed* pCompressed, bool flipped,
+        bool allowDifferential, int quality) {
     pCompressed->score = ~0;
     pCompressed->high = (flipped ? 1 : 0);
     pCompressed->low = 0;
 
     etc1_byte pBaseColors[6];
 
-    etc_encodeBaseColors(pBaseColors, pColors, pCompressed);
+    etc_encodeBaseColors(pBaseColors, pColors, pCompressed, allowDifferential);
 
     int originalHigh = pCompressed->high;
 
-    const int* pModifierTable = kModifierTable;
-    for (int i = 0; i < 8; i++, pModifierTable += 4) {
+    etc_subblock subblocks[2];
+    int firstTable[2] = { 0, 0 };
+    int lastTable[2] = { 7, 7 };
+    for (int i = 0; i < 2; i++) {
+        etc_gather_subblock(pIn, inMask, &subblocks[i], flipped, i != 0);
+        etc_prepare_subblock(&subblocks[i], pBaseColors + 3 * i);
+        if (quality == ETC1_QUALITY_FAST) {
+            etc_guess_tables(&subblocks[i], &firstTable[i], &lastTable[i]);
+        }
+    }
+
+    const int* pModifierTable = kModifierTable + firstTable[0] * 4;
+    for (int i = firstTable[0]; i <= lastTable[0]; i++, pModifierTable += 4) {
         etc_compressed temp;
         temp.score = 0;
         temp.high = originalHigh | (i << 5);
         temp.low = 0;
-        etc_encode_subblock_helper(pIn, inMask, &temp, flipped, false,
-                pBaseColors, pModifierTable);
+        etc_encode_subblock_helper(&subblocks[0], &temp, pBaseColors,
+                pModifierTable);
         take_best(pCompressed, &temp);
     }
-    pModifierTable = kModifierTable;
+    pModifierTable = kModifierTable + firstTable[1] * 4;
     etc_compressed firstHalf = *pCompressed;
-    for (int i = 0; i < 8; i++, pModifierTable += 4) {
+    for (int i = firstTable[1]; i <= lastTable[1]; i++, pModifierTable += 4) {
         etc_compressed temp;
         temp.score = firstHalf.score;
         temp.high = firstHalf.high | (i << 2);
         temp.low = firstHalf.low;
-        etc_encode_subblock_helper(pIn, inMask, &temp, flipped, true,
-                pBaseColors + 3, pModifierTable);
-        if (i == 0) {
+        etc_encode_subblock_helper(&subblocks[1], &temp, pBaseColors + 3,
+                pModifierTable);
+        if (i == firstTable[1]) {
             *pCompressed = temp;
         } else {
             take_best(pCompressed, &temp);
@@ -483,6 +673,19 @@ static void writeBigEndian(etc1_byte* pOut, etc1_uint32 d) {
 
 void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
         etc1_byte* pOut) {
+    etc1_encode_block_quality(pIn, inMask, pOut, ETC1_QUALITY_MEDIUM);
+}
+
+// Adds 'delta' to each channel of the 3-byte color at pIn, clamping.
+static inline
+void shift_color(etc1_byte* pOut, const etc1_byte* pIn, int delta) {
+    pOut[0] = clamp(pIn[0] + delta);
+    pOut[1] = clamp(pIn[1] + delta);
+    pOut[2] = clamp(pIn[2] + delta);
+}
+
+void etc1_encode_block_quality(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc1_byte* pOut, int quality) {
     etc1_byte colors[6];
     etc1_byte flippedColors[6];
     etc_average_colors_subblock(pIn, inMask, colors, false, false);
@@ -491,9 +694,36 @@ void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
     etc_average_colors_subblock(pIn, inMask, flippedColors + 3, true, true);
 
     etc_compressed a, b;
-    etc_encode_block_helper(pIn, inMask, colors, &a, false);
-    etc_encode_block_helper(pIn, inMask, flippedColors, &b, true);
+    etc_encode_block_helper(pIn, inMask, colors, &a, false, true, quality);
+    etc_encode_block_helper(pIn, inMask, flippedColors, &b, true, true, quality);
     take_best(&a, &b);
+
+    if (quality == ETC1_QUALITY_EXHAUSTIVE) {
+        // Also try base colors one 5-bit step brighter or darker than the
+        // averages, independently for each sub-block, in both the
+        // differential and the individual mode.
+        static const int kShifts[] = { -8, 0, 8 };
+        for (int flip = 0; flip < 2; flip++) {
+            const etc1_byte* averages = flip ? flippedColors : colors;
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 3; j++) {
+                    etc1_byte shifted[6];
+                    shift_color(shifted, averages, kShifts[i]);
+                    shift_color(shifted + 3, averages + 3, kShifts[j]);
+                    for (int differential = 0; differential < 2; differential++) {
+                        if (differential && !kShifts[i] && !kShifts[j]) {
+                            // Already done above.
+                            continue;
+                        }
+                        etc_encode_block_helper(pIn, inMask, shifted, &b,
+                                flip != 0, differential != 0, quality);
+                        take_best(&a, &b);
+                    }
+                }
+            }
+        }
+    }
+
     writeBigEndian(pOut, a.high);
     writeBigEndian(pOut + 4, a.low);
 }
@@ -509,11 +739,10 @@ etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height) {
 //       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset;
 // pOut - pointer to encoded data. Must be large enough to store entire encoded image.
 
-int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
-        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
-    if (pixelSize < 2 || pixelSize > 3) {
-        return -1;
-    }
+// Encodes the block rows [yBegin, yEnd) of the image, both multiples of 4.
+static void etc1_encode_rows(const etc1_byte* pIn, etc1_uint32 width,
+        etc1_uint32 height, etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_byte* pOut, int quality, etc1_uint32 yBegin, etc1_uint32 yLimit) {
     static const unsigned short kYMask[] = { 0x0, 0xf, 0xff, 0xfff, 0xffff };
     static const unsigned short kXMask[] = { 0x0, 0x1111, 0x3333, 0x7777,
             0xffff };
@@ -521,9 +750,8 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
     etc1_byte encoded[ETC1_ENCODED_BLOCK_SIZE];
 
     etc1_uint32 encodedWidth = (width + 3) & ~3;
-    etc1_uint32 encodedHeight = (height + 3) & ~3;
 
-    for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
+    for (etc1_uint32 y = yBegin; y < yLimit; y += 4) {
         etc1_uint32 yEnd = height - y;
         if (yEnd > 4) {
             yEnd = 4;
@@ -550,11 +778,105 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
                     }
                 }
             }
-            etc1_encode_block(block, mask, encoded);
+            etc1_encode_block_quality(block, mask, encoded, quality);
             memcpy(pOut, encoded, sizeof(encoded));
             pOut += sizeof(encoded);
         }
     }
+}
+
+int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
+    return etc1_encode_image_quality(pIn, width, height, pixelSize, stride,
+            pOut, ETC1_QUALITY_MEDIUM, 1);
+}
+
+#if defined(HAVE_PTHREADS)
+
+typedef struct {
+    const etc1_byte* pIn;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 pixelSize;
+    etc1_uint32 stride;
+    etc1_byte* pOut;
+    int quality;
+    etc1_uint32 yBegin;
+    etc1_uint32 yLimit;
+} etc1_encode_band;
+
+static void* etc1_encode_band_thread(void* arg) {
+    const etc1_encode_band* band = (const etc1_encode_band*) arg;
+    etc1_encode_rows(band->pIn, band->width, band->height, band->pixelSize,
+            band->stride, band->pOut, band->quality, band->yBegin, band->yLimit);
+    return NULL;
+}
+
+#endif
+
+int etc1_encode_image_quality(const etc1_byte* pIn, etc1_uint32 width,
+        etc1_uint32 height, etc1_uint32 pixelSize, etc1_uint32 stride,
+        etc1_byte* pOut, int quality, etc1_uint32 threadCount) {
+    if (pixelSize < 2 || pixelSize > 3) {
+        return -1;
+    }
+    if (quality < ETC1_QUALITY_FAST || quality > ETC1_QUALITY_EXHAUSTIVE) {
+        return -1;
+    }
+
+    etc1_uint32 encodedHeight = (height + 3) & ~3;
+    etc1_uint32 blockRows = encodedHeight / 4;
+    if (threadCount > blockRows) {
+        threadCount = blockRows;
+    }
+
+#if defined(HAVE_PTHREADS)
+    if (threadCount > 1) {
+        // Each thread gets a contiguous band of block rows; every block row
+        // has a fixed place in the output, so nothing needs to be merged.
+        etc1_uint32 encodedWidth = (width + 3) & ~3;
+        const etc1_uint32 kMaxThreads = 32;
+        if (threadCount > kMaxThreads) {
+            threadCount = kMaxThreads;
+        }
+        etc1_encode_band bands[kMaxThreads];
+        pthread_t threads[kMaxThreads];
+        bool started[kMaxThreads];
+        etc1_uint32 rowBegin = 0;
+        for (etc1_uint32 i = 0; i < threadCount; i++) {
+            etc1_uint32 rowLimit = (blockRows * (i + 1)) / threadCount;
+            etc1_encode_band* band = &bands[i];
+            band->pIn = pIn;
+            band->width = width;
+            band->height = height;
+            band->pixelSize = pixelSize;
+            band->stride = stride;
+            band->pOut = pOut + rowBegin * (encodedWidth / 4) * ETC1_ENCODED_BLOCK_SIZE;
+            band->quality = quality;
+            band->yBegin = rowBegin * 4;
+            band->yLimit = rowLimit * 4;
+            rowBegin = rowLimit;
+        }
+        // The calling thread takes the first band itself.
+        for (etc1_uint32 i = 1; i < threadCount; i++) {
+            started[i] = pthread_create(&threads[i], NULL,
+                    etc1_encode_band_thread, &bands[i]) == 0;
+            if (!started[i]) {
+                etc1_encode_band_thread(&bands[i]);
+            }
+        }
+        etc1_encode_band_thread(&bands[0]);
+        for (etc1_uint32 i = 1; i < threadCount; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+        return 0;
+    }
+#endif
+
+    etc1_encode_rows(pIn, width, height, pixelSize, stride, pOut, quality,
+            0, encodedHeight);
     return 0;
 }
 
@@ -7,6 +7,7 @@ LOCAL_SRC_FILES := \
     src/gltrace_context.cpp \
     src/gltrace_egl.cpp \
     src/gltrace_eglapi.cpp \
+    src/gltrace_fbdelta.cpp \
     src/gltrace_fixup.cpp \
     src/gltrace_hooks.cpp \
     src/gltrace.pb.cpp \
@@ -42,3 +43,23 @@ LOCAL_MODULE:= libGLES_trace
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    src/gltrace_fbdelta.cpp \
+    tools/gltrace_index.cpp
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/src \
+    external
+LOCAL_STATIC_LIBRARIES := liblzf
+
+LOCAL_MODULE := gltrace-index
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Build the host tests, unless building with mm or mmm.
+ifeq (,$(ONE_SHOT_MAKEFILE))
+include $(call first-makefiles-under,$(LOCAL_PATH))
+endif
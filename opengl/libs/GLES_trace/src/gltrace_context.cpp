@@ -17,10 +17,6 @@
 #include <pthread.h>
 #include <cutils/log.h>
 
-extern "C" {
-#include "liblzf/lzf.h"
-}
-
 #include "gltrace_context.h"
 
 namespace android {
@@ -56,24 +52,30 @@ void releaseContext() {
     }
 }
 
-GLTraceState::GLTraceState(TCPStream *stream) {
+GLTraceState::GLTraceState(OutputStream *stream, const AsyncOutputStream::Options &options) {
     mTraceContextIds = 0;
     mStream = stream;
+    mOutputStream = new AsyncOutputStream(stream, options);
 
     mCollectFbOnEglSwap = false;
     mCollectFbOnGlDraw = false;
     mCollectTextureDataOnGlTexImage = false;
+    mCollectFbDeltas = false;
     pthread_rwlock_init(&mTraceOptionsRwLock, NULL);
 }
 
 GLTraceState::~GLTraceState() {
+    // write out whatever is still queued before closing the stream
+    delete mOutputStream;
+    mOutputStream = NULL;
+
     if (mStream) {
         mStream->closeStream();
         mStream = NULL;
     }
 }
 
-TCPStream *GLTraceState::getStream() {
+OutputStream *GLTraceState::getStream() {
     return mStream;
 }
 
@@ -102,6 +104,10 @@ void GLTraceState::setCollectTextureDataOnGlTexImage(bool en) {
     safeSetValue(&mCollectTextureDataOnGlTexImage, en, &mTraceOptionsRwLock);
 }
 
+void GLTraceState::setCollectFbDeltas(bool en) {
+    safeSetValue(&mCollectFbDeltas, en, &mTraceOptionsRwLock);
+}
+
 bool GLTraceState::shouldCollectFbOnEglSwap() {
     return safeGetValue(&mCollectFbOnEglSwap, &mTraceOptionsRwLock);
 }
@@ -114,12 +120,14 @@ bool GLTraceState::shouldCollectTextureDataOnGlTexImage() {
     return safeGetValue(&mCollectTextureDataOnGlTexImage, &mTraceOptionsRwLock);
 }
 
+bool GLTraceState::shouldCollectFbDeltas() {
+    return safeGetValue(&mCollectFbDeltas, &mTraceOptionsRwLock);
+}
+
 GLTraceContext *GLTraceState::createTraceContext(int version, EGLContext eglContext) {
     int id = __sync_fetch_and_add(&mTraceContextIds, 1);
 
-    const size_t DEFAULT_BUFFER_SIZE = 8192;
-    BufferedOutputStream *stream = new BufferedOutputStream(mStream, DEFAULT_BUFFER_SIZE);
-    GLTraceContext *traceContext = new GLTraceContext(id, this, stream);
+    GLTraceContext *traceContext = new GLTraceContext(id, this, mOutputStream);
     mPerContextState[eglContext] = traceContext;
 
     return traceContext;
@@ -129,14 +137,15 @@ GLTraceContext *GLTraceState::getTraceContext(EGLContext c) {
     return mPerContextState[c];
 }
 
-GLTraceContext::GLTraceContext(int id, GLTraceState *state, BufferedOutputStream *stream) :
+GLTraceContext::GLTraceContext(int id, GLTraceState *state, AsyncOutputStream *stream) :
     mId(id),
     mState(state),
-    mBufferedOutputStream(stream),
+    mOutputStream(stream),
+    mBoundFBDelta(CURRENTLY_BOUND_FB),
+    mFB0Delta(FB0),
+    mDroppedCount(0),
     mElementArrayBuffers(DefaultKeyedVector<GLuint, ElementArrayBuffer*>(NULL))
 {
-    fbcontents = fbcompressed = NULL;
-    fbcontentsSize = 0;
 }
 
 int GLTraceContext::getId() {
@@ -147,30 +156,34 @@ GLTraceState *GLTraceContext::getGlobalTraceState() {
     return mState;
 }
 
-void GLTraceContext::resizeFBMemory(unsigned minSize) {
-    if (fbcontentsSize >= minSize) {
-        return;
-    }
-
-    if (fbcontents != NULL) {
-        free(fbcontents);
-        free(fbcompressed);
-    }
-
-    fbcontents = malloc(minSize);
-    fbcompressed = malloc(minSize);
-
-    fbcontentsSize = minSize;
-}
-
-/** obtain a pointer to the compressed framebuffer image */
-void GLTraceContext::getCompressedFB(void **fb, unsigned *fbsize, unsigned *fbwidth, 
-                            unsigned *fbheight, FBBinding fbToRead) {
+/** read the framebuffer contents into @fb */
+void GLTraceContext::getFB(std::string *fb, unsigned *fbwidth, unsigned *fbheight,
+                            FBBinding fbToRead) {
     int viewport[4] = {};
     hooks->gl.glGetIntegerv(GL_VIEWPORT, viewport);
     unsigned fbContentsSize = viewport[2] * viewport[3] * 4;
 
-    resizeFBMemory(fbContentsSize);
+    FBDeltaEncoder *delta = NULL;
+    if (mState->shouldCollectFbDeltas()) {
+        delta = fbToRead == FB0 ? &mFB0Delta : &mBoundFBDelta;
+
+        // a dropped message may have held the frame the next delta would
+        // build on, so start over from a key frame
+        uint64_t dropped = mOutputStream->getDroppedCount();
+        if (dropped != mDroppedCount) {
+            mBoundFBDelta.reset();
+            mFB0Delta.reset();
+            mDroppedCount = dropped;
+        }
+    } else {
+        mBoundFBDelta.reset();
+        mFB0Delta.reset();
+    }
+
+    // read straight into the message unless the frame is delta encoded;
+    // the transport compresses it later
+    std::string *pixels = delta != NULL ? &mFBScratch : fb;
+    pixels->resize(fbContentsSize);
 
     // switch current framebuffer binding if necessary
     GLint currentFb = -1;
@@ -184,29 +197,27 @@ void GLTraceContext::getCompressedFB(void **fb, unsigned *fbsize, unsigned *fbwi
         }
     }
 
-    hooks->gl.glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3],
-                                        GL_RGBA, GL_UNSIGNED_BYTE, fbcontents);
+    if (fbContentsSize > 0) {
+        hooks->gl.glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3],
+                                        GL_RGBA, GL_UNSIGNED_BYTE, &(*pixels)[0]);
+    }
 
     // switch back to previously bound buffer if necessary
     if (fbSwitched) {
         hooks->gl.glBindFramebuffer(GL_FRAMEBUFFER, currentFb);
     }
 
-    *fbsize = lzf_compress(fbcontents, fbContentsSize, fbcompressed, fbContentsSize);
-    *fb = fbcompressed;
+    if (delta != NULL) {
+        delta->encode((const uint8_t *) pixels->data(), viewport[2], viewport[3],
+                      viewport[2] * 4, fb);
+    }
+
     *fbwidth = viewport[2];
     *fbheight = viewport[3];
 }
 
 void GLTraceContext::traceGLMessage(GLMessage *msg) {
-    mBufferedOutputStream->send(msg);
-
-    GLMessage_Function func = msg->function();
-    if (func == GLMessage::eglSwapBuffers
-        || func == GLMessage::glDrawArrays
-        || func == GLMessage::glDrawElements) {
-        mBufferedOutputStream->flush();
-    }
+    mOutputStream->send(msg);
 }
 
 void GLTraceContext::bindBuffer(GLuint bufferId, GLvoid *data, GLsizeiptr size) {
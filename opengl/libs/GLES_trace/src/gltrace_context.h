@@ -22,6 +22,7 @@
 #include <utils/KeyedVector.h>
 
 #include "hooks.h"
+#include "gltrace_fbdelta.h"
 #include "gltrace_transport.h"
 
 namespace android {
@@ -52,24 +53,29 @@ class GLTraceContext {
     int mId;                    /* unique context id */
     GLTraceState *mState;       /* parent GL Trace state (for per process GL Trace State Info) */
 
-    void *fbcontents;           /* memory area to read framebuffer contents */
-    void *fbcompressed;         /* destination for lzf compressed framebuffer */
-    unsigned fbcontentsSize;    /* size of fbcontents & fbcompressed buffers */
+    AsyncOutputStream *mOutputStream; /* stream where trace info is sent */
 
-    BufferedOutputStream *mBufferedOutputStream; /* stream where trace info is sent */
+    /* delta mode state for framebuffer contents, one per FBBinding */
+    FBDeltaEncoder mBoundFBDelta;
+    FBDeltaEncoder mFB0Delta;
+    std::string mFBScratch;     /* full frame read in delta mode */
+    uint64_t mDroppedCount;     /* messages dropped by the stream as of the last frame */
 
     /* list of element array buffers in use. */
     DefaultKeyedVector<GLuint, ElementArrayBuffer*> mElementArrayBuffers;
 
-    void resizeFBMemory(unsigned minSize);
 public:
     gl_hooks_t *hooks;
 
-    GLTraceContext(int id, GLTraceState *state, BufferedOutputStream *stream);
+    GLTraceContext(int id, GLTraceState *state, AsyncOutputStream *stream);
     int getId();
     GLTraceState *getGlobalTraceState();
-    void getCompressedFB(void **fb, unsigned *fbsize,
-                            unsigned *fbwidth, unsigned *fbheight,
+
+    /**
+     * read the framebuffer as raw RGBA data into @fb, or only its changed tiles
+     * in delta mode (see gltrace_fbdelta.h); the transport compresses it
+     */
+    void getFB(std::string *fb, unsigned *fbwidth, unsigned *fbheight,
                             FBBinding fbToRead);
 
     // Methods to work with element array buffers
@@ -84,7 +90,8 @@ public:
 /** Per process trace state. */
 class GLTraceState {
     int mTraceContextIds;
-    TCPStream *mStream;
+    OutputStream *mStream;
+    AsyncOutputStream *mOutputStream;
     std::map<EGLContext, GLTraceContext*> mPerContextState;
 
     /* Options controlling additional data to be collected on
@@ -92,29 +99,32 @@ class GLTraceState {
     bool mCollectFbOnEglSwap;
     bool mCollectFbOnGlDraw;
     bool mCollectTextureDataOnGlTexImage;
+    bool mCollectFbDeltas;
     pthread_rwlock_t mTraceOptionsRwLock;
 
     /* helper methods to get/set values using provided lock for mutual exclusion. */
     void safeSetValue(bool *ptr, bool value, pthread_rwlock_t *lock);
     bool safeGetValue(bool *ptr, pthread_rwlock_t *lock);
 public:
-    GLTraceState(TCPStream *stream);
+    GLTraceState(OutputStream *stream, const AsyncOutputStream::Options &options);
     ~GLTraceState();
 
     GLTraceContext *createTraceContext(int version, EGLContext c);
     GLTraceContext *getTraceContext(EGLContext c);
 
-    TCPStream *getStream();
+    OutputStream *getStream();
 
     /* Methods to set trace options. */
     void setCollectFbOnEglSwap(bool en);
     void setCollectFbOnGlDraw(bool en);
     void setCollectTextureDataOnGlTexImage(bool en);
+    void setCollectFbDeltas(bool en);
 
     /* Methods to retrieve trace options. */
     bool shouldCollectFbOnEglSwap();
     bool shouldCollectFbOnGlDraw();
     bool shouldCollectTextureDataOnGlTexImage();
+    bool shouldCollectFbDeltas();
 };
 
 void setupTraceContextThreadSpecific(GLTraceContext *context);
@@ -15,7 +15,10 @@
  */
 
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <cutils/log.h>
 #include <cutils/properties.h>
 
@@ -31,18 +34,43 @@ namespace android {
 
 using gltrace::GLTraceState;
 using gltrace::GLTraceContext;
+using gltrace::AsyncOutputStream;
+using gltrace::FileStream;
+using gltrace::OutputStream;
 using gltrace::TCPStream;
 
 static GLTraceState *sGLTraceState;
 static pthread_t sReceiveThreadId;
 
+enum TraceSettingsMasks {
+    READ_FB_ON_EGLSWAP_MASK = 1 << 0,
+    READ_FB_ON_GLDRAW_MASK = 1 << 1,
+    READ_TEXTURE_DATA_ON_GLTEXIMAGE_MASK = 1 << 2,
+    READ_FB_DELTA_MASK = 1 << 3,
+};
+
+static void setTraceOptions(GLTraceState *state, uint32_t cmd) {
+    bool collectFbOnEglSwap = (cmd & READ_FB_ON_EGLSWAP_MASK) != 0;
+    bool collectFbOnGlDraw = (cmd & READ_FB_ON_GLDRAW_MASK) != 0;
+    bool collectTextureData = (cmd & READ_TEXTURE_DATA_ON_GLTEXIMAGE_MASK) != 0;
+    bool collectFbDeltas = (cmd & READ_FB_DELTA_MASK) != 0;
+
+    state->setCollectFbOnEglSwap(collectFbOnEglSwap);
+    state->setCollectFbOnGlDraw(collectFbOnGlDraw);
+    state->setCollectTextureDataOnGlTexImage(collectTextureData);
+    state->setCollectFbDeltas(collectFbDeltas);
+
+    ALOGD("trace options: eglswap: %d, gldraw: %d, texImage: %d, fbDeltas: %d",
+        collectFbOnEglSwap, collectFbOnGlDraw, collectTextureData, collectFbDeltas);
+}
+
 /**
  * Task that monitors the control stream from the host and updates
  * the trace status according to commands received from the host.
  */
 static void *commandReceiveTask(void *arg) {
     GLTraceState *state = (GLTraceState *)arg;
-    TCPStream *stream = state->getStream();
+    OutputStream *stream = state->getStream();
 
     // The control stream always receives an integer size of the
     // command buffer, followed by the actual command buffer.
@@ -52,12 +80,6 @@ static void *commandReceiveTask(void *arg) {
     void *cmdBuf = NULL;
     uint32_t cmdBufSize = 0;
 
-    enum TraceSettingsMasks {
-        READ_FB_ON_EGLSWAP_MASK = 1 << 0,
-        READ_FB_ON_GLDRAW_MASK = 1 << 1,
-        READ_TEXTURE_DATA_ON_GLTEXIMAGE_MASK = 1 << 2,
-    };
-
     while (true) {
         // read command size
         if (stream->receive(&cmdSize, sizeof(uint32_t)) < 0) {
@@ -86,17 +108,7 @@ static void *commandReceiveTask(void *arg) {
         }
 
         uint32_t cmd = ntohl(*(uint32_t*)cmdBuf);
-
-        bool collectFbOnEglSwap = (cmd & READ_FB_ON_EGLSWAP_MASK) != 0;
-        bool collectFbOnGlDraw = (cmd & READ_FB_ON_GLDRAW_MASK) != 0;
-        bool collectTextureData = (cmd & READ_TEXTURE_DATA_ON_GLTEXIMAGE_MASK) != 0;
-
-        state->setCollectFbOnEglSwap(collectFbOnEglSwap);
-        state->setCollectFbOnGlDraw(collectFbOnGlDraw);
-        state->setCollectTextureDataOnGlTexImage(collectTextureData);
-
-        ALOGD("trace options: eglswap: %d, gldraw: %d, texImage: %d",
-            collectFbOnEglSwap, collectFbOnGlDraw, collectTextureData);
+        setTraceOptions(state, cmd);
     }
 
     ALOGE("Stopping OpenGL Trace Command Receiver\n");
@@ -105,7 +117,56 @@ static void *commandReceiveTask(void *arg) {
     return NULL;
 }
 
+/** Read the transport settings from system properties. */
+static void getOutputOptions(AsyncOutputStream::Options *options, bool toFile) {
+    char value[PROPERTY_VALUE_MAX];
+
+    // maximum amount of queued trace data, in KB
+    property_get("debug.egl.debug_queue_kb", value, "4096");
+    options->maxQueuedBytes = (size_t) atoi(value) * 1024;
+
+    // what to do when the queue is full: "block", "newest" or "oldest"
+    property_get("debug.egl.debug_drop", value, "block");
+    if (!strcmp(value, "newest")) {
+        options->dropPolicy = AsyncOutputStream::DROP_NEWEST;
+    } else if (!strcmp(value, "oldest")) {
+        options->dropPolicy = AsyncOutputStream::DROP_OLDEST;
+    } else {
+        options->dropPolicy = AsyncOutputStream::BLOCK;
+    }
+
+    // Batch compression changes the format on the wire, so it is off by
+    // default for hosts, which may not understand it. Files always use the
+    // indexed format, which is compressed.
+    property_get("debug.egl.debug_compress", value, "0");
+    options->compressBatches = atoi(value) != 0;
+    options->chunkedFile = toFile;
+}
+
 void GLTrace_start() {
+    char fileName[PROPERTY_VALUE_MAX];
+    AsyncOutputStream::Options options;
+
+    // If a file is given, trace to it instead of waiting for the host.
+    property_get("debug.egl.debug_file", fileName, "");
+    if (fileName[0] != '\0') {
+        int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            ALOGE("Error (%d) opening GLTrace file %s. Quitting application.", errno, fileName);
+            exit(-1);
+        }
+
+        getOutputOptions(&options, true);
+        sGLTraceState = new GLTraceState(new FileStream(fd), options);
+
+        // with no host to send commands, the options come from a property
+        // holding the same mask
+        char value[PROPERTY_VALUE_MAX];
+        property_get("debug.egl.debug_options", value, "0");
+        setTraceOptions(sGLTraceState, strtoul(value, NULL, 0));
+        return;
+    }
+
     char udsName[PROPERTY_VALUE_MAX];
 
     property_get("debug.egl.debug_portname", udsName, "gltrace");
@@ -119,7 +180,8 @@ void GLTrace_start() {
     TCPStream *stream = new TCPStream(clientSocket);
 
     // initialize tracing state
-    sGLTraceState = new GLTraceState(stream);
+    getOutputOptions(&options, false);
+    sGLTraceState = new GLTraceState(stream, options);
 
     pthread_create(&sReceiveThreadId, NULL, commandReceiveTask, sGLTraceState);
 }
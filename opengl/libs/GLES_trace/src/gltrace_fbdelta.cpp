@@ -0,0 +1,199 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "gltrace_fbdelta.h"
+
+namespace android {
+namespace gltrace {
+
+static const unsigned BYTES_PER_PIXEL = 4;
+
+static inline unsigned tileCount(unsigned size, unsigned tileSize) {
+    return (size + tileSize - 1) / tileSize;
+}
+
+FBDeltaEncoder::FBDeltaEncoder(uint32_t source) :
+    mSource(source),
+    mWidth(0),
+    mHeight(0),
+    mSequence(0),
+    mFramesSinceKeyFrame(0),
+    mNeedKeyFrame(true)
+{
+}
+
+void FBDeltaEncoder::reset() {
+    mNeedKeyFrame = true;
+}
+
+uint64_t FBDeltaEncoder::hashTile(const uint8_t *pixels, size_t stride,
+                                  unsigned rowBytes, unsigned rows) {
+    // A multiply-xorshift hash over 8 bytes at a time. Rows are a whole
+    // number of pixels, so at most one trailing 4 byte word per row.
+    uint64_t hash = 0x9e3779b97f4a7c15ULL;
+    for (unsigned y = 0; y < rows; y++) {
+        const uint8_t *p = pixels + y * stride;
+        unsigned x = 0;
+        for (; x + 8 <= rowBytes; x += 8) {
+            uint64_t v;
+            memcpy(&v, p + x, sizeof(v));
+            hash = (hash ^ v) * 0xff51afd7ed558ccdULL;
+            hash ^= hash >> 32;
+        }
+        if (x < rowBytes) {
+            uint32_t v;
+            memcpy(&v, p + x, sizeof(v));
+            hash = (hash ^ v) * 0xff51afd7ed558ccdULL;
+            hash ^= hash >> 32;
+        }
+    }
+    return hash;
+}
+
+void FBDeltaEncoder::encode(const uint8_t *pixels, unsigned width, unsigned height,
+                            size_t stride, std::string *out) {
+    const unsigned tilesX = tileCount(width, TILE_SIZE);
+    const unsigned tilesY = tileCount(height, TILE_SIZE);
+    const size_t tiles = (size_t) tilesX * tilesY;
+
+    bool keyFrame = mNeedKeyFrame || width != mWidth || height != mHeight
+            || mFramesSinceKeyFrame + 1 >= KEY_FRAME_INTERVAL;
+    if (keyFrame) {
+        mTileHashes.assign(tiles, 0);
+        mWidth = width;
+        mHeight = height;
+        mFramesSinceKeyFrame = 0;
+        mNeedKeyFrame = false;
+    } else {
+        mFramesSinceKeyFrame++;
+    }
+
+    FBDeltaHeader header;
+    header.magic = FBDeltaHeader::MAGIC;
+    header.source = mSource;
+    header.sequence = ++mSequence;
+    header.flags = keyFrame ? FBDeltaHeader::KEY_FRAME : 0;
+    header.tileWidth = TILE_SIZE;
+    header.tileHeight = TILE_SIZE;
+
+    const size_t bitmapOffset = sizeof(header);
+    const size_t bitmapSize = (tiles + 7) / 8;
+    out->assign(bitmapOffset + bitmapSize, '\0');
+    memcpy(&(*out)[0], &header, sizeof(header));
+
+    size_t tile = 0;
+    for (unsigned ty = 0; ty < tilesY; ty++) {
+        const unsigned y = ty * TILE_SIZE;
+        const unsigned rows = height - y < TILE_SIZE ? height - y : TILE_SIZE;
+        for (unsigned tx = 0; tx < tilesX; tx++, tile++) {
+            const unsigned x = tx * TILE_SIZE;
+            const unsigned columns = width - x < TILE_SIZE ? width - x : TILE_SIZE;
+            const unsigned rowBytes = columns * BYTES_PER_PIXEL;
+            const uint8_t *p = pixels + y * stride + x * BYTES_PER_PIXEL;
+
+            uint64_t hash = hashTile(p, stride, rowBytes, rows);
+            if (!keyFrame && hash == mTileHashes[tile]) {
+                continue;
+            }
+            mTileHashes[tile] = hash;
+
+            (*out)[bitmapOffset + tile / 8] |= 1 << (tile & 7);
+            for (unsigned row = 0; row < rows; row++) {
+                out->append((const char *) p + row * stride, rowBytes);
+            }
+        }
+    }
+}
+
+FBDeltaDecoder::FBDeltaDecoder() :
+    mValid(false),
+    mWidth(0),
+    mHeight(0),
+    mSequence(0)
+{
+}
+
+const uint8_t *FBDeltaDecoder::getFrame() const {
+    return mValid && !mFrame.empty() ? &mFrame[0] : NULL;
+}
+
+bool FBDeltaDecoder::decode(const uint8_t *data, size_t len, unsigned width, unsigned height) {
+    FBDeltaHeader header;
+    if (len < sizeof(header)) {
+        mValid = false;
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    const bool keyFrame = (header.flags & FBDeltaHeader::KEY_FRAME) != 0;
+    if (header.magic != FBDeltaHeader::MAGIC
+            || header.tileWidth == 0 || header.tileHeight == 0
+            || (!keyFrame && (!mValid || width != mWidth || height != mHeight
+                    || header.sequence != mSequence + 1))) {
+        mValid = false;
+        return false;
+    }
+
+    const unsigned tilesX = tileCount(width, header.tileWidth);
+    const unsigned tilesY = tileCount(height, header.tileHeight);
+    const size_t tiles = (size_t) tilesX * tilesY;
+    const uint8_t *bitmap = data + sizeof(header);
+    const uint8_t *p = bitmap + (tiles + 7) / 8;
+    const uint8_t *end = data + len;
+    if (p > end) {
+        mValid = false;
+        return false;
+    }
+
+    const size_t stride = (size_t) width * BYTES_PER_PIXEL;
+    if (keyFrame) {
+        mFrame.assign(stride * height, 0);
+        mWidth = width;
+        mHeight = height;
+    }
+
+    size_t tile = 0;
+    for (unsigned ty = 0; ty < tilesY; ty++) {
+        const unsigned y = ty * header.tileHeight;
+        const unsigned rows = height - y < header.tileHeight ? height - y : header.tileHeight;
+        for (unsigned tx = 0; tx < tilesX; tx++, tile++) {
+            if (!(bitmap[tile / 8] & (1 << (tile & 7)))) {
+                continue;
+            }
+            const unsigned x = tx * header.tileWidth;
+            const unsigned columns = width - x < header.tileWidth ? width - x : header.tileWidth;
+            const size_t rowBytes = columns * BYTES_PER_PIXEL;
+            if ((size_t) (end - p) < rowBytes * rows) {
+                mValid = false;
+                return false;
+            }
+            uint8_t *q = &mFrame[y * stride + x * BYTES_PER_PIXEL];
+            for (unsigned row = 0; row < rows; row++) {
+                memcpy(q + row * stride, p, rowBytes);
+                p += rowBytes;
+            }
+        }
+    }
+
+    mSequence = header.sequence;
+    mValid = true;
+    return true;
+}
+
+};
+};
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GLTRACE_FBDELTA_H_
+#define __GLTRACE_FBDELTA_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace gltrace {
+
+/**
+ * Framebuffer contents in delta mode (requested by the host with
+ * READ_FB_DELTA_MASK) only carry the tiles that changed since the previous
+ * frame read from the same source in the same context. The contents of
+ * FrameBuffer messages are then, before lzf compression:
+ *
+ *     FBDeltaHeader
+ *     one bit per tile, in raster order (bit i & 7 of byte i / 8), set if
+ *         the tile is included
+ *     the RGBA pixels of each included tile in the same order, row by row,
+ *         tiles on the right and bottom edges being clipped to the frame
+ *
+ * Every key frame includes all tiles. A delta only applies on top of the
+ * frame with the previous sequence number from the same source; after a
+ * gap (e.g. messages dropped by the transport), the host must wait for
+ * the next key frame.
+ */
+struct FBDeltaHeader {
+    enum {
+        MAGIC = 0x31444246,     /* "FBD1" */
+        KEY_FRAME = 1 << 0,
+    };
+
+    uint32_t magic;
+    uint32_t source;            /* the FBBinding that was read */
+    uint32_t sequence;          /* per context and source */
+    uint16_t flags;
+    uint8_t  tileWidth;
+    uint8_t  tileHeight;
+};
+
+/** Encoder for one context and source; runs on the GL thread. */
+class FBDeltaEncoder {
+public:
+    enum {
+        TILE_SIZE = 32,
+        /* frames between key frames, so that readers can resync */
+        KEY_FRAME_INTERVAL = 60,
+    };
+
+    FBDeltaEncoder(uint32_t source);
+
+    /**
+     * Encode the RGBA @pixels of a @width x @height frame, @stride bytes
+     * per row, into @out.
+     */
+    void encode(const uint8_t *pixels, unsigned width, unsigned height, size_t stride,
+                std::string *out);
+
+    /** Make the next frame a key frame. */
+    void reset();
+
+private:
+    static uint64_t hashTile(const uint8_t *pixels, size_t stride,
+                             unsigned rowBytes, unsigned rows);
+
+    const uint32_t mSource;
+    unsigned mWidth;
+    unsigned mHeight;
+    uint32_t mSequence;
+    unsigned mFramesSinceKeyFrame;
+    bool mNeedKeyFrame;
+    /* hashes of the tiles of the previous frame */
+    std::vector<uint64_t> mTileHashes;
+};
+
+/** Rebuilds full frames from delta mode contents; for host side tools. */
+class FBDeltaDecoder {
+public:
+    FBDeltaDecoder();
+
+    /**
+     * Apply the (decompressed) contents of a @width x @height frame.
+     * Returns false if they are malformed, or if they are a delta that
+     * doesn't follow the last frame decoded; the last frame is then
+     * invalid until the next key frame.
+     */
+    bool decode(const uint8_t *data, size_t len, unsigned width, unsigned height);
+
+    /** The last decoded frame, as tightly packed RGBA rows; NULL if none. */
+    const uint8_t *getFrame() const;
+
+private:
+    bool mValid;
+    unsigned mWidth;
+    unsigned mHeight;
+    uint32_t mSequence;
+    std::vector<uint8_t> mFrame;
+};
+
+};
+};
+
+#endif
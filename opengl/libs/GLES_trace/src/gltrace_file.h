@@ -0,0 +1,136 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __GLTRACE_FILE_H_
+#define __GLTRACE_FILE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+namespace android {
+namespace gltrace {
+
+/**
+ * Layout of trace files written to debug.egl.debug_file. They can be
+ * mapped and queried without parsing any GLMessage:
+ *
+ *     TraceFileHeader
+ *     chunks: TraceChunkHeader, then its payload
+ *     TraceIndexEntry for every chunk
+ *     TraceFileFooter
+ *
+ * A chunk payload is a sequence of records: a TraceRecordHeader followed
+ * by a serialized GLMessage. The payload is lzf compressed, unless
+ * payloadSize == rawSize.
+ *
+ * The index and footer are only written when tracing stops cleanly; for
+ * a trace cut short (usually the app gets killed), the chunk headers hold
+ * everything needed to rebuild them (see tools/gltrace_index.cpp).
+ *
+ * Frame n is made of the messages following the n-th eglSwapBuffers (of
+ * any context), up to and including the next one. All fields are in host
+ * byte order, which is little endian on all supported devices.
+ */
+
+enum {
+    TRACE_FILE_VERSION = 1,
+    /* function bits tracked per chunk; the GLMessage_Function values are below this */
+    TRACE_FUNCTION_BITS = 4096,
+    /* context ids at or above this share the last bit of contextMask */
+    TRACE_CONTEXT_BITS = 64,
+    /* GLMessage::eglSwapBuffers, which ends a frame */
+    TRACE_FUNCTION_EGL_SWAP_BUFFERS = 2020,
+};
+
+struct TraceFileHeader {
+    char     magic[8];              /* TRACE_FILE_MAGIC */
+    uint32_t version;
+    uint32_t headerSize;            /* sizeof(TraceFileHeader) */
+};
+
+/** What a chunk holds, to decide whether to read it. */
+struct TraceChunkSummary {
+    uint32_t firstMessage;          /* index of the first message in the trace */
+    uint32_t messageCount;
+    uint32_t firstFrame;            /* frames of the first and last messages */
+    uint32_t lastFrame;
+    uint64_t contextMask;           /* bit min(context_id, 63) */
+    uint32_t functions[TRACE_FUNCTION_BITS / 32]; /* bit per GLMessage_Function */
+};
+
+struct TraceChunkHeader {
+    uint32_t magic;                 /* TRACE_CHUNK_MAGIC */
+    uint32_t payloadSize;
+    uint32_t rawSize;
+    uint32_t reserved;
+    TraceChunkSummary summary;
+};
+
+struct TraceRecordHeader {
+    uint32_t size;                  /* of the GLMessage that follows */
+    uint32_t function;
+    int32_t  contextId;
+};
+
+struct TraceIndexEntry {
+    uint64_t offset;                /* of the TraceChunkHeader in the file */
+    TraceChunkSummary summary;
+};
+
+struct TraceFileFooter {
+    uint64_t indexOffset;
+    uint32_t indexEntries;
+    uint32_t version;
+    char     magic[8];              /* TRACE_FOOTER_MAGIC */
+};
+
+static const char TRACE_FILE_MAGIC[8] = { 'G', 'L', 'T', 'R', 'A', 'C', 'E', '\0' };
+static const char TRACE_FOOTER_MAGIC[8] = { 'G', 'L', 'T', 'I', 'N', 'D', 'E', 'X' };
+static const uint32_t TRACE_CHUNK_MAGIC = 0x4b4e4843;    /* "CHNK" */
+
+inline void traceSummaryReset(TraceChunkSummary *s, uint32_t firstMessage, uint32_t frame) {
+    memset(s, 0, sizeof(*s));
+    s->firstMessage = firstMessage;
+    s->firstFrame = frame;
+    s->lastFrame = frame;
+}
+
+inline void traceSummaryAdd(TraceChunkSummary *s, uint32_t function, int32_t contextId,
+                            uint32_t frame) {
+    s->messageCount++;
+    s->lastFrame = frame;
+    uint32_t contextBit = contextId < 0 || contextId >= TRACE_CONTEXT_BITS
+            ? TRACE_CONTEXT_BITS - 1 : contextId;
+    s->contextMask |= 1ULL << contextBit;
+    function %= TRACE_FUNCTION_BITS;
+    s->functions[function / 32] |= 1U << (function % 32);
+}
+
+inline bool traceSummaryHasFunction(const TraceChunkSummary *s, uint32_t function) {
+    function %= TRACE_FUNCTION_BITS;
+    return (s->functions[function / 32] & (1U << (function % 32))) != 0;
+}
+
+inline bool traceSummaryHasContext(const TraceChunkSummary *s, int32_t contextId) {
+    uint32_t contextBit = contextId < 0 || contextId >= TRACE_CONTEXT_BITS
+            ? TRACE_CONTEXT_BITS - 1 : contextId;
+    return (s->contextMask & (1ULL << contextBit)) != 0;
+}
+
+};
+};
+
+#endif
@@ -144,14 +144,12 @@ void fixup_glGetString(GLMessage *glmsg, void *pointersToFixup[]) {
 
 /* Add the contents of the framebuffer to the protobuf message */
 void fixup_addFBContents(GLTraceContext *context, GLMessage *glmsg, FBBinding fbToRead) {
-    void *fbcontents;
-    unsigned fbsize, fbwidth, fbheight;
-    context->getCompressedFB(&fbcontents, &fbsize, &fbwidth, &fbheight, fbToRead);
-
+    unsigned fbwidth, fbheight;
     GLMessage_FrameBuffer *fb = glmsg->mutable_fb();
+    context->getFB(fb->add_contents(), &fbwidth, &fbheight, fbToRead);
+
     fb->set_width(fbwidth);
     fb->set_height(fbheight);
-    fb->add_contents(fbcontents, fbsize);
 }
 
 /** Common fixup routing for glTexImage2D & glTexSubImage2D. */
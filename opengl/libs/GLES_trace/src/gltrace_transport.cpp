@@ -16,6 +16,8 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <time.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <unistd.h>
@@ -25,6 +27,11 @@
 
 #include <cutils/log.h>
 #include <private/android_filesystem_config.h>
+#include <utils/Timers.h>
+
+extern "C" {
+#include "liblzf/lzf.h"
+}
 
 #include "gltrace_transport.h"
 
@@ -107,13 +114,31 @@ void TCPStream::closeStream() {
     }
 }
 
+/** write() all of @len bytes at @buf to @fd. Returns -1 on error, 0 on success. */
+static int writeFully(int fd, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t *) buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("Error writing trace data: %d", errno);
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
 int TCPStream::send(void *buf, size_t len) {
     if (mSocket <= 0) {
         return -1;
     }
 
     pthread_mutex_lock(&mSocketWriteMutex);
-    int n = write(mSocket, buf, len);
+    int n = writeFully(mSocket, buf, len);
     pthread_mutex_unlock(&mSocketWriteMutex);
 
     return n;
@@ -138,40 +163,379 @@ int TCPStream::receive(void *data, size_t len) {
     return 0;
 }
 
-BufferedOutputStream::BufferedOutputStream(TCPStream *stream, size_t bufferSize) {
-    mStream = stream;
+FileStream::FileStream(int fd) {
+    mFd = fd;
+}
 
-    mBufferSize = bufferSize;
-    mStringBuffer = "";
-    mStringBuffer.reserve(bufferSize);
+FileStream::~FileStream() {
+    closeStream();
 }
 
-int BufferedOutputStream::flush() {
-    if (mStringBuffer.size() == 0) {
-        return 0;
+void FileStream::closeStream() {
+    if (mFd >= 0) {
+        fsync(mFd);
+        close(mFd);
+        mFd = -1;
     }
+}
 
-    int n = mStream->send((void *)mStringBuffer.data(), mStringBuffer.size());
-    mStringBuffer.clear();
-    return n;
+int FileStream::send(void *buf, size_t len) {
+    if (mFd < 0) {
+        return -1;
+    }
+    return writeFully(mFd, buf, len);
+}
+
+int FileStream::receive(void *, size_t) {
+    return -1;
+}
+
+AsyncOutputStream::AsyncOutputStream(OutputStream *stream, const Options &options) :
+    mStream(stream),
+    mOptions(options),
+    mFileOffset(0),
+    mFrameCount(0),
+    mQueuedBytes(0),
+    mWriterWaiting(false),
+    mBlockedProducers(0),
+    mStopping(false),
+    mFailed(false),
+    mWriterStarted(false)
+{
+    memset(&mStats, 0, sizeof(mStats));
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mWorkCond, NULL);
+    pthread_cond_init(&mSpaceCond, NULL);
+
+    if (pthread_create(&mWriter, NULL, writerThread, this) == 0) {
+        mWriterStarted = true;
+    } else {
+        ALOGE("Failed to start the trace writer thread");
+        mFailed = true;
+    }
 }
 
-void BufferedOutputStream::enqueueMessage(GLMessage *msg) {
-    const uint32_t len = msg->ByteSize();
+AsyncOutputStream::~AsyncOutputStream() {
+    pthread_mutex_lock(&mLock);
+    mStopping = true;
+    pthread_cond_signal(&mWorkCond);
+    pthread_mutex_unlock(&mLock);
 
-    mStringBuffer.append((const char *)&len, sizeof(len));    // append header
-    msg->AppendToString(&mStringBuffer);                      // append message
+    if (mWriterStarted) {
+        pthread_join(mWriter, NULL);
+    }
+
+    // only left over if the writer failed
+    while (!mQueue.empty()) {
+        delete mQueue.front().msg;
+        mQueue.pop_front();
+    }
+
+    ALOGD("gltrace: %llu messages queued, %llu dropped, %llu written in %llu batches, "
+            "%llu bytes serialized, %llu bytes sent, %llu ms blocked",
+            (unsigned long long) mStats.messagesQueued,
+            (unsigned long long) mStats.messagesDropped,
+            (unsigned long long) mStats.messagesWritten,
+            (unsigned long long) mStats.batchesWritten,
+            (unsigned long long) mStats.bytesSerialized,
+            (unsigned long long) mStats.bytesWritten,
+            (unsigned long long) mStats.blockedNs / 1000000);
+
+    pthread_cond_destroy(&mSpaceCond);
+    pthread_cond_destroy(&mWorkCond);
+    pthread_mutex_destroy(&mLock);
 }
 
-int BufferedOutputStream::send(GLMessage *msg) {
-    enqueueMessage(msg);
+int AsyncOutputStream::send(GLMessage *msg) {
+    const size_t size = msg->ByteSize();
+
+    pthread_mutex_lock(&mLock);
+    if (mFailed) {
+        mStats.messagesDropped++;
+        pthread_mutex_unlock(&mLock);
+        return -1;
+    }
 
-    if (mStringBuffer.size() > mBufferSize) {
-        return flush();
+    // A message larger than the whole queue is let through once the queue
+    // is empty, rather than never.
+    while (!mQueue.empty() && mQueuedBytes + size > mOptions.maxQueuedBytes) {
+        if (mOptions.dropPolicy == DROP_NEWEST) {
+            mStats.messagesDropped++;
+            pthread_mutex_unlock(&mLock);
+            return -1;
+        } else if (mOptions.dropPolicy == DROP_OLDEST) {
+            Entry &oldest = mQueue.front();
+            mQueuedBytes -= oldest.size;
+            delete oldest.msg;
+            mQueue.pop_front();
+            mStats.messagesDropped++;
+        } else {
+            nsecs_t start = systemTime();
+            mBlockedProducers++;
+            pthread_cond_wait(&mSpaceCond, &mLock);
+            mBlockedProducers--;
+            mStats.blockedNs += systemTime() - start;
+            if (mFailed) {
+                mStats.messagesDropped++;
+                pthread_mutex_unlock(&mLock);
+                return -1;
+            }
+        }
     }
 
+    // Move the contents out of the caller's message: this is much cheaper
+    // than serializing it here.
+    Entry entry;
+    entry.msg = new GLMessage();
+    entry.msg->Swap(msg);
+    entry.size = size;
+    mQueue.push_back(entry);
+    mQueuedBytes += size;
+    mStats.messagesQueued++;
+
+    if (mWriterWaiting) {
+        mWriterWaiting = false;
+        pthread_cond_signal(&mWorkCond);
+    }
+    pthread_mutex_unlock(&mLock);
     return 0;
 }
 
+void AsyncOutputStream::getStats(Stats *stats) {
+    pthread_mutex_lock(&mLock);
+    *stats = mStats;
+    pthread_mutex_unlock(&mLock);
+}
+
+uint64_t AsyncOutputStream::getDroppedCount() {
+    pthread_mutex_lock(&mLock);
+    uint64_t dropped = mStats.messagesDropped;
+    pthread_mutex_unlock(&mLock);
+    return dropped;
+}
+
+void *AsyncOutputStream::writerThread(void *arg) {
+    static_cast<AsyncOutputStream *>(arg)->writerLoop();
+    return NULL;
+}
+
+void AsyncOutputStream::writerLoop() {
+    // Messages are collected into a batch of about this many bytes before
+    // being sent. Files get larger chunks, which compress better and keep
+    // the index small.
+    const size_t BATCH_SIZE = 64 * 1024;
+    const size_t CHUNK_SIZE = 256 * 1024;
+    // a partial chunk is written out after this long without new messages
+    const nsecs_t CHUNK_FLUSH_DELAY = ms2ns(500);
+
+    const size_t batchSize = mOptions.chunkedFile ? CHUNK_SIZE : BATCH_SIZE;
+    std::deque<Entry> work;
+    std::string batch;
+    batch.reserve(batchSize);
+    Stats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    if (mOptions.chunkedFile) {
+        TraceFileHeader header;
+        memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+        header.version = TRACE_FILE_VERSION;
+        header.headerSize = sizeof(header);
+        sendOrFail(&header, sizeof(header));
+        mFileOffset = sizeof(header);
+        traceSummaryReset(&mChunkSummary, 0, 0);
+    }
+
+    pthread_mutex_lock(&mLock);
+    while (true) {
+        bool idle = false;
+        while (mQueue.empty() && !mStopping && !idle) {
+            mWriterWaiting = true;
+            if (batch.empty()) {
+                pthread_cond_wait(&mWorkCond, &mLock);
+            } else {
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                nsecs_t t = s2ns(deadline.tv_sec) + deadline.tv_nsec
+                        + CHUNK_FLUSH_DELAY;
+                deadline.tv_sec = t / 1000000000;
+                deadline.tv_nsec = t % 1000000000;
+                idle = pthread_cond_timedwait(&mWorkCond, &mLock, &deadline) == ETIMEDOUT;
+            }
+        }
+        mWriterWaiting = false;
+        if (mQueue.empty() && !idle) {
+            break;
+        }
+
+        // Take everything queued so far, and let blocked GL threads go on
+        // queueing while this lot is being written.
+        work.swap(mQueue);
+        mQueuedBytes = 0;
+        if (mBlockedProducers > 0) {
+            pthread_cond_broadcast(&mSpaceCond);
+        }
+        pthread_mutex_unlock(&mLock);
+
+        while (!work.empty()) {
+            GLMessage *msg = work.front().msg;
+            work.pop_front();
+
+            compressFB(msg);
+            const uint32_t len = msg->ByteSize();
+            if (mOptions.chunkedFile) {
+                TraceRecordHeader record;
+                record.size = len;
+                record.function = msg->function();
+                record.contextId = msg->context_id();
+                batch.append((const char *)&record, sizeof(record));
+                traceSummaryAdd(&mChunkSummary, record.function, record.contextId,
+                        mFrameCount);
+                if (record.function == TRACE_FUNCTION_EGL_SWAP_BUFFERS) {
+                    mFrameCount++;
+                }
+            } else {
+                batch.append((const char *)&len, sizeof(len));
+            }
+            msg->AppendToString(&batch);
+            delete msg;
+            stats.messagesWritten++;
+
+            if (batch.size() >= batchSize) {
+                writeBatch(&batch, &stats);
+            }
+        }
+        // Hosts get everything right away. Files wait for a full chunk,
+        // unless the app has gone quiet.
+        if (!mOptions.chunkedFile || idle) {
+            writeBatch(&batch, &stats);
+        }
+
+        pthread_mutex_lock(&mLock);
+        addStatsLocked(&stats);
+        if (mFailed) {
+            // nobody is listening any more; drop whatever comes in
+            mStats.messagesDropped += mQueue.size();
+            while (!mQueue.empty()) {
+                delete mQueue.front().msg;
+                mQueue.pop_front();
+            }
+            mQueuedBytes = 0;
+            pthread_cond_broadcast(&mSpaceCond);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+
+    // stopping: write out the last chunk and the index
+    writeBatch(&batch, &stats);
+    if (mOptions.chunkedFile) {
+        writeIndex();
+    }
+    pthread_mutex_lock(&mLock);
+    addStatsLocked(&stats);
+    pthread_mutex_unlock(&mLock);
+}
+
+void AsyncOutputStream::addStatsLocked(Stats *stats) {
+    mStats.messagesWritten += stats->messagesWritten;
+    mStats.batchesWritten += stats->batchesWritten;
+    mStats.bytesSerialized += stats->bytesSerialized;
+    mStats.bytesWritten += stats->bytesWritten;
+    memset(stats, 0, sizeof(*stats));
+}
+
+void AsyncOutputStream::sendOrFail(const void *data, size_t len) {
+    // mFailed is only set on this thread, so it can be read without the lock
+    if (!mFailed && mStream->send((void *)data, len) < 0) {
+        pthread_mutex_lock(&mLock);
+        mFailed = true;
+        pthread_mutex_unlock(&mLock);
+    }
+}
+
+void AsyncOutputStream::compressFB(GLMessage *msg) {
+    if (!msg->has_fb()) {
+        return;
+    }
+
+    GLMessage_FrameBuffer *fb = msg->mutable_fb();
+    for (int i = 0; i < fb->contents_size(); i++) {
+        std::string *contents = fb->mutable_contents(i);
+        const size_t len = contents->size();
+        if (len == 0) {
+            continue;
+        }
+
+        // large enough for lzf's worst case, so that compression never fails
+        mFBScratch.resize(len + len / 16 + 64);
+        unsigned n = lzf_compress(contents->data(), len, &mFBScratch[0], mFBScratch.size());
+        contents->assign(mFBScratch.data(), n);
+    }
+}
+
+void AsyncOutputStream::writeBatch(std::string *batch, Stats *stats) {
+    if (batch->empty()) {
+        return;
+    }
+
+    const std::string *out = batch;
+    if (mOptions.chunkedFile || mOptions.compressBatches) {
+        const size_t headerSize = mOptions.chunkedFile
+                ? sizeof(TraceChunkHeader) : 2 * sizeof(uint32_t);
+        const uint32_t rawLen = batch->size();
+        mBatchScratch.resize(headerSize + rawLen);
+        char *payload = &mBatchScratch[headerSize];
+        // store the batch as is if it doesn't get any smaller
+        uint32_t payloadLen = lzf_compress(batch->data(), rawLen, payload, rawLen - 1);
+        if (payloadLen == 0) {
+            memcpy(payload, batch->data(), rawLen);
+            payloadLen = rawLen;
+        }
+        mBatchScratch.resize(headerSize + payloadLen);
+
+        if (mOptions.chunkedFile) {
+            TraceChunkHeader header;
+            header.magic = TRACE_CHUNK_MAGIC;
+            header.payloadSize = payloadLen;
+            header.rawSize = rawLen;
+            header.reserved = 0;
+            header.summary = mChunkSummary;
+            memcpy(&mBatchScratch[0], &header, sizeof(header));
+
+            TraceIndexEntry entry;
+            entry.offset = mFileOffset;
+            entry.summary = mChunkSummary;
+            mIndex.push_back(entry);
+            mFileOffset += mBatchScratch.size();
+            traceSummaryReset(&mChunkSummary,
+                    mChunkSummary.firstMessage + mChunkSummary.messageCount, mFrameCount);
+        } else {
+            uint32_t header[2] = { BATCH_FLAG | payloadLen, rawLen };
+            memcpy(&mBatchScratch[0], header, sizeof(header));
+        }
+        out = &mBatchScratch;
+    }
+
+    sendOrFail(out->data(), out->size());
+
+    stats->batchesWritten++;
+    stats->bytesSerialized += batch->size();
+    stats->bytesWritten += out->size();
+    batch->clear();
+}
+
+void AsyncOutputStream::writeIndex() {
+    if (!mIndex.empty()) {
+        sendOrFail(&mIndex[0], mIndex.size() * sizeof(TraceIndexEntry));
+    }
+
+    TraceFileFooter footer;
+    footer.indexOffset = mFileOffset;
+    footer.indexEntries = mIndex.size();
+    footer.version = TRACE_FILE_VERSION;
+    memcpy(footer.magic, TRACE_FOOTER_MAGIC, sizeof(footer.magic));
+    sendOrFail(&footer, sizeof(footer));
+}
+
 };  // namespace gltrace
 };  // namespace android
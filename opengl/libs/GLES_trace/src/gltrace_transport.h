@@ -17,18 +17,43 @@
 #ifndef __GLTRACE_TRANSPORT_H_
 #define __GLTRACE_TRANSPORT_H_
 
+#include <deque>
+#include <string>
+#include <vector>
 #include <pthread.h>
 
 #include "gltrace.pb.h"
+#include "gltrace_file.h"
 
 namespace android {
 namespace gltrace {
 
+/**
+ * OutputStream is a channel over which GLMessages leave the process:
+ * either a connection to the host, or a local file.
+ */
+class OutputStream {
+public:
+    virtual ~OutputStream() {}
+
+    /** Close the channel. */
+    virtual void closeStream() = 0;
+
+    /** Send @data of size @len. Returns -1 on error, 0 on success. */
+    virtual int send(void *data, size_t len) = 0;
+
+    /**
+     * Receive @len bytes of data into @buf from the remote end. This is a blocking call.
+     * Returns -1 on failure, 0 on success.
+     */
+    virtual int receive(void *buf, size_t len) = 0;
+};
+
 /**
  * TCPStream provides a TCP based communication channel from the device to
  * the host for transferring GLMessages.
  */
-class TCPStream {
+class TCPStream : public OutputStream {
     int mSocket;
     pthread_mutex_t mSocketWriteMutex;
 public:
@@ -36,46 +61,140 @@ public:
     TCPStream(int socket);
     ~TCPStream();
 
-    /** Close the channel. */
     void closeStream();
-
-    /** Send @data of size @len to host. . Returns -1 on error, 0 on success. */
     int send(void *data, size_t len);
-
-    /**
-     * Receive @len bytes of data into @buf from the remote end. This is a blocking call.
-     * Returns -1 on failure, 0 on success.
-     */
     int receive(void *buf, size_t len);
 };
 
 /**
- * BufferedOutputStream provides buffering of data sent to the underlying
- * unbuffered channel.
+ * FileStream writes the trace to a local file, so that it can be captured
+ * without a host connected. It has no remote end: receive() always fails.
  */
-class BufferedOutputStream {
-    TCPStream *mStream;
+class FileStream : public OutputStream {
+    int mFd;
+public:
+    /** Write to @fd, which the stream then owns. */
+    FileStream(int fd);
+    ~FileStream();
 
-    size_t mBufferSize;
-    std::string mStringBuffer;
+    void closeStream();
+    int send(void *data, size_t len);
+    int receive(void *buf, size_t len);
+};
 
-    /** Enqueue message into internal buffer. */
-    void enqueueMessage(GLMessage *msg);
+/**
+ * AsyncOutputStream hands GLMessages over to a writer thread, which
+ * serializes them, compresses framebuffer contents and sends them to the
+ * underlying stream in batches. All the GL thread pays for is moving the
+ * message into the queue.
+ *
+ * Framebuffer contents must be queued as raw RGBA data; they are lzf
+ * compressed by the writer, so that the host sees the same messages as
+ * before.
+ *
+ * By default, messages go out as a sequence of (uint32_t length, GLMessage).
+ * With compressBatches set, they are grouped into frames instead:
+ *     uint32_t BATCH_FLAG | payload length
+ *     uint32_t uncompressed length
+ *     payload: the lzf compressed messages, or the messages themselves if
+ *              payload length == uncompressed length.
+ * The messages inside a frame use the default format.
+ *
+ * With chunkedFile set, the output is an indexed trace file instead, as
+ * described in gltrace_file.h.
+ */
+class AsyncOutputStream {
 public:
-    /**
-     * Construct a Buffered stream of size @bufferSize, using @stream as
-     * its underlying channel for transport.
-     */
-    BufferedOutputStream(TCPStream *stream, size_t bufferSize);
+    enum DropPolicy {
+        /** Wait for the writer when the queue is full; nothing is lost. */
+        BLOCK,
+        /** Discard the message being sent when the queue is full. */
+        DROP_NEWEST,
+        /** Discard the oldest queued messages to make room. */
+        DROP_OLDEST,
+    };
+
+    enum {
+        /** Set in the first word of a batch frame. */
+        BATCH_FLAG = 0x80000000,
+    };
+
+    struct Options {
+        size_t maxQueuedBytes;
+        DropPolicy dropPolicy;
+        bool compressBatches;
+        bool chunkedFile;
+    };
+
+    struct Stats {
+        uint64_t messagesQueued;
+        uint64_t messagesDropped;
+        uint64_t messagesWritten;
+        uint64_t batchesWritten;
+        uint64_t bytesSerialized;   /* before batch compression */
+        uint64_t bytesWritten;
+        uint64_t blockedNs;         /* time GL threads waited for room */
+    };
+
+    /** Start a writer thread sending to @stream, which must outlive this object. */
+    AsyncOutputStream(OutputStream *stream, const Options &options);
+
+    /** Write out everything still queued, then stop the writer thread. */
+    ~AsyncOutputStream();
 
     /**
-     * Send @msg. The message could be buffered and sent later with a
-     * subsequent message. Returns -1 on error, 0 on success.
+     * Queue @msg for writing. Its contents are moved out, leaving @msg
+     * empty, unless it is dropped. Returns -1 if the message was dropped
+     * or the stream failed, 0 otherwise.
      */
     int send(GLMessage *msg);
 
-    /** Send any buffered messages, returns -1 on error, 0 on success. */
-    int flush();
+    void getStats(Stats *stats);
+
+    /** Number of messages dropped so far. */
+    uint64_t getDroppedCount();
+
+private:
+    struct Entry {
+        GLMessage *msg;
+        size_t size;
+    };
+
+    static void *writerThread(void *arg);
+    void writerLoop();
+
+    void compressFB(GLMessage *msg);
+    void writeBatch(std::string *batch, Stats *stats);
+    void writeIndex();
+    void sendOrFail(const void *data, size_t len);
+    void addStatsLocked(Stats *stats);
+
+    OutputStream *mStream;
+    const Options mOptions;
+
+    /* trace file state, only used by the writer thread */
+    uint64_t mFileOffset;
+    uint32_t mFrameCount;
+    TraceChunkSummary mChunkSummary;
+    std::vector<TraceIndexEntry> mIndex;
+
+    pthread_mutex_t mLock;
+    pthread_cond_t mWorkCond;       /* signalled when the queue gets work */
+    pthread_cond_t mSpaceCond;      /* signalled when the queue drains */
+    std::deque<Entry> mQueue;
+    size_t mQueuedBytes;
+    bool mWriterWaiting;
+    int mBlockedProducers;
+    bool mStopping;
+    bool mFailed;
+    Stats mStats;
+
+    pthread_t mWriter;
+    bool mWriterStarted;
+
+    /* scratch buffers, only used by the writer thread */
+    std::string mFBScratch;
+    std::string mBatchScratch;
 };
 
 /**
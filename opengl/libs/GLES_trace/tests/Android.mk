@@ -0,0 +1,18 @@
+# Build the host unit tests.
+LOCAL_PATH := $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    ../src/gltrace_fbdelta.cpp \
+    gltrace_fbdelta_test.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/../src \
+    external/gtest/include
+
+LOCAL_STATIC_LIBRARIES := libgtest_host libgtest_main_host
+
+LOCAL_MODULE := gltrace_fbdelta_test
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_EXECUTABLE)
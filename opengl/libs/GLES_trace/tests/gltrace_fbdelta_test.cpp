@@ -0,0 +1,191 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "gltrace_fbdelta.h"
+
+namespace android {
+namespace gltrace {
+
+class FBDeltaTest : public testing::Test {
+protected:
+    FBDeltaTest() : mEncoder(0) {}
+
+    /* A frame where every pixel is different. */
+    static std::vector<uint8_t> makeFrame(unsigned width, unsigned height, uint8_t seed) {
+        std::vector<uint8_t> frame(width * height * 4);
+        for (size_t i = 0; i < frame.size(); i++) {
+            frame[i] = (uint8_t) (i * 7 + i / 251 + seed);
+        }
+        return frame;
+    }
+
+    /* Flip the bits of the pixels in a rectangle. */
+    static void xorRect(std::vector<uint8_t> *frame, unsigned width,
+                        unsigned x, unsigned y, unsigned w, unsigned h) {
+        for (unsigned row = y; row < y + h; row++) {
+            for (unsigned i = x * 4; i < (x + w) * 4; i++) {
+                (*frame)[row * width * 4 + i] ^= 0xff;
+            }
+        }
+    }
+
+    void encode(const std::vector<uint8_t> &frame, unsigned width, unsigned height) {
+        mEncoder.encode(&frame[0], width, height, width * 4, &mEncoded);
+    }
+
+    bool decode(unsigned width, unsigned height) {
+        return mDecoder.decode((const uint8_t *) mEncoded.data(), mEncoded.size(),
+                               width, height);
+    }
+
+    FBDeltaHeader header() const {
+        FBDeltaHeader h;
+        memcpy(&h, mEncoded.data(), sizeof(h));
+        return h;
+    }
+
+    bool decodedFrameIs(const std::vector<uint8_t> &frame) const {
+        const uint8_t *decoded = mDecoder.getFrame();
+        return decoded != NULL && !memcmp(decoded, &frame[0], frame.size());
+    }
+
+    FBDeltaEncoder mEncoder;
+    FBDeltaDecoder mDecoder;
+    std::string mEncoded;
+};
+
+TEST_F(FBDeltaTest, KeyFrame) {
+    // 100x70 leaves clipped tiles on the right and bottom edges
+    std::vector<uint8_t> frame = makeFrame(100, 70, 0);
+    encode(frame, 100, 70);
+
+    EXPECT_EQ((uint32_t) FBDeltaHeader::MAGIC, header().magic);
+    EXPECT_TRUE(header().flags & FBDeltaHeader::KEY_FRAME);
+    ASSERT_TRUE(decode(100, 70));
+    EXPECT_TRUE(decodedFrameIs(frame));
+}
+
+TEST_F(FBDeltaTest, XorDeltaCarriesChangedTilesOnly) {
+    std::vector<uint8_t> frame = makeFrame(128, 128, 0);
+    encode(frame, 128, 128);
+    ASSERT_TRUE(decode(128, 128));
+
+    // a 10x10 region across the corner of four tiles
+    xorRect(&frame, 128, 28, 28, 10, 10);
+    encode(frame, 128, 128);
+
+    EXPECT_FALSE(header().flags & FBDeltaHeader::KEY_FRAME);
+    // header, a 16 tile bitmap and four 32x32 tiles
+    EXPECT_EQ(sizeof(FBDeltaHeader) + 2 + 4 * 32 * 32 * 4, mEncoded.size());
+    ASSERT_TRUE(decode(128, 128));
+    EXPECT_TRUE(decodedFrameIs(frame));
+
+    // flipping the bits back is another delta
+    xorRect(&frame, 128, 28, 28, 10, 10);
+    encode(frame, 128, 128);
+    ASSERT_TRUE(decode(128, 128));
+    EXPECT_TRUE(decodedFrameIs(frame));
+
+    // an unchanged frame carries no tiles
+    encode(frame, 128, 128);
+    EXPECT_EQ(sizeof(FBDeltaHeader) + 2, mEncoded.size());
+    ASSERT_TRUE(decode(128, 128));
+    EXPECT_TRUE(decodedFrameIs(frame));
+}
+
+TEST_F(FBDeltaTest, SizeChangeSendsKeyFrame) {
+    std::vector<uint8_t> frame = makeFrame(64, 64, 0);
+    encode(frame, 64, 64);
+    ASSERT_TRUE(decode(64, 64));
+
+    frame = makeFrame(40, 90, 1);
+    encode(frame, 40, 90);
+    EXPECT_TRUE(header().flags & FBDeltaHeader::KEY_FRAME);
+    ASSERT_TRUE(decode(40, 90));
+    EXPECT_TRUE(decodedFrameIs(frame));
+
+    // deltas follow at the new size
+    xorRect(&frame, 40, 35, 80, 5, 10);
+    encode(frame, 40, 90);
+    EXPECT_FALSE(header().flags & FBDeltaHeader::KEY_FRAME);
+    ASSERT_TRUE(decode(40, 90));
+    EXPECT_TRUE(decodedFrameIs(frame));
+
+    // but don't apply to a frame of another size
+    encode(frame, 40, 90);
+    EXPECT_FALSE(decode(64, 64));
+    EXPECT_TRUE(mDecoder.getFrame() == NULL);
+}
+
+TEST_F(FBDeltaTest, GapWaitsForKeyFrame) {
+    std::vector<uint8_t> frame = makeFrame(64, 64, 0);
+    encode(frame, 64, 64);
+    ASSERT_TRUE(decode(64, 64));
+
+    // the next delta never reaches the decoder
+    xorRect(&frame, 64, 0, 0, 8, 8);
+    encode(frame, 64, 64);
+    xorRect(&frame, 64, 40, 40, 8, 8);
+    encode(frame, 64, 64);
+    EXPECT_FALSE(decode(64, 64));
+    EXPECT_TRUE(mDecoder.getFrame() == NULL);
+
+    xorRect(&frame, 64, 0, 40, 8, 8);
+    encode(frame, 64, 64);
+    EXPECT_FALSE(decode(64, 64));
+
+    mEncoder.reset();
+    encode(frame, 64, 64);
+    EXPECT_TRUE(header().flags & FBDeltaHeader::KEY_FRAME);
+    ASSERT_TRUE(decode(64, 64));
+    EXPECT_TRUE(decodedFrameIs(frame));
+}
+
+TEST_F(FBDeltaTest, KeyFrameInterval) {
+    std::vector<uint8_t> frame = makeFrame(32, 32, 0);
+    for (int i = 0; i < FBDeltaEncoder::KEY_FRAME_INTERVAL; i++) {
+        encode(frame, 32, 32);
+        EXPECT_EQ(i == 0, (header().flags & FBDeltaHeader::KEY_FRAME) != 0);
+    }
+    encode(frame, 32, 32);
+    EXPECT_TRUE(header().flags & FBDeltaHeader::KEY_FRAME);
+}
+
+TEST_F(FBDeltaTest, RejectsMalformedContents) {
+    std::vector<uint8_t> frame = makeFrame(64, 64, 0);
+    encode(frame, 64, 64);
+
+    // truncated pixels
+    EXPECT_FALSE(mDecoder.decode((const uint8_t *) mEncoded.data(), mEncoded.size() - 1,
+                                 64, 64));
+    // truncated header
+    EXPECT_FALSE(mDecoder.decode((const uint8_t *) mEncoded.data(), sizeof(FBDeltaHeader) - 1,
+                                 64, 64));
+    // not delta contents
+    mEncoded[0] ^= 0xff;
+    EXPECT_FALSE(decode(64, 64));
+    EXPECT_TRUE(mDecoder.getFrame() == NULL);
+}
+
+};
+};
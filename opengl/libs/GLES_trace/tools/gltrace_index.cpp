@@ -0,0 +1,873 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * gltrace-index: works with the indexed trace files written by GLES_trace
+ * (see src/gltrace_file.h) without parsing the messages in them.
+ *
+ *   gltrace-index info FILE
+ *       Print the frames, contexts and chunks in FILE.
+ *   gltrace-index index FILE
+ *       Add the index to a trace that was cut short, dropping any partial
+ *       last chunk.
+ *   gltrace-index extract FILE OUT [-f FIRST[-LAST]] [-c CONTEXT] [-F FUNCTION] [-x]
+ *       Write the matching messages to OUT, in the plain stream format
+ *       (uint32_t length, GLMessage) that the trace viewer opens. Only the
+ *       chunks that may hold matching messages are decompressed. With -x,
+ *       delta encoded framebuffer contents (see src/gltrace_fbdelta.h) are
+ *       replaced by the full frames, which takes reading every chunk.
+ *   gltrace-index convert IN OUT
+ *       Turn a plain or batch compressed stream, as sent to the host, into
+ *       an indexed trace file.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "liblzf/lzf.h"
+}
+
+#include "gltrace_fbdelta.h"
+#include "gltrace_file.h"
+
+using namespace android::gltrace;
+
+namespace {
+
+/* see AsyncOutputStream::BATCH_FLAG */
+const uint32_t BATCH_FLAG = 0x80000000;
+
+const size_t CHUNK_SIZE = 256 * 1024;
+
+/** A read-only mapping of a whole file. */
+class MappedFile {
+public:
+    MappedFile() : mData(NULL), mSize(0) {}
+    ~MappedFile() {
+        if (mData != NULL) {
+            munmap(mData, mSize);
+        }
+    }
+
+    bool open(const char *path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            fprintf(stderr, "cannot stat %s: %s\n", path, strerror(errno));
+            close(fd);
+            return false;
+        }
+        mSize = st.st_size;
+        if (mSize > 0) {
+            void *data = mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                fprintf(stderr, "cannot map %s: %s\n", path, strerror(errno));
+                close(fd);
+                return false;
+            }
+            mData = (uint8_t *) data;
+        }
+        close(fd);
+        return true;
+    }
+
+    const uint8_t *data() const { return mData; }
+    size_t size() const { return mSize; }
+
+private:
+    uint8_t *mData;
+    size_t mSize;
+};
+
+/** The chunks of a trace file, from its footer or from its chunk headers. */
+struct TraceIndex {
+    std::vector<TraceIndexEntry> entries;
+    uint64_t dataEnd;       /* end of the last complete chunk */
+    bool fromFooter;
+};
+
+bool checkHeader(const MappedFile &file) {
+    TraceFileHeader header;
+    if (file.size() < sizeof(header)) {
+        fprintf(stderr, "not a trace file\n");
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic))
+            || header.headerSize < sizeof(header) || header.headerSize > file.size()) {
+        fprintf(stderr, "not a trace file\n");
+        return false;
+    }
+    if (header.version != TRACE_FILE_VERSION) {
+        fprintf(stderr, "unsupported trace file version %u\n", header.version);
+        return false;
+    }
+    return true;
+}
+
+/** Whether a whole chunk starts at @offset and ends by @dataEnd. */
+bool isChunkAt(const MappedFile &file, uint64_t dataStart, uint64_t dataEnd, uint64_t offset) {
+    if (offset < dataStart || offset > dataEnd
+            || dataEnd - offset < sizeof(TraceChunkHeader)) {
+        return false;
+    }
+    TraceChunkHeader chunk;
+    memcpy(&chunk, file.data() + offset, sizeof(chunk));
+    return chunk.magic == TRACE_CHUNK_MAGIC
+            && chunk.payloadSize <= dataEnd - offset - sizeof(chunk);
+}
+
+/**
+ * Load the index of @file. Every entry then points at a whole chunk, which
+ * readChunk() relies on.
+ */
+bool loadIndex(const MappedFile &file, TraceIndex *index) {
+    if (!checkHeader(file)) {
+        return false;
+    }
+    const uint8_t *data = file.data();
+    const uint64_t size = file.size();
+    TraceFileHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    // Use the footer if there is a valid one.
+    TraceFileFooter footer;
+    if (size >= header.headerSize + sizeof(footer)) {
+        memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+        const uint64_t indexEnd = size - sizeof(footer);
+        const uint64_t indexSize = (uint64_t) footer.indexEntries * sizeof(TraceIndexEntry);
+        if (!memcmp(footer.magic, TRACE_FOOTER_MAGIC, sizeof(footer.magic))
+                && footer.version == TRACE_FILE_VERSION
+                && footer.indexOffset >= header.headerSize
+                && footer.indexOffset <= indexEnd
+                && indexSize == indexEnd - footer.indexOffset) {
+            index->entries.resize(footer.indexEntries);
+            if (indexSize > 0) {
+                memcpy(&index->entries[0], data + footer.indexOffset, indexSize);
+            }
+            bool valid = true;
+            for (size_t i = 0; i < index->entries.size() && valid; i++) {
+                valid = isChunkAt(file, header.headerSize, footer.indexOffset,
+                        index->entries[i].offset);
+            }
+            if (valid) {
+                index->dataEnd = footer.indexOffset;
+                index->fromFooter = true;
+                return true;
+            }
+            fprintf(stderr, "ignoring corrupt index\n");
+        }
+    }
+
+    // Otherwise walk the chunk headers, skipping over the payloads.
+    uint64_t offset = header.headerSize;
+    index->entries.clear();
+    while (isChunkAt(file, header.headerSize, size, offset)) {
+        TraceChunkHeader chunk;
+        memcpy(&chunk, data + offset, sizeof(chunk));
+        TraceIndexEntry entry;
+        entry.offset = offset;
+        entry.summary = chunk.summary;
+        index->entries.push_back(entry);
+        offset += sizeof(chunk) + chunk.payloadSize;
+    }
+    index->dataEnd = offset;
+    index->fromFooter = false;
+    return true;
+}
+
+/** Decompress the records of the chunk at @offset, from the index, into @out. */
+bool readChunk(const MappedFile &file, uint64_t offset, std::string *out) {
+    TraceChunkHeader chunk;
+    memcpy(&chunk, file.data() + offset, sizeof(chunk));
+    const uint8_t *payload = file.data() + offset + sizeof(chunk);
+    if (chunk.payloadSize == chunk.rawSize) {
+        out->assign((const char *) payload, chunk.rawSize);
+        return true;
+    }
+    out->resize(chunk.rawSize);
+    if (chunk.rawSize == 0) {
+        return true;
+    }
+    unsigned n = lzf_decompress(payload, chunk.payloadSize, &(*out)[0], chunk.rawSize);
+    if (n != chunk.rawSize) {
+        fprintf(stderr, "corrupt chunk at offset %llu\n", (unsigned long long) offset);
+        return false;
+    }
+    return true;
+}
+
+/** Writes an indexed trace file; the same layout GLES_trace writes. */
+class TraceFileWriter {
+public:
+    TraceFileWriter() : mFile(NULL), mOffset(0), mFrame(0) {}
+
+    bool open(const char *path) {
+        mFile = fopen(path, "wb");
+        if (mFile == NULL) {
+            fprintf(stderr, "cannot create %s: %s\n", path, strerror(errno));
+            return false;
+        }
+        TraceFileHeader header;
+        memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+        header.version = TRACE_FILE_VERSION;
+        header.headerSize = sizeof(header);
+        fwrite(&header, sizeof(header), 1, mFile);
+        mOffset = sizeof(header);
+        traceSummaryReset(&mSummary, 0, 0);
+        return true;
+    }
+
+    void add(const uint8_t *msg, uint32_t size, uint32_t function, int32_t contextId) {
+        TraceRecordHeader record;
+        record.size = size;
+        record.function = function;
+        record.contextId = contextId;
+        mRecords.append((const char *) &record, sizeof(record));
+        mRecords.append((const char *) msg, size);
+        traceSummaryAdd(&mSummary, function, contextId, mFrame);
+        if (function == TRACE_FUNCTION_EGL_SWAP_BUFFERS) {
+            mFrame++;
+        }
+        if (mRecords.size() >= CHUNK_SIZE) {
+            writeChunk();
+        }
+    }
+
+    bool close() {
+        writeChunk();
+        if (!mIndex.empty()) {
+            fwrite(&mIndex[0], sizeof(TraceIndexEntry), mIndex.size(), mFile);
+        }
+        TraceFileFooter footer;
+        footer.indexOffset = mOffset;
+        footer.indexEntries = mIndex.size();
+        footer.version = TRACE_FILE_VERSION;
+        memcpy(footer.magic, TRACE_FOOTER_MAGIC, sizeof(footer.magic));
+        fwrite(&footer, sizeof(footer), 1, mFile);
+        bool ok = !ferror(mFile);
+        ok = fclose(mFile) == 0 && ok;
+        mFile = NULL;
+        if (!ok) {
+            fprintf(stderr, "error writing trace file\n");
+        }
+        return ok;
+    }
+
+private:
+    void writeChunk() {
+        if (mRecords.empty()) {
+            return;
+        }
+        const uint32_t rawSize = mRecords.size();
+        mPayload.resize(rawSize);
+        uint32_t payloadSize = lzf_compress(mRecords.data(), rawSize, &mPayload[0], rawSize - 1);
+        const char *payload = mPayload.data();
+        if (payloadSize == 0) {
+            payload = mRecords.data();
+            payloadSize = rawSize;
+        }
+
+        TraceChunkHeader chunk;
+        chunk.magic = TRACE_CHUNK_MAGIC;
+        chunk.payloadSize = payloadSize;
+        chunk.rawSize = rawSize;
+        chunk.reserved = 0;
+        chunk.summary = mSummary;
+        fwrite(&chunk, sizeof(chunk), 1, mFile);
+        fwrite(payload, payloadSize, 1, mFile);
+
+        TraceIndexEntry entry;
+        entry.offset = mOffset;
+        entry.summary = mSummary;
+        mIndex.push_back(entry);
+        mOffset += sizeof(chunk) + payloadSize;
+        traceSummaryReset(&mSummary, mSummary.firstMessage + mSummary.messageCount, mFrame);
+        mRecords.clear();
+    }
+
+    FILE *mFile;
+    uint64_t mOffset;
+    uint32_t mFrame;
+    TraceChunkSummary mSummary;
+    std::string mRecords;
+    std::string mPayload;
+    std::vector<TraceIndexEntry> mIndex;
+};
+
+int info(const char *path) {
+    MappedFile file;
+    TraceIndex index;
+    if (!file.open(path) || !loadIndex(file, &index)) {
+        return 1;
+    }
+
+    uint64_t messages = 0;
+    uint64_t contexts = 0;
+    uint64_t rawBytes = 0;
+    for (size_t i = 0; i < index.entries.size(); i++) {
+        const TraceChunkSummary &s = index.entries[i].summary;
+        messages += s.messageCount;
+        contexts |= s.contextMask;
+        TraceChunkHeader chunk;
+        memcpy(&chunk, file.data() + index.entries[i].offset, sizeof(chunk));
+        rawBytes += chunk.rawSize;
+    }
+
+    printf("%s: %s\n", path, index.fromFooter ? "indexed"
+            : "no index (run 'gltrace-index index' to add one)");
+    printf("  %zu chunks, %llu messages, %llu bytes (%llu uncompressed)\n",
+            index.entries.size(), (unsigned long long) messages,
+            (unsigned long long) index.dataEnd, (unsigned long long) rawBytes);
+    if (!index.entries.empty()) {
+        printf("  frames %u to %u\n", index.entries.front().summary.firstFrame,
+                index.entries.back().summary.lastFrame);
+    }
+    printf("  contexts:");
+    for (int i = 0; i < TRACE_CONTEXT_BITS; i++) {
+        if (contexts & (1ULL << i)) {
+            printf(i == TRACE_CONTEXT_BITS - 1 ? " %d+" : " %d", i);
+        }
+    }
+    printf("\n");
+    if (!index.fromFooter && index.dataEnd < file.size()) {
+        printf("  %llu trailing bytes of a partial chunk\n",
+                (unsigned long long) (file.size() - index.dataEnd));
+    }
+    return 0;
+}
+
+int addIndex(const char *path) {
+    TraceIndex index;
+    {
+        MappedFile file;
+        if (!file.open(path) || !loadIndex(file, &index)) {
+            return 1;
+        }
+    }
+    if (index.fromFooter) {
+        printf("%s is already indexed\n", path);
+        return 0;
+    }
+
+    int fd = open(path, O_WRONLY);
+    if (fd < 0 || ftruncate(fd, index.dataEnd) < 0
+            || lseek(fd, index.dataEnd, SEEK_SET) < 0) {
+        fprintf(stderr, "cannot update %s: %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+
+    std::string tail;
+    if (!index.entries.empty()) {
+        tail.append((const char *) &index.entries[0],
+                index.entries.size() * sizeof(TraceIndexEntry));
+    }
+    TraceFileFooter footer;
+    footer.indexOffset = index.dataEnd;
+    footer.indexEntries = index.entries.size();
+    footer.version = TRACE_FILE_VERSION;
+    memcpy(footer.magic, TRACE_FOOTER_MAGIC, sizeof(footer.magic));
+    tail.append((const char *) &footer, sizeof(footer));
+
+    const char *p = tail.data();
+    size_t left = tail.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "cannot update %s: %s\n", path, strerror(errno));
+            close(fd);
+            return 1;
+        }
+        p += n;
+        left -= n;
+    }
+    close(fd);
+    printf("indexed %zu chunks\n", index.entries.size());
+    return 0;
+}
+
+/** Read a protobuf varint at @p, up to @end. Returns NULL if malformed. */
+const uint8_t *readVarint(const uint8_t *p, const uint8_t *end, uint64_t *value) {
+    uint64_t v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+void appendVarint(std::string *out, uint64_t value) {
+    while (value >= 0x80) {
+        out->push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    out->push_back((char) value);
+}
+
+/** A field of a serialized protobuf message. */
+struct ProtoField {
+    uint32_t number;
+    uint32_t wireType;
+    uint64_t value;         /* of varint fields */
+    const uint8_t *data;    /* contents of length delimited fields */
+    const uint8_t *next;    /* the following field */
+};
+
+/** Read the field at @p, up to @end. Returns false if malformed. */
+bool readField(const uint8_t *p, const uint8_t *end, ProtoField *field) {
+    uint64_t key;
+    if ((p = readVarint(p, end, &key)) == NULL) {
+        return false;
+    }
+    field->number = (uint32_t) (key >> 3);
+    field->wireType = (uint32_t) (key & 7);
+    field->value = 0;
+    field->data = NULL;
+    switch (field->wireType) {
+        case 0:     // varint
+            if ((p = readVarint(p, end, &field->value)) == NULL) {
+                return false;
+            }
+            break;
+        case 1:     // 64 bit
+            if (end - p < 8) {
+                return false;
+            }
+            p += 8;
+            break;
+        case 2:     // length delimited
+            if ((p = readVarint(p, end, &field->value)) == NULL
+                    || field->value > (uint64_t) (end - p)) {
+                return false;
+            }
+            field->data = p;
+            p += field->value;
+            break;
+        case 5:     // 32 bit
+            if (end - p < 4) {
+                return false;
+            }
+            p += 4;
+            break;
+        default:
+            return false;
+    }
+    field->next = p;
+    return true;
+}
+
+/**
+ * Find the context_id (1) and function (4) fields of a serialized
+ * GLMessage, skipping over everything else.
+ */
+void peekMessage(const uint8_t *p, size_t size, uint32_t *function, int32_t *contextId) {
+    const uint8_t *end = p + size;
+    *function = 3000;   /* GLMessage::invalid */
+    *contextId = 0;
+    ProtoField field;
+    for (; p < end && readField(p, end, &field); p = field.next) {
+        if (field.wireType != 0) {
+            continue;
+        }
+        if (field.number == 1) {
+            *contextId = (int32_t) field.value;
+        } else if (field.number == 4) {
+            *function = (uint32_t) field.value;
+        }
+    }
+}
+
+/**
+ * Replaces the delta encoded framebuffer contents of GLMessages by the
+ * full frames, lzf compressed like GLES_trace sends them. Messages must
+ * be fed in trace order, since a delta builds on the frame before it.
+ */
+class FBExpander {
+public:
+    FBExpander() : mLost(0) {}
+
+    /**
+     * If the message at @msg has delta encoded contents, set @out to the
+     * message with the full frame and return true. When the frame can't be
+     * rebuilt (e.g. the trace dropped a message), the framebuffer is left
+     * out of the message.
+     */
+    bool expand(const uint8_t *msg, uint32_t size, int32_t contextId, std::string *out);
+
+    /** Frames that could not be rebuilt. */
+    uint64_t getLost() const { return mLost; }
+
+private:
+    /* GLMessage.fb, and GLMessage.FrameBuffer.{width,height,contents} */
+    enum { FB_FIELD = 7, WIDTH_FIELD = 1, HEIGHT_FIELD = 2, CONTENTS_FIELD = 3 };
+    /* larger than any framebuffer GLES_trace reads */
+    enum { MAX_FB_SIZE = 16384 };
+
+    /* by context id in the upper half, FBDeltaHeader::source in the lower */
+    std::map<uint64_t, FBDeltaDecoder> mDecoders;
+    std::string mRaw;
+    std::string mCompressed;
+    uint64_t mLost;
+};
+
+bool FBExpander::expand(const uint8_t *msg, uint32_t size, int32_t contextId,
+                        std::string *out) {
+    const uint8_t *end = msg + size;
+    const uint8_t *fbStart = NULL;
+    ProtoField fb;
+    for (const uint8_t *p = msg; p < end; p = fb.next) {
+        if (!readField(p, end, &fb)) {
+            return false;
+        }
+        if (fb.number == FB_FIELD && fb.wireType == 2) {
+            fbStart = p;
+            break;
+        }
+    }
+    if (fbStart == NULL) {
+        return false;
+    }
+
+    uint64_t width = 0, height = 0;
+    const uint8_t *contents = NULL;
+    size_t contentsSize = 0;
+    int contentsCount = 0;
+    ProtoField field;
+    for (const uint8_t *p = fb.data; p < fb.next; p = field.next) {
+        if (!readField(p, fb.next, &field)) {
+            return false;
+        }
+        if (field.number == WIDTH_FIELD && field.wireType == 0) {
+            width = field.value;
+        } else if (field.number == HEIGHT_FIELD && field.wireType == 0) {
+            height = field.value;
+        } else if (field.number == CONTENTS_FIELD && field.wireType == 2) {
+            contents = field.data;
+            contentsSize = field.value;
+            contentsCount++;
+        }
+    }
+    // GLES_trace only ever sends one frame per message
+    if (contentsCount != 1 || contentsSize == 0 || width == 0 || height == 0
+            || width > MAX_FB_SIZE || height > MAX_FB_SIZE) {
+        return false;
+    }
+
+    // Even a key frame with one pixel tiles fits in a bitmap byte per pixel
+    // on top of the pixels.
+    const size_t frameSize = width * height * 4;
+    mRaw.resize(sizeof(FBDeltaHeader) + width * height + frameSize);
+    const unsigned n = lzf_decompress(contents, contentsSize, &mRaw[0], mRaw.size());
+    FBDeltaHeader header;
+    if (n == frameSize || n < sizeof(header)) {
+        // a full frame, or nothing we can read
+        return false;
+    }
+    memcpy(&header, mRaw.data(), sizeof(header));
+    if (header.magic != FBDeltaHeader::MAGIC) {
+        return false;
+    }
+
+    FBDeltaDecoder &decoder = mDecoders[((uint64_t) (uint32_t) contextId << 32) | header.source];
+    const uint8_t *frame = NULL;
+    if (decoder.decode((const uint8_t *) mRaw.data(), n, width, height)) {
+        frame = decoder.getFrame();
+    } else {
+        mLost++;
+    }
+
+    // the message without its fb field, which is then added back at the end
+    out->assign((const char *) msg, fbStart - msg);
+    out->append((const char *) fb.next, end - fb.next);
+    if (frame == NULL) {
+        return true;
+    }
+
+    // large enough for lzf's worst case, so that compression never fails
+    mCompressed.resize(frameSize + frameSize / 16 + 64);
+    const unsigned compressedSize = lzf_compress(frame, frameSize,
+            &mCompressed[0], mCompressed.size());
+
+    std::string fbField;
+    appendVarint(&fbField, (WIDTH_FIELD << 3) | 0);
+    appendVarint(&fbField, width);
+    appendVarint(&fbField, (HEIGHT_FIELD << 3) | 0);
+    appendVarint(&fbField, height);
+    appendVarint(&fbField, (CONTENTS_FIELD << 3) | 2);
+    appendVarint(&fbField, compressedSize);
+    fbField.append(mCompressed.data(), compressedSize);
+
+    appendVarint(out, (FB_FIELD << 3) | 2);
+    appendVarint(out, fbField.size());
+    out->append(fbField);
+    return true;
+}
+
+struct Filter {
+    uint32_t firstFrame;
+    uint32_t lastFrame;
+    bool anyContext;
+    int32_t contextId;
+    bool anyFunction;
+    uint32_t function;
+};
+
+bool chunkMatches(const TraceChunkSummary &s, const Filter &filter) {
+    return s.messageCount > 0
+            && s.lastFrame >= filter.firstFrame && s.firstFrame <= filter.lastFrame
+            && (filter.anyContext || traceSummaryHasContext(&s, filter.contextId))
+            && (filter.anyFunction || traceSummaryHasFunction(&s, filter.function));
+}
+
+int extract(const char *path, const char *outPath, const Filter &filter, bool expandFB) {
+    MappedFile file;
+    TraceIndex index;
+    if (!file.open(path) || !loadIndex(file, &index)) {
+        return 1;
+    }
+    FILE *out = fopen(outPath, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "cannot create %s: %s\n", outPath, strerror(errno));
+        return 1;
+    }
+
+    std::string records;
+    std::string expanded;
+    FBExpander expander;
+    uint64_t written = 0;
+    size_t chunksRead = 0;
+    for (size_t i = 0; i < index.entries.size(); i++) {
+        const TraceIndexEntry &entry = index.entries[i];
+        // deltas build on frames that may be in any earlier chunk
+        if (expandFB ? entry.summary.messageCount == 0 : !chunkMatches(entry.summary, filter)) {
+            continue;
+        }
+        if (!readChunk(file, entry.offset, &records)) {
+            fclose(out);
+            return 1;
+        }
+        chunksRead++;
+
+        uint32_t frame = entry.summary.firstFrame;
+        size_t pos = 0;
+        while (pos + sizeof(TraceRecordHeader) <= records.size()) {
+            TraceRecordHeader record;
+            memcpy(&record, records.data() + pos, sizeof(record));
+            pos += sizeof(record);
+            if (record.size > records.size() - pos) {
+                fprintf(stderr, "corrupt chunk at offset %llu\n",
+                        (unsigned long long) entry.offset);
+                fclose(out);
+                return 1;
+            }
+            const uint8_t *msg = (const uint8_t *) records.data() + pos;
+            uint32_t msgSize = record.size;
+            if (expandFB && expander.expand(msg, msgSize, record.contextId, &expanded)) {
+                msg = (const uint8_t *) expanded.data();
+                msgSize = expanded.size();
+            }
+            if (frame >= filter.firstFrame && frame <= filter.lastFrame
+                    && (filter.anyContext || record.contextId == filter.contextId)
+                    && (filter.anyFunction || record.function == filter.function)) {
+                fwrite(&msgSize, sizeof(msgSize), 1, out);
+                fwrite(msg, msgSize, 1, out);
+                written++;
+            }
+            if (record.function == TRACE_FUNCTION_EGL_SWAP_BUFFERS) {
+                frame++;
+            }
+            pos += record.size;
+        }
+    }
+
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "error writing %s\n", outPath);
+        return 1;
+    }
+    printf("%llu messages from %zu of %zu chunks\n", (unsigned long long) written,
+            chunksRead, index.entries.size());
+    if (expander.getLost() > 0) {
+        printf("%llu framebuffer deltas could not be rebuilt and were left out\n",
+                (unsigned long long) expander.getLost());
+    }
+    return 0;
+}
+
+/** Feed the (uint32_t length, GLMessage) sequence in @data to @writer. */
+bool convertMessages(const uint8_t *data, size_t size, TraceFileWriter *writer,
+                     uint64_t *count) {
+    size_t pos = 0;
+    while (pos + sizeof(uint32_t) <= size) {
+        uint32_t len;
+        memcpy(&len, data + pos, sizeof(len));
+        pos += sizeof(len);
+
+        if (len & BATCH_FLAG) {
+            // a compressed batch frame
+            uint32_t payloadLen = len & ~BATCH_FLAG;
+            uint32_t rawLen;
+            if (pos + sizeof(rawLen) > size) {
+                break;
+            }
+            memcpy(&rawLen, data + pos, sizeof(rawLen));
+            pos += sizeof(rawLen);
+            if (payloadLen > size - pos) {
+                break;
+            }
+            std::string batch;
+            if (payloadLen == rawLen) {
+                batch.assign((const char *) data + pos, rawLen);
+            } else {
+                batch.resize(rawLen);
+                if (rawLen == 0 || lzf_decompress(data + pos, payloadLen,
+                        &batch[0], rawLen) != rawLen) {
+                    fprintf(stderr, "corrupt batch at offset %zu\n", pos);
+                    return false;
+                }
+            }
+            if (!convertMessages((const uint8_t *) batch.data(), batch.size(),
+                    writer, count)) {
+                return false;
+            }
+            pos += payloadLen;
+            continue;
+        }
+
+        if (len > size - pos) {
+            break;
+        }
+        uint32_t function;
+        int32_t contextId;
+        peekMessage(data + pos, len, &function, &contextId);
+        writer->add(data + pos, len, function, contextId);
+        (*count)++;
+        pos += len;
+    }
+    if (pos != size) {
+        fprintf(stderr, "ignoring %zu bytes of a partial message\n", size - pos);
+    }
+    return true;
+}
+
+int convert(const char *path, const char *outPath) {
+    MappedFile file;
+    TraceFileWriter writer;
+    if (!file.open(path) || !writer.open(outPath)) {
+        return 1;
+    }
+    uint64_t count = 0;
+    if (!convertMessages(file.data(), file.size(), &writer, &count)) {
+        writer.close();
+        return 1;
+    }
+    if (!writer.close()) {
+        return 1;
+    }
+    printf("converted %llu messages\n", (unsigned long long) count);
+    return 0;
+}
+
+void usage() {
+    fprintf(stderr,
+            "usage: gltrace-index info FILE\n"
+            "       gltrace-index index FILE\n"
+            "       gltrace-index extract FILE OUT [-f FIRST[-LAST]] [-c CONTEXT] [-F FUNCTION]"
+            " [-x]\n"
+            "       gltrace-index convert IN OUT\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+    const char *cmd = argv[1];
+
+    if (!strcmp(cmd, "info") && argc == 3) {
+        return info(argv[2]);
+    } else if (!strcmp(cmd, "index") && argc == 3) {
+        return addIndex(argv[2]);
+    } else if (!strcmp(cmd, "convert") && argc == 4) {
+        return convert(argv[2], argv[3]);
+    } else if (!strcmp(cmd, "extract") && argc >= 4) {
+        Filter filter;
+        filter.firstFrame = 0;
+        filter.lastFrame = 0xffffffff;
+        filter.anyContext = true;
+        filter.contextId = 0;
+        filter.anyFunction = true;
+        filter.function = 0;
+        bool expandFB = false;
+        for (int i = 4; i < argc; i++) {
+            if (!strcmp(argv[i], "-x")) {
+                expandFB = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                usage();
+                return 2;
+            }
+            const char *arg = argv[++i];
+            if (!strcmp(argv[i - 1], "-f")) {
+                char *end;
+                filter.firstFrame = strtoul(arg, &end, 0);
+                filter.lastFrame = *end == '-' ? strtoul(end + 1, NULL, 0) : filter.firstFrame;
+            } else if (!strcmp(argv[i - 1], "-c")) {
+                filter.anyContext = false;
+                filter.contextId = strtol(arg, NULL, 0);
+            } else if (!strcmp(argv[i - 1], "-F")) {
+                filter.anyFunction = false;
+                filter.function = strtoul(arg, NULL, 0);
+            } else {
+                usage();
+                return 2;
+            }
+        }
+        return extract(argv[2], argv[3], filter, expandFB);
+    }
+
+    usage();
+    return 2;
+}
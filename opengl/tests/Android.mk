@@ -2,6 +2,7 @@ dirs := \
 	angeles \
 	configdump \
 	EGLTest \
+	etc1 \
 	fillrate \
 	filter \
 	finish \
@@ -0,0 +1,14 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	etc1_benchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libETC1
+
+LOCAL_MODULE:= test-opengl-etc1
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
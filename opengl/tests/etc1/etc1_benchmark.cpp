@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures ETC1 encode and decode throughput for each quality preset and
+// thread count, and the PSNR of the result against the source image.
+//
+// usage: test-opengl-etc1 [width height [maxThreads]]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ETC1/etc1.h>
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// A deterministic test image mixing smooth gradients, hard edges and noise,
+// so that every part of the encoder gets exercised.
+static void makeImage(etc1_byte* pixels, int width, int height) {
+    unsigned int seed = 1;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            etc1_byte* p = pixels + (y * width + x) * 3;
+            seed = seed * 1103515245 + 12345;
+            int noise = (seed >> 16) & 0x1f;
+            int r = (x * 255) / width;
+            int g = (y * 255) / height;
+            int b = ((x / 16 + y / 16) & 1) ? 220 : 40;
+            if ((x / 64 + y / 64) & 1) {
+                r = 255 - r + noise - 16;
+                g = g + noise - 16;
+            }
+            p[0] = r < 0 ? 0 : (r > 255 ? 255 : r);
+            p[1] = g < 0 ? 0 : (g > 255 ? 255 : g);
+            p[2] = b;
+        }
+    }
+}
+
+static double psnr(const etc1_byte* a, const etc1_byte* b, size_t size) {
+    double sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        double d = double(a[i]) - double(b[i]);
+        sum += d * d;
+    }
+    if (sum == 0) {
+        return INFINITY;
+    }
+    return 10 * log10(255.0 * 255.0 * size / sum);
+}
+
+int main(int argc, char** argv) {
+    int width = 1024;
+    int height = 1024;
+    int maxThreads = 4;
+    if (argc >= 3) {
+        width = atoi(argv[1]);
+        height = atoi(argv[2]);
+    }
+    if (argc >= 4) {
+        maxThreads = atoi(argv[3]);
+    }
+    if (width <= 0 || height <= 0 || maxThreads <= 0) {
+        fprintf(stderr, "usage: %s [width height [maxThreads]]\n", argv[0]);
+        return 1;
+    }
+
+    const size_t imageSize = size_t(width) * height * 3;
+    const etc1_uint32 encodedSize = etc1_get_encoded_data_size(width, height);
+    etc1_byte* image = new etc1_byte[imageSize];
+    etc1_byte* decoded = new etc1_byte[imageSize];
+    etc1_byte* reference = new etc1_byte[encodedSize];
+    etc1_byte* encoded = new etc1_byte[encodedSize];
+    const double megapixels = double(width) * height * 1e-6;
+    makeImage(image, width, height);
+
+    // etc1_encode_image is the reference encoder.
+    double t = now();
+    etc1_encode_image(image, width, height, 3, width * 3, reference);
+    double referenceTime = now() - t;
+    etc1_decode_image(reference, decoded, width, height, 3, width * 3);
+    printf("%dx%d reference: %7.2f MP/s  PSNR %.3f dB\n", width, height,
+            megapixels / referenceTime, psnr(image, decoded, imageSize));
+
+    static const char* const kQualityNames[] = { "fast", "medium", "exhaustive" };
+    bool failed = false;
+    for (int quality = ETC1_QUALITY_FAST; quality <= ETC1_QUALITY_EXHAUSTIVE; quality++) {
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            t = now();
+            etc1_encode_image_quality(image, width, height, 3, width * 3, encoded,
+                    quality, threads);
+            double elapsed = now() - t;
+            etc1_decode_image(encoded, decoded, width, height, 3, width * 3);
+            const char* note = "";
+            if (quality == ETC1_QUALITY_MEDIUM
+                    && memcmp(encoded, reference, encodedSize)) {
+                note = "  MISMATCH with reference";
+                failed = true;
+            }
+            printf("%-10s %2d thread(s): %7.2f MP/s  PSNR %.3f dB%s\n",
+                    kQualityNames[quality], threads, megapixels / elapsed,
+                    psnr(image, decoded, imageSize), note);
+        }
+    }
+
+    const int kDecodeLoops = 10;
+    t = now();
+    for (int i = 0; i < kDecodeLoops; i++) {
+        etc1_decode_image(reference, decoded, width, height, 3, width * 3);
+    }
+    printf("decode: %7.2f MP/s\n", kDecodeLoops * megapixels / (now() - t));
+
+    delete[] image;
+    delete[] decoded;
+    delete[] reference;
+    delete[] encoded;
+    return failed ? 1 : 0;
+}
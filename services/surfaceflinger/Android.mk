@@ -16,6 +16,7 @@ LOCAL_SRC_FILES:= \
     SurfaceFlinger.cpp                      \
     SurfaceTextureLayer.cpp                 \
     Transform.cpp                           \
+    VSyncModel.cpp                          \
 
 LOCAL_CFLAGS:= -DLOG_TAG=\"SurfaceFlinger\"
 LOCAL_CFLAGS += -DGL_GLEXT_PROTOTYPES -DEGL_EGLEXT_PROTOTYPES
@@ -17,12 +17,16 @@
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include <gui/BitTube.h>
 #include <gui/IDisplayEventConnection.h>
 #include <gui/DisplayEventReceiver.h>
 
+#include <cutils/properties.h>
+
 #include <utils/Errors.h>
 #include <utils/Trace.h>
 
@@ -42,9 +46,33 @@ EventThread::EventThread(const sp<SurfaceFlinger>& flinger)
       mLastVSyncTimestamp(0),
       mVSyncTimestamp(0),
       mUseSoftwareVSync(false),
+      mHwVSyncState(-1),
       mDeliveredEvents(0),
+      mCoalesceEvents(false),
+      mUseModel(false),
       mDebugVsyncEnabled(false)
 {
+    for (size_t i=0 ; i<NUM_PHASES ; i++) {
+        mLastPhaseVSync[i] = 0;
+        mPhaseEvents[i] = 0;
+        mPhaseOffset[i] = 0;
+    }
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sf.vsync_coalesce", value, "0");
+    mCoalesceEvents = atoi(value);
+
+    // when set, a model of vsync learned from the h/w timestamps drives the
+    // events once it is stable, and h/w vsync is turned off most of the time
+    property_get("debug.sf.vsync_model", value, "0");
+    mUseModel = atoi(value);
+
+    // offsets from vsync at which apps and the compositor are woken, in ns.
+    // negative values wake them before vsync.
+    property_get("debug.sf.vsync_app_phase_ns", value, "0");
+    mPhaseOffset[PHASE_APP] = strtoll(value, NULL, 10);
+    property_get("debug.sf.vsync_sf_phase_ns", value, "0");
+    mPhaseOffset[PHASE_COMPOSITOR] = strtoll(value, NULL, 10);
 }
 
 void EventThread::onFirstRef() {
@@ -52,39 +80,62 @@ void EventThread::onFirstRef() {
     run("EventThread", PRIORITY_URGENT_DISPLAY + PRIORITY_MORE_FAVORABLE);
 }
 
-sp<EventThread::Connection> EventThread::createEventConnection() const {
-    return new Connection(const_cast<EventThread*>(this));
+sp<EventThread::Connection> EventThread::createEventConnection(Phase phase) const {
+    return new Connection(const_cast<EventThread*>(this), phase);
 }
 
 status_t EventThread::registerDisplayEventConnection(
         const sp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
-    mDisplayEventConnections.add(connection);
-    mCondition.broadcast();
+    if (connection->index < 0) {
+        ConnectionState state;
+        state.count = -1;
+        state.phase = connection->phase;
+        state.connection = connection;
+        connection->index = mConnections.add(state);
+        mCondition.broadcast();
+    }
     return NO_ERROR;
 }
 
 status_t EventThread::unregisterDisplayEventConnection(
         const wp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
-    mDisplayEventConnections.remove(connection);
+    removeConnectionLocked(connection.unsafe_get());
     mCondition.broadcast();
     return NO_ERROR;
 }
 
 void EventThread::removeDisplayEventConnection(
-        const wp<EventThread::Connection>& connection) {
+        const sp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
-    mDisplayEventConnections.remove(connection);
+    removeConnectionLocked(connection.get());
+}
+
+void EventThread::removeConnectionLocked(EventThread::Connection* connection) {
+    const ssize_t index = connection->index;
+    if (index < 0) {
+        return;
+    }
+    // keep the array dense by moving the last connection into the hole
+    const size_t last = mConnections.size() - 1;
+    if (size_t(index) != last) {
+        ConnectionState& state(mConnections.editItemAt(index));
+        state = mConnections[last];
+        state.connection.unsafe_get()->index = index;
+    }
+    mConnections.removeItemsAt(last);
+    connection->index = -1;
 }
 
 void EventThread::setVsyncRate(uint32_t count,
         const sp<EventThread::Connection>& connection) {
     if (int32_t(count) >= 0) { // server must protect against bad params
         Mutex::Autolock _l(mLock);
+        const ssize_t index = connection->index;
         const int32_t new_count = (count == 0) ? -1 : count;
-        if (connection->count != new_count) {
-            connection->count = new_count;
+        if (index >= 0 && mConnections[index].count != new_count) {
+            mConnections.editItemAt(index).count = new_count;
             mCondition.broadcast();
         }
     }
@@ -93,8 +144,9 @@ void EventThread::setVsyncRate(uint32_t count,
 void EventThread::requestNextVsync(
         const sp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
-    if (connection->count < 0) {
-        connection->count = 0;
+    const ssize_t index = connection->index;
+    if (index >= 0 && mConnections[index].count < 0) {
+        mConnections.editItemAt(index).count = 0;
         mCondition.broadcast();
     }
 }
@@ -104,6 +156,7 @@ void EventThread::onScreenReleased() {
     if (!mUseSoftwareVSync) {
         // disable reliance on h/w vsync
         mUseSoftwareVSync = true;
+        mHwVSyncState = -1;
         mCondition.broadcast();
     }
 }
@@ -113,6 +166,7 @@ void EventThread::onScreenAcquired() {
     if (mUseSoftwareVSync) {
         // resume use of h/w vsync
         mUseSoftwareVSync = false;
+        mHwVSyncState = -1;
         mCondition.broadcast();
     }
 }
@@ -120,6 +174,9 @@ void EventThread::onScreenAcquired() {
 
 void EventThread::onVSyncReceived(int, nsecs_t timestamp) {
     Mutex::Autolock _l(mLock);
+    if (mUseModel) {
+        mModel.addSample(timestamp);
+    }
     mVSyncTimestamp = timestamp;
     mCondition.broadcast();
 }
@@ -127,8 +184,10 @@ void EventThread::onVSyncReceived(int, nsecs_t timestamp) {
 bool EventThread::threadLoop() {
 
     nsecs_t timestamp;
-    DisplayEventReceiver::Event vsync;
-    Vector< wp<EventThread::Connection> > displayEventConnections;
+    uint32_t phases;
+    nsecs_t phaseTimestamp[NUM_PHASES];
+    Vector< sp<EventThread::Connection> > signalConnections[NUM_PHASES];
+    size_t signalCount;
 
     do {
         Mutex::Autolock _l(mLock);
@@ -137,41 +196,73 @@ bool EventThread::threadLoop() {
             timestamp = mVSyncTimestamp;
             mVSyncTimestamp = 0;
 
-            // check if we should be waiting for VSYNC events
-            bool waitForNextVsync = false;
-            size_t count = mDisplayEventConnections.size();
+            // check which phases have connections waiting for VSYNC events
+            uint32_t waiting = 0;
+            const size_t count = mConnections.size();
+            const ConnectionState* states = mConnections.array();
             for (size_t i=0 ; i<count ; i++) {
-                sp<Connection> connection =
-                        mDisplayEventConnections.itemAt(i).promote();
-                if (connection!=0 && connection->count >= 0) {
-                    // at least one continuous mode or active one-shot event
-                    waitForNextVsync = true;
-                    break;
+                if (states[i].count >= 0) {
+                    // continuous mode or active one-shot event
+                    waiting |= 1 << states[i].phase;
                 }
             }
-
-            if (timestamp) {
-                if (!waitForNextVsync) {
-                    // we received a VSYNC but we have no clients
-                    // don't report it, and disable VSYNC events
-                    disableVSyncLocked();
-                } else {
-                    // report VSYNC event
-                    break;
+            const bool waitForNextVsync = waiting != 0;
+            const bool useModel = useModelLocked();
+
+            if (timestamp && !waitForNextVsync) {
+                // we received a VSYNC but we have no clients
+                // don't report it, and disable VSYNC events
+                disableVSyncLocked();
+            } else if (timestamp && !useModel) {
+                // report VSYNC event to every phase
+                phases = (1 << NUM_PHASES) - 1;
+                for (size_t p=0 ; p<NUM_PHASES ; p++) {
+                    phaseTimestamp[p] = timestamp;
+                    mLastPhaseVSync[p] = timestamp + mModel.getPeriod() / 2;
                 }
-            } else {
+                break;
+            } else if (waitForNextVsync) {
                 // never disable VSYNC events immediately, instead
                 // we'll wait to receive the event and we'll
                 // reevaluate whether we need to dispatch it and/or
                 // disable VSYNC events then.
-                if (waitForNextVsync) {
-                    // enable
-                    enableVSyncLocked();
-                }
+                // when the model drives events, this also turns h/w VSYNC
+                // off, or back on to resync.
+                enableVSyncLocked();
             }
 
             // wait for something to happen
-            if (mUseSoftwareVSync && waitForNextVsync) {
+            if (useModel && waitForNextVsync) {
+                // find the phases due now, or else when the next one is
+                const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+                nsecs_t nextWakeup = 0;
+                phases = 0;
+                for (size_t p=0 ; p<NUM_PHASES ; p++) {
+                    if (!(waiting & (1 << p))) {
+                        continue;
+                    }
+                    // a vsync isn't skipped because we woke up a little
+                    // late, and never goes to the same phase twice
+                    const nsecs_t offset = mPhaseOffset[p];
+                    nsecs_t after = now - offset - mModel.getPeriod() / 4;
+                    if (after < mLastPhaseVSync[p]) {
+                        after = mLastPhaseVSync[p];
+                    }
+                    const nsecs_t vsync = mModel.computeNextVSync(after);
+                    const nsecs_t due = vsync + offset;
+                    if (due <= now) {
+                        phases |= 1 << p;
+                        phaseTimestamp[p] = due;
+                        mLastPhaseVSync[p] = vsync;
+                    } else if (!nextWakeup || due < nextWakeup) {
+                        nextWakeup = due;
+                    }
+                }
+                if (phases) {
+                    break;
+                }
+                mCondition.waitRelative(mLock, nextWakeup - now);
+            } else if (mUseSoftwareVSync && waitForNextVsync) {
                 // h/w vsync cannot be used (screen is off), so we use
                 // a  timeout instead. it doesn't matter how imprecise this
                 // is, we just need to make sure to serve the clients
@@ -185,20 +276,27 @@ bool EventThread::threadLoop() {
 
         // process vsync event
         mDeliveredEvents++;
-        mLastVSyncTimestamp = timestamp;
+        for (size_t p=0 ; p<NUM_PHASES ; p++) {
+            if (phases & (1 << p)) {
+                mPhaseEvents[p]++;
+                mLastVSyncTimestamp = phaseTimestamp[p];
+            }
+        }
 
-        // now see if we still need to report this VSYNC event
-        const size_t count = mDisplayEventConnections.size();
+        // now see if we still need to report this VSYNC event. only the
+        // connections that get it are promoted.
+        signalCount = 0;
+        const size_t count = mConnections.size();
+        ConnectionState* states = mConnections.editArray();
         for (size_t i=0 ; i<count ; i++) {
-            bool reportVsync = false;
-            sp<Connection> connection =
-                    mDisplayEventConnections.itemAt(i).promote();
-            if (connection == 0)
+            ConnectionState& state(states[i]);
+            if (!(phases & (1 << state.phase))) {
                 continue;
-
-            const int32_t count = connection->count;
+            }
+            bool reportVsync = false;
+            const int32_t count = state.count;
             if (count >= 1) {
-                if (count==1 || (mDeliveredEvents % count) == 0) {
+                if (count==1 || (mPhaseEvents[state.phase] % count) == 0) {
                     // continuous event, and time to report it
                     reportVsync = true;
                 }
@@ -207,63 +305,78 @@ bool EventThread::threadLoop() {
                     // fired this time around
                     reportVsync = true;
                 }
-                connection->count--;
+                state.count--;
             }
             if (reportVsync) {
-                displayEventConnections.add(connection);
+                sp<Connection> connection(state.connection.promote());
+                // a connection that can't be promoted is being destroyed
+                // and will remove itself.
+                if (connection != 0) {
+                    signalConnections[state.phase].add(connection);
+                    signalCount++;
+                }
             }
         }
-    } while (!displayEventConnections.size());
-
-    // dispatch vsync events to listeners...
-    vsync.header.type = DisplayEventReceiver::DISPLAY_EVENT_VSYNC;
-    vsync.header.timestamp = timestamp;
-    vsync.vsync.count = mDeliveredEvents;
-
-    const size_t count = displayEventConnections.size();
-    for (size_t i=0 ; i<count ; i++) {
-        sp<Connection> conn(displayEventConnections[i].promote());
-        // make sure the connection didn't die
-        if (conn != NULL) {
-            status_t err = conn->postEvent(vsync);
-            if (err == -EAGAIN || err == -EWOULDBLOCK) {
-                // The destination doesn't accept events anymore, it's probably
-                // full. For now, we just drop the events on the floor.
-                // Note that some events cannot be dropped and would have to be
-                // re-sent later. Right-now we don't have the ability to do
-                // this, but it doesn't matter for VSYNC.
-            } else if (err < 0) {
-                // handle any other error on the pipe as fatal. the only
-                // reasonable thing to do is to clean-up this connection.
-                // The most common error we'll get here is -EPIPE.
-                removeDisplayEventConnection(displayEventConnections[i]);
+    } while (!signalCount);
+
+    // dispatch vsync events to listeners without holding mLock...
+    for (size_t p=0 ; p<NUM_PHASES ; p++) {
+        const size_t count = signalConnections[p].size();
+        if (!count) {
+            continue;
+        }
+
+        // with a phase offset, the timestamp is when the event was due
+        DisplayEventReceiver::Event vsync;
+        vsync.header.type = DisplayEventReceiver::DISPLAY_EVENT_VSYNC;
+        vsync.header.timestamp = phaseTimestamp[p];
+        vsync.vsync.count = mPhaseEvents[p];
+
+        for (size_t i=0 ; i<count ; i++) {
+            const sp<Connection>& conn(signalConnections[p][i]);
+            status_t err = conn->postEvent(vsync, mCoalesceEvents);
+            if (err < 0) {
+                // handle any error on the pipe other than a full one as
+                // fatal. the only reasonable thing to do is to clean-up
+                // this connection. The most common error we'll get here is
+                // -EPIPE.
+                removeDisplayEventConnection(conn);
             }
-        } else {
-            // somehow the connection is dead, but we still have it in our list
-            // just clean the list.
-            removeDisplayEventConnection(displayEventConnections[i]);
         }
-    }
 
-    // clear all our references without holding mLock
-    displayEventConnections.clear();
+        // clear all our references without holding mLock
+        signalConnections[p].clear();
+    }
 
     return true;
 }
 
 void EventThread::enableVSyncLocked() {
     if (!mUseSoftwareVSync) {
-        // never enable h/w VSYNC when screen is off
-        mHw.eventControl(DisplayHardware::EVENT_VSYNC, true);
+        // never enable h/w VSYNC when screen is off. once the model drives
+        // events, h/w VSYNC is only needed now and then to check it.
+        setHwVSyncEnabledLocked(!useModelLocked() ||
+                mModel.needsSamples(systemTime(SYSTEM_TIME_MONOTONIC)));
     }
     mDebugVsyncEnabled = true;
 }
 
 void EventThread::disableVSyncLocked() {
-    mHw.eventControl(DisplayHardware::EVENT_VSYNC, false);
+    setHwVSyncEnabledLocked(false);
     mDebugVsyncEnabled = false;
 }
 
+void EventThread::setHwVSyncEnabledLocked(bool enabled) {
+    if (mHwVSyncState != int(enabled)) {
+        mHw.eventControl(DisplayHardware::EVENT_VSYNC, enabled);
+        mHwVSyncState = enabled;
+    }
+}
+
+bool EventThread::useModelLocked() const {
+    return mUseModel && mModel.isStable();
+}
+
 status_t EventThread::readyToRun() {
     ALOGI("EventThread ready to run.");
     return NO_ERROR;
@@ -275,22 +388,40 @@ void EventThread::dump(String8& result, char* buffer, size_t SIZE) const {
             mDebugVsyncEnabled?"enabled":"disabled");
     result.appendFormat("  soft-vsync: %s\n",
             mUseSoftwareVSync?"enabled":"disabled");
+    result.appendFormat("  h/w vsync: %s\n",
+            mHwVSyncState == 1 ? "on" : mHwVSyncState == 0 ? "off" : "unknown");
+    result.appendFormat("  coalesce-events: %s\n",
+            mCoalesceEvents?"enabled":"disabled");
+    if (mUseModel) {
+        mModel.dump(result);
+    } else {
+        result.append("  vsync-model: disabled\n");
+    }
+    result.appendFormat("  phase-offsets: app=%lldns sf=%lldns\n",
+            (long long) mPhaseOffset[PHASE_APP],
+            (long long) mPhaseOffset[PHASE_COMPOSITOR]);
     result.appendFormat("  numListeners=%u,\n  events-delivered: %u\n",
-            mDisplayEventConnections.size(), mDeliveredEvents);
-    for (size_t i=0 ; i<mDisplayEventConnections.size() ; i++) {
-        sp<Connection> connection =
-                mDisplayEventConnections.itemAt(i).promote();
-        result.appendFormat("    %p: count=%d\n",
-                connection.get(), connection!=NULL ? connection->count : 0);
+            mConnections.size(), mDeliveredEvents);
+    for (size_t i=0 ; i<mConnections.size() ; i++) {
+        const ConnectionState& state(mConnections[i]);
+        sp<Connection> connection = state.connection.promote();
+        result.appendFormat("    %p: %s count=%d", connection.get(),
+                state.phase == PHASE_COMPOSITOR ? "sf " : "app", state.count);
+        if (connection != NULL) {
+            connection->dumpStats(result);
+        }
+        result.append("\n");
     }
 }
 
 // ---------------------------------------------------------------------------
 
 EventThread::Connection::Connection(
-        const sp<EventThread>& eventThread)
-    : count(-1), mEventThread(eventThread), mChannel(new BitTube())
+        const sp<EventThread>& eventThread, Phase phase)
+    : index(-1), phase(phase), mEventThread(eventThread), mChannel(new BitTube()),
+      mPendingCount(0)
 {
+    memset(&mStats, 0, sizeof(mStats));
 }
 
 EventThread::Connection::~Connection() {
@@ -315,9 +446,68 @@ void EventThread::Connection::requestNextVsync() {
 }
 
 status_t EventThread::Connection::postEvent(
-        const DisplayEventReceiver::Event& event) {
-    ssize_t size = DisplayEventReceiver::sendEvents(mChannel, &event, 1);
-    return size < 0 ? status_t(size) : status_t(NO_ERROR);
+        const DisplayEventReceiver::Event& event, bool coalesce) {
+    const DisplayEventReceiver::Event* events = &event;
+    size_t count = 1;
+    if (coalesce && mPendingCount) {
+        // send what's left from earlier along with this event, keeping
+        // only the most recent ones
+        if (mPendingCount == MAX_PENDING_EVENTS) {
+            memmove(mPendingEvents, mPendingEvents + 1,
+                    (MAX_PENDING_EVENTS - 1) * sizeof(mPendingEvents[0]));
+            mPendingCount--;
+            mStats.dropped++;
+        }
+        mPendingEvents[mPendingCount++] = event;
+        events = mPendingEvents;
+        count = mPendingCount;
+    }
+
+    ssize_t size = DisplayEventReceiver::sendEvents(mChannel, events, count);
+    mStats.writes++;
+    if (size == -EAGAIN || size == -EWOULDBLOCK) {
+        // The destination doesn't accept events anymore, it's probably full.
+        // sendObjects() reports that as a short count, but be safe.
+        size = 0;
+    } else if (size < 0) {
+        mPendingCount = 0;
+        return status_t(size);
+    }
+
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (ssize_t i=0 ; i<size ; i++) {
+        const nsecs_t latency = now - events[i].header.timestamp;
+        mStats.totalLatency += latency;
+        if (latency > mStats.maxLatency) {
+            mStats.maxLatency = latency;
+        }
+    }
+    mStats.delivered += size;
+
+    if (!coalesce) {
+        // For now, we just drop the events on the floor. That's fine for
+        // VSYNC, since only the most recent one matters to the receiver.
+        mStats.dropped += count - size;
+    } else if (events == mPendingEvents) {
+        mPendingCount -= size;
+        memmove(mPendingEvents, mPendingEvents + size,
+                mPendingCount * sizeof(mPendingEvents[0]));
+    } else if (size == 0) {
+        mPendingEvents[0] = event;
+        mPendingCount = 1;
+    }
+    return NO_ERROR;
+}
+
+void EventThread::Connection::dumpStats(String8& result) const {
+    const uint32_t delivered = mStats.delivered;
+    result.appendFormat(" delivered=%u dropped=%u pending=%u writes=%u",
+            delivered, mStats.dropped, uint32_t(mPendingCount), mStats.writes);
+    if (delivered) {
+        result.appendFormat(" latency avg=%.2fms max=%.2fms",
+                ns2us(mStats.totalLatency / delivered) / 1000.0,
+                ns2us(mStats.maxLatency) / 1000.0);
+    }
 }
 
 // ---------------------------------------------------------------------------
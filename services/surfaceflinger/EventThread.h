@@ -25,9 +25,10 @@
 
 #include <utils/Errors.h>
 #include <utils/threads.h>
-#include <utils/SortedVector.h>
+#include <utils/Vector.h>
 
 #include "DisplayHardware/DisplayHardware.h"
+#include "VSyncModel.h"
 
 // ---------------------------------------------------------------------------
 
@@ -40,18 +41,47 @@ class SurfaceFlinger;
 // ---------------------------------------------------------------------------
 
 class EventThread : public Thread, public DisplayHardware::VSyncHandler {
+public:
+    // Each connection is woken at the phase offset of its group, relative
+    // to vsync. Offsets only apply once the vsync model is stable.
+    enum Phase {
+        PHASE_APP = 0,
+        PHASE_COMPOSITOR = 1,
+        NUM_PHASES
+    };
+
+private:
     class Connection : public BnDisplayEventConnection {
     public:
-        Connection(const sp<EventThread>& eventThread);
-        status_t postEvent(const DisplayEventReceiver::Event& event);
+        Connection(const sp<EventThread>& eventThread, Phase phase);
 
-        // count >= 1 : continuous event. count is the vsync rate
-        // count == 0 : one-shot event that has not fired
-        // count ==-1 : one-shot event that fired this round / disabled
-        // count ==-2 : one-shot event that fired the round before
-        int32_t count;
+        // When 'coalesce' is set, events that didn't fit in the pipe earlier
+        // are kept and sent along with 'event' in a single sendObjects()
+        // call. Otherwise they are dropped. Called from the EventThread only.
+        status_t postEvent(const DisplayEventReceiver::Event& event,
+                bool coalesce);
+
+        // may be slightly torn since the EventThread updates the stats
+        // without holding mLock.
+        void dumpStats(String8& result) const;
+
+        // index of this connection's ConnectionState in mConnections,
+        // or -1 once it is removed. protected by EventThread::mLock
+        ssize_t index;
+
+        const Phase phase;
 
     private:
+        enum { MAX_PENDING_EVENTS = 4 };
+
+        struct Stats {
+            uint32_t delivered;     // events written to the pipe
+            uint32_t dropped;       // events lost because the pipe was full
+            uint32_t writes;        // sendObjects() calls
+            nsecs_t totalLatency;   // vsync timestamp to delivery
+            nsecs_t maxLatency;
+        };
+
         virtual ~Connection();
         virtual void onFirstRef();
         virtual sp<BitTube> getDataChannel() const;
@@ -59,13 +89,31 @@ class EventThread : public Thread, public DisplayHardware::VSyncHandler {
         virtual void requestNextVsync();    // asynchronous
         sp<EventThread> const mEventThread;
         sp<BitTube> const mChannel;
+
+        // EventThread only
+        DisplayEventReceiver::Event mPendingEvents[MAX_PENDING_EVENTS];
+        size_t mPendingCount;
+        Stats mStats;
+    };
+
+    // What threadLoop() needs to know about a connection to decide whether
+    // to wait for vsync and whom to send it to, kept in one flat array so
+    // that no connection has to be promoted for that.
+    struct ConnectionState {
+        // count >= 1 : continuous event. count is the vsync rate
+        // count == 0 : one-shot event that has not fired
+        // count ==-1 : one-shot event that fired this round / disabled
+        // count ==-2 : one-shot event that fired the round before
+        int32_t count;
+        Phase phase;
+        wp<Connection> connection;
     };
 
 public:
 
     EventThread(const sp<SurfaceFlinger>& flinger);
 
-    sp<Connection> createEventConnection() const;
+    sp<Connection> createEventConnection(Phase phase = PHASE_APP) const;
     status_t registerDisplayEventConnection(const sp<Connection>& connection);
     status_t unregisterDisplayEventConnection(const wp<Connection>& connection);
 
@@ -86,9 +134,12 @@ private:
     virtual void        onFirstRef();
     virtual void        onVSyncReceived(int, nsecs_t timestamp);
 
-    void removeDisplayEventConnection(const wp<Connection>& connection);
+    void removeDisplayEventConnection(const sp<Connection>& connection);
+    void removeConnectionLocked(Connection* connection);
     void enableVSyncLocked();
     void disableVSyncLocked();
+    void setHwVSyncEnabledLocked(bool enabled);
+    bool useModelLocked() const;
 
     // constants
     sp<SurfaceFlinger> mFlinger;
@@ -98,13 +149,29 @@ private:
     mutable Condition mCondition;
 
     // protected by mLock
-    SortedVector< wp<Connection> > mDisplayEventConnections;
+    // Connections remove themselves from their destructor, which takes
+    // mLock, so the raw pointers behind these are valid while it is held.
+    Vector<ConnectionState> mConnections;
     nsecs_t mLastVSyncTimestamp;
     nsecs_t mVSyncTimestamp;
     bool mUseSoftwareVSync;
+    // state last passed to eventControl(), or -1 after a screen state
+    // change since the h/w may have lost it.
+    int mHwVSyncState;
+    VSyncModel mModel;
+    // the vsync last delivered to each phase when the model drives events
+    nsecs_t mLastPhaseVSync[NUM_PHASES];
 
     // main thread only
     size_t mDeliveredEvents;
+    size_t mPhaseEvents[NUM_PHASES];
+
+    // set from debug.sf.vsync_coalesce at construction
+    bool mCoalesceEvents;
+    // set from debug.sf.vsync_model at construction
+    bool mUseModel;
+    // set from debug.sf.vsync_app_phase_ns and debug.sf.vsync_sf_phase_ns
+    nsecs_t mPhaseOffset[NUM_PHASES];
 
     // for debugging
     bool mDebugVsyncEnabled;
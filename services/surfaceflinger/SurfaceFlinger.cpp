@@ -104,8 +104,10 @@ SurfaceFlinger::SurfaceFlinger()
         mLastTransactionTime(0),
         mBootFinished(false),
         mSecureFrameBuffer(0),
-        mUseDithering(0)
+        mUseDithering(0),
+        mIncrementalVisibleRegions(1)
 {
+    memset(&mVisibleRegionStats, 0, sizeof(mVisibleRegionStats));
     init();
 #ifdef BOARD_USES_SAMSUNG_HDMI
     LOGD(">>> Run service");
@@ -148,9 +150,13 @@ void SurfaceFlinger::init()
     property_get("persist.sys.use_dithering", value, "1");
     mUseDithering = atoi(value);
 
+    property_get("debug.sf.incremental_visregions", value, "1");
+    mIncrementalVisibleRegions = atoi(value);
+
     ALOGI_IF(mDebugRegion,       "showupdates enabled");
     ALOGI_IF(mDebugDDMS,         "DDMS debugging enabled");
     ALOGI_IF(mUseDithering,      "use dithering");
+    ALOGI_IF(!mIncrementalVisibleRegions, "incremental visible regions disabled");
 }
 
 void SurfaceFlinger::onFirstRef()
@@ -587,6 +593,7 @@ void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
             dcblk->h = plane.getHeight();
 
             mVisibleRegionsDirty = true;
+            mVisibleRegionCache.clear();
             mDirtyRegion.set(hw.bounds());
 
 #if defined(BOARD_USES_SAMSUNG_HDMI) && defined(SAMSUNG_EXYNOS5250)
@@ -635,6 +642,25 @@ void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
     commitTransaction();
 }
 
+static bool sameRegion(const Region& lhs, const Region& rhs)
+{
+    if (lhs.getBounds() != rhs.getBounds()) {
+        return false;
+    }
+    Region::const_iterator l = lhs.begin();
+    Region::const_iterator r = rhs.begin();
+    Region::const_iterator const tail = lhs.end();
+    if (tail - l != rhs.end() - r) {
+        return false;
+    }
+    for ( ; l != tail ; l++, r++) {
+        if (*l != *r) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void SurfaceFlinger::computeVisibleRegions(
     const LayerVector& currentLayers, Region& dirtyRegion, Region& opaqueRegion)
 {
@@ -644,20 +670,83 @@ void SurfaceFlinger::computeVisibleRegions(
     const Transform& planeTransform(plane.transform());
     const DisplayHardware& hw(plane.displayHardware());
     const Region screenRegion(hw.bounds());
+    const size_t count = currentLayers.size();
+
+    /*
+     * A layer's visible and covered regions only depend on its own
+     * geometry, alpha and opacity, and on the opaque and covered regions
+     * of the layers above it.  So, when the layer list itself is the same
+     * as last time, the layers above the topmost one that changed keep
+     * their regions, and we can stop going down as soon as the regions
+     * accumulated so far are the same as in the last pass and nothing
+     * below has changed.  Anything else recomputes the whole stack.
+     */
+    bool full = !mIncrementalVisibleRegions ||
+            mVisibleRegionCache.size() != count;
+    if (full) {
+        mVisibleRegionCache.clear();
+        mVisibleRegionCache.insertAt(0, count);
+    }
+
+    ssize_t top = -1;
+    ssize_t bottom = count;
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<LayerBase>& layer = currentLayers[i];
+        layer->validateVisibility(planeTransform);
+
+        const Layer::State& s(layer->drawingState());
+        const bool hidden = (s.flags & ISurfaceComposer::eLayerHidden) || !s.alpha;
+        const bool translucent = !layer->isOpaque();
+        const bool opaque = s.alpha==255 && !translucent &&
+                ((layer->getOrientation() & Transform::ROT_INVALID) == false);
+        const Rect bounds(layer->visibleBounds());
+
+        VisibleRegionCacheEntry& e(mVisibleRegionCache.editItemAt(i));
+        if (full || layer->contentDirty ||
+                e.sequence != layer->sequence ||
+                e.hidden != hidden ||
+                e.translucent != translucent ||
+                e.opaque != opaque ||
+                e.bounds != bounds ||
+                (translucent &&
+                    !sameRegion(e.transparentRegion, layer->transparentRegionScreen))) {
+            if (top < 0) {
+                bottom = i;
+            }
+            top = i;
+        }
+        if (!full && e.sequence != layer->sequence) {
+            // the layer list changed under us
+            full = true;
+        }
+        e.sequence = layer->sequence;
+        e.hidden = hidden;
+        e.translucent = translucent;
+        e.opaque = opaque;
+        e.bounds = bounds;
+        e.transparentRegion = layer->transparentRegionScreen;
+    }
+    if (full) {
+        top = count - 1;
+        bottom = 0;
+    }
 
     Region aboveOpaqueLayers;
     Region aboveCoveredLayers;
     Region dirty;
 
-    bool secureFrameBuffer = false;
+    if (top+1 < ssize_t(count)) {
+        const VisibleRegionCacheEntry& above(mVisibleRegionCache[top+1]);
+        aboveOpaqueLayers = above.aboveOpaqueLayers;
+        aboveCoveredLayers = above.aboveCoveredLayers;
+    }
 
-    size_t i = currentLayers.size();
+    size_t recomputed = 0;
+    ssize_t i = top + 1;
     while (i--) {
         const sp<LayerBase>& layer = currentLayers[i];
-        layer->validateVisibility(planeTransform);
-
-        // start with the whole surface at its current location
-        const Layer::State& s(layer->drawingState());
+        VisibleRegionCacheEntry& e(mVisibleRegionCache.editItemAt(i));
+        recomputed++;
 
         /*
          * opaqueRegion: area of a surface that is fully opaque.
@@ -680,21 +769,17 @@ void SurfaceFlinger::computeVisibleRegions(
 
 
         // handle hidden surfaces by setting the visible region to empty
-        if (CC_LIKELY(!(s.flags & ISurfaceComposer::eLayerHidden) && s.alpha)) {
-            const bool translucent = !layer->isOpaque();
-            const Rect bounds(layer->visibleBounds());
-            visibleRegion.set(bounds);
+        if (CC_LIKELY(!e.hidden)) {
+            visibleRegion.set(e.bounds);
             visibleRegion.andSelf(screenRegion);
             if (!visibleRegion.isEmpty()) {
                 // Remove the transparent area from the visible region
-                if (translucent) {
+                if (e.translucent) {
                     visibleRegion.subtractSelf(layer->transparentRegionScreen);
                 }
 
                 // compute the opaque region
-                const int32_t layerOrientation = layer->getOrientation();
-                if (s.alpha==255 && !translucent &&
-                        ((layerOrientation & Transform::ROT_INVALID) == false)) {
+                if (e.opaque) {
                     // the opaque region is the layer's footprint
                     opaqueRegion = visibleRegion;
                 }
@@ -748,9 +833,15 @@ void SurfaceFlinger::computeVisibleRegions(
         layer->setVisibleRegion(visibleRegion);
         layer->setCoveredRegion(coveredRegion);
 
-        // If a secure layer is partially visible, lock-down the screen!
-        if (layer->isSecure() && !visibleRegion.isEmpty()) {
-            secureFrameBuffer = true;
+        // once the layers below see the same thing as last time and
+        // none of them changed, their regions are still valid.
+        const bool converged = !full && i <= bottom &&
+                sameRegion(e.aboveOpaqueLayers, aboveOpaqueLayers) &&
+                sameRegion(e.aboveCoveredLayers, aboveCoveredLayers);
+        e.aboveOpaqueLayers = aboveOpaqueLayers;
+        e.aboveCoveredLayers = aboveCoveredLayers;
+        if (converged) {
+            break;
         }
     }
 
@@ -758,8 +849,34 @@ void SurfaceFlinger::computeVisibleRegions(
     dirtyRegion.orSelf(mDirtyRegionRemovedLayer);
     mDirtyRegionRemovedLayer.clear();
 
+    // If a secure layer is partially visible, lock-down the screen!
+    bool secureFrameBuffer = false;
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<LayerBase>& layer = currentLayers[i];
+        if (layer->isSecure() && !layer->visibleRegionScreen.isEmpty()) {
+            secureFrameBuffer = true;
+            break;
+        }
+    }
+
     mSecureFrameBuffer = secureFrameBuffer;
-    opaqueRegion = aboveOpaqueLayers;
+    if (count) {
+        opaqueRegion = mVisibleRegionCache[0].aboveOpaqueLayers;
+    } else {
+        opaqueRegion.clear();
+    }
+
+    VisibleRegionStats& stats(mVisibleRegionStats);
+    stats.passes++;
+    if (full) {
+        stats.fullPasses++;
+    }
+    stats.lastRecomputed = recomputed;
+    stats.lastSkipped = count - recomputed;
+    stats.recomputed += stats.lastRecomputed;
+    stats.skipped += stats.lastSkipped;
+    ATRACE_INT("VisRegionsRecomputed", stats.lastRecomputed);
+    ATRACE_INT("VisRegionsSkipped", stats.lastSkipped);
 }
 
 
@@ -1739,6 +1856,15 @@ void SurfaceFlinger::dumpAllLocked(
             inTransactionDuration/1000.0);
     result.append(buffer);
 
+    const VisibleRegionStats& vrs(mVisibleRegionStats);
+    snprintf(buffer, SIZE, "  visible regions (%s): %u passes (%u full), "
+            "%llu layers recomputed, %llu skipped, last %u/%u\n",
+            mIncrementalVisibleRegions ? "incremental" : "full",
+            vrs.passes, vrs.fullPasses,
+            (unsigned long long) vrs.recomputed, (unsigned long long) vrs.skipped,
+            vrs.lastRecomputed, vrs.lastRecomputed + vrs.lastSkipped);
+    result.append(buffer);
+
     /*
      * VSYNC state
      */
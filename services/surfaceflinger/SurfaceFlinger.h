@@ -300,6 +300,30 @@ private:
         uint8_t         orientationFlags;
     };
 
+    // What computeVisibleRegions() last saw for the layer at a given z
+    // position, and the opaque and covered regions of everything above it
+    // down to and including that layer.  Unchanged layers above the first
+    // changed one reuse these instead of being recomputed.
+    struct VisibleRegionCacheEntry {
+        int32_t         sequence;
+        Rect            bounds;
+        Region          transparentRegion;
+        bool            hidden;
+        bool            translucent;
+        bool            opaque;
+        Region          aboveOpaqueLayers;
+        Region          aboveCoveredLayers;
+    };
+
+    struct VisibleRegionStats {
+        uint32_t        passes;
+        uint32_t        fullPasses;
+        uint64_t        recomputed;
+        uint64_t        skipped;
+        uint32_t        lastRecomputed;
+        uint32_t        lastSkipped;
+    };
+
     virtual bool        threadLoop();
     virtual status_t    readyToRun();
     virtual void        onFirstRef();
@@ -409,6 +433,8 @@ private:
                 Region                      mSwapRegion;
                 Region                      mWormholeRegion;
                 bool                        mVisibleRegionsDirty;
+                Vector<VisibleRegionCacheEntry> mVisibleRegionCache;
+                VisibleRegionStats          mVisibleRegionStats;
                 bool                        mHwWorkListDirty;
                 int32_t                     mElectronBeamAnimationMode;
                 Vector< sp<LayerBase> >     mVisibleLayersSortedByZ;
@@ -436,6 +462,7 @@ private:
    // only written in the main thread, only read in other threads
    volatile     int32_t                     mSecureFrameBuffer;
                 int                         mUseDithering;
+                int                         mIncrementalVisibleRegions;
 #if defined(BOARD_USES_SAMSUNG_HDMI) && defined(SAMSUNG_EXYNOS5250)
     SecHdmiClient *                         mHdmiClient;
 #endif
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String8.h>
+
+#include "VSyncModel.h"
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+const nsecs_t VSyncModel::RESYNC_INTERVAL = s2ns(2);
+const nsecs_t VSyncModel::STABLE_ERROR = us2ns(250);
+
+// samples further than period / OUTLIER_DIVISOR from the model are outliers
+static const nsecs_t OUTLIER_DIVISOR = 8;
+
+VSyncModel::VSyncModel()
+    : mTotalSamples(0),
+      mTotalOutliers(0),
+      mResets(0)
+{
+    reset();
+}
+
+void VSyncModel::reset() {
+    mFirst = 0;
+    mCount = 0;
+    mPeriod = 0;
+    mPhase = 0;
+    mError = 0;
+    mStable = false;
+    mOutlierCount = 0;
+    mResyncCount = 0;
+    mResyncTime = 0;
+}
+
+bool VSyncModel::addSample(nsecs_t timestamp) {
+    mTotalSamples++;
+
+    // once the model is stable, check new samples against it before they
+    // get a say. while still learning, the fit sorts them out instead.
+    if (mStable) {
+        const nsecs_t nearest = computeNextVSync(timestamp - mPeriod / 2);
+        const nsecs_t residual = timestamp - nearest;
+        if (residual > mPeriod / OUTLIER_DIVISOR ||
+                residual < -mPeriod / OUTLIER_DIVISOR) {
+            mTotalOutliers++;
+            if (++mOutlierCount < MAX_OUTLIERS) {
+                return false;
+            }
+            // the display timing changed, start over
+            reset();
+            mResets++;
+        }
+    }
+    mOutlierCount = 0;
+
+    if (mCount == MAX_SAMPLES) {
+        mFirst = (mFirst + 1) % MAX_SAMPLES;
+        mCount--;
+    }
+    mSamples[(mFirst + mCount) % MAX_SAMPLES] = timestamp;
+    mCount++;
+
+    fit();
+
+    if (mStable) {
+        if (++mResyncCount >= RESYNC_SAMPLES) {
+            mResyncCount = 0;
+            mResyncTime = timestamp + RESYNC_INTERVAL;
+        }
+    } else {
+        mResyncCount = 0;
+        mResyncTime = 0;
+    }
+    return true;
+}
+
+void VSyncModel::fit() {
+    const bool wasStable = mStable;
+    mStable = false;
+    if (mCount < 2) {
+        return;
+    }
+
+    // work relative to the newest sample to keep the numbers small
+    const nsecs_t ref = sampleAt(mCount - 1);
+
+    double period = double(mPeriod);
+    if (!wasStable || !mPeriod) {
+        // guess the period from the median interval between samples,
+        // which isn't thrown off by a few missed or late interrupts
+        nsecs_t intervals[MAX_SAMPLES];
+        const size_t n = mCount - 1;
+        for (size_t i=0 ; i<n ; i++) {
+            const nsecs_t interval = sampleAt(i + 1) - sampleAt(i);
+            size_t j = i;
+            while (j > 0 && intervals[j - 1] > interval) {
+                intervals[j] = intervals[j - 1];
+                j--;
+            }
+            intervals[j] = interval;
+        }
+        period = double(intervals[n / 2]);
+    }
+    if (period <= 0) {
+        return;
+    }
+
+    bool inlier[MAX_SAMPLES];
+    for (size_t i=0 ; i<mCount ; i++) {
+        inlier[i] = true;
+    }
+
+    // fit t = phase + k * period, then drop the samples far from the line
+    // and fit again
+    double phase = 0;
+    double error = 0;
+    size_t inliers = 0;
+    for (int pass=0 ; pass<2 ; pass++) {
+        double sk = 0, st = 0, skk = 0, skt = 0;
+        size_t n = 0;
+        for (size_t i=0 ; i<mCount ; i++) {
+            if (!inlier[i])
+                continue;
+            const double t = double(sampleAt(i) - ref);
+            const double k = floor((t - phase) / period + 0.5);
+            sk += k;
+            st += t;
+            skk += k * k;
+            skt += k * t;
+            n++;
+        }
+        const double det = n * skk - sk * sk;
+        if (n < 2 || det <= 0) {
+            break;
+        }
+        const double newPeriod = (n * skt - sk * st) / det;
+        if (newPeriod <= 0) {
+            break;
+        }
+        period = newPeriod;
+        phase = (st - period * sk) / n;
+
+        error = 0;
+        inliers = 0;
+        for (size_t i=0 ; i<mCount ; i++) {
+            const double t = double(sampleAt(i) - ref);
+            const double k = floor((t - phase) / period + 0.5);
+            const double residual = t - (phase + k * period);
+            inlier[i] = fabs(residual) * OUTLIER_DIVISOR < period;
+            if (inlier[i]) {
+                error += residual * residual;
+                inliers++;
+            }
+        }
+        if (!inliers) {
+            break;
+        }
+        error = sqrt(error / inliers);
+    }
+
+    mPeriod = nsecs_t(period + 0.5);
+    mPhase = ref + nsecs_t(floor(phase + 0.5));
+    mError = nsecs_t(error + 0.5);
+    mStable = inliers >= size_t(MIN_SAMPLES)
+            && inliers * 4 >= mCount * 3
+            && mError <= STABLE_ERROR;
+}
+
+nsecs_t VSyncModel::computeNextVSync(nsecs_t time) const {
+    if (!mPeriod) {
+        return 0;
+    }
+    // n = floor((time - mPhase) / mPeriod) + 1, rounding down for
+    // negative values too
+    const nsecs_t delta = time - mPhase;
+    const nsecs_t n = delta >= 0 ?
+            delta / mPeriod + 1 :
+            1 - (mPeriod - 1 - delta) / mPeriod;
+    return mPhase + n * mPeriod;
+}
+
+bool VSyncModel::needsSamples(nsecs_t now) const {
+    return !mStable || now >= mResyncTime;
+}
+
+void VSyncModel::dump(String8& result) const {
+    result.appendFormat("  vsync-model: %s, period=%.3fms error=%.1fus "
+            "samples=%u outliers=%u resets=%u\n",
+            mStable ? "stable" : "learning",
+            mPeriod / 1000000.0, mError / 1000.0,
+            mTotalSamples, mTotalOutliers, mResets);
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
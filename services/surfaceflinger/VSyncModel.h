@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SURFACE_FLINGER_VSYNC_MODEL_H
+#define ANDROID_SURFACE_FLINGER_VSYNC_MODEL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Timers.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+
+class String8;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Learns the period and phase of the display's vsync from hardware vsync
+ * timestamps, so that vsync can be predicted while the hardware interrupt
+ * is off.
+ *
+ * The model is a least-squares line through the most recent samples, each
+ * assigned the vsync index nearest to its timestamp, so missed interrupts
+ * don't disturb it. Samples too far from the line are rejected as outliers;
+ * a run of them means the display timing changed and the model starts over.
+ *
+ * Not thread-safe; EventThread calls it with its lock held.
+ */
+class VSyncModel {
+public:
+    enum {
+        // samples kept for the fit
+        MAX_SAMPLES = 32,
+        // samples needed before the model can be stable
+        MIN_SAMPLES = 6,
+        // consecutive outliers after which the model is reset
+        MAX_OUTLIERS = 3,
+        // samples wanted each time the model is checked against h/w vsync
+        RESYNC_SAMPLES = 4,
+    };
+
+    VSyncModel();
+
+    void reset();
+
+    // Adds a h/w vsync timestamp. Returns false if it was rejected as an
+    // outlier.
+    bool addSample(nsecs_t timestamp);
+
+    // true when enough samples fit the model closely enough to predict
+    // vsync without the hardware.
+    bool isStable() const { return mStable; }
+
+    // 0 until there are at least two samples.
+    nsecs_t getPeriod() const { return mPeriod; }
+
+    // RMS distance of the accepted samples to the model.
+    nsecs_t getError() const { return mError; }
+
+    // Returns the first predicted vsync strictly after 'time', or 0 if there
+    // is no model yet.
+    nsecs_t computeNextVSync(nsecs_t time) const;
+
+    // Whether h/w vsync samples are needed at 'now': always while the model
+    // isn't stable, and for a few samples every RESYNC_INTERVAL otherwise.
+    bool needsSamples(nsecs_t now) const;
+
+    void dump(String8& result) const;
+
+    // longest time the model predicts vsync without a h/w sample
+    static const nsecs_t RESYNC_INTERVAL;
+    // largest RMS error for the model to be stable
+    static const nsecs_t STABLE_ERROR;
+
+private:
+    nsecs_t sampleAt(size_t i) const {
+        return mSamples[(mFirst + i) % MAX_SAMPLES];
+    }
+    void fit();
+
+    nsecs_t mSamples[MAX_SAMPLES];
+    size_t mFirst;
+    size_t mCount;
+
+    // the model: vsync happens at mPhase + k * mPeriod
+    nsecs_t mPeriod;
+    nsecs_t mPhase;
+    nsecs_t mError;
+    bool mStable;
+
+    uint32_t mOutlierCount;
+    uint32_t mResyncCount;
+    nsecs_t mResyncTime;
+
+    // for debugging
+    uint32_t mTotalSamples;
+    uint32_t mTotalOutliers;
+    uint32_t mResets;
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif /* ANDROID_SURFACE_FLINGER_VSYNC_MODEL_H */
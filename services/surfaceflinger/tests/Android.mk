@@ -29,6 +29,29 @@ LOCAL_C_INCLUDES := \
 # to integrate with auto-test framework.
 include $(BUILD_NATIVE_TEST)
 
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := VSyncModel_test
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+    VSyncModel_test.cpp \
+    ../VSyncModel.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libstlport \
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/.. \
+    bionic \
+    bionic/libstdc++/include \
+    external/gtest/include \
+    external/stlport/stlport \
+
+include $(BUILD_NATIVE_TEST)
+
 # Include subdirectory makefiles
 # ============================================================
 
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <utils/String8.h>
+
+#include "VSyncModel.h"
+
+namespace android {
+
+// 60Hz, with a start time large enough to look like systemTime()
+static const nsecs_t PERIOD = 16666667;
+static const nsecs_t START = 123456789012345LL;
+
+class VSyncModelTest : public ::testing::Test {
+protected:
+    VSyncModel mModel;
+    unsigned int mSeed;
+
+    virtual void SetUp() {
+        mSeed = 1;
+    }
+
+    // uniform in [-range, range]
+    nsecs_t jitter(nsecs_t range) {
+        return nsecs_t(rand_r(&mSeed) % (2 * range + 1)) - range;
+    }
+
+    void addSamples(nsecs_t start, nsecs_t period, size_t count, nsecs_t maxJitter) {
+        for (size_t i=0 ; i<count ; i++) {
+            mModel.addSample(start + nsecs_t(i) * period +
+                    (maxJitter ? jitter(maxJitter) : 0));
+        }
+    }
+};
+
+TEST_F(VSyncModelTest, EmptyModelPredictsNothing) {
+    EXPECT_FALSE(mModel.isStable());
+    EXPECT_EQ(0, mModel.getPeriod());
+    EXPECT_EQ(0, mModel.computeNextVSync(START));
+    EXPECT_TRUE(mModel.needsSamples(START));
+}
+
+TEST_F(VSyncModelTest, LearnsExactPeriod) {
+    addSamples(START, PERIOD, VSyncModel::MIN_SAMPLES - 1, 0);
+    EXPECT_FALSE(mModel.isStable());
+
+    addSamples(START + (VSyncModel::MIN_SAMPLES - 1) * PERIOD, PERIOD, 1, 0);
+    EXPECT_TRUE(mModel.isStable());
+    EXPECT_EQ(PERIOD, mModel.getPeriod());
+    EXPECT_EQ(0, mModel.getError());
+}
+
+TEST_F(VSyncModelTest, PredictsNextVSyncStrictlyAfter) {
+    addSamples(START, PERIOD, 10, 0);
+    ASSERT_TRUE(mModel.isStable());
+
+    const nsecs_t v = START + 20 * PERIOD;
+    EXPECT_EQ(v, mModel.computeNextVSync(v - 1));
+    EXPECT_EQ(v + PERIOD, mModel.computeNextVSync(v));
+    EXPECT_EQ(v + PERIOD, mModel.computeNextVSync(v + PERIOD / 2));
+
+    // before the samples, too
+    EXPECT_EQ(START, mModel.computeNextVSync(START - 1));
+    EXPECT_EQ(START - PERIOD, mModel.computeNextVSync(START - PERIOD - 1));
+    EXPECT_EQ(START, mModel.computeNextVSync(START - PERIOD));
+}
+
+TEST_F(VSyncModelTest, AveragesOutJitter) {
+    addSamples(START, PERIOD, 3 * VSyncModel::MAX_SAMPLES, us2ns(200));
+    ASSERT_TRUE(mModel.isStable());
+    EXPECT_NEAR(PERIOD, mModel.getPeriod(), us2ns(10));
+    EXPECT_GT(us2ns(200), mModel.getError());
+
+    // predictions a second ahead stay within the jitter
+    const nsecs_t v = START + 200 * PERIOD;
+    EXPECT_NEAR(v, mModel.computeNextVSync(v - PERIOD / 2), us2ns(200));
+}
+
+TEST_F(VSyncModelTest, IgnoresMissedVSyncs) {
+    // every third interrupt is lost
+    for (size_t i=0 ; i<60 ; i++) {
+        if (i % 3 != 2) {
+            mModel.addSample(START + i * PERIOD);
+        }
+    }
+    ASSERT_TRUE(mModel.isStable());
+    EXPECT_EQ(PERIOD, mModel.getPeriod());
+}
+
+TEST_F(VSyncModelTest, RejectsOutliers) {
+    addSamples(START, PERIOD, 20, us2ns(100));
+    ASSERT_TRUE(mModel.isStable());
+
+    // a late interrupt now and then
+    size_t rejected = 0;
+    for (size_t i=20 ; i<100 ; i++) {
+        nsecs_t t = START + i * PERIOD + jitter(us2ns(100));
+        if (i % 7 == 0) {
+            t += ms2ns(5);
+        }
+        if (!mModel.addSample(t)) {
+            rejected++;
+        }
+    }
+    EXPECT_EQ(size_t(80 / 7 + 1), rejected);
+    EXPECT_TRUE(mModel.isStable());
+    EXPECT_NEAR(PERIOD, mModel.getPeriod(), us2ns(10));
+}
+
+TEST_F(VSyncModelTest, OutliersWhileLearningDontPreventStability) {
+    for (size_t i=0 ; i<3 * VSyncModel::MAX_SAMPLES ; i++) {
+        nsecs_t t = START + i * PERIOD;
+        if (i % 5 == 0) {
+            t += ms2ns(4);
+        }
+        mModel.addSample(t);
+    }
+    EXPECT_TRUE(mModel.isStable());
+    EXPECT_NEAR(PERIOD, mModel.getPeriod(), us2ns(1));
+}
+
+TEST_F(VSyncModelTest, RelearnsWhenPeriodChanges) {
+    addSamples(START, PERIOD, 20, 0);
+    ASSERT_TRUE(mModel.isStable());
+
+    // switch to 50Hz
+    const nsecs_t period50 = 20000000;
+    const nsecs_t start50 = START + 20 * PERIOD;
+    addSamples(start50, period50, VSyncModel::MAX_OUTLIERS +
+            VSyncModel::MIN_SAMPLES, 0);
+    EXPECT_TRUE(mModel.isStable());
+    EXPECT_EQ(period50, mModel.getPeriod());
+}
+
+TEST_F(VSyncModelTest, NeedsSamplesOnlyToResync) {
+    addSamples(START, PERIOD, VSyncModel::MIN_SAMPLES, 0);
+    ASSERT_TRUE(mModel.isStable());
+    EXPECT_TRUE(mModel.needsSamples(START + VSyncModel::MIN_SAMPLES * PERIOD));
+
+    nsecs_t last = START + (VSyncModel::MIN_SAMPLES - 1) * PERIOD;
+    for (size_t i=0 ; i<VSyncModel::RESYNC_SAMPLES - 1 ; i++) {
+        last += PERIOD;
+        mModel.addSample(last);
+    }
+    EXPECT_FALSE(mModel.needsSamples(last + PERIOD));
+    EXPECT_FALSE(mModel.needsSamples(last + VSyncModel::RESYNC_INTERVAL - 1));
+    EXPECT_TRUE(mModel.needsSamples(last + VSyncModel::RESYNC_INTERVAL));
+}
+
+TEST_F(VSyncModelTest, StaysInSyncAcrossResync) {
+    addSamples(START, PERIOD, 20, us2ns(100));
+    ASSERT_TRUE(mModel.isStable());
+
+    // h/w vsync off for a few seconds, then a few samples
+    const nsecs_t resume = START + 300 * PERIOD;
+    for (size_t i=0 ; i<VSyncModel::RESYNC_SAMPLES ; i++) {
+        EXPECT_TRUE(mModel.addSample(resume + i * PERIOD + jitter(us2ns(100))));
+    }
+    EXPECT_TRUE(mModel.isStable());
+    EXPECT_NEAR(PERIOD, mModel.getPeriod(), us2ns(1));
+}
+
+TEST_F(VSyncModelTest, DumpShowsState) {
+    addSamples(START, PERIOD, 10, 0);
+    String8 result;
+    mModel.dump(result);
+    EXPECT_TRUE(strstr(result.string(), "stable, period=16.667ms") != NULL)
+            << result.string();
+}
+
+} // namespace android